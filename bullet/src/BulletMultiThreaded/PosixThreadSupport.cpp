@@ -33,6 +33,7 @@ subject to the following restrictions:
 // PosixThreadSupport helps to initialize/shutdown libspe2, start/stop SPU tasks and communication
 // Setup and initialize SPU/CELL/Libspe2
 PosixThreadSupport::PosixThreadSupport(ThreadConstructionInfo& threadConstructionInfo)
+:mainSemaphore(0)
 {
 	startThreads(threadConstructionInfo);
 }
@@ -47,9 +48,6 @@ PosixThreadSupport::~PosixThreadSupport()
 #define NAMED_SEMAPHORES
 #endif
 
-// this semaphore will signal, if and how many threads are finished with their work
-static sem_t* mainSemaphore=0;
-
 static sem_t* createSem(const char* baseName)
 {
 	static int semCount = 0;
@@ -103,12 +101,12 @@ static void *threadFunction(void *argument)
 			btAssert(status->m_status);
 			status->m_userThreadFunc(userPtr,status->m_lsMemory);
 			status->m_status = 2;
-			checkPThreadFunction(sem_post(mainSemaphore));
+			checkPThreadFunction(sem_post(status->mainSemaphore));
 	                status->threadUsed++;
 		} else {
 			//exit Thread
 			status->m_status = 3;
-			checkPThreadFunction(sem_post(mainSemaphore));
+			checkPThreadFunction(sem_post(status->mainSemaphore));
 			printf("Thread with taskId %i exiting\n",status->m_taskId);
 			break;
 		}
@@ -209,6 +207,7 @@ void PosixThreadSupport::startThreads(ThreadConstructionInfo& threadConstruction
 		btSpuStatus&	spuStatus = m_activeSpuStatus[i];
 
 		spuStatus.startSemaphore = createSem("threadLocal");                
+		spuStatus.mainSemaphore = mainSemaphore;
                 
                 checkPThreadFunction(pthread_create(&spuStatus.thread, NULL, &threadFunction, (void*)&spuStatus));
 
@@ -235,6 +234,9 @@ void PosixThreadSupport::startSPU()
 ///tell the task scheduler we are done with the SPU tasks
 void PosixThreadSupport::stopSPU()
 {
+	// SpuCollisionTaskProcess stops the threads itself, before we're destroyed
+	if (!mainSemaphore)
+		return;
 	for(size_t t=0; t < size_t(m_activeSpuStatus.size()); ++t) 
 	{
             btSpuStatus&	spuStatus = m_activeSpuStatus[t];
@@ -252,6 +254,7 @@ void PosixThreadSupport::stopSPU()
         }
 	printf("destroy main semaphore\n");
         destroySem(mainSemaphore);
+	mainSemaphore = 0;
 	printf("main semaphore destroyed\n");
 	m_activeSpuStatus.clear();
 }
@@ -61,12 +61,17 @@ public:
 
                 pthread_t thread;
                 sem_t* startSemaphore;
+                sem_t* mainSemaphore;
 
         unsigned long threadUsed;
 	};
 private:
 
 	btAlignedObjectArray<btSpuStatus>	m_activeSpuStatus;
+
+	// this semaphore will signal, if and how many threads are finished with their work
+	// (one per instance, so that more than one pool of threads can exist at once)
+	sem_t* mainSemaphore;
 public:
 	///Setup and initialize SPU/CELL/Libspe2
 
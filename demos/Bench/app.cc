@@ -0,0 +1,633 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* Bench: load a synthetic scene through the ordinary Scene and Prop loaders,
+ * fly a camera along a scripted path through it for a fixed number of
+ * frames, and report how long each part took as JSON.
+ *
+ * Usage: Bench [--props N] [--actors N] [--lights N] [--depth N]
+ *              [--seed N] [--path orbit|flyover|fixed] [--warmup N]
+ *              [--locomotion batched|individual] [--output FILE]
+ *              [Core options ...]
+ *
+ * The scene is written to assets/scenes/synthetic.xml before it's loaded.
+ * Props are arranged in groups on a square grid: the first of each group is
+ * a dynamic cube, and the rest of the group is nested beneath it, each
+ * within the last, to a depth of --depth. Frames are rendered with a fixed
+ * interval, rather than the time which actually elapsed, so that a given
+ * set of options always simulates and draws exactly the same thing.
+ *
+ * --frames N (default 600) sets the number of frames which are measured,
+ * after --warmup frames (default 30) which aren't; --headless runs without
+ * a window, and --trace writes a trace of the frame phases alongside.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "jyuzau.hh"
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_APPLE
+# include <OGRE/OSX/macUtils.h>
+#endif
+
+#define BENCH_SCENE                    "synthetic"
+#define BENCH_FRAMES                   600
+#define BENCH_WARMUP                   30
+#define BENCH_INTERVAL                 (1.0f / 60)
+/* Distance between the centres of adjacent groups of props */
+#define BENCH_PITCH                    250.0f
+/* Offset of each nested prop from the one which contains it */
+#define BENCH_NEST_OFFSET              110.0f
+
+struct BenchParams
+{
+	int props, actors, lights, depth;
+	unsigned long seed;
+	int warmup;
+	Ogre::String path, output;
+	bool batched;
+};
+
+/* A small linear congruential generator, so that a given seed produces the
+ * same scene whichever C library is in use
+ */
+static Ogre::Real
+benchRandom(unsigned long &state)
+{
+	state = (state * 1103515245 + 12345) & 0x7fffffff;
+	return (Ogre::Real) (state >> 8) / (0x7fffffff >> 8);
+}
+
+/* Return the peak resident set size of the process, in kilobytes */
+static long
+peakRSS(void)
+{
+	struct rusage usage;
+
+	if(getrusage(RUSAGE_SELF, &usage))
+	{
+		return -1;
+	}
+#if OGRE_PLATFORM == OGRE_PLATFORM_APPLE
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+/* Write a JSON object summarising a set of samples, in milliseconds */
+static void
+summarise(FILE *f, std::vector<float> samples)
+{
+	double total;
+	size_t n, c;
+
+	n = samples.size();
+	if(!n)
+	{
+		fprintf(f, "null");
+		return;
+	}
+	total = 0;
+	for(c = 0; c < n; c++)
+	{
+		total += samples[c];
+	}
+	std::sort(samples.begin(), samples.end());
+	fprintf(f, "{\"total\":%.3f,\"mean\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+		total, total / n, samples[(n - 1) * 50 / 100], samples[(n - 1) * 95 / 100],
+		samples[(n - 1) * 99 / 100], samples[n - 1]);
+}
+
+static void
+indent(FILE *f, int depth)
+{
+	while(depth--)
+	{
+		fputc('\t', f);
+	}
+}
+
+static double
+elapsed(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+/* BenchState generates, loads and attaches the synthetic scene, and then
+ * moves the camera along the chosen path as each frame is rendered
+ */
+class BenchState: public Jyuzau::State
+{
+public:
+	BenchState(const BenchParams &params, int frames);
+	virtual ~BenchState();
+
+	bool loaded(void) const;
+	double loadTime(void) const;
+	double attachTime(void) const;
+	const std::vector<float> &physicsTimes(void) const;
+protected:
+	BenchParams m_params;
+	int m_frames, m_frame;
+	Jyuzau::Scene *m_scene;
+	Ogre::Real m_extent;
+	double m_loadTime, m_attachTime;
+	std::chrono::steady_clock::time_point m_loadBegan;
+	std::vector<float> m_physicsTimes;
+
+	virtual bool generate(void);
+	virtual void createScenes(void);
+	virtual void attachScenes(void);
+	virtual void createPlayers(Jyuzau::Scene *scene);
+	virtual void moveCamera(void);
+	virtual void updatePhysics(btScalar timeSinceLastFrame);
+	virtual bool frameRenderingQueued(const Ogre::FrameEvent& evt);
+};
+
+BenchState::BenchState(const BenchParams &params, int frames):
+	State::State(),
+	m_params(params),
+	m_frames(frames),
+	m_frame(0),
+	m_scene(NULL),
+	m_extent(0),
+	m_loadTime(0),
+	m_attachTime(0)
+{
+	setBatchedLocomotion(params.batched);
+}
+
+BenchState::~BenchState()
+{
+	if(m_scene)
+	{
+		delete m_scene;
+	}
+}
+
+bool
+BenchState::loaded(void) const
+{
+	return m_scene != NULL;
+}
+
+double
+BenchState::loadTime(void) const
+{
+	return m_loadTime;
+}
+
+double
+BenchState::attachTime(void) const
+{
+	return m_attachTime;
+}
+
+const std::vector<float> &
+BenchState::physicsTimes(void) const
+{
+	return m_physicsTimes;
+}
+
+/* Write the scene descriptor for the chosen parameters */
+bool
+BenchState::generate(void)
+{
+	Ogre::String base, path;
+	unsigned long rng;
+	FILE *f;
+	int groups, side, group, n, c, d, depth;
+	Ogre::Real x, z;
+
+#if OGRE_PLATFORM == OGRE_PLATFORM_APPLE
+	base = Ogre::macBundlePath() + "/Contents/Resources/assets/scenes";
+#else
+	base = "assets/scenes";
+#endif
+	mkdir(base.c_str(), 0777);
+	path = base + "/" + BENCH_SCENE + ".xml";
+	f = fopen(path.c_str(), "w");
+	if(!f)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to open " + path + " to write synthetic scene");
+		return false;
+	}
+	rng = m_params.seed;
+	groups = (m_params.props + m_params.depth - 1) / m_params.depth;
+	side = std::max(1, (int) ceil(sqrt((double) groups)));
+	m_extent = side * BENCH_PITCH;
+	fprintf(f, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<scene>\n");
+	fprintf(f, "\t<ambientlight r=\"0.3\" g=\"0.3\" b=\"0.3\" />\n");
+	fprintf(f, "\t<gravity x=\"0\" y=\"-981\" z=\"0\" />\n");
+	fprintf(f, "\t<prop id=\"floor\" class=\"bench-floor\" fixed=\"yes\">\n");
+	fprintf(f, "\t\t<scale x=\"%.2f\" y=\"%.2f\" />\n", m_extent / 100, m_extent / 100);
+	fprintf(f, "\t\t<translate y=\"-50\" />\n\t\t<pitch deg=\"-90\" />\n\t</prop>\n");
+	for(c = 0; c < m_params.lights; c++)
+	{
+		x = (benchRandom(rng) - 0.5f) * m_extent;
+		z = (benchRandom(rng) - 0.5f) * m_extent;
+		fprintf(f, "\t<light id=\"light%d\" x=\"%.1f\" y=\"400\" z=\"%.1f\" />\n", c, x, z);
+	}
+	for(n = 0, group = 0; n < m_params.props; group++)
+	{
+		x = ((group % side) - (side - 1) / 2.0f) * BENCH_PITCH + (benchRandom(rng) - 0.5f) * BENCH_PITCH / 4;
+		z = ((group / side) - (side - 1) / 2.0f) * BENCH_PITCH + (benchRandom(rng) - 0.5f) * BENCH_PITCH / 4;
+		depth = std::min(m_params.depth, m_params.props - n);
+		fprintf(f, "\t<prop id=\"p%d\" class=\"bench-cube\" x=\"%.1f\" y=\"%.1f\" z=\"%.1f\">\n", n, x, benchRandom(rng) * 200, z);
+		fprintf(f, "\t\t<yaw deg=\"%.1f\" />\n", benchRandom(rng) * 360);
+		n++;
+		for(d = 1; d < depth; d++, n++)
+		{
+			indent(f, d + 1);
+			fprintf(f, "<prop id=\"p%d\" class=\"bench-part\" y=\"%.1f\">\n", n, BENCH_NEST_OFFSET);
+			indent(f, d + 2);
+			fprintf(f, "<scale x=\"0.9\" y=\"0.9\" z=\"0.9\" />\n");
+		}
+		for(d = depth - 1; d > 0; d--)
+		{
+			indent(f, d + 1);
+			fprintf(f, "</prop>\n");
+		}
+		fprintf(f, "\t</prop>\n");
+	}
+	fprintf(f, "</scene>\n");
+	if(fclose(f))
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to write synthetic scene to " + path);
+		return false;
+	}
+	return true;
+}
+
+void
+BenchState::createScenes(void)
+{
+	if(!generate())
+	{
+		return;
+	}
+	m_loadBegan = std::chrono::steady_clock::now();
+	m_scene = dynamic_cast<Jyuzau::Scene *>(factory("scene", BENCH_SCENE));
+}
+
+/* The scene may have been loaded in the background, so the load time runs
+ * from its creation until it's about to be attached
+ */
+void
+BenchState::attachScenes(void)
+{
+	std::chrono::steady_clock::time_point began;
+
+	if(m_scene)
+	{
+		m_loadTime = elapsed(m_loadBegan);
+		began = std::chrono::steady_clock::now();
+		m_scene->attach();
+		m_attachTime = elapsed(began);
+	}
+}
+
+/* Create the camera, and the actors, which are given no players but instead
+ * walk in circles for the duration
+ */
+void
+BenchState::createPlayers(Jyuzau::Scene *scene)
+{
+	Jyuzau::Camera *cam;
+	Jyuzau::Actor *actor;
+	Ogre::Real angle;
+	int c;
+
+	cam = new Jyuzau::Camera("BenchCam", m_sceneManager);
+	cam->setNearClipDistance(5);
+	m_cameras.push_back(cam);
+	moveCamera();
+	for(c = 0; c < m_params.actors; c++)
+	{
+		actor = dynamic_cast<Jyuzau::Actor *>(factory("actor", "bench-actor"));
+		if(!actor)
+		{
+			Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to create benchmark actor");
+			return;
+		}
+		angle = Ogre::Math::TWO_PI * c / m_params.actors;
+		actor->setPosition(cos(angle) * m_extent / 4, 100, sin(angle) * m_extent / 4);
+		if(!actor->attachToScene(scene, "actor" + std::to_string(c)))
+		{
+			delete actor;
+			continue;
+		}
+		actor->beginForward();
+		if(c % 2)
+		{
+			actor->beginTurnRight();
+		}
+		else
+		{
+			actor->beginTurnLeft();
+		}
+		addActor(actor);
+	}
+}
+
+/* Position the camera along the path according to the frame number alone */
+void
+BenchState::moveCamera(void)
+{
+	Ogre::Real t, radius, height;
+	Ogre::Vector3 pos;
+
+	if(!m_cameras.size())
+	{
+		return;
+	}
+	t = (Ogre::Real) std::max(0, m_frame - m_params.warmup) / m_frames;
+	radius = m_extent * 0.75f + 200;
+	height = m_extent * 0.4f + 200;
+	if(m_params.path == "flyover")
+	{
+		pos = Ogre::Vector3(-radius + 2 * radius * t, height / 2, -radius + 2 * radius * t);
+		m_cameras[0]->setPosition(pos);
+		m_cameras[0]->lookAt(pos + Ogre::Vector3(500, -height / 2, 500));
+	}
+	else if(m_params.path == "fixed")
+	{
+		m_cameras[0]->setPosition(Ogre::Vector3(0, height, radius));
+		m_cameras[0]->lookAt(Ogre::Vector3::ZERO);
+	}
+	else
+	{
+		t *= Ogre::Math::TWO_PI;
+		m_cameras[0]->setPosition(Ogre::Vector3(cos(t) * radius, height, sin(t) * radius));
+		m_cameras[0]->lookAt(Ogre::Vector3::ZERO);
+	}
+}
+
+void
+BenchState::updatePhysics(btScalar timeSinceLastFrame)
+{
+	std::chrono::steady_clock::time_point began;
+
+	began = std::chrono::steady_clock::now();
+	State::updatePhysics(timeSinceLastFrame);
+	if(m_frame >= m_params.warmup)
+	{
+		m_physicsTimes.push_back(elapsed(began));
+	}
+}
+
+bool
+BenchState::frameRenderingQueued(const Ogre::FrameEvent& evt)
+{
+	bool r;
+
+	moveCamera();
+	r = State::frameRenderingQueued(evt);
+	m_frame++;
+	return r;
+}
+
+/* BenchApp drives the run-loop itself, so that every frame is given the same
+ * interval, and writes the report once the frames have been rendered
+ */
+class BenchApp: public Jyuzau::Core
+{
+public:
+	BenchApp();
+
+	virtual bool parseArgs(int argc, char **argv);
+	virtual bool go();
+protected:
+	BenchParams m_params;
+	BenchState *m_bench;
+	std::vector<float> m_frameTimes;
+
+	virtual void createInitialState(void);
+	virtual bool report(void);
+};
+
+BenchApp::BenchApp():
+	Core::Core(),
+	m_bench(NULL)
+{
+	m_caption = "Jyuzau Benchmark";
+	m_params.props = 1000;
+	m_params.actors = 10;
+	m_params.lights = 4;
+	m_params.depth = 1;
+	m_params.seed = 1;
+	m_params.warmup = BENCH_WARMUP;
+	m_params.path = "orbit";
+	m_params.batched = true;
+}
+
+/* Parse the benchmark's own options after Core has applied its own; Core's
+ * options which take a value are skipped along with it
+ */
+bool
+BenchApp::parseArgs(int argc, char **argv)
+{
+	Ogre::String arg;
+	int c;
+
+	if(!Core::parseArgs(argc, argv))
+	{
+		return false;
+	}
+	for(c = 1; c < argc; c++)
+	{
+		arg = argv[c];
+		if(arg == "--headless")
+		{
+			continue;
+		}
+		if(c + 1 >= argc || arg.compare(0, 2, "--"))
+		{
+			fprintf(stderr, "%s: unexpected argument '%s'\n", argv[0], argv[c]);
+			return false;
+		}
+		c++;
+		if(arg == "--props")
+		{
+			m_params.props = atoi(argv[c]);
+		}
+		else if(arg == "--actors")
+		{
+			m_params.actors = atoi(argv[c]);
+		}
+		else if(arg == "--lights")
+		{
+			m_params.lights = atoi(argv[c]);
+		}
+		else if(arg == "--depth")
+		{
+			m_params.depth = atoi(argv[c]);
+		}
+		else if(arg == "--seed")
+		{
+			m_params.seed = strtoul(argv[c], NULL, 10);
+		}
+		else if(arg == "--warmup")
+		{
+			m_params.warmup = atoi(argv[c]);
+		}
+		else if(arg == "--path")
+		{
+			m_params.path = argv[c];
+		}
+		else if(arg == "--locomotion")
+		{
+			if(strcmp(argv[c], "batched") && strcmp(argv[c], "individual"))
+			{
+				fprintf(stderr, "%s: --locomotion must be 'batched' or 'individual'\n", argv[0]);
+				return false;
+			}
+			m_params.batched = !strcmp(argv[c], "batched");
+		}
+		else if(arg == "--output")
+		{
+			m_params.output = argv[c];
+		}
+		else if(!isOption(arg))
+		{
+			fprintf(stderr, "%s: unknown option '%s'\n", argv[0], arg.c_str());
+			return false;
+		}
+	}
+	if(m_params.props < 0 || m_params.actors < 0 || m_params.lights < 0 || m_params.depth < 1 || m_params.warmup < 0 ||
+		(m_params.path != "orbit" && m_params.path != "flyover" && m_params.path != "fixed"))
+	{
+		fprintf(stderr, "%s: invalid benchmark parameters\n", argv[0]);
+		return false;
+	}
+	return true;
+}
+
+void
+BenchApp::createInitialState(void)
+{
+	if(!m_frameLimit)
+	{
+		m_frameLimit = BENCH_FRAMES;
+	}
+	m_bench = new BenchState(m_params, m_frameLimit);
+	/* Core counts the warm-up frames, too */
+	setFrameLimit(m_frameLimit + m_params.warmup);
+	pushState(m_bench);
+}
+
+bool
+BenchApp::go()
+{
+	std::chrono::steady_clock::time_point began;
+	unsigned long frame;
+	bool running;
+
+	if(!init())
+	{
+		return false;
+	}
+	if(!m_bench->loaded())
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to load synthetic scene; aborting");
+		cleanup();
+		return false;
+	}
+	frame = 0;
+	do
+	{
+		began = std::chrono::steady_clock::now();
+		running = render(BENCH_INTERVAL);
+		if(frame >= (unsigned long) m_params.warmup)
+		{
+			m_frameTimes.push_back(elapsed(began));
+		}
+		frame++;
+	}
+	while(running);
+	if(!report())
+	{
+		return false;
+	}
+	return cleanup();
+}
+
+/* Write the results as a single JSON object */
+bool
+BenchApp::report(void)
+{
+	FILE *f;
+
+	if(m_params.output.length())
+	{
+		f = fopen(m_params.output.c_str(), "w");
+		if(!f)
+		{
+			Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to open " + m_params.output + " to write benchmark results");
+			return false;
+		}
+	}
+	else
+	{
+		f = stdout;
+	}
+	fprintf(f, "{\"scene\":{\"props\":%d,\"actors\":%d,\"lights\":%d,\"depth\":%d,\"seed\":%lu},\n",
+		m_params.props, m_params.actors, m_params.lights, m_params.depth, m_params.seed);
+	fprintf(f, " \"path\":\"%s\",\"locomotion\":\"%s\",\"headless\":%s,\"warmup\":%d,\"frames\":%u,\n",
+		m_params.path.c_str(), (m_params.batched ? "batched" : "individual"), (m_headless ? "true" : "false"), m_params.warmup, (unsigned) m_frameTimes.size());
+	fprintf(f, " \"load_ms\":%.3f,\"attach_ms\":%.3f,\n", m_bench->loadTime(), m_bench->attachTime());
+	fprintf(f, " \"frame_ms\":");
+	summarise(f, m_frameTimes);
+	fprintf(f, ",\n \"physics_ms\":");
+	summarise(f, m_bench->physicsTimes());
+	fprintf(f, ",\n \"peak_rss_kb\":%ld}\n", peakRSS());
+	if(f != stdout && fclose(f))
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to write benchmark results to " + m_params.output);
+		return false;
+	}
+	return true;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int
+main(int argc, char **argv)
+{
+	BenchApp app;
+
+	return Jyuzau::main(argc, argv, &app);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -19,10 +19,30 @@
 
 #include "demoapp.hh"
 
+/* The phases shown in the trace panel, in the order that they occur */
+static const char *tracePhases[] = {
+	"Frame",
+	"Core::capture",
+	"State::updatePhysics",
+	"ScriptScheduler::update",
+	"Locomotion::update",
+	"Actor::frameRenderingQueued",
+	"Scene graph",
+	"Culling",
+	"Submission",
+	"PhysicsThread::step",
+	NULL
+};
+
+/* Interval, in seconds, between refreshes of the trace panel */
+#define TRACE_PANEL_REFRESH            0.5
+
 DemoApp::DemoApp():
 	Core::Core(),
 	m_trayMgr(NULL),
-	m_detailsPanel(NULL)
+	m_detailsPanel(NULL),
+	m_tracePanel(NULL),
+	m_traceRefresh(0)
 {
 }
 
@@ -67,11 +87,49 @@ DemoApp::createFrameListener(void)
 	items.push_back("");
 	items.push_back("Filtering");
 	items.push_back("Poly Mode");
+	items.push_back("");
+	items.push_back("Phys. Steps");
+	items.push_back("Phys. Time");
+	items.push_back("Phys. Pairs");
+	items.push_back("Broadphase");
+	items.push_back("Characters");
 
 	m_detailsPanel = m_trayMgr->createParamsPanel(OgreBites::TL_NONE, "DetailsPanel", 200, items);
 	m_detailsPanel->setParamValue(9, "Bilinear");
 	m_detailsPanel->setParamValue(10, "Solid");
 	m_detailsPanel->hide();
+
+	// Create a params panel for displaying frame phase timings
+	items.clear();
+	for(int c = 0; tracePhases[c]; c++)
+	{
+		items.push_back(tracePhases[c]);
+	}
+	m_tracePanel = m_trayMgr->createParamsPanel(OgreBites::TL_NONE, "TracePanel", 360, items);
+	m_tracePanel->hide();
+}
+
+/* Show the 50th, 95th and 99th percentiles of the recent durations of each
+ * phase, in milliseconds
+ */
+void
+DemoApp::updateTracePanel(void)
+{
+	Jyuzau::TraceStats stats;
+	char buf[64];
+
+	for(int c = 0; tracePhases[c]; c++)
+	{
+		if(m_tracer->stats(tracePhases[c], stats))
+		{
+			snprintf(buf, sizeof(buf), "%.2f / %.2f / %.2f ms", stats.p50, stats.p95, stats.p99);
+			m_tracePanel->setParamValue(c, buf);
+		}
+		else
+		{
+			m_tracePanel->setParamValue(c, "-");
+		}
+	}
 }
 
 bool
@@ -79,6 +137,7 @@ DemoApp::frameRenderingQueued(const Ogre::FrameEvent& evt)
 {
 	bool r;
 	Jyuzau::Camera *cam;
+	Jyuzau::State *st;
 	
 	r = Core::frameRenderingQueued(evt);
 	if(!r)
@@ -100,6 +159,24 @@ DemoApp::frameRenderingQueued(const Ogre::FrameEvent& evt)
 			m_detailsPanel->setParamValue(6, Ogre::StringConverter::toString(cam->camera->getDerivedOrientation().y));
 			m_detailsPanel->setParamValue(7, Ogre::StringConverter::toString(cam->camera->getDerivedOrientation().z));
 		}
+		st = state();
+		if (m_detailsPanel->isVisible() && st)
+		{
+			m_detailsPanel->setParamValue(12, Ogre::StringConverter::toString(st->dynamicsStats().steps));
+			m_detailsPanel->setParamValue(13, Ogre::StringConverter::toString(st->dynamicsStats().time) + " ms");
+			m_detailsPanel->setParamValue(14, Ogre::StringConverter::toString(st->dynamicsStats().pairs) + " / " + Ogre::StringConverter::toString(st->dynamicsStats().objects));
+			m_detailsPanel->setParamValue(15, Ogre::StringConverter::toString(st->dynamicsStats().aabbTime + st->dynamicsStats().pairTime) + " ms");
+			m_detailsPanel->setParamValue(16, Ogre::StringConverter::toString(st->dynamicsStats().fullCharacters) + " / " + Ogre::StringConverter::toString(st->dynamicsStats().coarseCharacters) + " / " + Ogre::StringConverter::toString(st->dynamicsStats().idleCharacters));
+		}
+		if (m_tracePanel->isVisible())
+		{
+			m_traceRefresh -= evt.timeSinceLastFrame;
+			if (m_traceRefresh <= 0)
+			{
+				updateTracePanel();
+				m_traceRefresh = TRACE_PANEL_REFRESH;
+			}
+		}
 	}
 	return true;
 }
@@ -132,6 +209,26 @@ DemoApp::keyPressed(const OIS::KeyEvent &arg)
 			m_detailsPanel->hide();
 		}
 	}
+	else if (arg.key == OIS::KC_P)
+	{
+		/* Showing the trace panel enables tracing, if it isn't already */
+		if (m_tracePanel->getTrayLocation() == OgreBites::TL_NONE)
+		{
+			m_tracer->setEnabled(true);
+			m_trayMgr->moveWidgetToTray(m_tracePanel, OgreBites::TL_BOTTOMRIGHT, 0);
+			m_tracePanel->show();
+			m_traceRefresh = 0;
+		}
+		else
+		{
+			m_trayMgr->removeWidgetFromTray(m_tracePanel);
+			m_tracePanel->hide();
+		}
+	}
+	else if (arg.key == OIS::KC_F9)
+	{
+		m_tracer->write(m_traceFile.length() ? m_traceFile : Ogre::String("jyuzau-trace.json"));
+	}
 	else if (arg.key == OIS::KC_T)
 	{
 		Ogre::String newVal;
@@ -29,9 +29,12 @@ protected:
 	OgreBites::InputContext m_inputContext;
 	OgreBites::SdkTrayManager *m_trayMgr;
 	OgreBites::ParamsPanel *m_detailsPanel;
+	OgreBites::ParamsPanel *m_tracePanel;
+	Ogre::Real m_traceRefresh;
 	
 	virtual void createResourceGroups(void);
 	virtual void createFrameListener(void);
+	virtual void updateTracePanel(void);
 	
 	virtual bool frameRenderingQueued(const Ogre::FrameEvent& evt);
 	
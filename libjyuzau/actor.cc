@@ -22,6 +22,8 @@
 #include "jyuzau/camera.hh"
 #include "jyuzau/scene.hh"
 #include "jyuzau/kinematics.hh"
+#include "jyuzau/locomotion.hh"
+#include "jyuzau/snapshot.hh"
 
 #include <OGRE/OgreCamera.h>
 #include <OGRE/OgreSceneNode.h>
@@ -41,7 +43,9 @@ Actor::Actor(const Actor &object):
 	m_lookUp(false), m_lookDown(false),
 	m_camPitchVelocity(0.0f),
 	m_speed(MS_WALK),
-	m_kinematics(NULL)
+	m_kinematics(NULL),
+	m_locomotion(NULL),
+	m_locomotionIndex(0)
 {
 	m_health = object.m_health;
 	m_level = object.m_level;
@@ -56,13 +60,14 @@ Actor::Actor(const Actor &object):
 	m_rotAccel = object.m_rotAccel;
 	m_rotDecel = object.m_rotDecel;
 	m_rotAngle = object.m_rotAngle;
-	m_rotFactor = object.m_rotAngle;
+	m_rotFactor = object.m_rotFactor;
 	m_camPitchSpeed = object.m_camPitchSpeed;
 	m_camPitchStep = object.m_camPitchStep;
 	m_camPitchAccel = object.m_camPitchAccel;
 	m_camPitchDecel = object.m_camPitchDecel;
 	m_camPitchAngle = object.m_camPitchAngle;
-	m_camPitchFactor = object.m_camPitchAngle;
+	m_camPitchFactor = object.m_camPitchFactor;
+	resetActiveCameras();
 }
 
 Actor::Actor(Ogre::String name, State *state, Ogre::String kind):
@@ -95,13 +100,19 @@ Actor::Actor(Ogre::String name, State *state, Ogre::String kind):
 	m_camPitchAngle(ACTOR_CAM_PITCH_ANGLE),
 	m_camPitchFactor(ACTOR_CAM_PITCH_FACTOR),
 	m_speed(MS_WALK),
-	m_kinematics(NULL)
+	m_kinematics(NULL),
+	m_locomotion(NULL),
+	m_locomotionIndex(0)
 {
 	resetActiveCameras();
 }
 
 Actor::~Actor()
 {
+	if(m_locomotion)
+	{
+		m_locomotion->remove(this);
+	}
 }
 
 Loadable *
@@ -116,16 +127,92 @@ Actor::character(void) const
 	return m_character;
 }
 
+Locomotion *
+Actor::locomotion(void) const
+{
+	return m_locomotion;
+}
+
+/* Actors of kinematic classes are given their controllers once they have
+ * a rigid body
+ */
+bool
+Actor::attachToSceneNode(Scene *scene, Ogre::SceneNode *parentNode, Ogre::String id)
+{
+	if(!Prop::attachToSceneNode(scene, parentNode, id))
+	{
+		return false;
+	}
+	if(m_kinematic && m_rigidBody && !m_kinematics)
+	{
+		m_kinematics = new Kinematics(this);
+	}
+	return true;
+}
+
+/* An actor's node is about to be destroyed, so it can no longer be moved by
+ * a Locomotion, nor by a kinematic controller
+ */
+void
+Actor::detach(void)
+{
+	if(m_locomotion)
+	{
+		m_locomotion->remove(this);
+	}
+	delete m_kinematics;
+	m_kinematics = NULL;
+	Prop::detach();
+}
+
+/* Actors are always drawn as ordinary entities, as their cameras and
+ * kinematic controllers depend upon the entity and its node
+ */
+Ogre::InstancedEntity *
+Actor::createInstance(Ogre::SceneManager *sceneManager)
+{
+	return NULL;
+}
+
+/* Pass the current movement input and speed on to the Locomotion which is
+ * managing this actor, if any; invoked whenever either changes
+ */
+void
+Actor::updateLocomotion(void)
+{
+	if(!m_locomotion)
+	{
+		return;
+	}
+	m_locomotion->setInput(m_locomotionIndex,
+		(m_backward ? 1.0f : 0.0f) - (m_forward ? 1.0f : 0.0f),
+		(m_right ? 1.0f : 0.0f) - (m_left ? 1.0f : 0.0f),
+		(m_cclockwise ? 1.0f : 0.0f) - (m_clockwise ? 1.0f : 0.0f));
+	m_locomotion->setTopSpeed(m_locomotionIndex, (m_speed == MS_RUN ? m_topSpeed * m_moveRunFactor : (m_speed == MS_CREEP ? m_topSpeed * m_moveCreepFactor : m_topSpeed)));
+}
+
 void
 Actor::characterAttached(void)
 {
+	/* Players are moved by their kinematic controller, not in a batch */
+	if(m_locomotion)
+	{
+		m_locomotion->remove(this);
+	}
 	m_level = m_character->level();
-	m_kinematics = new Kinematics(this);	
+	if(!m_kinematics)
+	{
+		m_kinematics = new Kinematics(this);
+	}
 }
 
 void
 Actor::characterDetached(void)
 {
+	if(m_kinematic)
+	{
+		return;
+	}
 	delete m_kinematics;
 	m_kinematics = NULL;
 }
@@ -260,13 +347,94 @@ Actor::accelerateRotation(Ogre::Real &velocity, bool back, bool forward, Ogre::R
 	}
 }
 
+/* Record the actor's movement (which is held by its Locomotion, if it has
+ * one) along with its transform, and the properties of its Character
+ */
+void
+Actor::snapshot(SnapshotNode &record) const
+{
+	Ogre::Vector3 velocity;
+	Ogre::Real rotVelocity;
+
+	Prop::snapshot(record);
+	record.flags |= SNAPSHOT_ACTOR;
+	record.movement =
+		(m_forward ? SNAPSHOT_FORWARD : 0) | (m_backward ? SNAPSHOT_BACKWARD : 0) |
+		(m_left ? SNAPSHOT_LEFT : 0) | (m_right ? SNAPSHOT_RIGHT : 0) |
+		(m_clockwise ? SNAPSHOT_CLOCKWISE : 0) | (m_cclockwise ? SNAPSHOT_CCLOCKWISE : 0) |
+		(m_lookUp ? SNAPSHOT_LOOK_UP : 0) | (m_lookDown ? SNAPSHOT_LOOK_DOWN : 0);
+	record.speed = m_speed;
+	velocity = m_velocity;
+	rotVelocity = m_rotVelocity;
+	if(m_locomotion)
+	{
+		m_locomotion->velocity(m_locomotionIndex, velocity, rotVelocity);
+	}
+	record.velocity[0] = velocity.x;
+	record.velocity[1] = velocity.y;
+	record.velocity[2] = velocity.z;
+	record.rotVelocity = rotVelocity;
+	record.camPitchVelocity = m_camPitchVelocity;
+	record.level = m_level;
+	record.health = m_health;
+	if(m_character && m_character->actor() == this)
+	{
+		record.flags |= SNAPSHOT_CHARACTER;
+		m_character->snapshot(record);
+	}
+}
+
+/* Invoked with the dynamics lock held; a kinematic controller is moved
+ * to the restored position, and forgets whatever it was doing
+ */
+void
+Actor::restore(const SnapshotNode &record)
+{
+	btTransform xform;
+
+	Prop::restore(record);
+	if(!(record.flags & SNAPSHOT_ACTOR))
+	{
+		return;
+	}
+	m_forward = (record.movement & SNAPSHOT_FORWARD) ? true : false;
+	m_backward = (record.movement & SNAPSHOT_BACKWARD) ? true : false;
+	m_left = (record.movement & SNAPSHOT_LEFT) ? true : false;
+	m_right = (record.movement & SNAPSHOT_RIGHT) ? true : false;
+	m_clockwise = (record.movement & SNAPSHOT_CLOCKWISE) ? true : false;
+	m_cclockwise = (record.movement & SNAPSHOT_CCLOCKWISE) ? true : false;
+	m_lookUp = (record.movement & SNAPSHOT_LOOK_UP) ? true : false;
+	m_lookDown = (record.movement & SNAPSHOT_LOOK_DOWN) ? true : false;
+	m_speed = (MoveSpeed) record.speed;
+	m_velocity = Ogre::Vector3(record.velocity[0], record.velocity[1], record.velocity[2]);
+	m_rotVelocity = record.rotVelocity;
+	m_camPitchVelocity = record.camPitchVelocity;
+	m_level = record.level;
+	m_health = record.health;
+	if(m_locomotion)
+	{
+		m_locomotion->setVelocity(m_locomotionIndex, m_velocity, m_rotVelocity);
+		updateLocomotion();
+	}
+	if(m_kinematics)
+	{
+		updateNodeTransform();
+		getWorldTransform(xform);
+		m_kinematics->warp(xform);
+	}
+	if((record.flags & SNAPSHOT_CHARACTER) && m_character && m_character->actor() == this)
+	{
+		m_character->restore(record);
+	}
+}
+
 bool
 Actor::frameRenderingQueued(const Ogre::FrameEvent& evt)
 {
 	Ogre::Real taccel;
 	Ogre::Vector3 translation;
 	
-	if(!m_node)
+	if(!m_node || m_locomotion)
 	{
 		return false;
 	}
@@ -278,17 +446,15 @@ Actor::frameRenderingQueued(const Ogre::FrameEvent& evt)
 	 * m_speed
 	 */
 	accelerateXYMovement(m_velocity, m_forward, m_backward, m_left, m_right, (m_speed == MS_RUN ? m_topSpeed * m_moveRunFactor : (m_speed == MS_CREEP ? m_topSpeed * m_moveCreepFactor : m_topSpeed)), m_moveAccel, m_moveDecel, evt.timeSinceLastFrame);
-	if(m_velocity != Ogre::Vector3::ZERO)
+	translation = m_velocity * evt.timeSinceLastFrame;
+	if(m_kinematics)
 	{
-		translation = m_velocity * evt.timeSinceLastFrame;
-		if(m_kinematics)
-		{
-			m_kinematics->walkDirection(translation);
-		}
-		else
-		{
-			m_node->translate(translation);
-		}
+		/* The controller must also be told when we stop */
+		m_kinematics->walkDirection(translation);
+	}
+	else if(m_velocity != Ogre::Vector3::ZERO)
+	{
+		m_node->translate(translation);
 	}
 	/* Process rotation */
 	accelerateRotation(m_rotVelocity, m_cclockwise, m_clockwise, m_rotSpeed, m_rotStep, m_rotAccel, m_rotDecel, evt.timeSinceLastFrame);
@@ -333,6 +499,7 @@ Actor::setSpeed(MoveSpeed speed)
 	if(speed != MS_CURRENT)
 	{
 		m_speed = speed;
+		updateLocomotion();
 	}
 }
 
@@ -355,6 +522,7 @@ Actor::beginForward(MoveSpeed speed)
 		return;
 	}
 	m_forward = true;
+	updateLocomotion();
 	setSpeed(speed);
 }
 
@@ -366,6 +534,7 @@ Actor::endForward(void)
 		return;
 	}
 	m_forward = false;
+	updateLocomotion();
 }
 
 void
@@ -386,6 +555,7 @@ Actor::beginBackward(MoveSpeed speed)
 		return;
 	}
 	m_backward = true;
+	updateLocomotion();
 	setSpeed(speed);
 }
 
@@ -397,6 +567,7 @@ Actor::endBackward(void)
 		return;
 	}
 	m_backward = false;
+	updateLocomotion();
 }
 
 void
@@ -418,6 +589,7 @@ Actor::beginTurnLeft(void)
 		return;
 	}
 	m_cclockwise = true;
+	updateLocomotion();
 }
 
 void
@@ -428,6 +600,7 @@ Actor::endTurnLeft(void)
 		return;
 	}
 	m_cclockwise = false;
+	updateLocomotion();
 }
 
 void
@@ -449,6 +622,7 @@ Actor::beginTurnRight(void)
 		return;
 	}
 	m_clockwise = true;
+	updateLocomotion();
 }
 
 void
@@ -459,6 +633,7 @@ Actor::endTurnRight(void)
 		return;
 	}
 	m_clockwise = false;
+	updateLocomotion();
 }
 
 void
@@ -494,6 +669,7 @@ Actor::beginStrafeLeft(MoveSpeed speed)
 		return;
 	}
 	m_left = true;
+	updateLocomotion();
 	setSpeed(speed);
 }
 
@@ -505,6 +681,7 @@ Actor::endStrafeLeft(void)
 		return;
 	}
 	m_left = false;
+	updateLocomotion();
 }
 
 
@@ -527,6 +704,7 @@ Actor::beginStrafeRight(MoveSpeed speed)
 		return;
 	}
 	m_right = true;
+	updateLocomotion();
 	setSpeed(speed);
 }
 
@@ -538,6 +716,7 @@ Actor::endStrafeRight(void)
 		return;
 	}
 	m_right = false;
+	updateLocomotion();
 }
 
 void
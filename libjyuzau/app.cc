@@ -17,22 +17,35 @@
 # include "config.h"
 #endif
 
+#include <iostream>
+
 #include "jyuzau/main.hh"
+#include "jyuzau/core.hh"
 
 /* Implement main() for non-Cocoa Unix platforms */
 #if OGRE_PLATFORM != OGRE_PLATFORM_APPLE && OGRE_PLATFORM != OGRE_PLATFORM_WIN32
 int
 Jyuzau::main(int argc, char **argv, Jyuzau::Core *app)
 {
+	if(!app->parseArgs(argc, argv))
+	{
+		std::cerr << "Usage: " << argv[0] << " [--headless] [--render-system NAME] [--option NAME=VALUE ...] [--frames N] [--trace FILE] [--pack FILE] [--input-rate N] [--record FILE | --replay FILE | --replay-realtime FILE]" << std::endl;
+		return 1;
+	}
 	try
 	{
-		app->go();
+		if(!app->go())
+		{
+			return 1;
+		}
 	}
 	catch(Ogre::Exception& e)
 	{
 		std::cerr << "An exception has occurred: " <<
 e.getFullDescription().c_str() << std::endl;
+		return 1;
 	}
+	return 0;
 }
 #endif
 
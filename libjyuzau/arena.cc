@@ -0,0 +1,128 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <new>
+
+#include "jyuzau/arena.hh"
+
+using namespace Jyuzau;
+
+/* All allocations are rounded up to this alignment */
+#define ARENA_ALIGN                    16
+#define ARENA_ROUND(size)              (((size) + (ARENA_ALIGN - 1)) & ~((size_t) ARENA_ALIGN - 1))
+#define ARENA_HEADER                   ARENA_ROUND(sizeof(Block))
+
+LoadArena::LoadArena(size_t blockSize):
+	m_blockSize(blockSize),
+	m_blocks(NULL),
+	m_allocations(0),
+	m_bytes(0),
+	m_nblocks(0),
+	m_reserved(0)
+{
+}
+
+LoadArena::~LoadArena()
+{
+	release();
+}
+
+/* Allocate memory from the current block, or from a new one if there isn't
+ * enough room; a request larger than the block size is given a block of
+ * its own.
+ */
+void *
+LoadArena::allocate(size_t size)
+{
+	Block *block;
+	size_t len;
+	void *p;
+	
+	size = ARENA_ROUND(size);
+	block = m_blocks;
+	if(!block || block->size - block->used < size)
+	{
+		len = ARENA_HEADER + (size > m_blockSize ? size : m_blockSize);
+		block = static_cast<Block *>(::operator new(len));
+		block->size = len;
+		block->used = ARENA_HEADER;
+		/* An oversized block is placed behind the current one, so that the
+		 * space remaining in the current block isn't wasted
+		 */
+		if(m_blocks && size > m_blockSize)
+		{
+			block->next = m_blocks->next;
+			m_blocks->next = block;
+		}
+		else
+		{
+			block->next = m_blocks;
+			m_blocks = block;
+		}
+		m_nblocks++;
+		m_reserved += len;
+	}
+	p = reinterpret_cast<unsigned char *>(block) + block->used;
+	block->used += size;
+	m_allocations++;
+	m_bytes += size;
+	return p;
+}
+
+/* Return all of the arena's blocks to the heap */
+void
+LoadArena::release(void)
+{
+	Block *block;
+	
+	while(m_blocks)
+	{
+		block = m_blocks;
+		m_blocks = block->next;
+		::operator delete(block);
+	}
+}
+
+/* The number of allocations served by the arena */
+size_t
+LoadArena::allocations(void) const
+{
+	return m_allocations;
+}
+
+/* The number of bytes allocated from the arena */
+size_t
+LoadArena::bytes(void) const
+{
+	return m_bytes;
+}
+
+/* The number of blocks obtained from the heap */
+size_t
+LoadArena::blocks(void) const
+{
+	return m_nblocks;
+}
+
+/* The number of bytes obtained from the heap */
+size_t
+LoadArena::reserved(void) const
+{
+	return m_reserved;
+}
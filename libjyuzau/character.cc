@@ -19,6 +19,8 @@
 
 #include "jyuzau/character.hh"
 #include "jyuzau/actor.hh"
+#include "jyuzau/state.hh"
+#include "jyuzau/snapshot.hh"
 
 using namespace Jyuzau;
 
@@ -63,7 +65,7 @@ Character::createDummy(State *state, Scene *scene)
 {
 	Actor *actor;
 	
-	actor = new Actor(m_actorName, state);
+	actor = dynamic_cast<Actor *>(state->factory("actor", m_actorName));
 	if(!actor)
 	{
 		return NULL;
@@ -84,7 +86,7 @@ Character::createActor(State *state, Scene *scene)
 {
 	Actor *actor;
 	
-	actor = new Actor(m_actorName, state);
+	actor = dynamic_cast<Actor *>(state->factory("actor", m_actorName));
 	if(!actor)
 	{
 		return NULL;
@@ -170,3 +172,35 @@ Character::ammo(int slot)
 	}
 	return m_ammo[slot];
 }
+
+void
+Character::snapshot(SnapshotNode &record) const
+{
+	int c;
+
+	record.characterLevel = m_level;
+	for(c = 0; c <= CHAR_CURRENCY_MAX; c++)
+	{
+		record.currency[c] = m_currency[c];
+	}
+	for(c = 0; c <= CHAR_WEAPON_MAX; c++)
+	{
+		record.ammo[c] = m_ammo[c];
+	}
+}
+
+void
+Character::restore(const SnapshotNode &record)
+{
+	int c;
+
+	m_level = record.characterLevel;
+	for(c = 0; c <= CHAR_CURRENCY_MAX; c++)
+	{
+		m_currency[c] = record.currency[c];
+	}
+	for(c = 0; c <= CHAR_WEAPON_MAX; c++)
+	{
+		m_ammo[c] = record.ammo[c];
+	}
+}
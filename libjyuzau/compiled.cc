@@ -0,0 +1,285 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+#endif
+
+#include "jyuzau/compiled.hh"
+
+using namespace Jyuzau;
+
+/* Return the path of the compiled form of a source document */
+std::string
+CompiledDocument::compiledPath(const std::string &source)
+{
+	size_t len;
+
+	len = source.length();
+	if(len > 4 && !source.compare(len - 4, 4, ".xml"))
+	{
+		return source.substr(0, len - 4) + COMPILED_SUFFIX;
+	}
+	return source + COMPILED_SUFFIX;
+}
+
+/* Returns true if the compiled form of a document exists and is at least as
+ * recent as the source; if the source doesn't exist (as will be the case
+ * in a shipping build), the compiled form is always current.
+ */
+bool
+CompiledDocument::current(const std::string &source, const std::string &compiled)
+{
+	struct stat csb, ssb;
+
+	if(stat(compiled.c_str(), &csb))
+	{
+		return false;
+	}
+	if(stat(source.c_str(), &ssb))
+	{
+		return true;
+	}
+	return csb.st_mtime >= ssb.st_mtime;
+}
+
+CompiledDocument::CompiledDocument():
+	m_base(NULL),
+	m_len(0),
+	m_mapped(false),
+	m_borrowed(false),
+	m_header(NULL),
+	m_strings(NULL),
+	m_elements(NULL),
+	m_attrs(NULL),
+	m_data(NULL)
+{
+}
+
+CompiledDocument::~CompiledDocument()
+{
+	close();
+}
+
+/* Map (or, where mmap() is unavailable, read) a compiled document and
+ * validate it.
+ */
+bool
+CompiledDocument::open(const std::string &path)
+{
+	close();
+#ifdef HAVE_SYS_MMAN_H
+	int fd;
+	struct stat sb;
+	void *p;
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+	{
+		return false;
+	}
+	if(fstat(fd, &sb) || sb.st_size < (off_t) sizeof(CompiledHeader))
+	{
+		::close(fd);
+		return false;
+	}
+	p = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		return false;
+	}
+	m_base = (unsigned char *) p;
+	m_len = sb.st_size;
+	m_mapped = true;
+#else
+	FILE *f;
+	long size;
+
+	f = fopen(path.c_str(), "rb");
+	if(!f)
+	{
+		return false;
+	}
+	if(fseek(f, 0, SEEK_END) || (size = ftell(f)) < (long) sizeof(CompiledHeader) || fseek(f, 0, SEEK_SET))
+	{
+		fclose(f);
+		return false;
+	}
+	m_base = (unsigned char *) malloc(size);
+	if(!m_base || fread(m_base, size, 1, f) != 1)
+	{
+		fclose(f);
+		close();
+		return false;
+	}
+	fclose(f);
+	m_len = size;
+#endif
+	if(!validate())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+/* Validate a compiled document which is already in memory, without
+ * copying it
+ */
+bool
+CompiledDocument::open(const void *data, size_t len)
+{
+	close();
+	if(len < sizeof(CompiledHeader))
+	{
+		return false;
+	}
+	m_base = (unsigned char *) const_cast<void *>(data);
+	m_len = len;
+	m_borrowed = true;
+	if(!validate())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void
+CompiledDocument::close(void)
+{
+	if(m_base && !m_borrowed)
+	{
+#ifdef HAVE_SYS_MMAN_H
+		if(m_mapped)
+		{
+			munmap(m_base, m_len);
+		}
+		else
+#endif
+		{
+			free(m_base);
+		}
+	}
+	m_base = NULL;
+	m_len = 0;
+	m_mapped = false;
+	m_borrowed = false;
+	m_header = NULL;
+	m_strings = NULL;
+	m_elements = NULL;
+	m_attrs = NULL;
+	m_data = NULL;
+}
+
+uint32_t
+CompiledDocument::strings(void) const
+{
+	return (m_header ? m_header->nstrings : 0);
+}
+
+const char *
+CompiledDocument::string(uint32_t index) const
+{
+	return m_data + m_strings[index];
+}
+
+uint32_t
+CompiledDocument::elements(void) const
+{
+	return (m_header ? m_header->nelements : 0);
+}
+
+const CompiledElement *
+CompiledDocument::element(uint32_t index) const
+{
+	return &(m_elements[index]);
+}
+
+const CompiledAttr *
+CompiledDocument::attr(uint32_t index) const
+{
+	return &(m_attrs[index]);
+}
+
+/* Check that the document is one we understand, and that every offset and
+ * index within it is in bounds, so that the accessors need not do so.
+ */
+bool
+CompiledDocument::validate(void)
+{
+	const CompiledHeader *h;
+	uint32_t c;
+
+	h = (const CompiledHeader *) m_base;
+	if(memcmp(h->magic, COMPILED_MAGIC, 4) || h->byteorder != COMPILED_BYTEORDER || h->version != COMPILED_VERSION)
+	{
+		return false;
+	}
+	if((h->strings % 4) || h->strings < sizeof(CompiledHeader) || h->strings + (uint64_t) h->nstrings * sizeof(uint32_t) > m_len ||
+	   (h->elements % 4) || h->elements + (uint64_t) h->nelements * sizeof(CompiledElement) > m_len ||
+	   (h->attrs % 4) || h->attrs + (uint64_t) h->nattrs * sizeof(CompiledAttr) > m_len ||
+	   !h->datalen || h->data + (uint64_t) h->datalen > m_len || m_base[h->data + h->datalen - 1])
+	{
+		return false;
+	}
+	m_strings = (const uint32_t *) (m_base + h->strings);
+	m_elements = (const CompiledElement *) (m_base + h->elements);
+	m_attrs = (const CompiledAttr *) (m_base + h->attrs);
+	m_data = (const char *) (m_base + h->data);
+	for(c = 0; c < h->nstrings; c++)
+	{
+		if(m_strings[c] >= h->datalen)
+		{
+			return false;
+		}
+	}
+	for(c = 0; c < h->nattrs; c++)
+	{
+		if(m_attrs[c].name >= h->nstrings || m_attrs[c].value >= h->nstrings)
+		{
+			return false;
+		}
+	}
+	for(c = 0; c < h->nelements; c++)
+	{
+		/* There must be exactly one root element, and each element can only
+		 * be at most one level deeper than the one before it
+		 */
+		if(m_elements[c].name >= h->nstrings ||
+		   m_elements[c].attr + (uint64_t) m_elements[c].nattrs > h->nattrs ||
+		   (!c && m_elements[c].depth) ||
+		   (c && (!m_elements[c].depth || m_elements[c].depth > m_elements[c - 1].depth + 1)))
+		{
+			return false;
+		}
+	}
+	m_header = h;
+	return true;
+}
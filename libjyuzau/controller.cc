@@ -174,12 +174,9 @@ Controller::keyReleased(const OIS::KeyEvent &arg)
 bool
 Controller::mouseMoved(const OIS::MouseEvent &arg)
 {
-	if(arg.state.X.rel > 50 || arg.state.X.rel < -50 ||
-		arg.state.Y.rel > 50 || arg.state.Y.rel < -50)
-	{
-		/* Drop events which are out of range to prevent wild movement */
-		return false;
-	}
+	/* Spurious movements have already been dropped by the InputSampler,
+	 * and so this is the whole of the movement since the last frame
+	 */
 	if(m_actors.size() > 0)
 	{
 		/* Player 1 */
@@ -17,9 +17,12 @@
 # include "config.h"
 #endif
 
+#include <cstdlib>
+
 #include <OGRE/OgreLogManager.h>
 #include <OGRE/OgreConfigFile.h>
 #include <OGRE/OgreViewport.h>
+#include <OGRE/OgreArchiveManager.h>
 
 #if OGRE_PLATFORM == OGRE_PLATFORM_APPLE
 # include <OGRE/OSX/macUtils.h>
@@ -50,6 +53,15 @@
 #include "jyuzau/roster.hh"
 #include "jyuzau/character.hh"
 #include "jyuzau/controller.hh"
+#include "jyuzau/loadqueue.hh"
+#include "jyuzau/resourceloader.hh"
+#include "jyuzau/shapecache.hh"
+#include "jyuzau/nullrender.hh"
+#include "jyuzau/trace.hh"
+#include "jyuzau/inputlog.hh"
+#include "jyuzau/inputsampler.hh"
+#include "jyuzau/packarchive.hh"
+#include "jyuzau/packed.hh"
 
 using namespace Jyuzau;
 
@@ -79,11 +91,31 @@ Core::Core(void)
 	m_preInhibitState(NULL),
 	m_playersChanged(false),
 	m_controller(NULL),
-	m_caption("Jyuzau")
+	m_loadQueue(NULL),
+	m_resourceLoader(NULL),
+	m_shapeCache(NULL),
+	m_caption("Jyuzau"),
+	m_headless(false),
+	m_nullRender(NULL),
+	m_frameLimit(0),
+	m_frames(0),
+	m_tracer(NULL),
+	m_renderTrace(NULL),
+	m_tracingFrame(false),
+	m_recorder(NULL),
+	m_replay(NULL),
+	m_replayRealtime(false),
+	m_sampler(NULL),
+	m_inputRate(INPUT_SAMPLE_RATE),
+	m_packs(NULL)
 {
 	singleton = this;
+	m_shapeCache = new ShapeCache();
+	m_tracer = new Tracer();
 #if OGRE_PLATFORM == OGRE_PLATFORM_APPLE
 	m_resourcePath = Ogre::macBundlePath() + "/Contents/Resources/";
+	/* Events can only be read from the main thread */
+	m_inputRate = 0;
 #else
 	m_resourcePath = "";
 #endif
@@ -99,10 +131,20 @@ Core::~Core(void)
 	{
 		delete (*it);
 	}
+	delete m_loadQueue;
+	delete m_resourceLoader;
+	delete m_shapeCache;
 	if (m_overlaySystem) delete m_overlaySystem;
 	Ogre::WindowEventUtilities::removeWindowEventListener(m_window, this);
 	windowClosed(m_window);
 	delete m_root;
+	delete m_nullRender;
+	delete m_renderTrace;
+	delete m_tracer;
+	delete m_recorder;
+	delete m_replay;
+	/* Ogre::Root has destroyed any archives which refer to the packs */
+	delete m_packs;
 }
 
 /* Enter the rendering run-loop on non-Apple platforms */
@@ -112,11 +154,29 @@ Core::go()
 #if OGRE_PLATFORM == OGRE_PLATFORM_APPLE
 	return false;
 #else
+	float interval;
+
 	if(!init())
 	{
 		return false;
 	}
-	m_root->startRendering();
+	if(m_replay && !m_replay->realtime())
+	{
+		/* Give each frame the interval that it had when it was recorded,
+		 * rather than the time it actually took
+		 */
+		while(m_replay->nextFrame(interval))
+		{
+			if(!render(interval))
+			{
+				break;
+			}
+		}
+	}
+	else
+	{
+		m_root->startRendering();
+	}
 	return cleanup();
 #endif
 }
@@ -180,6 +240,277 @@ Core::controller(void)
 	return m_controller;
 }
 
+/* Return the LoadQueue used to load assets in the background */
+LoadQueue *
+Core::loadQueue(void)
+{
+	return m_loadQueue;
+}
+
+/* Return the ResourceLoader which loads the resource groups of assets */
+ResourceLoader *
+Core::resourceLoader(void)
+{
+	return m_resourceLoader;
+}
+
+/* Return the factory which holds the mounted packed archives; this is NULL
+ * until init() has been invoked
+ */
+PackArchiveFactory *
+Core::packs(void)
+{
+	return m_packs;
+}
+
+/* Return the cache of collision shapes shared between props */
+ShapeCache *
+Core::shapeCache(void)
+{
+	return m_shapeCache;
+}
+
+/* Return the Tracer which times the phases of each frame */
+Tracer *
+Core::tracer(void)
+{
+	return m_tracer;
+}
+
+/* Return the path that the trace will be written to at shutdown, if any */
+Ogre::String
+Core::traceFile(void)
+{
+	return m_traceFile;
+}
+
+/* Apply start-up options given on the command line:
+ *
+ *   --headless            Run without a window, configuration dialog or
+ *                         input devices, using the null render system
+ *   --render-system NAME  Use the named render system instead of asking
+ *   --option NAME=VALUE   Set a configuration option of the render system
+ *   --frames N            Shut down once N frames have been rendered
+ *   --trace FILE          Trace the phases of each frame, writing the
+ *                         trace to FILE at shutdown
+ *   --record FILE         Record keyboard and mouse input, along with the
+ *                         interval of each frame, to FILE
+ *   --replay FILE         Replay recorded input frame by frame, giving
+ *                         each frame its recorded interval
+ *   --replay-realtime FILE
+ *                         Replay recorded input as it happened, in real
+ *                         time
+ *   --pack FILE           Read assets from the packed archive FILE, in
+ *                         place of assets.jyzp
+ *   --input-rate N        Capture the keyboard and mouse N times a
+ *                         second, or once per frame if N is zero
+ *
+ * Any other arguments are left for the application. Returns false if an
+ * option is missing its value.
+ */
+bool
+Core::parseArgs(int argc, char **argv)
+{
+	Ogre::String arg, value;
+	size_t eq;
+	int c;
+
+	for(c = 1; c < argc; c++)
+	{
+		arg = argv[c];
+		if(arg == "--headless")
+		{
+			setHeadless(true);
+			continue;
+		}
+		if(!isOption(arg))
+		{
+			continue;
+		}
+		if(c + 1 >= argc)
+		{
+			return false;
+		}
+		value = argv[++c];
+		if(arg == "--render-system")
+		{
+			setRenderSystem(value);
+		}
+		else if(arg == "--frames")
+		{
+			setFrameLimit(strtoul(value.c_str(), NULL, 10));
+		}
+		else if(arg == "--trace")
+		{
+			setTraceFile(value);
+		}
+		else if(arg == "--record")
+		{
+			setRecordFile(value);
+		}
+		else if(arg == "--replay" || arg == "--replay-realtime")
+		{
+			setReplayFile(value, arg == "--replay-realtime");
+		}
+		else if(arg == "--pack")
+		{
+			setPackFile(value);
+		}
+		else if(arg == "--input-rate")
+		{
+			setInputRate(atoi(value.c_str()));
+		}
+		else
+		{
+			eq = value.find('=');
+			if(eq == Ogre::String::npos)
+			{
+				return false;
+			}
+			setRenderConfig(value.substr(0, eq), value.substr(eq + 1));
+		}
+	}
+	return true;
+}
+
+/* Return true if arg is one of the options, taking a value, which are
+ * handled by parseArgs(), so that an application which parses the rest can
+ * skip them
+ */
+bool
+Core::isOption(const Ogre::String &arg)
+{
+	return arg == "--render-system" || arg == "--option" || arg == "--frames" || arg == "--trace" ||
+		arg == "--record" || arg == "--replay" || arg == "--replay-realtime" || arg == "--pack" ||
+		arg == "--input-rate";
+}
+
+/* Return true if Core will run (or is running) headless */
+bool
+Core::headless(void)
+{
+	return m_headless;
+}
+
+/* When headless, Core uses the built-in null render system, and creates no
+ * configuration dialog, visible window or input devices, so that scenes can
+ * be loaded and simulated on machines without a GPU or display.
+ */
+bool
+Core::setHeadless(bool headless)
+{
+	if(m_root)
+	{
+		return false;
+	}
+	m_headless = headless;
+	return true;
+}
+
+/* Select a render system by name (e.g., "OpenGL Rendering Subsystem"),
+ * rather than showing the configuration dialog
+ */
+bool
+Core::setRenderSystem(const Ogre::String &name)
+{
+	if(m_root)
+	{
+		return false;
+	}
+	m_renderSystem = name;
+	return true;
+}
+
+/* Set a configuration option (e.g., "Video Mode") for the render system;
+ * options only apply if the render system is selected with
+ * setRenderSystem() or setHeadless()
+ */
+bool
+Core::setRenderConfig(const Ogre::String &name, const Ogre::String &value)
+{
+	if(m_root)
+	{
+		return false;
+	}
+	m_renderConfig[name] = value;
+	return true;
+}
+
+/* Shut down after a fixed number of frames, or never if frames is zero */
+void
+Core::setFrameLimit(unsigned long frames)
+{
+	m_frameLimit = frames;
+}
+
+/* Enable tracing, and write the trace to path when cleanup() is invoked */
+void
+Core::setTraceFile(const Ogre::String &path)
+{
+	m_traceFile = path;
+	m_tracer->setEnabled(path.length() > 0);
+}
+
+/* Read assets from a particular packed archive, instead of assets.jyzp
+ * alongside the application's resources; must precede init()
+ */
+bool
+Core::setPackFile(const Ogre::String &path)
+{
+	if(m_root)
+	{
+		return false;
+	}
+	m_packFile = path;
+	return true;
+}
+
+/* Capture the keyboard and mouse rate times a second on a thread of their
+ * own, or once per frame on the render thread if rate is zero (which is
+ * the only option on some platforms); must precede init()
+ */
+bool
+Core::setInputRate(int rate)
+{
+	if(m_root)
+	{
+		return false;
+	}
+	m_inputRate = (rate > 0 ? rate : 0);
+	return true;
+}
+
+/* Record all keyboard and mouse input to a file, from which it can later be
+ * replayed; must precede init()
+ */
+bool
+Core::setRecordFile(const Ogre::String &path)
+{
+	if(m_root)
+	{
+		return false;
+	}
+	m_recordFile = path;
+	return true;
+}
+
+/* Replay input from a recording made with setRecordFile() in place of
+ * the keyboard and mouse, shutting down when it runs out. Unless realtime
+ * is true, go() renders exactly the recorded frames, each with its recorded
+ * interval; must precede init()
+ */
+bool
+Core::setReplayFile(const Ogre::String &path, bool realtime)
+{
+	if(m_root)
+	{
+		return false;
+	}
+	m_replayFile = path;
+	m_replayRealtime = realtime;
+	return true;
+}
+
 /* Trigger application termination */
 void
 Core::shutdown()
@@ -251,16 +582,21 @@ Core::init(void)
 
 	Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: " + Ogre::String(PACKAGE_STRING));
 
+	mountPacks();
 	createResourceGroups();
 
-	if(!m_root->showConfigDialog())
+	if(!configureRenderSystem())
 	{
-		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: aborted at configuration dialog");
 		return false;
 	}
 	
 	m_window = m_root->initialise(true, m_caption);
+	m_tracer->nameThread("render");
+	m_renderTrace = new RenderTrace(m_tracer);
+	m_window->addListener(m_renderTrace);
 	m_overlaySystem = new Ogre::OverlaySystem();
+	m_loadQueue = new LoadQueue(m_root->getWorkQueue());
+	m_resourceLoader = new ResourceLoader(m_root->getWorkQueue());
 
 	Ogre::ResourceGroupManager::getSingleton().initialiseAllResourceGroups();
 
@@ -279,6 +615,15 @@ Core::init(void)
 		return false;
 	}
 	createFrameListener();
+	if(!createInputLog())
+	{
+		return false;
+	}
+	/* Live input is ignored for the duration of a replay */
+	if(m_sampler && !m_replay)
+	{
+		m_sampler->start();
+	}
 	m_shutdown = false;
 	enableStateActivation();
 	return true;
@@ -287,6 +632,14 @@ Core::init(void)
 bool
 Core::cleanup()
 {
+	if(m_recorder)
+	{
+		m_recorder->close();
+	}
+	if(m_traceFile.length())
+	{
+		m_tracer->write(m_traceFile);
+	}
 	if(m_firstState)
 	{
 		m_firstState->m_next = NULL;
@@ -424,19 +777,27 @@ Core::activateState(State *state)
 	}
 	if(m_inhibitStateActivation)
 	{
-		state->preload();
+		state->preloadInBackground();
 	}
 	else
 	{
 		state->activated(m_window);
 		state->sceneManager()->addRenderQueueListener(m_overlaySystem);
+		state->sceneManager()->addListener(m_renderTrace);
 	}
 }
 
 void
 Core::deactivateState(State *state)
 {
-	state->sceneManager()->removeRenderQueueListener(m_overlaySystem);
+	/* A state which has only been preloaded in the background doesn't have
+	 * a scene manager yet
+	 */
+	if(state->sceneManager())
+	{
+		state->sceneManager()->removeListener(m_renderTrace);
+		state->sceneManager()->removeRenderQueueListener(m_overlaySystem);
+	}
 	state->deactivated(m_window);
 }
 
@@ -467,12 +828,90 @@ Core::enableStateActivation()
 
 /* Initialisation methods */
 
+/* Select the render system and apply its configuration, either as given by
+ * setHeadless(), setRenderSystem() and setRenderConfig(), or by showing the
+ * configuration dialog
+ */
+bool
+Core::configureRenderSystem(void)
+{
+	Ogre::RenderSystem *rs;
+	Ogre::NameValuePairList::iterator it;
+	Ogre::String err;
+
+	if(m_headless)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: running headless");
+		m_nullRender = new NullRenderPlugin();
+		m_root->installPlugin(m_nullRender);
+		rs = m_root->getRenderSystemByName(NULLRENDER_NAME);
+	}
+	else if(m_renderSystem.length())
+	{
+		rs = m_root->getRenderSystemByName(m_renderSystem);
+		if(!rs)
+		{
+			Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: render system '" + m_renderSystem + "' is not available");
+			return false;
+		}
+	}
+	else
+	{
+		if(!m_root->showConfigDialog())
+		{
+			Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: aborted at configuration dialog");
+			return false;
+		}
+		return true;
+	}
+	for(it = m_renderConfig.begin(); it != m_renderConfig.end(); it++)
+	{
+		if(rs->getConfigOptions().find(it->first) == rs->getConfigOptions().end())
+		{
+			Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: render system '" + rs->getName() + "' has no option '" + it->first + "'");
+			return false;
+		}
+		rs->setConfigOption(it->first, it->second);
+	}
+	err = rs->validateConfigOptions();
+	if(err.length())
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: " + err);
+		return false;
+	}
+	m_root->setRenderSystem(rs);
+	return true;
+}
+
 void
 Core::createResourceGroups(void)
 {
 	/* Can be overidden to initialise any resource groups */
 }
 
+/* Register the archive type for packed assets with Ogre, and mount the
+ * packed archive, if there is one; if there isn't, assets are read from the
+ * filesystem as usual
+ */
+void
+Core::mountPacks(void)
+{
+	m_packs = new PackArchiveFactory();
+	Ogre::ArchiveManager::getSingleton().addArchiveFactory(m_packs);
+	if(m_packFile.length())
+	{
+		/* Paths within an explicitly-specified archive are relative to
+		 * the working directory, just as they are when unpacked
+		 */
+		if(!m_packs->mount(m_packFile))
+		{
+			Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to mount packed archive " + m_packFile);
+		}
+		return;
+	}
+	m_packs->mount(m_resourcePath + "assets" + PACKED_SUFFIX, m_resourcePath);
+}
+
 void
 Core::createRoster(void)
 {
@@ -500,28 +939,84 @@ Core::createFrameListener(void)
 	size_t windowHnd = 0;
 	std::ostringstream windowHndStr;
 
-	m_window->getCustomAttribute("WINDOW", &windowHnd);
-	windowHndStr << windowHnd;
+	/* A headless window has no native handle for OIS to attach to */
+	if(!m_headless)
+	{
+		m_window->getCustomAttribute("WINDOW", &windowHnd);
+		windowHndStr << windowHnd;
 
-	pl.insert(std::make_pair(std::string("WINDOW"), windowHndStr.str()));
+		pl.insert(std::make_pair(std::string("WINDOW"), windowHndStr.str()));
 
-	m_inputManager = OIS::InputManager::createInputSystem(pl);
+		m_inputManager = OIS::InputManager::createInputSystem(pl);
 
-	m_keyboard = static_cast<OIS::Keyboard*>(m_inputManager->createInputObject(OIS::OISKeyboard, true));
-	m_mouse = static_cast<OIS::Mouse*>(m_inputManager->createInputObject(OIS::OISMouse, true));
+		m_keyboard = static_cast<OIS::Keyboard*>(m_inputManager->createInputObject(OIS::OISKeyboard, true));
+		m_mouse = static_cast<OIS::Mouse*>(m_inputManager->createInputObject(OIS::OISMouse, true));
 
-	m_mouse->setEventCallback(this);
-	m_keyboard->setEventCallback(this);
+		/* The sampler queues the devices' events, and passes them on
+		 * once per frame
+		 */
+		m_sampler = new InputSampler(m_keyboard, m_mouse, m_inputRate);
+		m_sampler->setListeners(this, this);
+		m_mouse->setEventCallback(m_sampler);
+		m_keyboard->setEventCallback(m_sampler);
 
-	windowResized(m_window);
+		windowResized(m_window);
+	}
 
 	Ogre::WindowEventUtilities::addWindowEventListener(m_window, this);
 
 	m_root->addFrameListener(this);
 }
 
+/* Open the input recording or replay, if either was asked for; a recorder
+ * is interposed between the input sampler and ourselves
+ */
+bool
+Core::createInputLog(void)
+{
+	if(m_replayFile.length())
+	{
+		m_replay = new InputReplay(m_replayRealtime);
+		return m_replay->load(m_replayFile);
+	}
+	if(m_recordFile.length())
+	{
+		m_recorder = new InputRecorder(this, this);
+		if(!m_recorder->open(m_recordFile))
+		{
+			return false;
+		}
+		if(m_sampler)
+		{
+			m_sampler->setListeners(m_recorder, m_recorder);
+		}
+	}
+	return true;
+}
+
 /* Event listeners */
 
+/* The frame span runs from the start of one frame to the end of it,
+ * including the wait for the buffers to be swapped
+ */
+bool
+Core::frameStarted(const Ogre::FrameEvent& evt)
+{
+	m_tracingFrame = m_tracer->begin("Frame");
+	return true;
+}
+
+bool
+Core::frameEnded(const Ogre::FrameEvent& evt)
+{
+	if(m_tracingFrame)
+	{
+		m_tracer->end();
+		m_tracingFrame = false;
+	}
+	return true;
+}
+
 bool
 Core::frameRenderingQueued(const Ogre::FrameEvent& evt)
 {
@@ -534,8 +1029,35 @@ Core::frameRenderingQueued(const Ogre::FrameEvent& evt)
 	{
 		return false;
 	}
-	m_keyboard->capture();
-	m_mouse->capture();
+	{
+		TraceScope scope(m_tracer, "Core::capture");
+
+		if(m_recorder)
+		{
+			m_recorder->frame(evt.timeSinceLastFrame);
+		}
+		if(m_replay)
+		{
+			/* Live input is ignored for the duration of a replay */
+			m_replay->dispatch(this, this, m_keyboard, m_mouse);
+			if(m_replay->realtime() && m_replay->finished())
+			{
+				m_shutdown = true;
+			}
+		}
+		else if(m_sampler)
+		{
+			m_sampler->sample();
+			m_sampler->dispatch();
+		}
+	}
+	/* Start loading any resource groups declared since the last frame */
+	m_resourceLoader->update();
+	m_frames++;
+	if(m_frameLimit && m_frames >= m_frameLimit)
+	{
+		m_shutdown = true;
+	}
 
 	if(!m_firstState)
 	{
@@ -600,11 +1122,12 @@ Core::windowResized(Ogre::RenderWindow* rw)
 	unsigned int width, height, depth;
 	int left, top;
 	
+	if(!m_sampler)
+	{
+		return;
+	}
 	rw->getMetrics(width, height, depth, left, top);
-
-	const OIS::MouseState &ms = m_mouse->getMouseState();
-	ms.width = width;
-	ms.height = height;
+	m_sampler->resize(width, height);
 }
 
 void
@@ -614,6 +1137,8 @@ Core::windowClosed(Ogre::RenderWindow* rw)
 	{
 		if(m_inputManager)
 		{
+			delete m_sampler;
+			m_sampler = NULL;
 			m_inputManager->destroyInputObject(m_mouse);
 			m_inputManager->destroyInputObject(m_keyboard);
 
@@ -0,0 +1,396 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cstring>
+
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreStringConverter.h>
+
+#include "jyuzau/inputlog.hh"
+
+using namespace Jyuzau;
+
+void
+Jyuzau::dispatchInputEvent(const InputEvent &event, OIS::KeyListener *keys, OIS::MouseListener *mouse, OIS::Keyboard *keyboard, OIS::Mouse *mouseDevice)
+{
+	OIS::MouseState state;
+
+	switch(event.type)
+	{
+	case INPUT_KEY_PRESSED:
+		keys->keyPressed(OIS::KeyEvent(keyboard, (OIS::KeyCode) event.key, event.text));
+		return;
+	case INPUT_KEY_RELEASED:
+		keys->keyReleased(OIS::KeyEvent(keyboard, (OIS::KeyCode) event.key, event.text));
+		return;
+	}
+	state.X.abs = event.axes[0];
+	state.Y.abs = event.axes[1];
+	state.Z.abs = event.axes[2];
+	state.X.rel = event.axes[3];
+	state.Y.rel = event.axes[4];
+	state.Z.rel = event.axes[5];
+	state.width = event.width;
+	state.height = event.height;
+	state.buttons = event.buttons;
+	switch(event.type)
+	{
+	case INPUT_MOUSE_MOVED:
+		mouse->mouseMoved(OIS::MouseEvent(mouseDevice, state));
+		break;
+	case INPUT_MOUSE_PRESSED:
+		mouse->mousePressed(OIS::MouseEvent(mouseDevice, state), (OIS::MouseButtonID) event.button);
+		break;
+	case INPUT_MOUSE_RELEASED:
+		mouse->mouseReleased(OIS::MouseEvent(mouseDevice, state), (OIS::MouseButtonID) event.button);
+		break;
+	}
+}
+
+/* InputRecorder */
+
+InputRecorder::InputRecorder(OIS::KeyListener *keys, OIS::MouseListener *mouse):
+	m_keys(keys),
+	m_mouse(mouse),
+	m_file(NULL),
+	m_frames(0),
+	m_events(0)
+{
+}
+
+InputRecorder::~InputRecorder()
+{
+	close();
+}
+
+bool
+InputRecorder::open(const Ogre::String &path)
+{
+	InputLogHeader header;
+
+	close();
+	m_file = fopen(path.c_str(), "wb");
+	if(!m_file)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to open " + path + " to record input");
+		return false;
+	}
+	memcpy(header.magic, INPUT_LOG_MAGIC, 4);
+	header.byteorder = INPUT_LOG_BYTEORDER;
+	header.version = INPUT_LOG_VERSION;
+	fwrite(&header, sizeof(header), 1, m_file);
+	m_last = std::chrono::steady_clock::now();
+	m_frames = 0;
+	m_events = 0;
+	Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: recording input to " + path);
+	return true;
+}
+
+void
+InputRecorder::close(void)
+{
+	if(!m_file)
+	{
+		return;
+	}
+	if(fclose(m_file))
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to write input recording");
+	}
+	else
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: recorded " + Ogre::StringConverter::toString(m_events) + " input events over " + Ogre::StringConverter::toString(m_frames) + " frames");
+	}
+	m_file = NULL;
+}
+
+/* Write the type and time of a record, ahead of its fields */
+void
+InputRecorder::writeRecord(char type)
+{
+	std::chrono::steady_clock::time_point now;
+	uint32_t delta;
+
+	now = std::chrono::steady_clock::now();
+	delta = std::chrono::duration_cast<std::chrono::microseconds>(now - m_last).count();
+	m_last = now;
+	fputc(type, m_file);
+	fwrite(&delta, sizeof(delta), 1, m_file);
+}
+
+void
+InputRecorder::writeMouse(char type, const OIS::MouseEvent &arg, uint32_t button)
+{
+	int32_t fields[9];
+
+	fields[0] = arg.state.X.abs;
+	fields[1] = arg.state.Y.abs;
+	fields[2] = arg.state.Z.abs;
+	fields[3] = arg.state.X.rel;
+	fields[4] = arg.state.Y.rel;
+	fields[5] = arg.state.Z.rel;
+	fields[6] = arg.state.width;
+	fields[7] = arg.state.height;
+	fields[8] = arg.state.buttons;
+	writeRecord(type);
+	fwrite(fields, sizeof(fields), 1, m_file);
+	fwrite(&button, sizeof(button), 1, m_file);
+	m_events++;
+}
+
+void
+InputRecorder::frame(float interval)
+{
+	if(!m_file)
+	{
+		return;
+	}
+	writeRecord(INPUT_FRAME);
+	fwrite(&interval, sizeof(interval), 1, m_file);
+	m_frames++;
+}
+
+bool
+InputRecorder::keyPressed(const OIS::KeyEvent &arg)
+{
+	uint32_t fields[2];
+
+	if(m_file)
+	{
+		fields[0] = arg.key;
+		fields[1] = arg.text;
+		writeRecord(INPUT_KEY_PRESSED);
+		fwrite(fields, sizeof(fields), 1, m_file);
+		m_events++;
+	}
+	return m_keys->keyPressed(arg);
+}
+
+bool
+InputRecorder::keyReleased(const OIS::KeyEvent &arg)
+{
+	uint32_t fields[2];
+
+	if(m_file)
+	{
+		fields[0] = arg.key;
+		fields[1] = arg.text;
+		writeRecord(INPUT_KEY_RELEASED);
+		fwrite(fields, sizeof(fields), 1, m_file);
+		m_events++;
+	}
+	return m_keys->keyReleased(arg);
+}
+
+bool
+InputRecorder::mouseMoved(const OIS::MouseEvent &arg)
+{
+	if(m_file)
+	{
+		writeMouse(INPUT_MOUSE_MOVED, arg, 0);
+	}
+	return m_mouse->mouseMoved(arg);
+}
+
+bool
+InputRecorder::mousePressed(const OIS::MouseEvent &arg, OIS::MouseButtonID id)
+{
+	if(m_file)
+	{
+		writeMouse(INPUT_MOUSE_PRESSED, arg, id);
+	}
+	return m_mouse->mousePressed(arg, id);
+}
+
+bool
+InputRecorder::mouseReleased(const OIS::MouseEvent &arg, OIS::MouseButtonID id)
+{
+	if(m_file)
+	{
+		writeMouse(INPUT_MOUSE_RELEASED, arg, id);
+	}
+	return m_mouse->mouseReleased(arg, id);
+}
+
+/* InputReplay */
+
+InputReplay::InputReplay(bool realtime):
+	m_realtime(realtime),
+	m_cursor(0),
+	m_frames(0),
+	m_started(false)
+{
+}
+
+InputReplay::~InputReplay()
+{
+}
+
+/* Read an entire input log into memory, so that replaying it never waits
+ * for the disk
+ */
+bool
+InputReplay::load(const Ogre::String &path)
+{
+	InputLogHeader header;
+	InputEvent event;
+	uint32_t delta, fields[2];
+	int32_t mouse[9];
+	FILE *f;
+	int type;
+	bool ok;
+
+	m_events.clear();
+	m_cursor = 0;
+	m_frames = 0;
+	m_started = false;
+	f = fopen(path.c_str(), "rb");
+	if(!f)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to open input recording " + path);
+		return false;
+	}
+	if(fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, INPUT_LOG_MAGIC, 4) ||
+		header.byteorder != INPUT_LOG_BYTEORDER || header.version != INPUT_LOG_VERSION)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: " + path + " is not a valid input recording");
+		fclose(f);
+		return false;
+	}
+	memset(&event, 0, sizeof(event));
+	ok = true;
+	while((type = fgetc(f)) != EOF)
+	{
+		if(fread(&delta, sizeof(delta), 1, f) != 1)
+		{
+			ok = false;
+			break;
+		}
+		event.type = type;
+		event.time += delta;
+		switch(type)
+		{
+		case INPUT_FRAME:
+			ok = (fread(&event.interval, sizeof(event.interval), 1, f) == 1);
+			m_frames++;
+			break;
+		case INPUT_KEY_PRESSED:
+		case INPUT_KEY_RELEASED:
+			ok = (fread(fields, sizeof(fields), 1, f) == 1);
+			event.key = fields[0];
+			event.text = fields[1];
+			break;
+		case INPUT_MOUSE_MOVED:
+		case INPUT_MOUSE_PRESSED:
+		case INPUT_MOUSE_RELEASED:
+			ok = (fread(mouse, sizeof(mouse), 1, f) == 1 && fread(&event.button, sizeof(event.button), 1, f) == 1);
+			memcpy(event.axes, mouse, sizeof(event.axes));
+			event.width = mouse[6];
+			event.height = mouse[7];
+			event.buttons = mouse[8];
+			break;
+		default:
+			ok = false;
+		}
+		if(!ok)
+		{
+			break;
+		}
+		m_events.push_back(event);
+	}
+	fclose(f);
+	if(!ok)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: input recording " + path + " is truncated or corrupt");
+		m_events.clear();
+		return false;
+	}
+	Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: replaying " + Ogre::StringConverter::toString(m_events.size() - m_frames) + " input events over " + Ogre::StringConverter::toString(m_frames) + " frames from " + path + (m_realtime ? " in real time" : ""));
+	return true;
+}
+
+bool
+InputReplay::realtime(void) const
+{
+	return m_realtime;
+}
+
+bool
+InputReplay::finished(void) const
+{
+	return m_cursor >= m_events.size();
+}
+
+unsigned long
+InputReplay::frames(void) const
+{
+	return m_frames;
+}
+
+/* Advance to the next recorded frame, returning its interval */
+bool
+InputReplay::nextFrame(float &interval)
+{
+	while(m_cursor < m_events.size())
+	{
+		if(m_events[m_cursor++].type == INPUT_FRAME)
+		{
+			interval = m_events[m_cursor - 1].interval;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Pass on the events captured during the current frame or, in real time,
+ * those which are now due
+ */
+void
+InputReplay::dispatch(OIS::KeyListener *keys, OIS::MouseListener *mouse, OIS::Keyboard *keyboard, OIS::Mouse *mouseDevice)
+{
+	uint64_t now;
+
+	if(m_realtime)
+	{
+		if(!m_started)
+		{
+			m_began = std::chrono::steady_clock::now();
+			m_started = true;
+		}
+		now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_began).count();
+		for(; m_cursor < m_events.size() && m_events[m_cursor].time <= now; m_cursor++)
+		{
+			if(m_events[m_cursor].type != INPUT_FRAME)
+			{
+				dispatchEvent(m_events[m_cursor], keys, mouse, keyboard, mouseDevice);
+			}
+		}
+		return;
+	}
+	for(; m_cursor < m_events.size() && m_events[m_cursor].type != INPUT_FRAME; m_cursor++)
+	{
+		dispatchEvent(m_events[m_cursor], keys, mouse, keyboard, mouseDevice);
+	}
+}
+
+void
+InputReplay::dispatchEvent(const InputEvent &event, OIS::KeyListener *keys, OIS::MouseListener *mouse, OIS::Keyboard *keyboard, OIS::Mouse *mouseDevice)
+{
+	dispatchInputEvent(event, keys, mouse, keyboard, mouseDevice);
+}
@@ -0,0 +1,443 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cstdlib>
+#include <system_error>
+
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreStringConverter.h>
+
+#include "jyuzau/inputsampler.hh"
+#include "jyuzau/core.hh"
+#include "jyuzau/trace.hh"
+
+using namespace Jyuzau;
+
+InputSampler::InputSampler(OIS::Keyboard *keyboard, OIS::Mouse *mouse, int rate):
+	m_keyboard(keyboard),
+	m_mouseDevice(mouse),
+	m_keys(NULL),
+	m_mouse(NULL),
+	m_rate(rate),
+	m_stop(false),
+	m_running(false),
+	m_queue(INPUT_QUEUE_SIZE),
+	m_head(0),
+	m_tail(0),
+	m_holding(false),
+	m_dropped(0),
+	m_width(0),
+	m_height(0),
+	m_resized(false),
+	m_time(0),
+	m_reported(0)
+{
+	m_began = std::chrono::steady_clock::now();
+}
+
+InputSampler::~InputSampler()
+{
+	stop();
+}
+
+/* Start capturing the devices on a thread of our own; returns false, leaving
+ * sample() to capture them once per frame, if the rate is zero or the thread
+ * can't be started
+ */
+bool
+InputSampler::start(void)
+{
+	if(m_running)
+	{
+		return true;
+	}
+	if(m_rate <= 0)
+	{
+		return false;
+	}
+	m_stop = false;
+	try
+	{
+		m_thread = std::thread(&InputSampler::run, this);
+	}
+	catch(std::system_error &e)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to start input thread: " + Ogre::String(e.what()));
+		return false;
+	}
+	m_running = true;
+	Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: sampling input at " + Ogre::StringConverter::toString(m_rate) + "Hz");
+	return true;
+}
+
+void
+InputSampler::stop(void)
+{
+	if(!m_running)
+	{
+		return;
+	}
+	m_stop = true;
+	m_thread.join();
+	m_running = false;
+}
+
+bool
+InputSampler::running(void) const
+{
+	return m_running;
+}
+
+int
+InputSampler::rate(void) const
+{
+	return m_rate;
+}
+
+void
+InputSampler::setListeners(OIS::KeyListener *keys, OIS::MouseListener *mouse)
+{
+	m_keys = keys;
+	m_mouse = mouse;
+}
+
+/* Set the size of the window, to which the absolute position of the mouse is
+ * clipped; while the thread is running, it's passed to it to apply before
+ * the next capture
+ */
+void
+InputSampler::resize(int width, int height)
+{
+	if(!m_running)
+	{
+		const OIS::MouseState &ms = m_mouseDevice->getMouseState();
+
+		ms.width = width;
+		ms.height = height;
+		return;
+	}
+	m_width = width;
+	m_height = height;
+	m_resized = true;
+}
+
+/* Capture the devices now, unless the thread is doing so */
+void
+InputSampler::sample(void)
+{
+	if(!m_running)
+	{
+		capture();
+	}
+}
+
+/* Pass on every event which has been queued, in the order in which they were
+ * captured; consecutive movements of the mouse are passed on as one, so that
+ * the listeners see the whole of the movement since the last frame, however
+ * many samples it was spread across
+ */
+void
+InputSampler::dispatch(void)
+{
+	size_t head, tail;
+	InputEvent move;
+	bool moved;
+	int c;
+
+	moved = false;
+	head = m_head.load(std::memory_order_relaxed);
+	tail = m_tail.load(std::memory_order_acquire);
+	for(; head != tail; head++)
+	{
+		const InputEvent &event = m_queue[head & (m_queue.size() - 1)];
+
+		if(event.type == INPUT_MOUSE_MOVED)
+		{
+			if(moved)
+			{
+				for(c = 0; c < 3; c++)
+				{
+					move.axes[c] = event.axes[c];
+					move.axes[c + 3] += event.axes[c + 3];
+				}
+				move.time = event.time;
+				move.width = event.width;
+				move.height = event.height;
+				move.buttons = event.buttons;
+			}
+			else
+			{
+				move = event;
+				moved = true;
+			}
+			continue;
+		}
+		if(moved)
+		{
+			dispatchEvent(move);
+			moved = false;
+		}
+		dispatchEvent(event);
+	}
+	/* Events are only read from the queue above, and so its slots can all be
+	 * handed back at once
+	 */
+	m_head.store(head, std::memory_order_release);
+	if(moved)
+	{
+		dispatchEvent(move);
+	}
+	if(m_dropped.load() != m_reported)
+	{
+		m_reported = m_dropped.load();
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: input queue full; " + Ogre::StringConverter::toString(m_reported) + " events dropped so far");
+	}
+}
+
+uint64_t
+InputSampler::time(void) const
+{
+	return m_time;
+}
+
+unsigned long
+InputSampler::dropped(void) const
+{
+	return m_dropped.load();
+}
+
+/* The thread body: capture the devices, and sleep until the next sample is
+ * due; if a capture overruns, the next is taken straight away, rather than
+ * trying to catch up
+ */
+void
+InputSampler::run(void)
+{
+	std::chrono::steady_clock::time_point next, now;
+	std::chrono::steady_clock::duration interval;
+	Tracer *tracer;
+
+	tracer = Core::getInstance() ? Core::getInstance()->tracer() : NULL;
+	if(tracer)
+	{
+		tracer->nameThread("input");
+	}
+	interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / m_rate));
+	next = std::chrono::steady_clock::now();
+	while(!m_stop)
+	{
+		now = std::chrono::steady_clock::now();
+		if(now < next)
+		{
+			std::this_thread::sleep_until(next);
+			continue;
+		}
+		if(m_resized.exchange(false))
+		{
+			const OIS::MouseState &ms = m_mouseDevice->getMouseState();
+
+			ms.width = m_width;
+			ms.height = m_height;
+		}
+		capture();
+		next += interval;
+		if(next < now)
+		{
+			next = now + interval;
+		}
+	}
+}
+
+void
+InputSampler::capture(void)
+{
+	if(m_keyboard)
+	{
+		m_keyboard->capture();
+	}
+	if(m_mouseDevice)
+	{
+		m_mouseDevice->capture();
+	}
+	/* Try again to queue a movement held back by a full queue, even if the
+	 * mouse hasn't moved since
+	 */
+	if(m_holding && push(m_held))
+	{
+		m_holding = false;
+	}
+}
+
+/* Append an event to the queue, returning false if it's full; only ever
+ * invoked by whichever thread is capturing
+ */
+bool
+InputSampler::push(const InputEvent &event)
+{
+	size_t head, tail;
+
+	tail = m_tail.load(std::memory_order_relaxed);
+	head = m_head.load(std::memory_order_acquire);
+	if(tail - head >= m_queue.size())
+	{
+		return false;
+	}
+	m_queue[tail & (m_queue.size() - 1)] = event;
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+/* Queue an event from one of the devices. A movement of the mouse which
+ * doesn't fit is held back, and added to by any which follow it, until
+ * there's room; any other event is dropped, unless a held movement (which
+ * came first) can be queued ahead of it.
+ */
+void
+InputSampler::enqueue(const InputEvent &event)
+{
+	InputEvent move;
+	int c;
+
+	if(m_holding)
+	{
+		if(event.type == INPUT_MOUSE_MOVED)
+		{
+			/* Add this movement to the one being held back */
+			for(c = 0; c < 3; c++)
+			{
+				m_held.axes[c + 3] += event.axes[c + 3];
+			}
+			move = event;
+			move.axes[3] = m_held.axes[3];
+			move.axes[4] = m_held.axes[4];
+			move.axes[5] = m_held.axes[5];
+			m_holding = !push(move);
+			if(m_holding)
+			{
+				m_held = move;
+			}
+			return;
+		}
+		if(!push(m_held))
+		{
+			m_dropped++;
+			return;
+		}
+		m_holding = false;
+	}
+	if(push(event))
+	{
+		return;
+	}
+	if(event.type == INPUT_MOUSE_MOVED)
+	{
+		m_held = event;
+		m_holding = true;
+		return;
+	}
+	m_dropped++;
+}
+
+void
+InputSampler::pushKey(char type, const OIS::KeyEvent &arg)
+{
+	InputEvent event;
+
+	event.type = type;
+	event.time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_began).count();
+	event.interval = 0;
+	event.key = arg.key;
+	event.text = arg.text;
+	enqueue(event);
+}
+
+void
+InputSampler::pushMouse(char type, const OIS::MouseEvent &arg, uint32_t button)
+{
+	InputEvent event;
+
+	event.type = type;
+	event.time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_began).count();
+	event.interval = 0;
+	event.key = 0;
+	event.text = 0;
+	event.axes[0] = arg.state.X.abs;
+	event.axes[1] = arg.state.Y.abs;
+	event.axes[2] = arg.state.Z.abs;
+	event.axes[3] = arg.state.X.rel;
+	event.axes[4] = arg.state.Y.rel;
+	event.axes[5] = arg.state.Z.rel;
+	event.width = arg.state.width;
+	event.height = arg.state.height;
+	event.buttons = arg.state.buttons;
+	event.button = button;
+	enqueue(event);
+}
+
+void
+InputSampler::dispatchEvent(const InputEvent &event)
+{
+	m_time = event.time;
+	dispatchInputEvent(event, m_keys, m_mouse, m_keyboard, m_mouseDevice);
+}
+
+/* Event callbacks, invoked by the devices on the capturing thread */
+
+bool
+InputSampler::keyPressed(const OIS::KeyEvent &arg)
+{
+	pushKey(INPUT_KEY_PRESSED, arg);
+	return true;
+}
+
+bool
+InputSampler::keyReleased(const OIS::KeyEvent &arg)
+{
+	pushKey(INPUT_KEY_RELEASED, arg);
+	return true;
+}
+
+/* A single sample in which the mouse moves further than INPUT_WILD_DELTA is
+ * taken to be spurious (such as the jump when the pointer is warped back to
+ * the centre of the window) and ignored
+ */
+bool
+InputSampler::mouseMoved(const OIS::MouseEvent &arg)
+{
+	if(abs(arg.state.X.rel) > INPUT_WILD_DELTA || abs(arg.state.Y.rel) > INPUT_WILD_DELTA)
+	{
+		return true;
+	}
+	pushMouse(INPUT_MOUSE_MOVED, arg, 0);
+	return true;
+}
+
+bool
+InputSampler::mousePressed(const OIS::MouseEvent &arg, OIS::MouseButtonID id)
+{
+	pushMouse(INPUT_MOUSE_PRESSED, arg, id);
+	return true;
+}
+
+bool
+InputSampler::mouseReleased(const OIS::MouseEvent &arg, OIS::MouseButtonID id)
+{
+	pushMouse(INPUT_MOUSE_RELEASED, arg, id);
+	return true;
+}
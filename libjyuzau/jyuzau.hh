@@ -23,6 +23,23 @@
 # include "jyuzau/camera.hh"
 # include "jyuzau/controller.hh"
 # include "jyuzau/loadable.hh"
+# include "jyuzau/loadqueue.hh"
+# include "jyuzau/compiled.hh"
+# include "jyuzau/arena.hh"
+# include "jyuzau/physicsthread.hh"
+# include "jyuzau/physicsworld.hh"
+# include "jyuzau/shapecache.hh"
+# include "jyuzau/nullrender.hh"
+# include "jyuzau/trace.hh"
+# include "jyuzau/inputlog.hh"
+# include "jyuzau/locomotion.hh"
+# include "jyuzau/resourceloader.hh"
+# include "jyuzau/packed.hh"
+# include "jyuzau/packarchive.hh"
+# include "jyuzau/script.hh"
+# include "jyuzau/snapshot.hh"
+# include "jyuzau/query.hh"
+# include "jyuzau/inputsampler.hh"
 # include "jyuzau/prop.hh"
 # include "jyuzau/actor.hh"
 # include "jyuzau/scene.hh"
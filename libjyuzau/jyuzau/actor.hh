@@ -30,13 +30,20 @@ namespace Jyuzau
 	class Camera;
 	class Character;
 	class Kinematics;
+	class Locomotion;
 	
 	/* An actor is a kind of prop which can have autonomous behaviours
 	 * and cameras attached to it.
+	 *
+	 * The actor of a player is moved by a kinematic character controller
+	 * (see Kinematics) for as long as its Character is attached; an actor
+	 * class may give every actor of the class one, whenever it's attached
+	 * to a scene, by specifying kinematic="yes" on its <actor> element.
 	 */
 	class Actor: public Prop, public Ogre::FrameListener
 	{
 		friend class Character;
+		friend class Locomotion;
 	public:
 		Actor(const Actor &object);
 		Actor(Ogre::String name, State *state, Ogre::String kind = "actor");
@@ -45,6 +52,7 @@ namespace Jyuzau
 		virtual Loadable *clone(void) const;
 		
 		virtual Character *character(void) const;
+		virtual Locomotion *locomotion(void) const;
 		
 		virtual Camera *createCamera(CameraType type);
 		virtual void resetActiveCameras(void);
@@ -52,6 +60,9 @@ namespace Jyuzau
 		
 		virtual bool frameRenderingQueued(const Ogre::FrameEvent& evt);
 
+		virtual void snapshot(SnapshotNode &record) const;
+		virtual void restore(const SnapshotNode &record);
+
 		/* Basic movement primitives */
 		virtual void setSpeed(MoveSpeed speed);
 		virtual void beginRun(void);
@@ -140,9 +151,17 @@ namespace Jyuzau
 		
 		/* Physics */
 		Kinematics *m_kinematics;
+		
+		/* Batched movement, if this actor is managed by a Locomotion */
+		Locomotion *m_locomotion;
+		size_t m_locomotionIndex;
 
+		virtual void detach(void);
+		virtual bool attachToSceneNode(Scene *scene, Ogre::SceneNode *parentNode, Ogre::String id);
+		virtual Ogre::InstancedEntity *createInstance(Ogre::SceneManager *sceneManager);
 		virtual void characterAttached(void);
 		virtual void characterDetached(void);
+		virtual void updateLocomotion(void);
 		
 		void accelerateXYMovement(Ogre::Vector3 &velocity, bool f, bool b, bool l, bool r, Ogre::Real topSpeed, Ogre::Real accelFactor, Ogre::Real decelFactor, Ogre::Real elapsed);
 		void accelerateRotation(Ogre::Real &velocity, bool back, bool forward, Ogre::Real topSpeed, Ogre::Real step, Ogre::Real accelFactor, Ogre::Real decelFactor, Ogre::Real elapsed);
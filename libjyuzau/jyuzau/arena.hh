@@ -0,0 +1,65 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_ARENA_HH_
+# define JYUZAU_ARENA_HH_              1
+
+# include <cstddef>
+
+# include "jyuzau/defs.hh"
+
+namespace Jyuzau
+{
+	/* A LoadArena is a monotonic allocator used for the LoadableObject
+	 * tree built while an asset is being loaded. Memory is obtained from
+	 * the heap in large blocks, is never returned piecemeal, and is freed
+	 * all at once when the arena is destroyed or release() is invoked.
+	 *
+	 * Objects allocated from the arena must be destroyed before the arena
+	 * is released (their destructors still run), but freeing them costs
+	 * nothing.
+	 *
+	 * The counters record how many allocations the arena has served and
+	 * how many blocks it has needed from the heap to do so.
+	 */
+	class LoadArena
+	{
+	public:
+		LoadArena(size_t blockSize = LOAD_ARENA_BLOCK_SIZE);
+		virtual ~LoadArena();
+		
+		virtual void *allocate(size_t size);
+		virtual void release(void);
+		
+		/* Statistics */
+		virtual size_t allocations(void) const;
+		virtual size_t bytes(void) const;
+		virtual size_t blocks(void) const;
+		virtual size_t reserved(void) const;
+	protected:
+		struct Block
+		{
+			Block *next;
+			size_t size;
+			size_t used;
+		};
+		
+		size_t m_blockSize;
+		Block *m_blocks;
+		size_t m_allocations, m_bytes, m_nblocks, m_reserved;
+	};
+};
+
+#endif /*!JYUZAU_ARENA_HH_*/
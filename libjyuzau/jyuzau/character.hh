@@ -31,6 +31,7 @@ namespace Jyuzau
 	class Actor;
 	class Scene;
 	class State;
+	struct SnapshotNode;
 	
 	/* A Character represents the identity and properties of a player, and is
 	 * attached to an Actor object. Persistent state such as the player's name,
@@ -74,6 +75,10 @@ namespace Jyuzau
 		virtual unsigned level(void);
 		virtual unsigned currency(int slot);
 		virtual unsigned ammo(int slot);
+
+		/* Snapshots (see Snapshot) */
+		virtual void snapshot(SnapshotNode &record) const;
+		virtual void restore(const SnapshotNode &record);
 	protected:
 		Actor *m_actor;
 		Ogre::String m_actorName;
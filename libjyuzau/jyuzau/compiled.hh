@@ -0,0 +1,124 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_COMPILED_HH_
+# define JYUZAU_COMPILED_HH_           1
+
+# include <cstddef>
+# include <string>
+
+# include <stdint.h>
+
+/* Compiled asset descriptors are produced from the XML by jyzc, and are
+ * stored alongside the source document with the COMPILED_SUFFIX in place of
+ * ".xml".
+ *
+ * This header deliberately has no dependency upon OGRE, so that it can be
+ * used by the compiler.
+ */
+# define COMPILED_MAGIC                "JYZB"
+# define COMPILED_VERSION              1
+# define COMPILED_BYTEORDER            0x01020304
+# define COMPILED_SUFFIX               ".jyzb"
+
+namespace Jyuzau
+{
+	/* A compiled document consists of a header, followed by four tables,
+	 * each of which is aligned to a four-byte boundary:
+	 *
+	 * - the string index: the offset of each string within the string data
+	 * - the elements, in document order
+	 * - the attributes, in document order
+	 * - the string data: NUL-terminated UTF-8 strings
+	 *
+	 * Every element name, attribute name and attribute value is interned in
+	 * the string table, and referred to by its index. Element names and
+	 * attribute names are qualified in the same way as by the SAX loader,
+	 * i.e., the namespace URI (if any) followed by the local name.
+	 *
+	 * All fields are in the byte order of the machine which compiled the
+	 * document; a loader whose byte order differs will reject it.
+	 */
+	struct CompiledHeader
+	{
+		char magic[4];
+		uint32_t byteorder;
+		uint32_t version;
+		uint32_t nstrings;
+		uint32_t nelements;
+		uint32_t nattrs;
+		uint32_t strings;
+		uint32_t elements;
+		uint32_t attrs;
+		uint32_t data;
+		uint32_t datalen;
+	};
+
+	/* An element's depth is its distance from the root element (whose depth
+	 * is zero); its attributes are attrs[attr] .. attrs[attr + nattrs - 1]
+	 */
+	struct CompiledElement
+	{
+		uint32_t name;
+		uint32_t depth;
+		uint32_t attr;
+		uint32_t nattrs;
+	};
+
+	struct CompiledAttr
+	{
+		uint32_t name;
+		uint32_t value;
+	};
+
+	/* The CompiledDocument class provides read-only access to a compiled
+	 * document, which is memory-mapped where possible and validated before
+	 * any of it is used. A document may also be opened in place within a
+	 * block of memory, such as a packed archive, which must outlive it.
+	 */
+	class CompiledDocument
+	{
+	public:
+		static std::string compiledPath(const std::string &source);
+		static bool current(const std::string &source, const std::string &compiled);
+
+		CompiledDocument();
+		virtual ~CompiledDocument();
+
+		virtual bool open(const std::string &path);
+		virtual bool open(const void *data, size_t len);
+		virtual void close(void);
+
+		virtual uint32_t strings(void) const;
+		virtual const char *string(uint32_t index) const;
+		virtual uint32_t elements(void) const;
+		virtual const CompiledElement *element(uint32_t index) const;
+		virtual const CompiledAttr *attr(uint32_t index) const;
+	protected:
+		unsigned char *m_base;
+		size_t m_len;
+		bool m_mapped;
+		bool m_borrowed;
+		const CompiledHeader *m_header;
+		const uint32_t *m_strings;
+		const CompiledElement *m_elements;
+		const CompiledAttr *m_attrs;
+		const char *m_data;
+
+		virtual bool validate(void);
+	};
+};
+
+#endif /*!JYUZAU_COMPILED_HH_*/
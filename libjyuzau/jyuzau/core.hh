@@ -38,6 +38,16 @@ namespace Jyuzau
 	class Roster;
 	class Camera;
 	class Controller;
+	class LoadQueue;
+	class ResourceLoader;
+	class PackArchiveFactory;
+	class ShapeCache;
+	class NullRenderPlugin;
+	class Tracer;
+	class RenderTrace;
+	class InputRecorder;
+	class InputReplay;
+	class InputSampler;
 	
 	class Core: public Ogre::FrameListener, public Ogre::WindowEventListener, public OIS::KeyListener, public OIS::MouseListener
 	{
@@ -51,6 +61,20 @@ namespace Jyuzau
 		/* Single-method run-loop */
 		virtual bool go();
 
+		/* Start-up configuration, which must precede init() */
+		virtual bool parseArgs(int argc, char **argv);
+		static bool isOption(const Ogre::String &arg);
+		virtual bool headless(void);
+		virtual bool setHeadless(bool headless = true);
+		virtual bool setRenderSystem(const Ogre::String &name);
+		virtual bool setRenderConfig(const Ogre::String &name, const Ogre::String &value);
+		virtual void setFrameLimit(unsigned long frames);
+		virtual void setTraceFile(const Ogre::String &path);
+		virtual bool setRecordFile(const Ogre::String &path);
+		virtual bool setReplayFile(const Ogre::String &path, bool realtime = false);
+		virtual bool setPackFile(const Ogre::String &path);
+		virtual bool setInputRate(int rate);
+
 		/* Alternative interface to the run-loop */
 		virtual bool init();
 		virtual bool cleanup();
@@ -65,6 +89,12 @@ namespace Jyuzau
 		virtual Camera *camera(int index = 0);
 		virtual Ogre::SceneManager *sceneManager(void);
 		virtual Controller *controller(void);
+		virtual LoadQueue *loadQueue(void);
+		virtual ResourceLoader *resourceLoader(void);
+		virtual PackArchiveFactory *packs(void);
+		virtual ShapeCache *shapeCache(void);
+		virtual Tracer *tracer(void);
+		virtual Ogre::String traceFile(void);
 		
 		/* State management */
 		virtual void pushState(State *state);
@@ -104,18 +134,44 @@ namespace Jyuzau
 		std::vector<Character *>m_players;
 		bool m_playersChanged;
 		Controller *m_controller;
+		LoadQueue *m_loadQueue;
+		ResourceLoader *m_resourceLoader;
+		ShapeCache *m_shapeCache;
 		Ogre::String m_caption;
+		bool m_headless;
+		Ogre::String m_renderSystem;
+		Ogre::NameValuePairList m_renderConfig;
+		NullRenderPlugin *m_nullRender;
+		unsigned long m_frameLimit;
+		unsigned long m_frames;
+		Tracer *m_tracer;
+		RenderTrace *m_renderTrace;
+		Ogre::String m_traceFile;
+		bool m_tracingFrame;
+		InputRecorder *m_recorder;
+		InputReplay *m_replay;
+		Ogre::String m_recordFile, m_replayFile;
+		bool m_replayRealtime;
+		InputSampler *m_sampler;
+		int m_inputRate;
+		PackArchiveFactory *m_packs;
+		Ogre::String m_packFile;
 		
 		virtual void activateState(State *state);
 		virtual void deactivateState(State *state);
 		
+		virtual bool configureRenderSystem(void);
 		virtual void createResourceGroups(void);
 		virtual void createRoster(void);
 		virtual void createInitialState(void);
 		virtual void createFrameListener(void);
 		virtual void createController(void);
+		virtual bool createInputLog(void);
+		virtual void mountPacks(void);
 
 		/* Event listeners */
+		virtual bool frameStarted(const Ogre::FrameEvent& evt);
+		virtual bool frameEnded(const Ogre::FrameEvent& evt);
 		virtual bool frameRenderingQueued(const Ogre::FrameEvent& evt);
 		virtual bool keyPressed(const OIS::KeyEvent &arg);
 		virtual bool keyReleased(const OIS::KeyEvent &arg);
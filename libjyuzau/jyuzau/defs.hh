@@ -43,8 +43,83 @@
 # define ACTOR_CAM_PITCH_ANGLE         0.15f
 # define ACTOR_CAM_PITCH_FACTOR        0.005f
 
+/* The dynamics world is stepped at a fixed rate (in ticks per second),
+ * decoupled from the frame rate; no more than DYNAMICS_MAX_SUBSTEPS ticks
+ * are run in a single frame, any further backlog being dropped
+ */
+# define DYNAMICS_TICK_RATE            60
 # define DYNAMICS_MAX_SUBSTEPS         4
 
+/* Scene streaming defaults: the radius (in cells) around each camera within
+ * which cells are attached, and the factor beyond the radius which a cell
+ * must reach before it is evicted
+ */
+# define SCENE_STREAM_RADIUS           2
+# define SCENE_STREAM_HYSTERESIS       1.5f
+
+/* The size of the regions into which the fixed props of a scene which isn't
+ * streamed are batched (a streamed scene uses one region per cell)
+ */
+# define SCENE_BATCH_REGION_SIZE       2000.0f
+
+/* The margin added around the objects of a scene to form the bounds of a
+ * sweep-and-prune broadphase, when the scene doesn't specify them
+ */
+# define SCENE_WORLD_MARGIN            1000.0f
+
+/* Kinematic characters further than CROWD_NEAR_DISTANCE from every camera
+ * are moved by a single pair of sweeps, rather than by the full character
+ * controller; idle characters are only checked for collisions once every
+ * CROWD_IDLE_INTERVAL ticks
+ */
+# define CROWD_NEAR_DISTANCE           5000.0f
+# define CROWD_IDLE_INTERVAL           30
+
+/* A batch of spatial queries is only spread across worker threads if it
+ * has at least QUERY_PARALLEL_MIN queries; each worker takes
+ * QUERY_CHUNK_SIZE at a time
+ */
+# define QUERY_PARALLEL_MIN            32
+# define QUERY_CHUNK_SIZE              8
+
+/* Input: the rate (in samples per second) at which the keyboard and mouse
+ * are captured, on a thread of their own, where the platform allows it; the
+ * number of events which can be queued between frames (which must be a
+ * power of two); and the furthest the mouse may move in a single sample
+ * before the movement is taken to be spurious
+ */
+# define INPUT_SAMPLE_RATE             1000
+# define INPUT_QUEUE_SIZE              1024
+# define INPUT_WILD_DELTA              50
+
+/* The number of instances per batch requested for instanced props; the
+ * technique in use may support fewer
+ */
+# define PROP_INSTANCES_PER_BATCH      80
+
+/* Size of the blocks obtained from the heap by a LoadArena */
+# define LOAD_ARENA_BLOCK_SIZE         16384
+
+/* Scripting: the time (in milliseconds) which the behaviour scripts may
+ * take in each frame, and the number of Lua instructions between checks
+ * of it; allocations of up to SCRIPT_POOL_MAX bytes are served from free
+ * lists, in multiples of SCRIPT_POOL_ALIGN, refilled in blocks of
+ * SCRIPT_POOL_BLOCK_SIZE
+ */
+# define SCRIPT_FRAME_BUDGET           2.0f
+# define SCRIPT_HOOK_COUNT             1000
+# define SCRIPT_POOL_ALIGN             16
+# define SCRIPT_POOL_MAX               256
+# define SCRIPT_POOL_BLOCK_SIZE        65536
+
+/* Tracing: the number of spans kept for each thread, the deepest nesting of
+ * spans which is recorded, and the number of the most recent spans of a
+ * kind from which percentiles are calculated
+ */
+# define TRACE_BUFFER_SPANS            65536
+# define TRACE_MAX_DEPTH               32
+# define TRACE_STATS_WINDOW            300
+
 namespace Ogre
 {
 	class Camera;
@@ -83,6 +158,37 @@ namespace Jyuzau
 		Ogre::Viewport *vp;
 	};
 
+	/* Statistics about the most recent update of the dynamics world: the
+	 * number of fixed ticks run, the wall-clock time they took (in
+	 * milliseconds), the interpolation factor applied to the render
+	 * transforms, and the simulated time dropped because the substep cap
+	 * was reached (in seconds).
+	 *
+	 * The broadphase statistics are those of the last of the ticks: the
+	 * number of collision objects and of overlapping pairs, and the time
+	 * taken to update the objects' bounds and to find the pairs (in
+	 * milliseconds).
+	 *
+	 * The character statistics are also those of the last tick: the
+	 * number of kinematic characters, and how many of them were moved by
+	 * the full controller, moved coarsely, or skipped as idle.
+	 */
+	struct DynamicsStats
+	{
+		int steps;
+		float time;
+		float alpha;
+		float dropped;
+		int objects;
+		int pairs;
+		float aabbTime;
+		float pairTime;
+		int characters;
+		int fullCharacters;
+		int coarseCharacters;
+		int idleCharacters;
+	};
+
 	typedef std::pair<Ogre::String, Ogre::String> Attr;
 	typedef std::vector<Attr> AttrList;
 	typedef AttrList::iterator AttrListIterator;
@@ -0,0 +1,155 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_INPUTLOG_HH_
+# define JYUZAU_INPUTLOG_HH_           1
+
+# include <chrono>
+# include <cstdio>
+# include <vector>
+
+# include <stdint.h>
+
+# include <OGRE/OgreString.h>
+
+# include <OIS/OISEvents.h>
+# include <OIS/OISKeyboard.h>
+# include <OIS/OISMouse.h>
+
+/* An input log is a header, followed by a sequence of records, each of
+ * which is a single type byte followed by that type's fields:
+ *
+ * - INPUT_FRAME marks the start of a frame, and gives its interval; the
+ *   events which follow it were captured during that frame
+ * - INPUT_KEY_PRESSED and INPUT_KEY_RELEASED give the key code and the
+ *   character (if any)
+ * - INPUT_MOUSE_MOVED, INPUT_MOUSE_PRESSED and INPUT_MOUSE_RELEASED give
+ *   the state of the mouse, and the button which changed
+ *
+ * Every record begins with the number of microseconds since the previous
+ * record. As with compiled documents, all fields are in the byte order of
+ * the machine which made the recording, and a reader whose byte order
+ * differs will reject it.
+ */
+# define INPUT_LOG_MAGIC               "JYZI"
+# define INPUT_LOG_VERSION             1
+# define INPUT_LOG_BYTEORDER           0x01020304
+
+# define INPUT_FRAME                   'F'
+# define INPUT_KEY_PRESSED             'K'
+# define INPUT_KEY_RELEASED            'k'
+# define INPUT_MOUSE_MOVED             'M'
+# define INPUT_MOUSE_PRESSED           'B'
+# define INPUT_MOUSE_RELEASED          'b'
+
+namespace Jyuzau
+{
+	struct InputLogHeader
+	{
+		char magic[4];
+		uint32_t byteorder;
+		uint32_t version;
+	};
+
+	/* A single record, once read; time is the number of microseconds since
+	 * the recording began
+	 */
+	struct InputEvent
+	{
+		char type;
+		uint64_t time;
+		float interval;
+		uint32_t key;
+		uint32_t text;
+		int32_t axes[6];
+		int32_t width, height;
+		uint32_t buttons;
+		uint32_t button;
+	};
+
+	/* Pass a single keyboard or mouse event on to the listeners, as though
+	 * it had come from the devices given
+	 */
+	void dispatchInputEvent(const InputEvent &event, OIS::KeyListener *keys, OIS::MouseListener *mouse, OIS::Keyboard *keyboard, OIS::Mouse *mouseDevice);
+
+	/* An InputRecorder is installed as the event callback of the keyboard
+	 * and mouse in place of the listeners which would otherwise receive
+	 * their events; it writes each event to the log before passing it on.
+	 */
+	class InputRecorder: public OIS::KeyListener, public OIS::MouseListener
+	{
+	public:
+		InputRecorder(OIS::KeyListener *keys, OIS::MouseListener *mouse);
+		virtual ~InputRecorder();
+
+		virtual bool open(const Ogre::String &path);
+		virtual void close(void);
+
+		/* Invoked at the start of each frame, before input is captured */
+		virtual void frame(float interval);
+
+		virtual bool keyPressed(const OIS::KeyEvent &arg);
+		virtual bool keyReleased(const OIS::KeyEvent &arg);
+		virtual bool mouseMoved(const OIS::MouseEvent &arg);
+		virtual bool mousePressed(const OIS::MouseEvent &arg, OIS::MouseButtonID id);
+		virtual bool mouseReleased(const OIS::MouseEvent &arg, OIS::MouseButtonID id);
+	protected:
+		OIS::KeyListener *m_keys;
+		OIS::MouseListener *m_mouse;
+		FILE *m_file;
+		std::chrono::steady_clock::time_point m_last;
+		unsigned long m_frames, m_events;
+
+		virtual void writeRecord(char type);
+		virtual void writeMouse(char type, const OIS::MouseEvent &arg, uint32_t button);
+	};
+
+	/* An InputReplay reads an input log and passes its events to the
+	 * listeners, in one of two ways:
+	 *
+	 * - frame by frame, where nextFrame() supplies the recorded interval of
+	 *   each frame in turn and dispatch() passes on the events captured
+	 *   during it, so that each frame sees exactly the same input and
+	 *   interval as it did when it was recorded, however long it takes to
+	 *   render;
+	 * - in real time, where dispatch() passes on every event which is due,
+	 *   according to the time elapsed since the replay began.
+	 */
+	class InputReplay
+	{
+	public:
+		InputReplay(bool realtime = false);
+		virtual ~InputReplay();
+
+		virtual bool load(const Ogre::String &path);
+		virtual bool realtime(void) const;
+		virtual bool finished(void) const;
+		virtual unsigned long frames(void) const;
+
+		virtual bool nextFrame(float &interval);
+		virtual void dispatch(OIS::KeyListener *keys, OIS::MouseListener *mouse, OIS::Keyboard *keyboard, OIS::Mouse *mouseDevice);
+	protected:
+		bool m_realtime;
+		std::vector<InputEvent> m_events;
+		size_t m_cursor;
+		unsigned long m_frames;
+		bool m_started;
+		std::chrono::steady_clock::time_point m_began;
+
+		virtual void dispatchEvent(const InputEvent &event, OIS::KeyListener *keys, OIS::MouseListener *mouse, OIS::Keyboard *keyboard, OIS::Mouse *mouseDevice);
+	};
+};
+
+#endif /*!JYUZAU_INPUTLOG_HH_*/
@@ -0,0 +1,117 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_INPUTSAMPLER_HH_
+# define JYUZAU_INPUTSAMPLER_HH_       1
+
+# include "jyuzau/defs.hh"
+# include "jyuzau/inputlog.hh"
+
+# include <atomic>
+# include <chrono>
+# include <thread>
+# include <vector>
+
+# include <OIS/OISEvents.h>
+# include <OIS/OISKeyboard.h>
+# include <OIS/OISMouse.h>
+
+namespace Jyuzau
+{
+	/* An InputSampler is installed as the event callback of the keyboard
+	 * and mouse, and captures them at a fixed rate on a thread of its own,
+	 * so that input isn't only read once per frame. Each event is stamped
+	 * with the time at which it was captured and pushed on to a queue,
+	 * which dispatch() empties on the render thread, passing the events on
+	 * to the listeners in order; the movements of the mouse between two
+	 * other events are passed on as one, with their deltas summed.
+	 *
+	 * The queue has a single writer (whichever thread is capturing) and a
+	 * single reader, and neither ever waits for the other; if it fills up,
+	 * movements of the mouse are held back until there's room, and any
+	 * other events are dropped.
+	 *
+	 * If the sampler isn't started (or its rate is zero), sample() captures
+	 * the devices on the render thread, once per frame, as before. Nothing
+	 * else may use the devices while it's running.
+	 */
+	class InputSampler: public OIS::KeyListener, public OIS::MouseListener
+	{
+	public:
+		InputSampler(OIS::Keyboard *keyboard, OIS::Mouse *mouse, int rate = INPUT_SAMPLE_RATE);
+		virtual ~InputSampler();
+
+		virtual bool start(void);
+		virtual void stop(void);
+		virtual bool running(void) const;
+		virtual int rate(void) const;
+
+		virtual void setListeners(OIS::KeyListener *keys, OIS::MouseListener *mouse);
+		virtual void resize(int width, int height);
+
+		/* Invoked on the render thread, once per frame */
+		virtual void sample(void);
+		virtual void dispatch(void);
+
+		/* The time (in microseconds since the sampler was created) at which
+		 * the event being dispatched was captured
+		 */
+		virtual uint64_t time(void) const;
+		virtual unsigned long dropped(void) const;
+
+		virtual bool keyPressed(const OIS::KeyEvent &arg);
+		virtual bool keyReleased(const OIS::KeyEvent &arg);
+		virtual bool mouseMoved(const OIS::MouseEvent &arg);
+		virtual bool mousePressed(const OIS::MouseEvent &arg, OIS::MouseButtonID id);
+		virtual bool mouseReleased(const OIS::MouseEvent &arg, OIS::MouseButtonID id);
+	protected:
+		OIS::Keyboard *m_keyboard;
+		OIS::Mouse *m_mouseDevice;
+		OIS::KeyListener *m_keys;
+		OIS::MouseListener *m_mouse;
+		int m_rate;
+		std::thread m_thread;
+		std::atomic<bool> m_stop;
+		bool m_running;
+		std::chrono::steady_clock::time_point m_began;
+		/* The queue, and the (ever-increasing) positions at which the
+		 * next event will be read and written
+		 */
+		std::vector<InputEvent> m_queue;
+		std::atomic<size_t> m_head, m_tail;
+		/* Written only by the capturing side: a movement of the mouse which
+		 * didn't fit on the queue
+		 */
+		InputEvent m_held;
+		bool m_holding;
+		std::atomic<unsigned long> m_dropped;
+		/* The size of the window, to be applied by the capturing side */
+		std::atomic<int> m_width, m_height;
+		std::atomic<bool> m_resized;
+		/* Read only by the render thread */
+		uint64_t m_time;
+		unsigned long m_reported;
+
+		virtual void run(void);
+		virtual void capture(void);
+		virtual bool push(const InputEvent &event);
+		virtual void enqueue(const InputEvent &event);
+		virtual void pushKey(char type, const OIS::KeyEvent &arg);
+		virtual void pushMouse(char type, const OIS::MouseEvent &arg, uint32_t button);
+		virtual void dispatchEvent(const InputEvent &event);
+	};
+};
+
+#endif /*!JYUZAU_INPUTSAMPLER_HH_*/
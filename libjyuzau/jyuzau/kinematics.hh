@@ -16,25 +16,32 @@
 #ifndef JYUZAU_KINEMATICS_HH_
 # define JYUZAU_KINEMATICS_HH_         1
 
+# include <vector>
+
 # include <OGRE/OgreFrameListener.h>
+# include <OGRE/OgreVector3.h>
 
 # include <LinearMath/btMotionState.h>
+# include <BulletDynamics/Dynamics/btActionInterface.h>
+
+# include "jyuzau/defs.hh"
 
 class btDynamicsWorld;
 class btPairCachingGhostObject;
-class btKinematicCharacterController;
-class btBroadphaseInterface;
 class btConvexShape;
 class btRigidBody;
+class KinematicsController;
 
 namespace Jyuzau
 {
 
 	class Actor;
+	class Crowd;
 	class Scene;
 	
 	/* The Kinematics class implements controllable physics for an Actor,
-	 * for example one which is player-controlled.
+	 * for example one which is player-controlled, by way of a character
+	 * controller which is moved by the scene's Crowd.
 	 */
 	class Kinematics: public btMotionState
 	{
@@ -44,6 +51,8 @@ namespace Jyuzau
 		
 		virtual bool walkDirection(const Ogre::Vector3 &vec);
 		virtual bool jump(void);
+		virtual void synchronise(void);
+		virtual void warp(const btTransform &worldTrans);
 		
 		virtual bool frameRenderingQueued(const Ogre::FrameEvent& evt);
 		
@@ -52,14 +61,78 @@ namespace Jyuzau
 	protected:
 		Actor *m_actor;
 		Scene *m_scene;
+		Crowd *m_crowd;
 		btRigidBody *m_rigidBody;
 		btDynamicsWorld *m_dynamics;
 		btPairCachingGhostObject *m_ghost;
-		btKinematicCharacterController *m_actionController;
-		btBroadphaseInterface *m_pairCache;
+		KinematicsController *m_controller;
 		btConvexShape *m_shape;
 	};
 
+	/* A Crowd moves all of the kinematic characters of a scene, as a single
+	 * action of its dynamics world, so that hundreds of them can be moved
+	 * in each tick.
+	 *
+	 * In each tick, the characters are first sorted into three groups,
+	 * which are then stepped in turn:
+	 *
+	 * - A character which isn't walking, and is standing on the ground
+	 *   without touching anything else, is idle and isn't swept at all;
+	 *   idle characters are only stepped once every idleInterval ticks, so
+	 *   that they still notice if the ground goes from under them.
+	 * - A character further than nearDistance from every focus point (the
+	 *   cameras) is moved coarsely: one sweep of its capsule along its walk
+	 *   direction, stopping at the first thing in the way, and one up or
+	 *   down to the ground, without stepping up, sliding along walls or
+	 *   resolving penetrations.
+	 * - Every other character is moved by the full character controller,
+	 *   Bullet's btKinematicCharacterController.
+	 *
+	 * The world may be stepped on another thread, so the walk directions
+	 * set by the actors and the positions read back by them are staged:
+	 * submit() and collect() exchange them with the controllers once per
+	 * frame, with the dynamics lock held, while setWalkDirection(),
+	 * position() and setFocus() are used without it.
+	 */
+	class Crowd: public btActionInterface
+	{
+	public:
+		Crowd(btDynamicsWorld *dynamics, btScalar nearDistance = CROWD_NEAR_DISTANCE, int idleInterval = CROWD_IDLE_INTERVAL);
+		virtual ~Crowd();
+
+		virtual size_t size(void) const;
+		virtual btScalar nearDistance(void) const;
+		virtual int idleInterval(void) const;
+
+		/* Invoked with the dynamics lock held */
+		virtual size_t add(KinematicsController *controller);
+		virtual void remove(KinematicsController *controller);
+		virtual void submit(void);
+		virtual void collect(DynamicsStats &stats);
+		virtual void reset(size_t index);
+
+		/* Invoked by the render thread without the lock */
+		virtual void setWalkDirection(size_t index, const btVector3 &walk);
+		virtual const btVector3 &position(size_t index) const;
+		virtual void setFocus(const std::vector<Ogre::Vector3> &focus);
+
+		/* btActionInterface */
+		virtual void updateAction(btCollisionWorld *world, btScalar deltaTime);
+		virtual void debugDraw(btIDebugDraw *debugDrawer);
+	protected:
+		btDynamicsWorld *m_dynamics;
+		btScalar m_near;
+		int m_idleInterval;
+		std::vector<KinematicsController *> m_controllers;
+		/* Staged for (and by) the render thread */
+		std::vector<btVector3> m_walk, m_positions;
+		std::vector<Ogre::Vector3> m_pendingFocus;
+		/* Used while stepping */
+		std::vector<btVector3> m_focus;
+		std::vector<KinematicsController *> m_full, m_coarse;
+		int m_idle;
+	};
+
 };
 
 #endif /*!JYUZAU_KINEMATICS_HH_*/
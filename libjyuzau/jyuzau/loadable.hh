@@ -29,6 +29,9 @@
 namespace Jyuzau
 {
 	class LoadableObject;
+	class LoadQueue;
+	class CompiledDocument;
+	class LoadArena;
 	class State;
 	
 	/* The Loadable class represents different kinds of assets which can be
@@ -44,15 +47,20 @@ namespace Jyuzau
 		Loadable();
 		Loadable(const Loadable &object);
 		Loadable(Ogre::String name, State *state, Ogre::String kind, bool subdir);
-		~Loadable();
+		virtual ~Loadable();
 
 		virtual Loadable *clone(void) const;
 		
 		virtual bool load(void);
 		
+		/* The individual phases of load(), invoked separately by LoadQueue */
+		virtual bool parse(void);
+		virtual bool finish(void);
+		
 		virtual LoadableObject *root(void) const;
 		virtual Ogre::String className(void) const;
 		virtual Ogre::String kind(void) const;
+		virtual Ogre::String group(void) const;
 		virtual bool unique(void) const;
 		virtual State *state(void) const;
 		
@@ -67,25 +75,30 @@ namespace Jyuzau
 	protected:
 		Ogre::String m_className, m_kind, m_path, m_container, m_group;
 		int m_skip;
-		bool m_loaded, m_load_status;
+		bool m_loaded, m_load_status, m_parsed;
 		LoadableObject *m_root, *m_cur;
 		Loadable *m_owner;
 		std::vector<Loadable *> m_objects;
 		bool m_unique;
 		State *m_state;
+		LoadArena *m_arena;
 
 		virtual bool complete(void) const;
 		
 		virtual bool loadDocument(Ogre::String path);
+		virtual bool loadCompiled(const CompiledDocument &doc);
 		
 		virtual void didFinishLoading(void);
 		virtual bool addResources(Ogre::String groupName);
 		virtual void discard(void);
+		virtual void releaseArena(void);
 		
 		virtual LoadableObject *factory(Ogre::String name, AttrList &attrs);
 		
 		virtual void startElement(const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes);
 		virtual void endElement(const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI);
+		virtual void openElement(const Ogre::String &name, AttrList &attrs);
+		virtual void closeElement(void);
 	};
 	
 	/* LoadableObject is the base class used to encapsulate XML elements as
@@ -107,12 +120,21 @@ namespace Jyuzau
 		virtual ~LoadableObject();
 		virtual LoadableObject *clone(void);
 		
+		/* LoadableObjects may be allocated from a Loadable's LoadArena */
+		void *operator new(size_t size);
+		void *operator new(size_t size, LoadArena *arena);
+		void operator delete(void *ptr);
+		void operator delete(void *ptr, LoadArena *arena);
+		
 		virtual Ogre::String kind(void) const;
 		virtual LoadableObject *parent(void) const;
+		virtual LoadableObject *first(void) const;
+		virtual LoadableObject *next(void) const;
 		virtual bool complete(void) const;
 		
 		virtual bool attach(void);
 		virtual bool detach(void);
+		virtual void prefetch(LoadQueue *queue);
 	protected:
 		Loadable *m_owner;
 		LoadableObject *m_parent, *m_first, *m_last, *m_prev, *m_next;
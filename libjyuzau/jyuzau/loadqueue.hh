@@ -0,0 +1,70 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_LOADQUEUE_HH_
+# define JYUZAU_LOADQUEUE_HH_          1
+
+# include <set>
+
+# include <OGRE/OgreString.h>
+# include <OGRE/OgreWorkQueue.h>
+
+namespace Jyuzau
+{
+	class Loadable;
+
+	/* The LoadQueue class loads asset definitions using the worker threads
+	 * of Ogre's WorkQueue.
+	 *
+	 * Each enqueued Loadable has its descriptor parsed (and, where Ogre has
+	 * been built with full thread support, its resources declared) by a
+	 * worker; the remainder of the load, including adding the definition to
+	 * the State's object pool, takes place on the main thread when the
+	 * responses are processed, either by Ogre at the end of each frame, or
+	 * explicitly by wait().
+	 *
+	 * The LoadQueue takes ownership of the Loadables passed to it, and
+	 * destroys them once they have been pooled, unless they're enqueued
+	 * with adopt set to false, in which case they're loaded in place and
+	 * remain the caller's: this is how a State preloads its scenes in the
+	 * background. Either way, the Loadable's State is informed via
+	 * State::assetQueued() and State::assetLoaded().
+	 */
+	class LoadQueue: public Ogre::WorkQueue::RequestHandler, public Ogre::WorkQueue::ResponseHandler
+	{
+	public:
+		LoadQueue(Ogre::WorkQueue *queue);
+		virtual ~LoadQueue();
+		
+		virtual bool enqueue(Loadable *loadable, bool adopt = true);
+		virtual bool queued(Loadable *loadable) const;
+		virtual size_t pending(void) const;
+		virtual void wait(void);
+		virtual void release(Loadable *loadable);
+
+		/* Ogre::WorkQueue handlers */
+		virtual Ogre::WorkQueue::Response *handleRequest(const Ogre::WorkQueue::Request *req, const Ogre::WorkQueue *srcQ);
+		virtual void handleResponse(const Ogre::WorkQueue::Response *res, const Ogre::WorkQueue *srcQ);
+	protected:
+		Ogre::WorkQueue *m_queue;
+		Ogre::uint16 m_channel;
+		std::set<Ogre::String> m_queued;
+		std::set<Loadable *> m_borrowed;
+		
+		virtual void completed(Loadable *loadable, bool status);
+	};
+};
+
+#endif /*!JYUZAU_LOADQUEUE_HH_*/
@@ -0,0 +1,88 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_LOCOMOTION_HH_
+# define JYUZAU_LOCOMOTION_HH_         1
+
+# include <vector>
+
+# include <OGRE/OgrePrerequisites.h>
+
+namespace Ogre
+{
+	class SceneNode;
+};
+
+namespace Jyuzau
+{
+	class Actor;
+	class Kinematics;
+
+	/* Locomotion moves and turns a large number of actors at once, in place
+	 * of each actor doing so in its own frameRenderingQueued().
+	 *
+	 * The movement state of every actor (its input, speeds, velocities and
+	 * the orientation of its node) is held in a separate array per field,
+	 * so that update() can apply the same acceleration and turning as
+	 * Actor::frameRenderingQueued() in a single branch-free pass over
+	 * contiguous data, which the compiler is able to vectorise. Nodes are
+	 * read once, beforehand, and written once, afterwards.
+	 *
+	 * Only actors without a Character are accepted, because players need
+	 * their camera pitching; and an actor which is managed by a Locomotion
+	 * has no frameRenderingQueued() of its own. An actor of a kinematic
+	 * class is moved by handing its translation to its controller, instead
+	 * of by translating its node.
+	 */
+	class Locomotion
+	{
+	public:
+		Locomotion();
+		virtual ~Locomotion();
+
+		virtual size_t size(void) const;
+		virtual bool add(Actor *actor);
+		virtual void remove(Actor *actor);
+
+		/* Invoked by the actor when its input or speed changes */
+		virtual void setInput(size_t index, Ogre::Real advance, Ogre::Real strafe, Ogre::Real turn);
+		virtual void setTopSpeed(size_t index, Ogre::Real topSpeed);
+
+		/* Invoked when the actor is snapshotted or restored */
+		virtual void velocity(size_t index, Ogre::Vector3 &velocity, Ogre::Real &rotVelocity) const;
+		virtual void setVelocity(size_t index, const Ogre::Vector3 &velocity, Ogre::Real rotVelocity);
+
+		virtual void update(Ogre::Real elapsed);
+	protected:
+		std::vector<Actor *> m_actors;
+		std::vector<Ogre::SceneNode *> m_nodes;
+		std::vector<Kinematics *> m_kinematics;
+		/* Input: -1, 0 or 1 along each axis */
+		std::vector<Ogre::Real> m_advance, m_strafe, m_turn;
+		/* Per-actor parameters */
+		std::vector<Ogre::Real> m_topSpeed, m_moveAccel, m_moveDecel;
+		std::vector<Ogre::Real> m_rotSpeed, m_rotStep, m_rotAccel, m_rotDecel;
+		/* Velocities, which persist between frames */
+		std::vector<Ogre::Real> m_vx, m_vy, m_vz, m_rotVelocity;
+		/* Orientation, gathered from the nodes, and the results */
+		std::vector<Ogre::Real> m_qw, m_qx, m_qy, m_qz;
+		std::vector<Ogre::Real> m_tx, m_ty, m_tz, m_yaw;
+
+		virtual void resize(size_t size);
+		virtual void move(size_t from, size_t to);
+	};
+};
+
+#endif /*!JYUZAU_LOCOMOTION_HH_*/
@@ -23,6 +23,7 @@
 namespace Jyuzau
 {
 	class Scene;
+	struct SnapshotNode;
 	
 	/* A Node is a base class for objects which can be attached to scenes
 	 * and can have child objects attached, including areas, props, actors,
@@ -44,6 +45,7 @@ namespace Jyuzau
 		virtual bool attachToScene(Scene *scene, Ogre::String id = "");
 		virtual bool attachToScene(Node *scene, Ogre::String id = "");
 
+		virtual bool pinned(void) const;
 		virtual void setPosition(Ogre::Real x, Ogre::Real y, Ogre::Real z);
 		virtual void setPosition(const Ogre::Vector3 &vec);
 		virtual void setOrientation(const Ogre::Quaternion &quaternion);
@@ -53,6 +55,10 @@ namespace Jyuzau
 		virtual void yaw(const Ogre::Radian &angle);
 		virtual void pitch(const Ogre::Radian &angle);
 		virtual void roll(const Ogre::Radian &angle);
+
+		/* Snapshots (see Snapshot) */
+		virtual void snapshot(SnapshotNode &record) const;
+		virtual void restore(const SnapshotNode &record);
 	protected:
 		Scene *m_scene;
 		Ogre::SceneNode *m_node;
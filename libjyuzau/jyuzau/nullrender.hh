@@ -0,0 +1,281 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_NULLRENDER_HH_
+# define JYUZAU_NULLRENDER_HH_         1
+
+# include <vector>
+
+# include <OGRE/OgreRenderSystem.h>
+# include <OGRE/OgreHardwareBufferManager.h>
+# include <OGRE/OgreRenderWindow.h>
+# include <OGRE/OgreHardwarePixelBuffer.h>
+# include <OGRE/OgreHardwareOcclusionQuery.h>
+# include <OGRE/OgreTexture.h>
+# include <OGRE/OgreTextureManager.h>
+# include <OGRE/OgreGpuProgram.h>
+# include <OGRE/OgreGpuProgramManager.h>
+# include <OGRE/OgrePlugin.h>
+
+# define NULLRENDER_NAME               "Null Rendering Subsystem"
+# define NULLRENDER_PLUGIN_NAME        "Null RenderSystem"
+# define NULLRENDER_DEFAULT_MODE       "800 x 600"
+
+namespace Jyuzau
+{
+	/* The null render system allows the engine to run without a GPU or a
+	 * display: hardware buffers and textures are held in system memory,
+	 * render state changes are discarded, and draw calls are counted (so
+	 * that the frame statistics remain meaningful) but otherwise ignored.
+	 *
+	 * Only the fixed-function pipeline is advertised, so that materials with
+	 * a fixed-function technique are considered supported; programs for
+	 * other syntaxes are created but never loaded.
+	 */
+	class NullRenderSystem: public Ogre::RenderSystem
+	{
+	public:
+		NullRenderSystem();
+		virtual ~NullRenderSystem();
+
+		/* Configuration */
+		virtual const Ogre::String &getName(void) const;
+		virtual Ogre::ConfigOptionMap &getConfigOptions(void);
+		virtual void setConfigOption(const Ogre::String &name, const Ogre::String &value);
+		virtual Ogre::String validateConfigOptions(void);
+
+		/* Lifecycle */
+		virtual Ogre::RenderWindow *_initialise(bool autoCreateWindow, const Ogre::String &windowTitle = "OGRE Render Window");
+		virtual void reinitialise(void);
+		virtual void shutdown(void);
+		virtual Ogre::RenderSystemCapabilities *createRenderSystemCapabilities(void) const;
+		virtual void initialiseFromRenderSystemCapabilities(Ogre::RenderSystemCapabilities *caps, Ogre::RenderTarget *primary);
+
+		/* Render targets */
+		virtual Ogre::RenderWindow *_createRenderWindow(const Ogre::String &name, unsigned int width, unsigned int height, bool fullScreen, const Ogre::NameValuePairList *miscParams = 0);
+		virtual Ogre::MultiRenderTarget *createMultiRenderTarget(const Ogre::String &name);
+		virtual Ogre::DepthBuffer *_createDepthBufferFor(Ogre::RenderTarget *renderTarget);
+		virtual Ogre::HardwareOcclusionQuery *createHardwareOcclusionQuery(void);
+		virtual void _setRenderTarget(Ogre::RenderTarget *target);
+		virtual void _setViewport(Ogre::Viewport *vp);
+		virtual unsigned int getDisplayMonitorCount(void) const;
+
+		/* Frames and draw calls */
+		virtual void _beginFrame(void);
+		virtual void _endFrame(void);
+		virtual void _render(const Ogre::RenderOperation &op);
+		virtual void clearFrameBuffer(unsigned int buffers, const Ogre::ColourValue &colour = Ogre::ColourValue::Black, Ogre::Real depth = 1.0f, unsigned short stencil = 0);
+
+		/* Projection */
+		virtual Ogre::VertexElementType getColourVertexElementType(void) const;
+		virtual void _convertProjectionMatrix(const Ogre::Matrix4 &matrix, Ogre::Matrix4 &dest, bool forGpuProgram = false);
+		virtual void _makeProjectionMatrix(const Ogre::Radian &fovy, Ogre::Real aspect, Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4 &dest, bool forGpuProgram = false);
+		virtual void _makeProjectionMatrix(Ogre::Real left, Ogre::Real right, Ogre::Real bottom, Ogre::Real top, Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4 &dest, bool forGpuProgram = false);
+		virtual void _makeOrthoMatrix(const Ogre::Radian &fovy, Ogre::Real aspect, Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4 &dest, bool forGpuProgram = false);
+		virtual void _applyObliqueDepthProjection(Ogre::Matrix4 &matrix, const Ogre::Plane &plane, bool forGpuProgram);
+		virtual Ogre::Real getHorizontalTexelOffset(void);
+		virtual Ogre::Real getVerticalTexelOffset(void);
+		virtual Ogre::Real getMinimumDepthInputValue(void);
+		virtual Ogre::Real getMaximumDepthInputValue(void);
+
+		/* Render state, all of which is discarded */
+		virtual void setAmbientLight(float r, float g, float b);
+		virtual void setShadingType(Ogre::ShadeOptions so);
+		virtual void setLightingEnabled(bool enabled);
+		virtual void setNormaliseNormals(bool normalise);
+		virtual void setStencilCheckEnabled(bool enabled);
+		virtual void setStencilBufferParams(Ogre::CompareFunction func = Ogre::CMPF_ALWAYS_PASS, Ogre::uint32 refValue = 0, Ogre::uint32 compareMask = 0xFFFFFFFF, Ogre::uint32 writeMask = 0xFFFFFFFF, Ogre::StencilOperation stencilFailOp = Ogre::SOP_KEEP, Ogre::StencilOperation depthFailOp = Ogre::SOP_KEEP, Ogre::StencilOperation passOp = Ogre::SOP_KEEP, bool twoSidedOperation = false);
+		virtual void setVertexDeclaration(Ogre::VertexDeclaration *decl);
+		virtual void setVertexBufferBinding(Ogre::VertexBufferBinding *binding);
+		virtual void setScissorTest(bool enabled, size_t left = 0, size_t top = 0, size_t right = 800, size_t bottom = 600);
+		virtual void bindGpuProgramParameters(Ogre::GpuProgramType gptype, Ogre::GpuProgramParametersSharedPtr params, Ogre::uint16 variabilityMask);
+		virtual void bindGpuProgramPassIterationParameters(Ogre::GpuProgramType gptype);
+		virtual void _useLights(const Ogre::LightList &lights, unsigned short limit);
+		virtual void _setWorldMatrix(const Ogre::Matrix4 &m);
+		virtual void _setViewMatrix(const Ogre::Matrix4 &m);
+		virtual void _setProjectionMatrix(const Ogre::Matrix4 &m);
+		virtual void _setSurfaceParams(const Ogre::ColourValue &ambient, const Ogre::ColourValue &diffuse, const Ogre::ColourValue &specular, const Ogre::ColourValue &emissive, Ogre::Real shininess, Ogre::TrackVertexColourType tracking = Ogre::TVC_NONE);
+		virtual void _setPointSpritesEnabled(bool enabled);
+		virtual void _setPointParameters(Ogre::Real size, bool attenuationEnabled, Ogre::Real constant, Ogre::Real linear, Ogre::Real quadratic, Ogre::Real minSize, Ogre::Real maxSize);
+		virtual void _setTexture(size_t unit, bool enabled, const Ogre::TexturePtr &texPtr);
+		virtual void _setTextureCoordSet(size_t unit, size_t index);
+		virtual void _setTextureCoordCalculation(size_t unit, Ogre::TexCoordCalcMethod m, const Ogre::Frustum *frustum = 0);
+		virtual void _setTextureBlendMode(size_t unit, const Ogre::LayerBlendModeEx &bm);
+		virtual void _setTextureUnitFiltering(size_t unit, Ogre::FilterType ftype, Ogre::FilterOptions filter);
+		virtual void _setTextureUnitCompareEnabled(size_t unit, bool compare);
+		virtual void _setTextureUnitCompareFunction(size_t unit, Ogre::CompareFunction function);
+		virtual void _setTextureLayerAnisotropy(size_t unit, unsigned int maxAnisotropy);
+		virtual void _setTextureAddressingMode(size_t unit, const Ogre::TextureUnitState::UVWAddressingMode &uvw);
+		virtual void _setTextureBorderColour(size_t unit, const Ogre::ColourValue &colour);
+		virtual void _setTextureMipmapBias(size_t unit, float bias);
+		virtual void _setTextureMatrix(size_t unit, const Ogre::Matrix4 &xform);
+		virtual void _setSceneBlending(Ogre::SceneBlendFactor sourceFactor, Ogre::SceneBlendFactor destFactor, Ogre::SceneBlendOperation op = Ogre::SBO_ADD);
+		virtual void _setSeparateSceneBlending(Ogre::SceneBlendFactor sourceFactor, Ogre::SceneBlendFactor destFactor, Ogre::SceneBlendFactor sourceFactorAlpha, Ogre::SceneBlendFactor destFactorAlpha, Ogre::SceneBlendOperation op = Ogre::SBO_ADD, Ogre::SceneBlendOperation alphaOp = Ogre::SBO_ADD);
+		virtual void _setAlphaRejectSettings(Ogre::CompareFunction func, unsigned char value, bool alphaToCoverage);
+		virtual void _setCullingMode(Ogre::CullingMode mode);
+		virtual void _setDepthBufferParams(bool depthTest = true, bool depthWrite = true, Ogre::CompareFunction depthFunction = Ogre::CMPF_LESS_EQUAL);
+		virtual void _setDepthBufferCheckEnabled(bool enabled = true);
+		virtual void _setDepthBufferWriteEnabled(bool enabled = true);
+		virtual void _setDepthBufferFunction(Ogre::CompareFunction func = Ogre::CMPF_LESS_EQUAL);
+		virtual void _setColourBufferWriteEnabled(bool red, bool green, bool blue, bool alpha);
+		virtual void _setDepthBias(float constantBias, float slopeScaleBias = 0.0f);
+		virtual void _setFog(Ogre::FogMode mode = Ogre::FOG_NONE, const Ogre::ColourValue &colour = Ogre::ColourValue::White, Ogre::Real expDensity = 1.0, Ogre::Real linearStart = 0.0, Ogre::Real linearEnd = 1.0);
+		virtual void _setPolygonMode(Ogre::PolygonMode level);
+
+		/* Miscellany */
+		virtual Ogre::String getErrorDescription(long errorNumber) const;
+		virtual bool hasAnisotropicMipMapFilter(void) const;
+		virtual void eventOccurred(const Ogre::String &eventName, const Ogre::NameValuePairList *parameters = 0);
+		virtual void preExtraThreadsStarted(void);
+		virtual void postExtraThreadsStarted(void);
+		virtual void registerThread(void);
+		virtual void unregisterThread(void);
+		virtual void beginProfileEvent(const Ogre::String &eventName);
+		virtual void endProfileEvent(void);
+		virtual void markProfileEvent(const Ogre::String &event);
+	protected:
+		Ogre::ConfigOptionMap m_options;
+		Ogre::HardwareBufferManager *m_hardwareBufferManager;
+		Ogre::GpuProgramManager *m_gpuProgramManager;
+		bool m_initialised;
+
+		virtual void setClipPlanesImpl(const Ogre::PlaneList &clipPlanes);
+		virtual bool parseVideoMode(const Ogre::String &mode, unsigned int &width, unsigned int &height) const;
+	};
+
+	/* A window which is never shown and never closes unless asked to */
+	class NullRenderWindow: public Ogre::RenderWindow
+	{
+	public:
+		NullRenderWindow();
+		virtual ~NullRenderWindow();
+
+		virtual void create(const Ogre::String &name, unsigned int width, unsigned int height, bool fullScreen, const Ogre::NameValuePairList *miscParams);
+		virtual void destroy(void);
+		virtual void resize(unsigned int width, unsigned int height);
+		virtual void reposition(int left, int top);
+		virtual bool isClosed(void) const;
+		virtual void copyContentsToMemory(const Ogre::PixelBox &dst, FrameBuffer buffer = FB_AUTO);
+		virtual bool requiresTextureFlipping(void) const;
+	protected:
+		bool m_closed;
+	};
+
+	/* A pixel buffer held in system memory, which may be a surface of a
+	 * NullTexture
+	 */
+	class NullPixelBuffer: public Ogre::HardwarePixelBuffer
+	{
+	public:
+		NullPixelBuffer(Ogre::uint32 width, Ogre::uint32 height, Ogre::uint32 depth, Ogre::PixelFormat format, Ogre::HardwareBuffer::Usage usage);
+		virtual ~NullPixelBuffer();
+
+		virtual void blitFromMemory(const Ogre::PixelBox &src, const Ogre::Image::Box &dstBox);
+		virtual void blitToMemory(const Ogre::Image::Box &srcBox, const Ogre::PixelBox &dst);
+	protected:
+		Ogre::uint8 *m_data;
+
+		virtual Ogre::PixelBox lockImpl(const Ogre::Image::Box lockBox, LockOptions options);
+		virtual void unlockImpl(void);
+		virtual Ogre::PixelBox contents(void) const;
+	};
+
+	class NullTexture: public Ogre::Texture
+	{
+	public:
+		NullTexture(Ogre::ResourceManager *creator, const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader);
+		virtual ~NullTexture();
+
+		virtual Ogre::HardwarePixelBufferSharedPtr getBuffer(size_t face = 0, size_t mipmap = 0);
+	protected:
+		std::vector<Ogre::HardwarePixelBufferSharedPtr> m_surfaces;
+
+		virtual void loadImpl(void);
+		virtual void readImage(const Ogre::String &name, const Ogre::String &ext, Ogre::Image &image);
+		virtual void createInternalResourcesImpl(void);
+		virtual void freeInternalResourcesImpl(void);
+	};
+
+	class NullTextureManager: public Ogre::TextureManager
+	{
+	public:
+		NullTextureManager();
+		virtual ~NullTextureManager();
+
+		virtual Ogre::PixelFormat getNativeFormat(Ogre::TextureType ttype, Ogre::PixelFormat format, int usage);
+		virtual bool isHardwareFilteringSupported(Ogre::TextureType ttype, Ogre::PixelFormat format, int usage, bool preciseFormatOnly = false);
+	protected:
+		virtual Ogre::Resource *createImpl(const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader, const Ogre::NameValuePairList *createParams);
+	};
+
+	/* A GPU program whose source is loaded but never compiled */
+	class NullGpuProgram: public Ogre::GpuProgram
+	{
+	public:
+		NullGpuProgram(Ogre::ResourceManager *creator, const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader);
+		virtual ~NullGpuProgram();
+	protected:
+		virtual void loadFromSource(void);
+		virtual void unloadImpl(void);
+	};
+
+	class NullGpuProgramManager: public Ogre::GpuProgramManager
+	{
+	public:
+		NullGpuProgramManager();
+		virtual ~NullGpuProgramManager();
+	protected:
+		virtual Ogre::Resource *createImpl(const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader, const Ogre::NameValuePairList *params);
+		virtual Ogre::Resource *createImpl(const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader, Ogre::GpuProgramType gptype, const Ogre::String &syntaxCode);
+	};
+
+	/* An occlusion query which always reports that something was drawn, so
+	 * that nothing is culled by occlusion when running headless which a
+	 * real render system would draw
+	 */
+	class NullOcclusionQuery: public Ogre::HardwareOcclusionQuery
+	{
+	public:
+		NullOcclusionQuery();
+		virtual ~NullOcclusionQuery();
+
+		virtual void beginOcclusionQuery(void);
+		virtual void endOcclusionQuery(void);
+		virtual bool pullOcclusionQuery(unsigned int *NumOfFragments);
+		virtual bool isStillOutstanding(void);
+	};
+
+	/* The null render system is built into the library rather than being
+	 * loaded from plugins.cfg; Core installs this plugin with
+	 * Ogre::Root::installPlugin() when it's started headless, and it
+	 * registers the render system with Root in the usual way.
+	 */
+	class NullRenderPlugin: public Ogre::Plugin
+	{
+	public:
+		NullRenderPlugin();
+		virtual ~NullRenderPlugin();
+
+		virtual const Ogre::String &getName(void) const;
+		virtual void install(void);
+		virtual void initialise(void);
+		virtual void shutdown(void);
+		virtual void uninstall(void);
+	protected:
+		NullRenderSystem *m_renderSystem;
+	};
+};
+
+#endif /*!JYUZAU_NULLRENDER_HH_*/
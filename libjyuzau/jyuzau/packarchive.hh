@@ -0,0 +1,89 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_PACKARCHIVE_HH_
+# define JYUZAU_PACKARCHIVE_HH_        1
+
+# include <vector>
+
+# include <OGRE/OgreArchive.h>
+# include <OGRE/OgreArchiveFactory.h>
+
+/* The Ogre archive type of a directory within a mounted packed archive */
+# define PACK_ARCHIVE_TYPE             "JyuzauPack"
+
+namespace Jyuzau
+{
+	class PackedArchive;
+
+	/* A PackArchive presents a single directory of a mounted packed archive
+	 * (such as the container of a prop class) to Ogre as a resource
+	 * location. Its listing is taken from the archive's index when it's
+	 * loaded, and files are opened as streams over the mapped archive,
+	 * without being copied.
+	 */
+	class PackArchive: public Ogre::Archive
+	{
+	public:
+		PackArchive(const Ogre::String &name, const PackedArchive *pack);
+		virtual ~PackArchive();
+
+		virtual bool isCaseSensitive(void) const;
+		virtual void load(void);
+		virtual void unload(void);
+		virtual Ogre::DataStreamPtr open(const Ogre::String &filename, bool readOnly = true) const;
+		virtual Ogre::StringVectorPtr list(bool recursive = true, bool dirs = false);
+		virtual Ogre::FileInfoListPtr listFileInfo(bool recursive = true, bool dirs = false);
+		virtual Ogre::StringVectorPtr find(const Ogre::String &pattern, bool recursive = true, bool dirs = false);
+		virtual Ogre::FileInfoListPtr findFileInfo(const Ogre::String &pattern, bool recursive = true, bool dirs = false) const;
+		virtual bool exists(const Ogre::String &filename);
+		virtual time_t getModifiedTime(const Ogre::String &filename);
+	protected:
+		const PackedArchive *m_pack;
+		Ogre::String m_prefix;
+		Ogre::FileInfoList m_files;
+	};
+
+	/* The PackArchiveFactory holds the packed archives which have been
+	 * mounted, and creates a PackArchive for any resource location which
+	 * lies within one of them. Loadable uses it to read its documents from
+	 * the same archives.
+	 *
+	 * Archives are mounted before any assets are loaded, and aren't
+	 * modified afterwards, so they may be searched by LoadQueue workers.
+	 */
+	class PackArchiveFactory: public Ogre::ArchiveFactory
+	{
+	public:
+		PackArchiveFactory();
+		virtual ~PackArchiveFactory();
+
+		virtual bool mount(const Ogre::String &path, const Ogre::String &root = "");
+		virtual size_t mounted(void) const;
+		virtual bool contains(const Ogre::String &directory) const;
+		virtual bool read(const Ogre::String &path, const void *&data, size_t &length) const;
+
+		/* Ogre::ArchiveFactory */
+		virtual const Ogre::String &getType(void) const;
+		virtual Ogre::Archive *createInstance(const Ogre::String &name, bool readOnly);
+		virtual void destroyInstance(Ogre::Archive *archive);
+	protected:
+		std::vector<PackedArchive *> m_packs;
+
+		virtual const PackedArchive *directory(const Ogre::String &directory) const;
+	};
+};
+
+#endif /*!JYUZAU_PACKARCHIVE_HH_*/
@@ -0,0 +1,112 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_PACKED_HH_
+# define JYUZAU_PACKED_HH_             1
+
+# include <cstddef>
+# include <string>
+
+# include <stdint.h>
+
+/* Packed archives are produced by jyzc --pack from a tree of assets, and
+ * hold every file within it, so that loading them needs neither a
+ * directory scan nor an open() and stat() per file.
+ *
+ * As with compiled documents, this header deliberately has no dependency
+ * upon OGRE, so that it can be used by the compiler.
+ */
+# define PACKED_MAGIC                  "JYZP"
+# define PACKED_VERSION                1
+# define PACKED_BYTEORDER              0x01020304
+# define PACKED_SUFFIX                 ".jyzp"
+# define PACKED_ALIGN                  16
+
+namespace Jyuzau
+{
+	/* A packed archive consists of a header, followed by the index, the
+	 * names, and then the contents of each file, each of which is aligned
+	 * to a PACKED_ALIGN-byte boundary.
+	 *
+	 * The index is sorted by name, so that files can be found by a binary
+	 * search, and so that the files within a directory are adjacent. Names
+	 * are NUL-terminated, '/'-separated paths, relative to the directory
+	 * from which the archive was packed.
+	 *
+	 * All fields are in the byte order of the machine which packed the
+	 * archive; a loader whose byte order differs will reject it.
+	 */
+	struct PackedHeader
+	{
+		char magic[4];
+		uint32_t byteorder;
+		uint32_t version;
+		uint32_t nentries;
+		uint32_t entries;
+		uint32_t names;
+		uint32_t nameslen;
+		uint32_t reserved;
+	};
+
+	struct PackedEntry
+	{
+		uint32_t name;
+		uint32_t namelen;
+		uint64_t offset;
+		uint64_t length;
+		int64_t mtime;
+	};
+
+	/* The PackedArchive class provides read-only access to a packed
+	 * archive, which is memory-mapped where possible and validated before
+	 * any of it is used.
+	 *
+	 * The archive is mounted at a root, which is stripped from the paths
+	 * passed to find(), so that the same archive can be found using the
+	 * absolute paths of an application bundle.
+	 */
+	class PackedArchive
+	{
+	public:
+		PackedArchive();
+		virtual ~PackedArchive();
+
+		virtual bool open(const std::string &path, const std::string &root = "");
+		virtual void close(void);
+
+		virtual const std::string &path(void) const;
+		virtual const std::string &root(void) const;
+		virtual uint32_t entries(void) const;
+		virtual const PackedEntry *entry(uint32_t index) const;
+		virtual const char *name(const PackedEntry *entry) const;
+		virtual const void *data(const PackedEntry *entry) const;
+
+		virtual const PackedEntry *find(const std::string &path) const;
+		virtual uint32_t lowerBound(const std::string &prefix) const;
+		virtual bool relative(const std::string &path, std::string &name) const;
+	protected:
+		std::string m_path, m_root;
+		unsigned char *m_base;
+		size_t m_len;
+		bool m_mapped;
+		const PackedHeader *m_header;
+		const PackedEntry *m_entries;
+		const char *m_names;
+
+		virtual bool validate(void);
+	};
+};
+
+#endif /*!JYUZAU_PACKED_HH_*/
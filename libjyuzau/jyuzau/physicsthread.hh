@@ -0,0 +1,104 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_PHYSICSTHREAD_HH_
+# define JYUZAU_PHYSICSTHREAD_HH_      1
+
+# include <atomic>
+# include <chrono>
+# include <mutex>
+# include <thread>
+
+# include <btBulletDynamicsCommon.h>
+
+# include "jyuzau/physicsworld.hh"
+
+namespace Jyuzau
+{
+	class Prop;
+
+	/* The transform of a single moving prop at the end of a tick */
+	struct PhysicsTransform
+	{
+		Prop *prop;
+		btTransform transform;
+	};
+
+	/* A PhysicsFrame is the set of transforms published by a PhysicsThread
+	 * at the end of a batch of ticks, along with the statistics for the
+	 * batch. The generation identifies the set of bodies in the world at
+	 * the time (see PhysicsThread::invalidate()).
+	 */
+	struct PhysicsFrame
+	{
+		btAlignedObjectArray<PhysicsTransform> transforms;
+		unsigned long generation;
+		unsigned long ticks;
+		float time;
+		float dropped;
+		std::chrono::steady_clock::time_point published;
+		BroadphaseStats broadphase;
+	};
+
+	/* A PhysicsThread steps a dynamics world at a fixed rate on a thread of
+	 * its own, publishing the resulting transforms through a triple buffer:
+	 * the thread fills one frame while the render thread reads another, and
+	 * the third holds the most recently completed frame; the two sides swap
+	 * frames with it atomically, so neither ever waits for the other.
+	 *
+	 * Anything else which touches the dynamics world while the thread is
+	 * running must hold the lock, which the thread holds for the duration of
+	 * each batch of ticks.
+	 */
+	class PhysicsThread
+	{
+	public:
+		PhysicsThread(PhysicsWorld *world, int tickRate, int maxSubsteps);
+		virtual ~PhysicsThread();
+
+		virtual bool start(void);
+		virtual void stop(void);
+		virtual bool running(void) const;
+		virtual btScalar tickLength(void) const;
+
+		virtual void lock(void);
+		virtual void unlock(void);
+		virtual void invalidate(void);
+
+		virtual bool acquire(void);
+		virtual const PhysicsFrame &front(void) const;
+		virtual bool current(void) const;
+	protected:
+		PhysicsWorld *m_world;
+		btDynamicsWorld *m_dynamics;
+		btScalar m_tick;
+		int m_maxSubsteps;
+		std::thread m_thread;
+		std::recursive_mutex m_mutex;
+		std::atomic<bool> m_stop;
+		bool m_running;
+		unsigned long m_generation, m_ticks;
+		float m_dropped;
+		PhysicsFrame m_frames[3];
+		int m_write, m_read;
+		std::atomic<int> m_ready;
+
+		virtual void run(void);
+		virtual void publish(float time);
+	};
+
+};
+
+#endif /*!JYUZAU_PHYSICSTHREAD_HH_*/
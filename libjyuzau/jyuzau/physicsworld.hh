@@ -0,0 +1,141 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_PHYSICSWORLD_HH_
+# define JYUZAU_PHYSICSWORLD_HH_       1
+
+# include <btBulletDynamicsCommon.h>
+
+/* This header deliberately has no dependency upon OGRE, so that it can be
+ * used by the physics benchmark.
+ */
+
+/* The parallel constraint solver requires every contact manifold to be
+ * allocated from the collision configuration's pool, so the pool must be
+ * large enough for the busiest scene.
+ */
+# define PHYSICS_MANIFOLD_POOL_SIZE    32768
+
+/* The half-size of the world bounded by a sweep-and-prune broadphase when
+ * no bounds are given
+ */
+# define PHYSICS_WORLD_EXTENT          10000.0f
+
+class btThreadSupportInterface;
+class btGhostPairCallback;
+
+namespace Jyuzau
+{
+	enum BroadphaseType {
+		/* A dynamic AABB tree, which needs no bounds (the default) */
+		BP_DBVT,
+		/* Sweep and prune, within fixed bounds, of up to 16384 objects */
+		BP_SWEEP,
+		/* Sweep and prune with 32-bit handles, for larger worlds */
+		BP_SWEEP32
+	};
+
+	/* The PhysicsConfig of a world selects and tunes its broadphase, and
+	 * sets thresholds which Bullet otherwise applies to every world alike.
+	 */
+	struct PhysicsConfig
+	{
+		BroadphaseType broadphase;
+		/* The bounds of a sweep-and-prune broadphase; objects outside them
+		 * are still simulated, but are culled far less efficiently
+		 */
+		bool bounded;
+		btVector3 worldMin, worldMax;
+		/* The maximum number of objects of a sweep-and-prune broadphase, or
+		 * zero for Bullet's default
+		 */
+		unsigned int maxProxies;
+		/* btDbvtBroadphase: the velocity prediction applied to the bounds
+		 * of moving objects, and the percentages of the dynamic and fixed
+		 * trees which are re-balanced each step
+		 */
+		btScalar prediction;
+		int dynamicUpdates, fixedUpdates;
+		/* The distance beyond which contact points are discarded, or zero
+		 * for Bullet's default (relative to the size of each shape)
+		 */
+		btScalar contactBreaking;
+		/* The linear and angular velocities below which bodies may be
+		 * deactivated, or negative to leave each body's own
+		 */
+		btScalar linearSleep, angularSleep;
+
+		PhysicsConfig();
+	};
+
+	/* The cost of the broadphase during the most recent step: the number of
+	 * overlapping pairs which it found, and the time taken to update the
+	 * bounds of every object and to find the pairs, in milliseconds
+	 */
+	struct BroadphaseStats
+	{
+		unsigned long steps;
+		int objects;
+		int pairs;
+		float aabbTime;
+		float pairTime;
+	};
+
+	/* A PhysicsWorld owns a Bullet dynamics world along with the broadphase,
+	 * collision configuration, dispatcher and constraint solver which it is
+	 * built from.
+	 *
+	 * With more than one thread, narrowphase collision is dispatched across
+	 * a pool of worker threads by BulletMultiThreaded's
+	 * SpuGatheringCollisionDispatcher, and contacts are solved by its
+	 * btParallelConstraintSolver on a second pool of the same size;
+	 * otherwise, the standard sequential dispatcher and solver are used.
+	 *
+	 * The broadphase is chosen by the PhysicsConfig, and the world records
+	 * its cost in each step; sleeping thresholds are applied to the bodies
+	 * which are added with addRigidBody(). A single btGhostPairCallback is
+	 * installed on the broadphase's pair cache, and shared by every ghost
+	 * object (such as those of kinematic characters) in the world.
+	 */
+	class PhysicsWorld
+	{
+	public:
+		PhysicsWorld(int threads = 1, const PhysicsConfig &config = PhysicsConfig());
+		virtual ~PhysicsWorld();
+
+		virtual int threads(void) const;
+		virtual const PhysicsConfig &config(void) const;
+		virtual btDiscreteDynamicsWorld *dynamics(void) const;
+		virtual btBroadphaseInterface *broadphase(void) const;
+		virtual const BroadphaseStats &broadphaseStats(void) const;
+		virtual void addRigidBody(btRigidBody *body);
+	protected:
+		int m_threads;
+		PhysicsConfig m_config;
+		btBroadphaseInterface *m_broadphase;
+		btCollisionConfiguration *m_collisionConfig;
+		btCollisionDispatcher *m_dispatcher;
+		btConstraintSolver *m_solver;
+		btDiscreteDynamicsWorld *m_dynamics;
+		btThreadSupportInterface *m_collisionThreads;
+		btThreadSupportInterface *m_solverThreads;
+		btGhostPairCallback *m_ghostPairs;
+		BroadphaseStats m_stats;
+
+		virtual btBroadphaseInterface *createBroadphase(void);
+	};
+};
+
+#endif /*!JYUZAU_PHYSICSWORLD_HH_*/
@@ -26,6 +26,7 @@
 namespace Jyuzau
 {
 	class Scene;
+	class Script;
 	
 	class LoadableProp;
 	class LoadablePropMesh;
@@ -37,6 +38,24 @@ namespace Jyuzau
 	 * behaviours.
 	 *
 	 * Props have physical properties (mass, intertia, a collision shape, etc.)
+	 * The collision shape of a mesh prop is a simplified convex hull of the
+	 * mesh, unless the prop is fixed (or has no mass), in which case it's
+	 * the mesh's triangles; in either case it's obtained from the Core's
+	 * ShapeCache, and shared with the other props of the same class.
+	 *
+	 * A prop class can opt in to hardware instancing, by specifying
+	 * instancing="hw-basic", "hw-vtf" or "vtf" on its <prop> element, in
+	 * which case each prop is drawn as an InstancedEntity rather than an
+	 * Entity of its own, so that props sharing a mesh and material are
+	 * drawn together. Its material must be one written for the technique.
+	 * The instance follows the prop's node until the prop's rigid body is
+	 * first simulated, and from then on is positioned directly from the
+	 * body's motion state. If the render system doesn't support the
+	 * technique, an ordinary Entity is used instead.
+	 *
+	 * A prop class may also name a Lua behaviour script with the script
+	 * attribute of its <prop> element, an instance of which is run by the
+	 * State's ScriptScheduler for as long as each prop is attached.
 	 */	
 	class Prop: public Node, public btMotionState
 	{
@@ -44,6 +63,7 @@ namespace Jyuzau
 		friend class LoadablePropMesh;
 		friend class LoadablePropMaterial;
 		friend class LoadablePropPrefab;
+		friend class ScriptScheduler;
 	public:
 		Prop(const Prop &object);
 		Prop(Ogre::String className, State *state, Ogre::String kind = "prop");
@@ -52,11 +72,23 @@ namespace Jyuzau
 		virtual Loadable *clone(void) const;
 	
 		Ogre::Entity *entity(void) const;
+		Ogre::InstancedEntity *instancedEntity(void) const;
 		btRigidBody *rigidBody(void) const;
+		Script *script(void) const;
 		virtual btScalar mass(void) const;
 		virtual btVector3 inertia(void) const;
 		
-		virtual void setFixed(bool isFixed = false);
+		virtual bool fixed(void) const;
+		virtual void setFixed(bool isFixed = true);
+		virtual bool batched(void) const;
+		virtual void setBatched(bool isBatched);
+		virtual bool pinned(void) const;
+		virtual void setSimulatedTransform(const btTransform &worldTrans);
+		virtual void interpolate(btScalar alpha);
+		virtual void settle(void);
+		virtual void updateNodeTransform(void);
+		virtual void snapshot(SnapshotNode &record) const;
+		virtual void restore(const SnapshotNode &record);
 
 		/* btMotionState interface */
 		virtual void getWorldTransform(btTransform &worldTrans) const;
@@ -73,9 +105,29 @@ namespace Jyuzau
 		btRigidBody *m_rigidBody;
 		btScalar m_restitution;
 		btScalar m_friction;
+		bool m_fixed;
+		bool m_batched;
+		bool m_instanced;
+		Ogre::InstanceManager::InstancingTechnique m_instancing;
+		Ogre::InstancedEntity *m_instance;
+		btTransform m_prevTransform, m_curTransform;
+		/* The transform reported to Bullet by getWorldTransform(), which may
+		 * be invoked on the physics thread, and so mustn't read the node
+		 */
+		btTransform m_nodeTransform;
+		bool m_simulated;
+		/* Whether the prop is on its scene's list of those to interpolate */
+		bool m_interpolating;
+		Ogre::String m_scriptPath;
+		Script *m_script;
+		/* Only meaningful for actors (see Actor) */
+		bool m_kinematic;
 		
+		virtual void detach(void);
+		virtual void stopScript(void);
 		virtual bool attachToSceneNode(Scene *scene, Ogre::SceneNode *parentNode, Ogre::String id);
 		virtual Ogre::Entity *createEntity(Ogre::SceneManager *sceneManager, Ogre::String name = "");
+		virtual Ogre::InstancedEntity *createInstance(Ogre::SceneManager *sceneManager);
 		virtual bool createNode(Ogre::SceneNode *parentNode, Ogre::String name);
 		virtual bool createPhysics(btDynamicsWorld *dynamics);
 		virtual bool attachPhysics(btDynamicsWorld *dynamics);
@@ -0,0 +1,151 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_QUERY_HH_
+# define JYUZAU_QUERY_HH_              1
+
+# include "jyuzau/defs.hh"
+
+# include <atomic>
+# include <condition_variable>
+# include <mutex>
+# include <thread>
+# include <vector>
+
+# include <OGRE/OgreVector3.h>
+
+# include <btBulletDynamicsCommon.h>
+
+struct btDbvtNode;
+
+namespace Jyuzau
+{
+	class Prop;
+	class Actor;
+
+	enum QueryType
+	{
+		/* The closest thing along a line segment */
+		QT_RAY,
+		/* The closest thing a convex shape would hit if moved from one
+		 * point to another
+		 */
+		QT_SWEEP,
+		/* Everything whose bounds overlap a box */
+		QT_AABB,
+		/* Everything whose bounds overlap a sphere */
+		QT_SPHERE
+	};
+
+	/* A single query; for QT_AABB, from and to are the corners of the box,
+	 * and for QT_SPHERE, from is the centre. Objects are only considered if
+	 * their broadphase filters match group and mask, and the prop ignore
+	 * (such as the actor doing the looking) never is.
+	 */
+	struct Query
+	{
+		QueryType type;
+		btVector3 from, to;
+		btScalar radius;
+		const btConvexShape *shape;
+		const Prop *ignore;
+		short group, mask;
+	};
+
+	/* The result of a query. A ray or sweep which hit something has its
+	 * closest hit, as a fraction of the way from one end to the other, and
+	 * the object, and the Prop and Actor it belongs to (if any); the props
+	 * found by an overlap are listed, each once.
+	 */
+	struct QueryResult
+	{
+		bool hit;
+		btScalar fraction;
+		Ogre::Vector3 point, normal;
+		const btCollisionObject *object;
+		Prop *prop;
+		Actor *actor;
+		std::vector<Prop *> props;
+	};
+
+	/* A QueryBatch is a set of queries which are run together, by
+	 * Scene::query(); it may be re-used (after clear()) from one frame to
+	 * the next, without allocating.
+	 */
+	class QueryBatch
+	{
+		friend class QueryService;
+	public:
+		QueryBatch();
+		virtual ~QueryBatch();
+
+		/* Each returns the index of the query's result */
+		virtual size_t ray(const Ogre::Vector3 &from, const Ogre::Vector3 &to, const Prop *ignore = NULL, short mask = btBroadphaseProxy::AllFilter);
+		virtual size_t sweep(const btConvexShape *shape, const Ogre::Vector3 &from, const Ogre::Vector3 &to, const Prop *ignore = NULL, short mask = btBroadphaseProxy::AllFilter);
+		virtual size_t aabb(const Ogre::Vector3 &min, const Ogre::Vector3 &max, const Prop *ignore = NULL, short mask = btBroadphaseProxy::AllFilter);
+		virtual size_t sphere(const Ogre::Vector3 &centre, Ogre::Real radius, const Prop *ignore = NULL, short mask = btBroadphaseProxy::AllFilter);
+		virtual void clear(void);
+
+		virtual size_t size(void) const;
+		virtual const Query &query(size_t index) const;
+		virtual const QueryResult &result(size_t index) const;
+	protected:
+		std::vector<Query> m_queries;
+		std::vector<QueryResult> m_results;
+		size_t m_size;
+
+		virtual Query &add(QueryType type, const Prop *ignore, short mask);
+	};
+
+	/* A QueryService runs batches of queries against a collision world.
+	 *
+	 * If the world's broadphase is a btDbvtBroadphase, each query walks its
+	 * two trees directly, with a stack of its own, and narrows the search
+	 * as closer hits are found; the queries of a large enough batch are
+	 * shared between the calling thread and a pool of workers. Otherwise,
+	 * the queries are run one after another through the broadphase's own
+	 * rayTest() and aabbTest().
+	 *
+	 * Nothing may modify the world while a batch is being run; the caller
+	 * must hold the dynamics lock of a threaded scene.
+	 */
+	class QueryService
+	{
+	public:
+		QueryService(btCollisionWorld *world, int threads = 1);
+		virtual ~QueryService();
+
+		virtual int threads(void) const;
+		virtual void execute(QueryBatch &batch);
+	protected:
+		btCollisionWorld *m_world;
+		btDbvtBroadphase *m_dbvt;
+		std::vector<std::thread> m_threads;
+		std::mutex m_mutex;
+		std::condition_variable m_wake, m_done;
+		QueryBatch *m_batch;
+		std::atomic<size_t> m_next;
+		unsigned long m_generation;
+		int m_busy;
+		bool m_stop;
+		std::vector<const btDbvtNode *> m_stack;
+
+		virtual void run(void);
+		virtual void work(std::vector<const btDbvtNode *> &stack);
+		virtual void process(const Query &query, QueryResult &result, std::vector<const btDbvtNode *> &stack);
+	};
+};
+
+#endif /*!JYUZAU_QUERY_HH_*/
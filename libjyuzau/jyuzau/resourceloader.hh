@@ -0,0 +1,87 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_RESOURCELOADER_HH_
+# define JYUZAU_RESOURCELOADER_HH_     1
+
+# include <map>
+# include <mutex>
+
+# include <OGRE/OgreString.h>
+# include <OGRE/OgreWorkQueue.h>
+# include <OGRE/OgreResourceBackgroundQueue.h>
+
+namespace Jyuzau
+{
+	enum ResourceGroupStatus {
+		/* Declared, and waiting to be initialised on the main thread */
+		RG_DECLARED,
+		/* Being initialised in the background */
+		RG_INITIALISING,
+		/* Being loaded (or prepared) in the background */
+		RG_LOADING,
+		/* Loaded, or failed to load, and left to Ogre to load on demand */
+		RG_READY
+	};
+
+	/* The ResourceLoader initialises and loads the resource groups of asset
+	 * classes, in place of each class doing so itself as it's loaded.
+	 *
+	 * Groups are handed to add() once their resources have been declared,
+	 * and are loaded together, in parallel, by the worker threads of
+	 * Ogre's ResourceBackgroundQueue, with each stage started by the
+	 * completion callback of the one before:
+	 *
+	 * - where Ogre has been built with full thread support, both the
+	 *   initialisation of the group (the scan of its location and the
+	 *   parsing of its scripts) and the loading of its meshes, materials
+	 *   and textures take place in the background as soon as it's added;
+	 * - otherwise, groups are initialised on the main thread, all at once,
+	 *   the next time that update() or wait() is invoked, and then loaded;
+	 *   with OGRE_THREAD_SUPPORT == 2 the preparation of the resources
+	 *   takes place in the background, and with none, synchronously.
+	 *
+	 * Scene::attach() waits for every outstanding group before it creates
+	 * any entities, and Prop::attachToSceneNode() for the prop's own.
+	 */
+	class ResourceLoader: public Ogre::ResourceBackgroundQueue::Listener
+	{
+	public:
+		ResourceLoader(Ogre::WorkQueue *queue);
+		virtual ~ResourceLoader();
+
+		virtual void add(const Ogre::String &group);
+		virtual bool ready(const Ogre::String &group);
+		virtual size_t pending(void);
+		virtual void update(void);
+		virtual void wait(void);
+		virtual void wait(const Ogre::String &group);
+
+		/* Ogre::ResourceBackgroundQueue::Listener */
+		virtual void operationCompleted(Ogre::BackgroundProcessTicket ticket, const Ogre::BackgroundProcessResult &result);
+	protected:
+		Ogre::WorkQueue *m_queue;
+		std::recursive_mutex m_mutex;
+		std::map<Ogre::String, ResourceGroupStatus> m_groups;
+		std::map<Ogre::BackgroundProcessTicket, Ogre::String> m_tickets;
+		size_t m_pending;
+
+		virtual void initialise(const Ogre::String &group);
+		virtual void load(const Ogre::String &group);
+		virtual void loaded(const Ogre::String &group);
+	};
+};
+
+#endif /*!JYUZAU_RESOURCELOADER_HH_*/
@@ -18,39 +18,101 @@
 
 # include "jyuzau/loadable.hh"
 
+# include <map>
+# include <set>
 # include <utility>
+# include <vector>
 
 # include <OGRE/OgreString.h>
 # include <OGRE/OgreSceneManager.h>
+# include <OGRE/OgreStaticGeometry.h>
 # include <OGRE/OgreVector3.h>
 # include <OGRE/OgreColourValue.h>
 
 # include <btBulletDynamicsCommon.h>
 
+# include "jyuzau/physicsworld.hh"
+
 namespace Jyuzau
 {
 	class Node;
+	class Crowd;
+	class Snapshot;
+	class LoadQueue;
+	class PhysicsThread;
+	class PhysicsWorld;
 	class Prop;
+	class QueryBatch;
+	class QueryService;
 	class Light;
 	class LoadableSceneObject;
 	class LoadableSceneProp;
 	class LoadableSceneLight;
 	class LoadableSceneAmbientLight;
 	class LoadableSceneGravity;
+	class LoadableScenePhysics;
 
+	/* A SceneCell is a square region of a streamed scene, containing the
+	 * top-level objects whose origins lie within it; cells are keyed by
+	 * their grid co-ordinates on the X-Z plane.
+	 */
+	typedef std::pair<int, int> SceneCellKey;
+	
+	struct SceneCell
+	{
+		SceneCellKey key;
+		std::vector<LoadableSceneObject *> objects;
+		Ogre::StaticGeometry *geometry;
+		size_t size;
+		bool resident;
+		bool prefetched;
+		unsigned long lastWanted;
+		unsigned long lastRequired;
+	};
+	
+	/* A Scene is the description of a level; when it's attached, it
+	 * instantiates its props, actors and lights.
+	 *
+	 * If the <scene> has a cellsize attribute, the scene is streamed: its
+	 * objects are divided into cells, and only the cells within radius of
+	 * the active cameras are attached at any one time (see stream()). A
+	 * budget attribute limits the number of objects which may be resident
+	 * at once.
+	 *
+	 * The entities of fixed props are merged into Ogre::StaticGeometry
+	 * batches when they're attached (one per cell, if the scene is
+	 * streamed), unless the <scene> has batch="no"; their nodes and rigid
+	 * bodies are left in place, but a batched prop can't be moved (see
+	 * Prop::pinned()), and moving the node it's attached to won't move it.
+	 *
+	 * A threads attribute spreads collision detection and constraint solving
+	 * across that many worker threads (see PhysicsWorld), and the
+	 * <broadphase>, <deactivation> and <contacts> elements configure the
+	 * world (see LoadableScenePhysics). The kinematic characters within the
+	 * scene are moved by its Crowd, which <characters> configures.
+	 * Gameplay and AI code can cast rays and sweeps, and look for overlaps,
+	 * in batches with query(); a large batch is also spread across the
+	 * scene's worker threads.
+	 *
+	 * The state of an attached scene can be saved, and later put back
+	 * without attaching it again, with a Snapshot.
+	 */
 	class Scene: public Loadable
 	{
+		friend class LoadableScene;
 		friend class LoadableSceneProp;
 		friend class LoadableSceneLight;
 		friend class LoadableSceneAmbientLight;
 		friend class LoadableSceneGravity;
+		friend class LoadableScenePhysics;
 		friend class LoadableSceneActor;
+		friend class Snapshot;
 	public:
 		Scene(const Scene &scene);
 		Scene(Ogre::String className, State *state);
 		virtual ~Scene();
 		
-		virtual Loadable *clone(void);
+		virtual Loadable *clone(void) const;
 		
 		/* Properties */
 		Ogre::SceneManager *sceneManager(void) const;
@@ -60,32 +122,101 @@ namespace Jyuzau
 		virtual Ogre::Vector3 gravity(void) const;
 		virtual bool setGravity(const Ogre::Vector3 &vec);
 		virtual bool setGravity(const btVector3 &vec);
-
+		virtual void interpolate(btScalar alpha);
+		virtual void moving(Prop *prop);
+		virtual bool threaded(void) const;
+		virtual void setThreaded(bool threaded);
+		virtual int physicsThreads(void) const;
+		virtual bool setPhysicsThreads(int threads);
+		virtual const PhysicsConfig &physicsConfig(void) const;
+		virtual bool setPhysicsConfig(const PhysicsConfig &config);
+		virtual const BroadphaseStats *broadphaseStats(void) const;
+		virtual Crowd *crowd(void) const;
+		virtual void query(QueryBatch &batch);
+		virtual void synchronise(DynamicsStats &stats);
+		virtual void lockDynamics(void);
+		virtual void unlockDynamics(void);
+		virtual bool addRigidBody(btRigidBody *body);
+		virtual bool removeRigidBody(btRigidBody *body);
 
 		bool attach(void);
 		bool detach(void);
+		virtual void preload(LoadQueue *queue);
 		
+		/* Streaming */
+		virtual bool streaming(void) const;
+		virtual void stream(const std::vector<Ogre::Vector3> &focus);
+		virtual size_t residentCells(void) const;
+		virtual size_t residentObjects(void) const;
+
+		/* Batching */
+		virtual bool batching(void) const;
+		virtual void setBatching(bool batching);
 	protected:
 		Ogre::SceneManager *m_manager;
 		bool m_hasAmbientLight;
 		Ogre::ColourValue m_ambientColour;
-		btBroadphaseInterface *m_broadphase;
-		btCollisionConfiguration *m_collisionConfig;
-		btCollisionDispatcher *m_dispatcher;
+		PhysicsWorld *m_world;
 		btDynamicsWorld *m_dynamics;
-		btConstraintSolver *m_solver;
+		int m_physicsThreads;
+		PhysicsConfig m_physicsConfig;
+		Crowd *m_crowd;
+		QueryService *m_queries;
+		btScalar m_crowdNear;
+		int m_crowdIdle;
 		btVector3 m_gravity;
+		bool m_threaded;
+		PhysicsThread *m_physicsThread;
+		std::vector<Prop *> m_moving;
+		/* When the scene isn't threaded, the props whose bodies were
+		 * awake at the last tick, which interpolate() blends
+		 */
+		std::vector<Prop *> m_active;
+		unsigned long m_lastTicks;
+		float m_lastDropped;
+		Ogre::Real m_cellSize, m_streamRadius;
+		size_t m_streamBudget;
+		std::map<SceneCellKey, SceneCell> m_cells;
+		bool m_partitioned;
+		unsigned long m_streamFrame;
+		size_t m_residentCells, m_residentObjects;
+		bool m_batching;
+		Ogre::StaticGeometry *m_staticGeometry;
+		unsigned long m_batches;
 		
-		virtual bool load(void);
+		virtual bool parse(void);
+		virtual void prefetch(void);
 		virtual LoadableObject *factory(Ogre::String kind, AttrList &attrs);
 		
 		/* Physics */
 		virtual void createPhysics(void);
-		virtual bool addRigidBody(btRigidBody *body);
-		virtual bool removeRigidBody(btRigidBody *body);
+		virtual bool startPhysics(void);
+		virtual void stopPhysics(void);
 		
+		/* Streaming */
+		virtual void partition(void);
+		virtual bool attachCell(SceneCell &cell);
+		virtual void evictCell(SceneCell &cell);
+		virtual void removeObjects(const std::set<Loadable *> &objects);
+		virtual Ogre::Real cellDistance(const SceneCellKey &key, const Ogre::Vector3 &point) const;
+
+		/* Batching */
+		virtual Ogre::StaticGeometry *batch(const std::vector<LoadableSceneObject *> &objects, const Ogre::Vector3 &origin, const Ogre::Vector3 &regionSize);
+		virtual void unbatch(Ogre::StaticGeometry *geometry);
 	};
 	
+	/* A SceneDynamicsLock holds a scene's dynamics lock for as long as it
+	 * exists; if the scene isn't threaded, it does nothing.
+	 */
+	class SceneDynamicsLock
+	{
+	public:
+		SceneDynamicsLock(Scene *scene);
+		~SceneDynamicsLock();
+	protected:
+		Scene *m_scene;
+	};
+
 	/* LoadableScene encapsulates the <scene> root element */
 	class LoadableScene: public LoadableObject
 	{
@@ -134,6 +265,7 @@ namespace Jyuzau
 	protected:
 		Node *m_node;
 		Ogre::String m_id;
+		bool m_streamed;
 		Ogre::Vector3 m_scale, m_translate;
 		Ogre::Radian m_yaw, m_pitch, m_roll;
 		
@@ -185,6 +317,24 @@ namespace Jyuzau
 	public:
 		LoadableSceneGravity(Scene *owner, Ogre::String kind, AttrList &attrs);
 	};
+
+	/* LoadableScenePhysics encapsulates the elements within a <scene> which
+	 * configure its physics world.
+	 * <broadphase type="dbvt|sweep|sweep32" proxies="n" prediction="n"
+	 *   dynamic="n" fixed="n" minx="n" miny="n" minz="n" maxx="n" maxy="n"
+	 *   maxz="n" />
+	 * <deactivation linear="n" angular="n" />
+	 * <contacts breaking="n" />
+	 * <characters near="n" idle="n" />
+	 *
+	 * A sweep-and-prune broadphase without bounds is bounded by the origins
+	 * of the scene's objects, plus SCENE_WORLD_MARGIN.
+	 */
+	class LoadableScenePhysics: public LoadableSceneProperty
+	{
+	public:
+		LoadableScenePhysics(Scene *owner, Ogre::String kind, AttrList &attrs);
+	};
 	
 	
 	/* LoadableSceneProp encapsulates a <prop> within a scene
@@ -201,6 +351,8 @@ namespace Jyuzau
 		virtual bool complete(void) const;
 		virtual Ogre::String className(void) const;
 		virtual bool fixed(void) const;
+		
+		virtual void prefetch(LoadQueue *queue);
 	protected:
 		Ogre::String m_className;
 		bool m_fixed;
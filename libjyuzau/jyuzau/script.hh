@@ -0,0 +1,212 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_SCRIPT_HH_
+# define JYUZAU_SCRIPT_HH_             1
+
+# include "jyuzau/defs.hh"
+
+# include <chrono>
+# include <map>
+# include <vector>
+
+# include <OGRE/OgreString.h>
+
+struct lua_State;
+struct lua_Debug;
+
+namespace Jyuzau
+{
+	class Prop;
+	class Actor;
+	class Script;
+	class ScriptScheduler;
+
+	/* The ScriptAllocator is the lua_Alloc of a ScriptScheduler's Lua
+	 * state. Small allocations (the great majority of those made by Lua:
+	 * strings, tables, closures and so on) are served from per-size free
+	 * lists, which are refilled from blocks obtained from the heap; the
+	 * blocks are only returned when the allocator is destroyed. Anything
+	 * larger than SCRIPT_POOL_MAX is passed to the system allocator.
+	 */
+	class ScriptAllocator
+	{
+	public:
+		ScriptAllocator(size_t blockSize = SCRIPT_POOL_BLOCK_SIZE);
+		virtual ~ScriptAllocator();
+
+		static void *alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+
+		virtual void *allocate(size_t size);
+		virtual void release(void *ptr, size_t size);
+		virtual void *reallocate(void *ptr, size_t osize, size_t nsize);
+
+		/* Statistics */
+		virtual size_t allocations(void) const;
+		virtual size_t bytes(void) const;
+		virtual size_t peak(void) const;
+		virtual size_t reserved(void) const;
+	protected:
+		struct Block
+		{
+			Block *next;
+		};
+		struct Free
+		{
+			Free *next;
+		};
+
+		size_t m_blockSize;
+		Block *m_blocks;
+		unsigned char *m_cur;
+		size_t m_left;
+		Free *m_free[SCRIPT_POOL_MAX / SCRIPT_POOL_ALIGN];
+		size_t m_allocations, m_bytes, m_peak, m_reserved;
+
+		virtual void *refill(size_t size);
+	};
+
+	/* The cost of a script: the number of times it has been resumed, the
+	 * number of those which ended with it being preempted rather than
+	 * yielding, and the total, longest and most recent time it ran for (in
+	 * milliseconds)
+	 */
+	struct ScriptStats
+	{
+		unsigned long resumes;
+		unsigned long preempted;
+		float time;
+		float worst;
+		float last;
+	};
+
+	/* The cost of the scripts in the most recent frame */
+	struct ScriptFrameStats
+	{
+		size_t scripts;
+		size_t resumed;
+		size_t preempted;
+		float time;
+	};
+
+	/* The userdata through which a script refers to its prop; the pointers
+	 * are resolved once, when the script is started, and are cleared when
+	 * it's stopped, so that a handle which outlives its script is harmless
+	 */
+	struct ScriptHandle
+	{
+		unsigned int magic;
+		ScriptScheduler *scheduler;
+		Script *script;
+		Prop *prop;
+		Actor *actor;
+	};
+
+	/* A Script is a single instance of a behaviour script, running as a
+	 * coroutine on behalf of a prop or actor.
+	 */
+	class Script
+	{
+		friend class ScriptScheduler;
+	public:
+		Script(Prop *prop, const Ogre::String &path);
+		virtual ~Script();
+
+		virtual Prop *prop(void) const;
+		virtual const Ogre::String &path(void) const;
+		virtual bool finished(void) const;
+		virtual const ScriptStats &stats(void) const;
+		virtual lua_State *thread(void) const;
+		virtual void sleep(double until);
+	protected:
+		Prop *m_prop;
+		Ogre::String m_path;
+		lua_State *m_thread;
+		int m_ref, m_handleRef;
+		ScriptHandle *m_handle;
+		double m_wake;
+		bool m_started, m_finished;
+		ScriptStats m_stats;
+	};
+
+	/* The ScriptScheduler runs the behaviour scripts of the props and actors
+	 * of a State.
+	 *
+	 * A prop or actor class names its script with the script attribute of
+	 * its <prop> or <actor> element. The script is compiled once, when the
+	 * first prop of the class is attached, and each prop then runs it as a
+	 * coroutine of its own, with the prop's handle as its argument:
+	 *
+	 *   local self = ...
+	 *   while true do
+	 *     self:yaw(0.01)
+	 *     coroutine.yield()
+	 *   end
+	 *
+	 * Each frame, update() resumes the scripts in turn, starting from where
+	 * the previous frame left off, until every script has been resumed once
+	 * or the frame's budget has been spent; the rest wait for the next
+	 * frame. A script which runs past the end of the budget without
+	 * yielding is suspended by an instruction-count hook, and continues
+	 * where it left off when its turn next comes. (A script which is running
+	 * within a callback from C, such as a table.sort() comparator, can't be
+	 * suspended, and is stopped instead.)
+	 *
+	 * A script may also call self:wait(seconds), in which case it isn't
+	 * resumed again until that much time has passed.
+	 *
+	 * Lua isn't thread-safe, so scripts are only started, run and stopped
+	 * on the main thread.
+	 */
+	class ScriptScheduler
+	{
+	public:
+		ScriptScheduler(float budget = SCRIPT_FRAME_BUDGET);
+		virtual ~ScriptScheduler();
+
+		virtual lua_State *lua(void) const;
+		virtual size_t size(void) const;
+		virtual float budget(void) const;
+		virtual void setBudget(float budget);
+		virtual double clock(void) const;
+
+		virtual Script *start(Prop *prop, const Ogre::String &path);
+		virtual void stop(Script *script);
+
+		virtual void update(float elapsed);
+
+		/* Statistics */
+		virtual const ScriptFrameStats &frameStats(void) const;
+		virtual const ScriptAllocator &allocator(void) const;
+	protected:
+		ScriptAllocator m_allocator;
+		lua_State *m_lua;
+		std::vector<Script *> m_scripts;
+		size_t m_cursor;
+		std::map<Ogre::String, int> m_chunks;
+		int m_nodeMeta, m_actorMeta;
+		float m_budget;
+		double m_clock;
+		ScriptFrameStats m_frameStats;
+
+		virtual void bind(void);
+		virtual int chunk(const Ogre::String &path);
+		virtual bool resume(Script *script, std::chrono::steady_clock::time_point deadline);
+
+		static void hook(lua_State *L, lua_Debug *ar);
+	};
+};
+
+#endif /*!JYUZAU_SCRIPT_HH_*/
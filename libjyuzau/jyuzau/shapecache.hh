@@ -0,0 +1,134 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_SHAPECACHE_HH_
+# define JYUZAU_SHAPECACHE_HH_         1
+
+# include <map>
+
+# include <stdint.h>
+
+# include <OGRE/OgreString.h>
+# include <OGRE/OgreMesh.h>
+# include <OGRE/OgreSceneManager.h>
+
+# include <btBulletDynamicsCommon.h>
+
+/* Cooked collision shapes are stored alongside the mesh they were built
+ * from, with the suffix for their type appended to its name.
+ */
+# define COOKED_MAGIC                  "JYZS"
+# define COOKED_VERSION                1
+# define COOKED_BYTEORDER              0x01020304
+# define COOKED_HULL_SUFFIX            ".hull.jyzs"
+# define COOKED_BVH_SUFFIX             ".bvh.jyzs"
+
+namespace Jyuzau
+{
+	enum ShapeType {
+		/* A simplified convex hull, for dynamic props */
+		ST_HULL,
+		/* A BVH of the mesh's triangles, for fixed props */
+		ST_BVH
+	};
+
+	/* A cooked shape file consists of a header, followed by the vertices
+	 * (as btScalar triples), the triangle indices, and for a BVH, the
+	 * btOptimizedBvh in the form written by serializeInPlace(), which is
+	 * aligned to a sixteen-byte boundary. A hull has no indices; its
+	 * vertices are the points of the simplified hull.
+	 *
+	 * The file is only valid for a build of Bullet of the same version,
+	 * precision and byte order as the one which produced it.
+	 */
+	struct CookedShapeHeader
+	{
+		char magic[4];
+		uint32_t byteorder;
+		uint32_t version;
+		uint32_t bullet;
+		uint32_t scalar;
+		uint32_t type;
+		uint32_t nvertices;
+		uint32_t nindices;
+		uint32_t bvh;
+		uint32_t bvhlen;
+	};
+
+	/* The ShapeCache hands out collision shapes for props, sharing a single
+	 * btCollisionShape between every prop of the same class and scale.
+	 *
+	 * Shapes for meshes are built from an unscaled "cooked" form: the
+	 * points of a hull simplified by btShapeHull, or the triangles of the
+	 * mesh along with their BVH. Cooking is slow, and so the cooked form is
+	 * written to disk, and re-used by subsequent loads for as long as it's
+	 * newer than the mesh. A BVH is shared between scales by wrapping it in
+	 * a btScaledBvhTriangleMeshShape.
+	 *
+	 * Shapes are reference-counted, and must be returned with release()
+	 * once the rigid body using them has been destroyed.
+	 */
+	class ShapeCache
+	{
+	public:
+		ShapeCache();
+		virtual ~ShapeCache();
+
+		virtual btCollisionShape *prefab(const Ogre::String &group, Ogre::SceneManager::PrefabType type, const btVector3 &scale);
+		virtual btCollisionShape *mesh(const Ogre::String &group, const Ogre::MeshPtr &mesh, const Ogre::String &source, ShapeType type, const btVector3 &scale);
+		virtual void release(btCollisionShape *shape);
+
+		virtual size_t shapes(void) const;
+		virtual size_t cooked(void) const;
+	protected:
+		struct CookedShape
+		{
+			Ogre::String key;
+			ShapeType type;
+			btAlignedObjectArray<btScalar> vertices;
+			btAlignedObjectArray<int> indices;
+			void *bvhData;
+			btTriangleIndexVertexArray *meshInterface;
+			btBvhTriangleMeshShape *bvhShape;
+			int refs;
+		};
+
+		struct CachedShape
+		{
+			btCollisionShape *shape;
+			CookedShape *cooked;
+			int refs;
+		};
+
+		std::map<Ogre::String, CachedShape> m_shapes;
+		std::map<btCollisionShape *, Ogre::String> m_keys;
+		std::map<Ogre::String, CookedShape *> m_cooked;
+
+		virtual Ogre::String key(const Ogre::String &group, const Ogre::String &tag, const btVector3 &scale) const;
+		virtual btCollisionShape *retain(const Ogre::String &key);
+		virtual btCollisionShape *add(const Ogre::String &key, btCollisionShape *shape, CookedShape *cooked);
+
+		virtual CookedShape *cook(const Ogre::String &group, const Ogre::MeshPtr &mesh, const Ogre::String &source, ShapeType type);
+		virtual bool extract(const Ogre::MeshPtr &mesh, CookedShape *shape);
+		virtual bool buildHull(CookedShape *shape);
+		virtual bool buildBvh(CookedShape *shape);
+		virtual bool packed(const Ogre::String &path) const;
+		virtual bool readCooked(const Ogre::String &path, CookedShape *shape);
+		virtual bool writeCooked(const Ogre::String &path, const CookedShape *shape);
+		virtual void freeCooked(CookedShape *shape);
+	};
+};
+
+#endif /*!JYUZAU_SHAPECACHE_HH_*/
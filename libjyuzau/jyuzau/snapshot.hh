@@ -0,0 +1,145 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_SNAPSHOT_HH_
+# define JYUZAU_SNAPSHOT_HH_           1
+
+# include "jyuzau/defs.hh"
+
+# include <cstddef>
+# include <vector>
+
+# include <stdint.h>
+
+# include <OGRE/OgreString.h>
+
+/* A snapshot is a header, followed by a record for each node, the names of
+ * the nodes, and then the state of the rigid bodies, exactly as written by
+ * Bullet's btDefaultSerializer (less its DNA, which is only needed by
+ * readers built differently, and which a snapshot's reader is not).
+ *
+ * All fields are in the byte order of the machine which took the
+ * snapshot, and the Bullet data is also in its precision and pointer
+ * size; a reader for which any of these differ will reject it.
+ */
+# define SNAPSHOT_MAGIC                "JYZS"
+# define SNAPSHOT_VERSION              1
+# define SNAPSHOT_BYTEORDER            0x01020304
+# define SNAPSHOT_ALIGN                16
+
+/* SnapshotNode flags */
+# define SNAPSHOT_SIMULATED            0x0001
+# define SNAPSHOT_ACTOR                0x0002
+# define SNAPSHOT_CHARACTER            0x0004
+
+/* SnapshotNode movement flags */
+# define SNAPSHOT_FORWARD              0x0001
+# define SNAPSHOT_BACKWARD             0x0002
+# define SNAPSHOT_LEFT                 0x0004
+# define SNAPSHOT_RIGHT                0x0008
+# define SNAPSHOT_CLOCKWISE            0x0010
+# define SNAPSHOT_CCLOCKWISE           0x0020
+# define SNAPSHOT_LOOK_UP              0x0040
+# define SNAPSHOT_LOOK_DOWN            0x0080
+
+namespace Jyuzau
+{
+	class Scene;
+
+	struct SnapshotHeader
+	{
+		char magic[4];
+		uint32_t byteorder;
+		uint32_t version;
+		uint32_t nnodes;
+		uint32_t nodes;
+		uint32_t names;
+		uint32_t nameslen;
+		uint32_t nbodies;
+		uint32_t bodies;
+		uint32_t bodieslen;
+	};
+
+	/* The state of a single Node; name is the offset of the name of its
+	 * scene node, and body is the index of its rigid body within the
+	 * Bullet data, or -1 if it has none (or its body isn't dynamic). The
+	 * actor and character fields are only meaningful if the corresponding
+	 * flags are set.
+	 */
+	struct SnapshotNode
+	{
+		uint32_t name;
+		int32_t body;
+		uint32_t flags;
+		uint32_t movement;
+		float position[3];
+		float orientation[4];
+		float scale[3];
+		/* Actors */
+		int32_t speed;
+		float velocity[3];
+		float rotVelocity;
+		float camPitchVelocity;
+		uint32_t level;
+		double health;
+		/* Characters */
+		uint32_t characterLevel;
+		uint32_t currency[CHAR_CURRENCY_MAX + 1];
+		uint32_t ammo[CHAR_WEAPON_MAX + 1];
+	};
+
+	/* A Snapshot holds the state of an attached scene: the transform of
+	 * every node, the state of every dynamic rigid body, and the movement of
+	 * every actor, along with the properties of any Character attached to
+	 * one. Restoring a snapshot puts everything back as it was, without
+	 * reloading or recreating anything, so that a level can be restarted
+	 * (or a checkpoint returned to) in a fraction of the time it takes to
+	 * attach the scene again.
+	 *
+	 * Nodes are matched up by the names of their scene nodes, and so a
+	 * snapshot can only be restored to the scene from which it was taken
+	 * (or another instance of the same class, if its objects all have ids).
+	 * Nodes which aren't attached when it's restored, such as those in
+	 * cells of a streamed scene which have since been evicted, are left
+	 * alone.
+	 */
+	class Snapshot
+	{
+	public:
+		Snapshot();
+		virtual ~Snapshot();
+
+		virtual bool capture(Scene *scene);
+		virtual bool restore(Scene *scene) const;
+
+		virtual const void *data(void) const;
+		virtual size_t size(void) const;
+		virtual size_t nodes(void) const;
+		virtual size_t bodies(void) const;
+		virtual bool assign(const void *data, size_t size);
+		virtual void clear(void);
+
+		virtual bool save(const Ogre::String &path) const;
+		virtual bool load(const Ogre::String &path);
+	protected:
+		std::vector<unsigned char> m_data;
+		/* The offset of each rigid body's data, found by validate() */
+		std::vector<size_t> m_bodies;
+
+		virtual bool validate(void);
+	};
+};
+
+#endif /*!JYUZAU_SNAPSHOT_HH_*/
@@ -18,8 +18,11 @@
 
 # include "jyuzau/defs.hh"
 
+# include <map>
+
 # include <OGRE/OgreFrameListener.h>
 # include <OGRE/OgreSceneManager.h>
+# include <OGRE/OgreTimer.h>
 
 # include <OIS/OISEvents.h>
 # include <OIS/OISKeyboard.h>
@@ -36,6 +39,8 @@ namespace Jyuzau
 	class Camera;
 	class Controller;
 	class Scene;
+	class Locomotion;
+	class ScriptScheduler;
 
 	/* The State class encapsulates the game logic at any given point,
 	 * including cut-scenes, menus, and so on.
@@ -51,6 +56,14 @@ namespace Jyuzau
 		virtual ~State();
 		
 		virtual void preload(void);
+		
+		/* Background preloading */
+		virtual void preloadInBackground(void);
+		virtual bool preloading(void) const;
+		virtual bool preloaded(void) const;
+		virtual float preloadProgress(void) const;
+		virtual void assetQueued(Loadable *loadable);
+		virtual void assetLoaded(Loadable *loadable, bool status);
 
 		/* Properties */
 		virtual Ogre::SceneManager *sceneManager(void) const;
@@ -59,9 +72,27 @@ namespace Jyuzau
 		virtual int cameras(void) const;
 		virtual Camera *camera(int index = 0);
 		
+		/* Physics timing */
+		virtual int tickRate(void) const;
+		virtual void setTickRate(int rate);
+		virtual int maxSubsteps(void) const;
+		virtual void setMaxSubsteps(int steps);
+		virtual const DynamicsStats &dynamicsStats(void) const;
+		
 		/* Object management */
 		virtual void addToPool(const Loadable *object);
+		virtual const Loadable *pooled(Ogre::String kind, Ogre::String name) const;
+		virtual void purgePool(void);
 		virtual Loadable *factory(Ogre::String m_kind, Ogre::String m_name);
+		virtual Loadable *create(Ogre::String kind, Ogre::String name);
+		
+		/* Actor management */
+		virtual void addActor(Actor *actor);
+		virtual Locomotion *locomotion(void) const;
+		virtual void setBatchedLocomotion(bool enabled);
+		
+		/* Behaviour scripts */
+		virtual ScriptScheduler *scripts(void);
 		
 		virtual void sceneAttached(Scene *scene);
 		virtual void sceneDetached(Scene *scene);
@@ -69,14 +100,23 @@ namespace Jyuzau
 		Core *m_core;
 		State *m_prev, *m_next;
 		bool m_loaded;
+		bool m_preloading;
+		size_t m_preloadQueued, m_preloadCompleted;
 		Ogre::SceneManager *m_sceneManager;
 		Scene *m_currentScene;
 		std::vector<Camera *> m_cameras;
 		std::vector<Actor *> m_actors;
+		Locomotion *m_locomotion;
+		ScriptScheduler *m_scripts;
 		CameraType m_defaultPlayerCameraType;
 		Controller *m_controller;
 		btDynamicsWorld *m_dynamics;
+		int m_tickRate, m_maxSubsteps;
+		btScalar m_accumulator;
+		DynamicsStats m_dynamicsStats;
+		Ogre::Timer m_dynamicsTimer;
 		bool m_overlay;
+		std::map<Ogre::String, Loadable *> m_pool;
 		
 		virtual void load(void);
 		virtual void createScenes(void);
@@ -104,6 +144,8 @@ namespace Jyuzau
 		virtual bool mouseReleased(const OIS::MouseEvent &arg, OIS::MouseButtonID id);
 		
 		virtual void updatePhysics(btScalar timeSinceListFrame);
+		virtual void updateStreaming(void);
+		virtual void focus(std::vector<Ogre::Vector3> &points) const;
 	};
 
 };
@@ -0,0 +1,170 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef JYUZAU_TRACE_HH_
+# define JYUZAU_TRACE_HH_              1
+
+# include "jyuzau/defs.hh"
+
+# include <atomic>
+# include <chrono>
+# include <mutex>
+# include <thread>
+# include <vector>
+
+# include <stdint.h>
+
+# include <OGRE/OgreSceneManager.h>
+# include <OGRE/OgreRenderTargetListener.h>
+
+namespace Jyuzau
+{
+	/* A single timed span; times are in nanoseconds since the Tracer was
+	 * created, and the name must be a string which outlives the Tracer
+	 * (in practice, a literal)
+	 */
+	struct TraceSpan
+	{
+		const char *name;
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	/* Percentiles of the durations of recent spans of a kind, in
+	 * milliseconds
+	 */
+	struct TraceStats
+	{
+		size_t count;
+		float p50;
+		float p95;
+		float p99;
+		float max;
+	};
+
+	/* A TraceBuffer is a ring of the most recent spans completed by a single
+	 * thread. Only that thread ever writes to it, and it never waits: once
+	 * a span has been written, the head is advanced atomically. Readers on
+	 * other threads copy what they need and then check the head again,
+	 * discarding anything which may have been overwritten in the meantime.
+	 */
+	class TraceBuffer
+	{
+	public:
+		TraceBuffer(unsigned int thread, size_t capacity);
+		virtual ~TraceBuffer();
+
+		virtual unsigned int thread(void) const;
+		virtual const char *name(void) const;
+		virtual void setName(const char *name);
+
+		/* Invoked only by the owning thread */
+		virtual bool begin(const char *name, uint64_t now);
+		virtual const char *end(uint64_t now);
+		virtual void push(const char *name, uint64_t begin, uint64_t end);
+
+		/* Invoked from any thread */
+		virtual void snapshot(std::vector<TraceSpan> &spans) const;
+		virtual void recent(const char *name, size_t count, std::vector<float> &durations) const;
+	protected:
+		unsigned int m_thread;
+		const char *m_name;
+		TraceSpan *m_spans;
+		size_t m_capacity;
+		std::atomic<uint64_t> m_head;
+		const char *m_open[TRACE_MAX_DEPTH];
+		uint64_t m_openBegin[TRACE_MAX_DEPTH];
+		int m_depth, m_skipped;
+	};
+
+	/* The Tracer times the phases of each frame, along with anything else
+	 * which is instrumented, on whichever thread they run. Tracing is
+	 * disabled until setEnabled() is called, and costs no more than a
+	 * check of a flag until then.
+	 *
+	 * The spans can be written out at any time as a trace in the JSON
+	 * format understood by Chrome's about:tracing (and by Perfetto), or
+	 * summarised as percentiles.
+	 *
+	 * Where OGRE has been built with its profiler enabled, spans begun and
+	 * ended on the thread which created the Tracer are passed on to
+	 * Ogre::Profiler too, so that they also appear in its overlay.
+	 */
+	class Tracer
+	{
+	public:
+		Tracer();
+		virtual ~Tracer();
+
+		virtual bool enabled(void) const;
+		virtual void setEnabled(bool enabled = true);
+		virtual uint64_t now(void) const;
+
+		/* Spans on the calling thread; end() closes the most recently begun
+		 * span, and must only be called if begin() returned true
+		 */
+		virtual bool begin(const char *name);
+		virtual void end(void);
+		virtual void span(const char *name, uint64_t begin, uint64_t end);
+		virtual void nameThread(const char *name);
+
+		virtual bool stats(const char *name, TraceStats &stats, size_t window = TRACE_STATS_WINDOW);
+		virtual bool write(const Ogre::String &path);
+	protected:
+		std::atomic<bool> m_enabled;
+		std::chrono::steady_clock::time_point m_epoch;
+		std::thread::id m_mainThread;
+		std::mutex m_mutex;
+		std::vector<TraceBuffer *> m_buffers;
+		unsigned long m_serial;
+
+		virtual TraceBuffer *buffer(void);
+	};
+
+	/* Times the enclosing scope, if tracing is enabled when it's entered */
+	class TraceScope
+	{
+	public:
+		TraceScope(Tracer *tracer, const char *name);
+		~TraceScope();
+	protected:
+		Tracer *m_tracer;
+	};
+
+	/* RenderTrace listens to the render window and the active state's scene
+	 * manager in order to time the phases of rendering which take place
+	 * within OGRE: updating the scene graph, finding the visible objects
+	 * (culling), and submitting them to the render system, all within a
+	 * span for each viewport.
+	 */
+	class RenderTrace: public Ogre::SceneManager::Listener, public Ogre::RenderTargetListener
+	{
+	public:
+		RenderTrace(Tracer *tracer);
+		virtual ~RenderTrace();
+
+		virtual void preViewportUpdate(const Ogre::RenderTargetViewportEvent &evt);
+		virtual void postViewportUpdate(const Ogre::RenderTargetViewportEvent &evt);
+		virtual void preUpdateSceneGraph(Ogre::SceneManager *source, Ogre::Camera *camera);
+		virtual void postUpdateSceneGraph(Ogre::SceneManager *source, Ogre::Camera *camera);
+		virtual void preFindVisibleObjects(Ogre::SceneManager *source, Ogre::SceneManager::IlluminationRenderStage irs, Ogre::Viewport *v);
+		virtual void postFindVisibleObjects(Ogre::SceneManager *source, Ogre::SceneManager::IlluminationRenderStage irs, Ogre::Viewport *v);
+	protected:
+		Tracer *m_tracer;
+		bool m_viewport, m_sceneGraph, m_culling, m_submission;
+	};
+};
+
+#endif /*!JYUZAU_TRACE_HH_*/
@@ -32,39 +32,202 @@
 
 using namespace Jyuzau;
 
+/* The controller of a single kinematic character, which is stepped by a
+ * Crowd rather than being an action of the world in its own right
+ */
 class KinematicsController: public btKinematicCharacterController
 {
+	friend class Jyuzau::Crowd;
 public:
 	KinematicsController(btPairCachingGhostObject *ghostObject, btConvexShape *convexShape, btScalar stepHeight, int upAxis = 1);
+
+	virtual size_t index(void) const;
+	virtual const btVector3 &walk(void) const;
+	virtual bool idle(void) const;
+	virtual void coarseStep(btCollisionWorld *world, btScalar dt);
+protected:
+	size_t m_index;
+	int m_idleTicks;
+
+	virtual bool sweep(btCollisionWorld *world, const btVector3 &from, const btVector3 &to, const btVector3 &up, btVector3 &result);
 };
 
+/* Finds the closest thing a character's capsule would hit, ignoring the
+ * character itself and anything which has no contact response; when
+ * sweeping vertically, anything too steep to stand on (or under) is
+ * ignored as well, so that a character beside a wall isn't held by it
+ */
+class KinematicsSweepCallback: public btCollisionWorld::ClosestConvexResultCallback
+{
+public:
+	KinematicsSweepCallback(const btCollisionObject *self, const btVector3 &up, btScalar minSlopeDot):
+		btCollisionWorld::ClosestConvexResultCallback(btVector3(0, 0, 0), btVector3(0, 0, 0)),
+		m_self(self),
+		m_up(up),
+		m_minSlopeDot(minSlopeDot)
+	{
+	}
+
+	virtual btScalar
+	addSingleResult(btCollisionWorld::LocalConvexResult &convexResult, bool normalInWorldSpace)
+	{
+		btVector3 normal;
+
+		if(convexResult.m_hitCollisionObject == m_self || !convexResult.m_hitCollisionObject->hasContactResponse())
+		{
+			return 1;
+		}
+		if(!m_up.isZero())
+		{
+			normal = convexResult.m_hitNormalLocal;
+			if(!normalInWorldSpace)
+			{
+				normal = convexResult.m_hitCollisionObject->getWorldTransform().getBasis() * normal;
+			}
+			if(btFabs(normal.dot(m_up)) < m_minSlopeDot)
+			{
+				return 1;
+			}
+		}
+		return btCollisionWorld::ClosestConvexResultCallback::addSingleResult(convexResult, normalInWorldSpace);
+	}
+protected:
+	const btCollisionObject *m_self;
+	btVector3 m_up;
+	btScalar m_minSlopeDot;
+};
+
+/* KinematicsController */
+
 KinematicsController::KinematicsController(btPairCachingGhostObject *ghostObject, btConvexShape *convexShape, btScalar stepHeight, int upAxis):
-	btKinematicCharacterController::btKinematicCharacterController(ghostObject, convexShape, stepHeight, upAxis)
+	btKinematicCharacterController::btKinematicCharacterController(ghostObject, convexShape, stepHeight, upAxis),
+	m_index(0),
+	m_idleTicks(CROWD_IDLE_INTERVAL)
 {
 }
-	
+
+size_t
+KinematicsController::index(void) const
+{
+	return m_index;
+}
+
+const btVector3 &
+KinematicsController::walk(void) const
+{
+	return m_walkDirection;
+}
+
+/* A character is idle if it has nowhere to go and is standing still on
+ * the ground, without anything having pushed into it
+ */
+bool
+KinematicsController::idle(void) const
+{
+	return m_walkDirection.fuzzyZero() && onGround() && !m_wasJumping && !m_touchingContact;
+}
+
+/* Move the character by just two sweeps of its capsule, from a step above
+ * its position: along its walk direction, and then up or down by however
+ * far it has jumped or fallen in this tick
+ */
+void
+KinematicsController::coarseStep(btCollisionWorld *world, btScalar dt)
+{
+	btTransform xform;
+	btVector3 up, from, to;
+	btScalar offset;
+
+	m_touchingContact = false;
+	m_wasOnGround = onGround();
+	m_verticalVelocity -= m_gravity * dt;
+	if(m_verticalVelocity > m_jumpSpeed)
+	{
+		m_verticalVelocity = m_jumpSpeed;
+	}
+	if(m_verticalVelocity < -btFabs(m_fallSpeed))
+	{
+		m_verticalVelocity = -btFabs(m_fallSpeed);
+	}
+	m_verticalOffset = m_verticalVelocity * dt;
+	up = getUpAxisDirections()[m_upAxis];
+	xform = m_ghostObject->getWorldTransform();
+	from = xform.getOrigin() + up * m_stepHeight;
+	if(sweep(world, from, from + m_walkDirection, btVector3(0, 0, 0), to))
+	{
+		m_touchingContact = true;
+	}
+	from = to;
+	offset = m_verticalOffset - m_stepHeight;
+	if(sweep(world, from, from + up * offset, up, to))
+	{
+		/* Landed, or hit the ceiling */
+		m_verticalVelocity = 0;
+		m_verticalOffset = 0;
+		if(offset < 0)
+		{
+			m_wasJumping = false;
+		}
+	}
+	xform.setOrigin(to);
+	m_ghostObject->setWorldTransform(xform);
+}
+
+/* Sweep the capsule through the world, returning true if it hit anything;
+ * result is the position at which it stopped. The ghost's cached pairs
+ * aren't enough here, as a coarse step may cover more than its bounds.
+ * If up is non-zero, the sweep is vertical.
+ */
+bool
+KinematicsController::sweep(btCollisionWorld *world, const btVector3 &from, const btVector3 &to, const btVector3 &up, btVector3 &result)
+{
+	KinematicsSweepCallback callback(m_ghostObject, up, m_maxSlopeCosine);
+	btTransform start, end;
+
+	result = to;
+	if((to - from).fuzzyZero())
+	{
+		return false;
+	}
+	start.setIdentity();
+	start.setOrigin(from);
+	end.setIdentity();
+	end.setOrigin(to);
+	callback.m_collisionFilterGroup = m_ghostObject->getBroadphaseHandle()->m_collisionFilterGroup;
+	callback.m_collisionFilterMask = m_ghostObject->getBroadphaseHandle()->m_collisionFilterMask;
+	world->convexSweepTest(m_convexShape, start, end, callback, world->getDispatchInfo().m_allowedCcdPenetration);
+	if(!callback.hasHit())
+	{
+		return false;
+	}
+	result.setInterpolate3(from, to, callback.m_closestHitFraction);
+	return true;
+}
+
+/* Kinematics */
+
 Kinematics::Kinematics(Actor *actor):
 	m_actor(actor)
 {
 	Ogre::Vector3 vec;
-	btDynamicsWorld *dynamics;
 	btScalar characterHeight, characterWidth, stepHeight;
 	btTransform startTransform;
 	KinematicsController *c;
 	
 	m_rigidBody = actor->rigidBody();
 	m_scene = actor->scene();
+	SceneDynamicsLock lock(m_scene);
 	m_dynamics = m_scene->dynamics();
-	m_pairCache = m_scene->broadphase();
+	m_crowd = m_scene->crowd();
 
 	vec = actor->entity()->getBoundingBox().getSize();
 	characterWidth = (vec.x / 2);
 	characterHeight = (vec.y / 2);
 	stepHeight = characterHeight / 50;
 	
-	m_pairCache->getOverlappingPairCache()->setInternalGhostPairCallback(new btGhostPairCallback());
-
 	m_ghost = new btPairCachingGhostObject();
+	/* Queries which find the ghost report the actor */
+	m_ghost->setUserPointer(static_cast<Prop *>(actor));
 
 	startTransform.setIdentity();
 
@@ -78,8 +241,9 @@ Kinematics::Kinematics(Actor *actor):
 	c->setMaxJumpHeight(characterHeight / 4);
 	c->setJumpSpeed(25 * 100);
 
-	m_actionController = c;
+	m_controller = c;
 	/* Remove the Actor body from the scene */
+	m_actor->updateNodeTransform();
 	m_actor->getWorldTransform(startTransform);
 	m_dynamics->removeRigidBody(m_rigidBody);
 	m_rigidBody->setCollisionFlags(m_rigidBody->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
@@ -90,29 +254,33 @@ Kinematics::Kinematics(Actor *actor):
 	/* Add the ghost in its place */
 	m_ghost->setWorldTransform(startTransform);
 	m_dynamics->addCollisionObject(m_ghost, btBroadphaseProxy::CharacterFilter, btBroadphaseProxy::AllFilter & ~(btBroadphaseProxy::DebrisFilter | btBroadphaseProxy::CharacterFilter));
-	/* Add the character controller */
-	m_dynamics->addAction(m_actionController);
+	/* Hand the character controller to the crowd */
+	m_crowd->add(m_controller);
 }
 
 Kinematics::~Kinematics()
 {
-	m_dynamics->removeAction(m_actionController);
+	SceneDynamicsLock lock(m_scene);
+
+	m_crowd->remove(m_controller);
 	m_dynamics->removeCollisionObject(m_ghost);
 	m_dynamics->removeRigidBody(m_rigidBody);
 	m_rigidBody->forceActivationState(ACTIVE_TAG);
+	/* The body is placed where the actor's node was last put */
+	m_actor->updateNodeTransform();
 	m_rigidBody->setMotionState(m_actor);
 	m_rigidBody->setCollisionFlags(m_rigidBody->getCollisionFlags() & ~btCollisionObject::CF_KINEMATIC_OBJECT);
 	m_rigidBody->setMassProps(m_actor->mass(), btVector3(0, 0, 0));
 	m_dynamics->addRigidBody(m_rigidBody);
 	
 	m_rigidBody = NULL;
-	delete m_actionController;
-	m_actionController = NULL;
+	delete m_controller;
+	m_controller = NULL;
 	delete m_shape;
 	m_shape = NULL;
 	delete m_ghost;
 	m_ghost = NULL;
-	m_pairCache = NULL;
+	m_crowd = NULL;
 	m_dynamics = NULL;
 	m_scene = NULL;
 	m_actor = NULL;
@@ -124,26 +292,40 @@ Kinematics::~Kinematics()
 bool
 Kinematics::frameRenderingQueued(const Ogre::FrameEvent& evt)
 {
-	btVector3 btVec;
-	btTransform transform;
-
-	/* Keep the actor's position in sync with the ghost */
-	transform = m_ghost->getWorldTransform();
-	btVec = transform.getOrigin();
-	m_actor->setPosition(bulletVecToOgre(btVec));
+	synchronise();
 	return true;
 }
 
-/* Invoked by Actor::frameRenderingQueued() when the movement velocity is
- * non-zero.
+/* Keep the actor's position in sync with the ghost, as of the most recent
+ * Crowd::collect()
+ */
+void
+Kinematics::synchronise(void)
+{
+	m_actor->setPosition(bulletVecToOgre(m_crowd->position(m_controller->index())));
+}
+
+/* Move the character to a new position, stopping it and discarding its
+ * contacts, as if it had been there all along; invoked with the dynamics
+ * lock held (by Actor::restore())
+ */
+void
+Kinematics::warp(const btTransform &worldTrans)
+{
+	m_controller->reset(m_dynamics);
+	m_ghost->setWorldTransform(worldTrans);
+	m_rigidBody->setWorldTransform(worldTrans);
+	m_dynamics->updateSingleAabb(m_ghost);
+	m_crowd->reset(m_controller->index());
+}
+
+/* Invoked each frame by Actor::frameRenderingQueued() or by Locomotion; the
+ * direction is passed on to the controller by the next Crowd::submit()
  */
 bool
 Kinematics::walkDirection(const Ogre::Vector3 &vec)
 {
-	btVector3 btVec;
-	
-	btVec = ogreVecToBullet(vec);
-	m_actionController->setWalkDirection(btVec);
+	m_crowd->setWalkDirection(m_controller->index(), ogreVecToBullet(vec));
 	return true;
 }
 
@@ -151,7 +333,9 @@ Kinematics::walkDirection(const Ogre::Vector3 &vec)
 bool
 Kinematics::jump(void)
 {
-	m_actionController->jump();
+	SceneDynamicsLock lock(m_scene);
+
+	m_controller->jump();
 	return true;
 }
 
@@ -169,3 +353,197 @@ Kinematics::setWorldTransform(const btTransform &worldTrans)
 	m_actor->setWorldTransform(worldTrans);
 }
 
+/* Crowd */
+
+Crowd::Crowd(btDynamicsWorld *dynamics, btScalar nearDistance, int idleInterval):
+	m_dynamics(dynamics),
+	m_near(nearDistance),
+	m_idleInterval(idleInterval),
+	m_idle(0)
+{
+	m_dynamics->addAction(this);
+}
+
+/* Any remaining controllers belong to their Kinematics */
+Crowd::~Crowd()
+{
+	m_dynamics->removeAction(this);
+}
+
+size_t
+Crowd::size(void) const
+{
+	return m_controllers.size();
+}
+
+btScalar
+Crowd::nearDistance(void) const
+{
+	return m_near;
+}
+
+int
+Crowd::idleInterval(void) const
+{
+	return m_idleInterval;
+}
+
+size_t
+Crowd::add(KinematicsController *controller)
+{
+	controller->m_index = m_controllers.size();
+	m_controllers.push_back(controller);
+	m_walk.push_back(btVector3(0, 0, 0));
+	m_positions.push_back(controller->getGhostObject()->getWorldTransform().getOrigin());
+	return controller->m_index;
+}
+
+/* Remove a controller, moving the last into its place */
+void
+Crowd::remove(KinematicsController *controller)
+{
+	size_t i, last;
+
+	i = controller->m_index;
+	if(i >= m_controllers.size() || m_controllers[i] != controller)
+	{
+		return;
+	}
+	last = m_controllers.size() - 1;
+	if(i != last)
+	{
+		m_controllers[i] = m_controllers[last];
+		m_walk[i] = m_walk[last];
+		m_positions[i] = m_positions[last];
+		m_controllers[i]->m_index = i;
+	}
+	m_controllers.pop_back();
+	m_walk.pop_back();
+	m_positions.pop_back();
+}
+
+/* Pass the staged walk directions and focus points to the controllers */
+void
+Crowd::submit(void)
+{
+	size_t i;
+	std::vector<Ogre::Vector3>::const_iterator it;
+
+	for(i = 0; i < m_controllers.size(); i++)
+	{
+		if(m_walk[i] != m_controllers[i]->walk())
+		{
+			m_controllers[i]->setWalkDirection(m_walk[i]);
+		}
+	}
+	m_focus.clear();
+	for(it = m_pendingFocus.begin(); it != m_pendingFocus.end(); it++)
+	{
+		m_focus.push_back(ogreVecToBullet(*it));
+	}
+}
+
+/* Stage the positions of the characters, and record the cost of the most
+ * recent tick
+ */
+void
+Crowd::collect(DynamicsStats &stats)
+{
+	size_t i;
+
+	for(i = 0; i < m_controllers.size(); i++)
+	{
+		m_positions[i] = m_controllers[i]->getGhostObject()->getWorldTransform().getOrigin();
+	}
+	stats.characters = m_controllers.size();
+	stats.fullCharacters = m_full.size();
+	stats.coarseCharacters = m_coarse.size();
+	stats.idleCharacters = m_idle;
+}
+
+/* Restage a character which has been warped, so that it stays where it's
+ * been put; it's stepped in the next tick, even if it's idle
+ */
+void
+Crowd::reset(size_t index)
+{
+	m_walk[index].setValue(0, 0, 0);
+	m_positions[index] = m_controllers[index]->getGhostObject()->getWorldTransform().getOrigin();
+	m_controllers[index]->m_idleTicks = m_idleInterval;
+}
+
+void
+Crowd::setWalkDirection(size_t index, const btVector3 &walk)
+{
+	m_walk[index] = walk;
+}
+
+const btVector3 &
+Crowd::position(size_t index) const
+{
+	return m_positions[index];
+}
+
+/* Set the points (normally the positions of the cameras) near to which
+ * characters are moved by their full controllers; if there are none, they
+ * all are
+ */
+void
+Crowd::setFocus(const std::vector<Ogre::Vector3> &focus)
+{
+	m_pendingFocus = focus;
+}
+
+/* Invoked by the dynamics world in each tick */
+void
+Crowd::updateAction(btCollisionWorld *world, btScalar deltaTime)
+{
+	std::vector<KinematicsController *>::iterator it;
+	std::vector<btVector3>::const_iterator fit;
+	KinematicsController *c;
+	btScalar near2;
+	bool nearby;
+	size_t i;
+
+	m_full.clear();
+	m_coarse.clear();
+	m_idle = 0;
+	near2 = m_near * m_near;
+	for(i = 0; i < m_controllers.size(); i++)
+	{
+		c = m_controllers[i];
+		if(c->idle() && c->m_idleTicks < m_idleInterval)
+		{
+			c->m_idleTicks++;
+			m_idle++;
+			continue;
+		}
+		c->m_idleTicks = 0;
+		nearby = m_focus.empty();
+		for(fit = m_focus.begin(); !nearby && fit != m_focus.end(); fit++)
+		{
+			nearby = (c->getGhostObject()->getWorldTransform().getOrigin().distance2(*fit) <= near2);
+		}
+		if(nearby)
+		{
+			m_full.push_back(c);
+		}
+		else
+		{
+			m_coarse.push_back(c);
+		}
+	}
+	for(it = m_full.begin(); it != m_full.end(); it++)
+	{
+		(*it)->updateAction(world, deltaTime);
+	}
+	for(it = m_coarse.begin(); it != m_coarse.end(); it++)
+	{
+		(*it)->coarseStep(world, deltaTime);
+	}
+}
+
+void
+Crowd::debugDraw(btIDebugDraw *debugDrawer)
+{
+}
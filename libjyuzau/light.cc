@@ -23,14 +23,19 @@
 using namespace Jyuzau;
 
 Light::Light(const Light &object):
-	Node::Node(object)
+	Node::Node(object),
+	m_light(NULL)
 {
 }
 
+/* Lights are defined entirely by the scene which contains them, so there is
+ * no shared definition to be pooled.
+ */
 Light::Light(Ogre::String name, State *state, Ogre::String kind):
 	Node::Node(name, state, kind, false),
 	m_light(NULL)
 {
+	m_unique = true;
 }
 
 Light::~Light()
@@ -74,7 +79,7 @@ Light::detach(void)
 	if(m_light)
 	{
 		m_light->detachFromParent();
-		delete m_light;
+		m_light->_getManager()->destroyLight(m_light);
 		m_light = NULL;
 	}
 }
@@ -19,6 +19,10 @@
 
 #include "jyuzau/loadable.hh"
 #include "jyuzau/state.hh"
+#include "jyuzau/compiled.hh"
+#include "jyuzau/arena.hh"
+#include "jyuzau/core.hh"
+#include "jyuzau/packarchive.hh"
 
 #include <OGRE/OgreLogManager.h>
 #include <OGRE/OgreColourValue.h>
@@ -33,21 +37,26 @@ using namespace Jyuzau;
  *
  * Loadable::Loadable()                 [public constructor]
  * Loadable::load()                     [public]
- *  Loadable::loadDocument()
- *   Loadable::startElement()           [via SAX callbacks]
- *    Loadable::factory()
- *     [LoadableObject or descendant constructor]
- *    Loadable::add()
- *   Loadable::endElement()             [via SAX callbacks]
- *    LoadableObject::didFinishLoding() [may recurse the tree]
- *  Loadable::complete()
- *   LoadableObject::complete()         [may recurse the tree]
- *  Loadable::didFinishLoading()
- *   Loadable::addResources()
- *    LoadableObject::addResources()    [may recurse the tree]
- *  Loadable::discard()
- *   delete LoadableObject              [if root is discardable, or...]
- *   LoadableObject::discard()          [may recurse the tree]
+ *  Loadable::parse()                   [may be invoked by a worker thread]
+ *   Loadable::loadDocument()
+ *    Loadable::startElement()          [via SAX callbacks, or...]
+ *    Loadable::loadCompiled()          [if a compiled document exists]
+ *     Loadable::openElement()
+ *      Loadable::factory()
+ *       [LoadableObject or descendant constructor]
+ *      LoadableObject::addChild()
+ *     Loadable::closeElement()         [via SAX endElement, or replay]
+ *      LoadableObject::didFinishLoding() [may recurse the tree]
+ *   Loadable::complete()
+ *    LoadableObject::complete()        [may recurse the tree]
+ *  Loadable::finish()
+ *   Loadable::didFinishLoading()
+ *    Loadable::addResources()
+ *     LoadableObject::addResources()   [may recurse the tree]
+ *   Loadable::discard()
+ *    delete LoadableObject             [if root is discardable, or...]
+ *    LoadableObject::discard()         [may recurse the tree]
+ *  State::addToPool()                  [unless the asset is unique]
  * 
  * Descendants will typically include an attach() method which attaches the
  * asset to the scene (or in the case of a Scene, attaches the scene to an
@@ -61,12 +70,14 @@ Loadable::Loadable():
 	m_path(""),
 	m_loaded(false),
 	m_load_status(false),
+	m_parsed(false),
 	m_root(NULL),
 	m_cur(NULL),
 	m_objects(),
 	m_owner(NULL),
 	m_unique(false),
-	m_state(NULL)
+	m_state(NULL),
+	m_arena(NULL)
 {
 }
 
@@ -78,12 +89,14 @@ Loadable::Loadable(const Loadable &object):
 	m_path(""),
 	m_loaded(false),
 	m_load_status(false),
+	m_parsed(false),
 	m_root(NULL),
 	m_cur(NULL),
 	m_objects(),
 	m_owner(NULL),
 	m_unique(false),
-	m_state(NULL)
+	m_state(NULL),
+	m_arena(NULL)
 {
 	if(!object.m_loaded || !object.m_load_status)
 	{
@@ -94,6 +107,7 @@ Loadable::Loadable(const Loadable &object):
 	m_kind = object.m_kind;
 	m_container = object.m_container;
 	m_path = object.m_path;
+	m_group = object.m_group;
 	m_loaded = object.m_loaded;
 	m_load_status = object.m_load_status;
 	m_unique = object.m_unique;
@@ -107,12 +121,14 @@ Loadable::Loadable(Ogre::String className, State *state, Ogre::String kind, bool
 	m_path(""),
 	m_loaded(false),
 	m_load_status(false),
+	m_parsed(false),
 	m_root(NULL),
 	m_cur(NULL),
 	m_objects(),
 	m_owner(NULL),
 	m_unique(false),
-	m_state(state)
+	m_state(state),
+	m_arena(NULL)
 {
 	Ogre::String base;
 	
@@ -149,6 +165,7 @@ Loadable::~Loadable()
 	{
 		delete m_root;
 	}
+	releaseArena();
 }
 
 Loadable *
@@ -170,6 +187,15 @@ Loadable::kind(void) const
 	return m_kind;
 }
 
+/* The group name (kind::class) identifies both the asset's OGRE resource
+ * group and its definition within a state's object pool.
+ */
+Ogre::String
+Loadable::group(void) const
+{
+	return m_group;
+}
+
 LoadableObject *
 Loadable::root(void) const
 {
@@ -196,12 +222,43 @@ Loadable::state(void) const
 bool
 Loadable::load(void)
 {
-	if(m_loaded)
+	if(m_loaded && !m_parsed)
 	{
 		return m_load_status;
 	}
+	if(!parse())
+	{
+		return false;
+	}
+	if(!finish())
+	{
+		return false;
+	}
+	if(!m_unique)
+	{
+		m_state->addToPool(this);
+	}
+	return true;
+}
+
+/* The first phase of load(): parse the asset's descriptor and check that
+ * the resulting definition is complete. parse() touches nothing beyond this
+ * instance and its LoadableObject tree, and so may be invoked by a worker
+ * thread.
+ */
+bool
+Loadable::parse(void)
+{
+	if(m_loaded)
+	{
+		return m_parsed || m_load_status;
+	}
 	m_loaded = true;
 	m_load_status = false;
+	if(!m_arena)
+	{
+		m_arena = new LoadArena();
+	}
 	if(!m_path.length())
 	{
 		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to load " + m_className + "[" + m_kind + "] which has no path");
@@ -218,14 +275,26 @@ Loadable::load(void)
 		discard();
 		return false;
 	}
+	m_parsed = true;
+	return true;
+}
+
+/* The second phase of load(): declare the asset's resources and discard
+ * the parts of the LoadableObject tree which are no longer needed. Adding
+ * the definition to the State's object pool is left to the caller.
+ */
+bool
+Loadable::finish(void)
+{
+	if(!m_parsed)
+	{
+		return m_load_status;
+	}
+	m_parsed = false;
 	m_load_status = true;
 	didFinishLoading();
 	discard();
-	if(!m_unique)
-	{
-		m_state->addToPool(this);
-	}
-	return true;
+	return m_load_status;
 }
 
 /* Utility method invoked by load() to check if an object's definition is
@@ -289,6 +358,7 @@ Loadable::discard(void)
 		delete m_root;
 		m_root = NULL;
 		m_cur = NULL;
+		releaseArena();
 	}
 	else
 	{
@@ -296,6 +366,29 @@ Loadable::discard(void)
 	}
 }
 
+/* Release the arena used for the LoadableObject tree, once nothing remains
+ * which was allocated from it: either when the whole tree has been
+ * discarded, or when the Loadable itself is destroyed.
+ */
+void
+Loadable::releaseArena(void)
+{
+	if(!m_arena)
+	{
+		return;
+	}
+	if(m_arena->allocations())
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: " + m_group + ": " +
+			std::to_string(m_arena->allocations()) + " allocations (" +
+			std::to_string(m_arena->bytes()) + " bytes) served from " +
+			std::to_string(m_arena->blocks()) + " arena blocks (" +
+			std::to_string(m_arena->reserved()) + " bytes)", Ogre::LML_TRIVIAL);
+	}
+	delete m_arena;
+	m_arena = NULL;
+}
+
 /* Invoked by startElement() to create a new LoadableObject to add to the
  * tree.
  */
@@ -305,18 +398,54 @@ Loadable::factory(Ogre::String kind, AttrList &attrs)
 	/* Default loadable object factory; simply returns a new instance
 	 * of LoadableObject
 	 */
-	return new LoadableObject(this, m_cur, kind, attrs);
+	return new(m_arena) LoadableObject(this, m_cur, kind, attrs);
 }
 
-/* Invoked by load() to parse the XML document for this asset */
+/* Invoked by load() to parse the document for this asset. If a compiled
+ * form of the document exists and is up to date, it's used in preference to
+ * parsing the XML.
+ *
+ * If packed archives have been mounted, the document is read from them
+ * instead of the filesystem, if they contain it: the compiled form, if
+ * it was packed, and otherwise the XML.
+ */
 bool
 Loadable::loadDocument(Ogre::String path)
 {
 	xmlParserCtxtPtr ctx;
 	xmlSAXHandler sax;
 	xmlDocPtr doc;
+	CompiledDocument compiled;
+	Ogre::String cpath;
+	PackArchiveFactory *packs;
+	const void *data;
+	size_t length;
+	bool packed;
 	
 	m_skip = 0;
+	cpath = CompiledDocument::compiledPath(path);
+	packs = (Core::getInstance() ? Core::getInstance()->packs() : NULL);
+	packed = false;
+	if(packs && packs->mounted())
+	{
+		if(packs->read(cpath, data, length))
+		{
+			if(compiled.open(data, length))
+			{
+				return loadCompiled(compiled);
+			}
+			Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: ignoring invalid packed compiled document " + cpath);
+		}
+		packed = packs->read(path, data, length);
+	}
+	if(!packed && CompiledDocument::current(path, cpath))
+	{
+		if(compiled.open(cpath))
+		{
+			return loadCompiled(compiled);
+		}
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: ignoring invalid compiled document " + cpath);
+	}
 	memset(&sax, 0, sizeof(sax));
 	sax.initialized = XML_SAX2_MAGIC;
 	sax.startElementNs = sax_startElement;
@@ -328,7 +457,14 @@ Loadable::loadDocument(Ogre::String path)
 		return false;
 	}
 	xmlCtxtUseOptions(ctx, XML_PARSE_NODICT | XML_PARSE_NOENT);
-	doc = xmlCtxtReadFile(ctx, path.c_str(), "utf-8", XML_PARSE_NONET|XML_PARSE_NOCDATA);
+	if(packed)
+	{
+		doc = xmlCtxtReadMemory(ctx, (const char *) data, length, path.c_str(), "utf-8", XML_PARSE_NONET|XML_PARSE_NOCDATA);
+	}
+	else
+	{
+		doc = xmlCtxtReadFile(ctx, path.c_str(), "utf-8", XML_PARSE_NONET|XML_PARSE_NOCDATA);
+	}
 	if(doc)
 	{
 		xmlFreeDoc(doc);
@@ -337,6 +473,52 @@ Loadable::loadDocument(Ogre::String path)
 	return true;
 }
 
+/* Invoked by loadDocument() to replay the elements of a compiled document,
+ * so that the tree is built exactly as it would have been by the SAX
+ * callbacks. Each interned string is converted to an Ogre::String once, no
+ * matter how many times it's used.
+ */
+bool
+Loadable::loadCompiled(const CompiledDocument &doc)
+{
+	std::vector<Ogre::String> strings;
+	const CompiledElement *el;
+	const CompiledAttr *attr;
+	uint32_t c, n, depth;
+	
+	strings.reserve(doc.strings());
+	for(c = 0; c < doc.strings(); c++)
+	{
+		strings.push_back(Ogre::String(doc.string(c)));
+	}
+	depth = 0;
+	for(c = 0; c < doc.elements(); c++)
+	{
+		AttrList attrs;
+		
+		el = doc.element(c);
+		while(depth > el->depth)
+		{
+			closeElement();
+			depth--;
+		}
+		attrs.reserve(el->nattrs);
+		for(n = 0; n < el->nattrs; n++)
+		{
+			attr = doc.attr(el->attr + n);
+			attrs.push_back(std::make_pair(strings[attr->name], strings[attr->value]));
+		}
+		openElement(strings[el->name], attrs);
+		depth++;
+	}
+	while(depth)
+	{
+		closeElement();
+		depth--;
+	}
+	return true;
+}
+
 /* Add a child object to this one; the child becomes owned by this object, and
  * will be destroyed by this object's destructor.
  */
@@ -348,19 +530,12 @@ Loadable::addObject(Loadable *child)
 }
 
 /* Invoked by the SAX startElementNS handler whenever an opening tag is
- * encountered in the XML document. Unless we're ignoring part of the DOM
- * tree (m_skip), startElement() calls factory() to create a new 
- * LoadableObject then calls the current tree leaf's add() method to add the
- * new object as a child (or sets the new object as m_root if there isn't a
- * tree yet), then sets the current tree leaf to the new object.
+ * encountered in the XML document; builds the qualified element name and
+ * attribute list, and passes them to openElement().
  */
 void
 Loadable::startElement(const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes)
 {
-	LoadableObject *obj;
-	Ogre::String name((const char *) localname);
-	Ogre::String ns(URI ? (const char *) URI : "");
-	Ogre::String qname(ns + name);
 	size_t i, c;
 	AttrList attrs;
 	
@@ -372,17 +547,55 @@ Loadable::startElement(const xmlChar *localname, const xmlChar *prefix, const xm
 		m_skip++;
 		return;
 	}
+	Ogre::String qname(URI ? (const char *) URI : "");
+	
+	qname.append((const char *) localname);
+	/* The attribute strings are built in place, and the list itself is
+	 * handed over to the new LoadableObject rather than copied
+	 */
+	attrs.resize(nb_attributes);
 	for(i = c = 0; c < nb_attributes; c++)
 	{
-		Ogre::String ans(attributes[i + 2] ? (const char *) attributes[i + 2] : "");
-		Ogre::String aname((const char *) attributes[i]);
-		Ogre::String attr(ans + aname);
-		Ogre::String value((const char *) attributes[i + 3], (size_t) (attributes[i+4] - attributes[i+3]));
-		attrs.push_back(std::make_pair(attr, value));
+		Attr &attr = attrs[c];
+		
+		if(attributes[i + 2])
+		{
+			attr.first.assign((const char *) attributes[i + 2]);
+		}
+		attr.first.append((const char *) attributes[i]);
+		attr.second.assign((const char *) attributes[i + 3], (size_t) (attributes[i+4] - attributes[i+3]));
 		i += 5;
 	}
+	openElement(qname, attrs);
+}
+
+/* Invoked by the SAX startElementNS handler whenever a closing tag is
+ * encountered in the XML document.
+ */
+void
+Loadable::endElement(const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+{
+	closeElement();
+}
+
+/* Invoked for each opening tag, whether parsed from XML or replayed from a
+ * compiled document. Unless we're ignoring part of the DOM tree (m_skip),
+ * openElement() calls factory() to create a new LoadableObject then calls
+ * the current tree leaf's add() method to add the new object as a child (or
+ * sets the new object as m_root if there isn't a tree yet), then sets the
+ * current tree leaf to the new object.
+ */
+void
+Loadable::openElement(const Ogre::String &name, AttrList &attrs)
+{
+	LoadableObject *obj;
 	
-	obj = factory(qname, attrs);
+	if(m_skip)
+	{
+		m_skip++;
+		return;
+	}
+	obj = factory(name, attrs);
 	if(!obj)
 	{
 		m_skip++;
@@ -394,6 +607,7 @@ Loadable::startElement(const xmlChar *localname, const xmlChar *prefix, const xm
 		{
 			delete obj;
 			m_skip++;
+			return;
 		}
 		m_cur = obj;
 	}
@@ -403,13 +617,12 @@ Loadable::startElement(const xmlChar *localname, const xmlChar *prefix, const xm
 	}
 }
 
-/* Invoked by the SAX startElementNS handler whenever a closing tag is
- * encountered in the XML document. If we're currently skipping part of the
+/* Invoked for each closing tag. If we're currently skipping part of the
  * tree, the skip depth (m_skip), otherwise, we adjust the current tree leaf
  * to point to its own parent.
  */
 void
-Loadable::endElement(const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+Loadable::closeElement(void)
 {
 	if(m_skip)
 	{
@@ -478,14 +691,71 @@ LoadableObject::LoadableObject(const LoadableObject &object):
 }
 
 
+/* Note that the contents of attrs are moved, rather than copied, into the
+ * new instance, and so subclasses must use m_attrs instead.
+ */
 LoadableObject::LoadableObject(Loadable *owner, LoadableObject *parent, Ogre::String kind, AttrList &attrs):
 	m_owner(owner),
 	m_kind(kind),
-	m_attrs(attrs),
+	m_attrs(),
 	m_discardable(false)
 {
 	m_first = m_last = m_prev = m_next = m_parent = NULL;
 	m_loaded = false;
+	m_attrs.swap(attrs);
+}
+
+/* Each allocation is preceded by a header recording the arena (if any) it
+ * was allocated from, so that delete can tell whether there's anything to
+ * free: memory obtained from an arena is reclaimed only when the arena is
+ * released.
+ */
+#define OBJECT_HEADER                  16
+
+void *
+LoadableObject::operator new(size_t size)
+{
+	return LoadableObject::operator new(size, (LoadArena *) NULL);
+}
+
+void *
+LoadableObject::operator new(size_t size, LoadArena *arena)
+{
+	unsigned char *p;
+	
+	if(arena)
+	{
+		p = static_cast<unsigned char *>(arena->allocate(size + OBJECT_HEADER));
+	}
+	else
+	{
+		p = static_cast<unsigned char *>(::operator new(size + OBJECT_HEADER));
+	}
+	*(reinterpret_cast<LoadArena **>(p)) = arena;
+	return p + OBJECT_HEADER;
+}
+
+void
+LoadableObject::operator delete(void *ptr)
+{
+	unsigned char *p;
+	
+	if(!ptr)
+	{
+		return;
+	}
+	p = static_cast<unsigned char *>(ptr) - OBJECT_HEADER;
+	if(!*(reinterpret_cast<LoadArena **>(p)))
+	{
+		::operator delete(p);
+	}
+}
+
+/* Invoked only if a constructor throws */
+void
+LoadableObject::operator delete(void *ptr, LoadArena *arena)
+{
+	LoadableObject::operator delete(ptr);
 }
 
 LoadableObject::~LoadableObject()
@@ -519,6 +789,20 @@ LoadableObject::parent(void) const
 	return m_parent;
 }
 
+/* Return the first child of this object */
+LoadableObject *
+LoadableObject::first(void) const
+{
+	return m_first;
+}
+
+/* Return the next sibling of this object */
+LoadableObject *
+LoadableObject::next(void) const
+{
+	return m_next;
+}
+
 
 /* Invoked by Loadable::complete() to check whether the asset has a complete
  * (useable) definition. This default implementation simply recurses the
@@ -673,6 +957,21 @@ LoadableObject::detach(void)
 	return true;
 }
 
+/* Invoked by Scene::attach() before the tree is attached, so that any
+ * assets it refers to can be loaded ahead of time by the LoadQueue. By
+ * default, simply recurses the tree.
+ */
+void
+LoadableObject::prefetch(LoadQueue *queue)
+{
+	LoadableObject *p;
+	
+	for(p = m_first; p; p = p->m_next)
+	{
+		p->prefetch(queue);
+	}
+}
+
 /* Utility method to parse a colour value specified in the attribute list */
 Ogre::ColourValue
 LoadableObject::parseColourValue(AttrList &attrs)
@@ -0,0 +1,210 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <OGRE/OgreLogManager.h>
+
+#include <libxml/parser.h>
+
+#include "jyuzau/loadqueue.hh"
+#include "jyuzau/loadable.hh"
+#include "jyuzau/state.hh"
+
+using namespace Jyuzau;
+
+LoadQueue::LoadQueue(Ogre::WorkQueue *queue):
+	m_queue(queue),
+	m_queued()
+{
+	/* libxml2 must be initialised by the main thread before any worker
+	 * thread attempts to parse a document
+	 */
+	xmlInitParser();
+	m_channel = m_queue->getChannel("Jyuzau/Loadable");
+	m_queue->addRequestHandler(m_channel, this);
+	m_queue->addResponseHandler(m_channel, this);
+}
+
+/* Any requests which are still outstanding are completed before the
+ * handlers are removed, so that none of the queued Loadables are leaked.
+ */
+LoadQueue::~LoadQueue()
+{
+	wait();
+	m_queue->removeRequestHandler(m_channel, this);
+	m_queue->removeResponseHandler(m_channel, this);
+}
+
+/* Add a Loadable to the queue; the LoadQueue takes ownership of it unless
+ * adopt is false. If an asset of the same kind and class is already queued,
+ * an adopted Loadable is simply destroyed, while one which isn't is
+ * refused, and left for the caller to load itself.
+ */
+bool
+LoadQueue::enqueue(Loadable *loadable, bool adopt)
+{
+	Ogre::WorkQueue::RequestID rid;
+	
+	if(queued(loadable))
+	{
+		if(!adopt)
+		{
+			return false;
+		}
+		delete loadable;
+		return true;
+	}
+	/* If Ogre was built without thread support, addRequest() will process
+	 * both the request and the response before it returns
+	 */
+	m_queued.insert(loadable->group());
+	if(!adopt)
+	{
+		m_borrowed.insert(loadable);
+	}
+	if(loadable->state())
+	{
+		loadable->state()->assetQueued(loadable);
+	}
+	rid = m_queue->addRequest(m_channel, 0, Ogre::Any(loadable));
+	if(!rid)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: the work queue is not accepting requests; failed to enqueue " + loadable->group());
+		m_queued.erase(loadable->group());
+		m_borrowed.erase(loadable);
+		if(loadable->state())
+		{
+			loadable->state()->assetLoaded(loadable, false);
+		}
+		if(adopt)
+		{
+			delete loadable;
+		}
+		return false;
+	}
+	return true;
+}
+
+/* Returns true if an asset of the same kind and class as the Loadable has
+ * been queued but not yet completed.
+ */
+bool
+LoadQueue::queued(Loadable *loadable) const
+{
+	return m_queued.find(loadable->group()) != m_queued.end();
+}
+
+/* Return the number of assets which are yet to be completed */
+size_t
+LoadQueue::pending(void) const
+{
+	return m_queued.size();
+}
+
+/* Block until all of the queued assets have been completed */
+void
+LoadQueue::wait(void)
+{
+	while(m_queued.size())
+	{
+		m_queue->processResponses();
+		if(m_queued.size())
+		{
+			OGRE_THREAD_SLEEP(1);
+		}
+	}
+}
+
+/* Block until a Loadable which was enqueued without being adopted has been
+ * completed, so that its owner can safely destroy it
+ */
+void
+LoadQueue::release(Loadable *loadable)
+{
+	while(m_borrowed.find(loadable) != m_borrowed.end())
+	{
+		m_queue->processResponses();
+		if(m_borrowed.find(loadable) != m_borrowed.end())
+		{
+			OGRE_THREAD_SLEEP(1);
+		}
+	}
+}
+
+/* Invoked by a WorkQueue worker thread to process a request */
+Ogre::WorkQueue::Response *
+LoadQueue::handleRequest(const Ogre::WorkQueue::Request *req, const Ogre::WorkQueue *srcQ)
+{
+	Loadable *loadable;
+	bool status;
+
+	loadable = Ogre::any_cast<Loadable *>(req->getData());
+	status = loadable->parse();
+#if OGRE_THREAD_SUPPORT == 1
+	/* Resource groups may only be initialised away from the main thread
+	 * if Ogre's resource system is fully thread-safe
+	 */
+	if(status)
+	{
+		status = loadable->finish();
+	}
+#endif
+	return OGRE_NEW Ogre::WorkQueue::Response(req, status, req->getData());
+}
+
+/* Invoked on the main thread when a request has been processed */
+void
+LoadQueue::handleResponse(const Ogre::WorkQueue::Response *res, const Ogre::WorkQueue *srcQ)
+{
+	completed(Ogre::any_cast<Loadable *>(res->getData()), res->succeeded());
+}
+
+/* Complete the loading of an asset which a worker has parsed, add it to the
+ * pool, inform its State, and then destroy it if it's ours.
+ */
+void
+LoadQueue::completed(Loadable *loadable, bool status)
+{
+	bool adopted;
+	
+	m_queued.erase(loadable->group());
+	adopted = !m_borrowed.erase(loadable);
+	if(status)
+	{
+		status = loadable->finish();
+	}
+	if(status)
+	{
+		if(!loadable->unique())
+		{
+			loadable->state()->addToPool(loadable);
+		}
+	}
+	else
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to load " + loadable->group() + " in the background");
+	}
+	if(loadable->state())
+	{
+		loadable->state()->assetLoaded(loadable, status);
+	}
+	if(adopted)
+	{
+		delete loadable;
+	}
+}
@@ -0,0 +1,270 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cmath>
+#include <limits>
+
+#include <OGRE/OgreSceneNode.h>
+
+#include "jyuzau/locomotion.hh"
+#include "jyuzau/actor.hh"
+#include "jyuzau/kinematics.hh"
+
+using namespace Jyuzau;
+
+Locomotion::Locomotion()
+{
+}
+
+/* Return any remaining actors to their own frameRenderingQueued() */
+Locomotion::~Locomotion()
+{
+	while(m_actors.size())
+	{
+		remove(m_actors.back());
+	}
+}
+
+size_t
+Locomotion::size(void) const
+{
+	return m_actors.size();
+}
+
+void
+Locomotion::resize(size_t size)
+{
+	m_actors.resize(size);
+	m_nodes.resize(size);
+	m_kinematics.resize(size);
+	m_advance.resize(size);
+	m_strafe.resize(size);
+	m_turn.resize(size);
+	m_topSpeed.resize(size);
+	m_moveAccel.resize(size);
+	m_moveDecel.resize(size);
+	m_rotSpeed.resize(size);
+	m_rotStep.resize(size);
+	m_rotAccel.resize(size);
+	m_rotDecel.resize(size);
+	m_vx.resize(size);
+	m_vy.resize(size);
+	m_vz.resize(size);
+	m_rotVelocity.resize(size);
+	m_qw.resize(size);
+	m_qx.resize(size);
+	m_qy.resize(size);
+	m_qz.resize(size);
+	m_tx.resize(size);
+	m_ty.resize(size);
+	m_tz.resize(size);
+	m_yaw.resize(size);
+}
+
+/* Move the state of one actor to another slot */
+void
+Locomotion::move(size_t from, size_t to)
+{
+	m_actors[to] = m_actors[from];
+	m_nodes[to] = m_nodes[from];
+	m_kinematics[to] = m_kinematics[from];
+	m_advance[to] = m_advance[from];
+	m_strafe[to] = m_strafe[from];
+	m_turn[to] = m_turn[from];
+	m_topSpeed[to] = m_topSpeed[from];
+	m_moveAccel[to] = m_moveAccel[from];
+	m_moveDecel[to] = m_moveDecel[from];
+	m_rotSpeed[to] = m_rotSpeed[from];
+	m_rotStep[to] = m_rotStep[from];
+	m_rotAccel[to] = m_rotAccel[from];
+	m_rotDecel[to] = m_rotDecel[from];
+	m_vx[to] = m_vx[from];
+	m_vy[to] = m_vy[from];
+	m_vz[to] = m_vz[from];
+	m_rotVelocity[to] = m_rotVelocity[from];
+	m_actors[to]->m_locomotionIndex = to;
+}
+
+/* Take over the movement of an actor, which must be attached to a scene and
+ * have no Character
+ */
+bool
+Locomotion::add(Actor *actor)
+{
+	size_t i;
+
+	if(actor->m_locomotion || actor->m_character || !actor->m_node)
+	{
+		return false;
+	}
+	i = m_actors.size();
+	resize(i + 1);
+	m_actors[i] = actor;
+	m_nodes[i] = actor->m_node;
+	m_kinematics[i] = actor->m_kinematics;
+	m_moveAccel[i] = actor->m_moveAccel;
+	m_moveDecel[i] = actor->m_moveDecel;
+	m_rotSpeed[i] = actor->m_rotSpeed;
+	m_rotStep[i] = actor->m_rotStep;
+	m_rotAccel[i] = actor->m_rotAccel;
+	m_rotDecel[i] = actor->m_rotDecel;
+	m_vx[i] = actor->m_velocity.x;
+	m_vy[i] = actor->m_velocity.y;
+	m_vz[i] = actor->m_velocity.z;
+	m_rotVelocity[i] = actor->m_rotVelocity;
+	actor->m_locomotion = this;
+	actor->m_locomotionIndex = i;
+	actor->updateLocomotion();
+	return true;
+}
+
+/* Hand an actor's movement back to it, along with its velocities */
+void
+Locomotion::remove(Actor *actor)
+{
+	size_t i, last;
+
+	if(actor->m_locomotion != this)
+	{
+		return;
+	}
+	i = actor->m_locomotionIndex;
+	actor->m_velocity = Ogre::Vector3(m_vx[i], m_vy[i], m_vz[i]);
+	actor->m_rotVelocity = m_rotVelocity[i];
+	actor->m_locomotion = NULL;
+	last = m_actors.size() - 1;
+	if(i != last)
+	{
+		move(last, i);
+	}
+	resize(last);
+}
+
+void
+Locomotion::setInput(size_t index, Ogre::Real advance, Ogre::Real strafe, Ogre::Real turn)
+{
+	m_advance[index] = advance;
+	m_strafe[index] = strafe;
+	m_turn[index] = turn;
+}
+
+void
+Locomotion::setTopSpeed(size_t index, Ogre::Real topSpeed)
+{
+	m_topSpeed[index] = topSpeed;
+}
+
+void
+Locomotion::velocity(size_t index, Ogre::Vector3 &velocity, Ogre::Real &rotVelocity) const
+{
+	velocity = Ogre::Vector3(m_vx[index], m_vy[index], m_vz[index]);
+	rotVelocity = m_rotVelocity[index];
+}
+
+void
+Locomotion::setVelocity(size_t index, const Ogre::Vector3 &velocity, Ogre::Real rotVelocity)
+{
+	m_vx[index] = velocity.x;
+	m_vy[index] = velocity.y;
+	m_vz[index] = velocity.z;
+	m_rotVelocity[index] = rotVelocity;
+}
+
+/* Accelerate, move and turn every actor; this is equivalent to the movement
+ * and turning performed by Actor::frameRenderingQueued(), with each
+ * condition replaced by arithmetic so that the loop has no branches
+ */
+void
+Locomotion::update(Ogre::Real elapsed)
+{
+	const Ogre::Real minVelocity = std::numeric_limits<Ogre::Real>::epsilon();
+	Ogre::Real ax, ay, az, len, has, scale, speed, top, s, c, w, x, y, z;
+	size_t i, n;
+
+	n = m_actors.size();
+	for(i = 0; i < n; i++)
+	{
+		const Ogre::Quaternion &q = m_nodes[i]->getOrientation();
+
+		m_qw[i] = q.w;
+		m_qx[i] = q.x;
+		m_qy[i] = q.y;
+		m_qz[i] = q.z;
+	}
+	for(i = 0; i < n; i++)
+	{
+		w = m_qw[i];
+		x = m_qx[i];
+		y = m_qy[i];
+		z = m_qz[i];
+		/* The sum of the node's Z axis scaled by advance (which is
+		 * negative going forwards, along -Z, as in
+		 * Actor::accelerateXYMovement()) and its X axis scaled by strafe
+		 */
+		ax = m_advance[i] * 2 * (x * z + w * y) + m_strafe[i] * (1 - 2 * (y * y + z * z));
+		ay = m_advance[i] * 2 * (y * z - w * x) + m_strafe[i] * 2 * (x * y + w * z);
+		az = m_advance[i] * (1 - 2 * (x * x + y * y)) + m_strafe[i] * 2 * (x * z - w * y);
+		len = ax * ax + ay * ay + az * az;
+		has = (len > 0) ? 1.0f : 0.0f;
+		scale = has * m_topSpeed[i] * elapsed * m_moveAccel[i] / std::sqrt(len + (1 - has));
+		m_vx[i] += ax * scale - (1 - has) * m_vx[i] * elapsed * m_moveDecel[i];
+		m_vy[i] += ay * scale - (1 - has) * m_vy[i] * elapsed * m_moveDecel[i];
+		m_vz[i] += az * scale - (1 - has) * m_vz[i] * elapsed * m_moveDecel[i];
+		/* Limit to the top speed, and stop altogether below the minimum */
+		top = m_topSpeed[i];
+		len = m_vx[i] * m_vx[i] + m_vy[i] * m_vy[i] + m_vz[i] * m_vz[i];
+		scale = (len > top * top) ? top / std::sqrt(len) : ((len < minVelocity * minVelocity) ? 0.0f : 1.0f);
+		m_vx[i] *= scale;
+		m_vy[i] *= scale;
+		m_vz[i] *= scale;
+		m_tx[i] = m_vx[i] * elapsed;
+		m_ty[i] = m_vy[i] * elapsed;
+		m_tz[i] = m_vz[i] * elapsed;
+		/* Turning */
+		has = (m_turn[i] != 0) ? 1.0f : 0.0f;
+		speed = m_rotSpeed[i];
+		m_rotVelocity[i] += has * m_turn[i] * m_rotStep[i] * speed * elapsed * m_rotAccel[i] - (1 - has) * m_rotVelocity[i] * elapsed * m_rotDecel[i];
+		m_rotVelocity[i] = std::min(speed, std::max(-speed, m_rotVelocity[i]));
+		m_rotVelocity[i] *= (std::abs(m_rotVelocity[i]) < minVelocity) ? 0.0f : 1.0f;
+		m_yaw[i] = m_rotVelocity[i] * elapsed;
+		/* Yaw about the local Y axis: q * (cos(a/2), 0, sin(a/2), 0) */
+		s = std::sin(m_yaw[i] / 2);
+		c = std::cos(m_yaw[i] / 2);
+		m_qw[i] = w * c - y * s;
+		m_qx[i] = x * c - z * s;
+		m_qy[i] = w * s + y * c;
+		m_qz[i] = x * s + z * c;
+	}
+	for(i = 0; i < n; i++)
+	{
+		if(m_kinematics[i])
+		{
+			m_kinematics[i]->walkDirection(Ogre::Vector3(m_tx[i], m_ty[i], m_tz[i]));
+			m_kinematics[i]->synchronise();
+		}
+		else if(m_tx[i] != 0 || m_ty[i] != 0 || m_tz[i] != 0)
+		{
+			m_nodes[i]->translate(m_tx[i], m_ty[i], m_tz[i]);
+		}
+		if(m_yaw[i] != 0)
+		{
+			m_nodes[i]->setOrientation(m_qw[i], m_qx[i], m_qy[i], m_qz[i]);
+		}
+	}
+}
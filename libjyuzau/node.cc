@@ -19,6 +19,7 @@
 
 #include "jyuzau/node.hh"
 #include "jyuzau/scene.hh"
+#include "jyuzau/snapshot.hh"
 
 #include <utility>
 
@@ -109,19 +110,15 @@ Node::attachToScene(Node *node, Ogre::String id)
 	return true;
 }
 
+/* Destroy the scene node; this must be done via the scene manager, so that
+ * the node's name can be re-used if the Node is attached again.
+ */
 void
 Node::detach(void)
 {
-	Ogre::Node *parentNode;
-	
 	if(m_node)
 	{
-		parentNode = m_node->getParent();
-		if(parentNode)
-		{
-			parentNode->removeChild(m_node);
-		}
-		delete m_node;
+		m_node->getCreator()->destroySceneNode(m_node);
 	}
 	m_node = NULL;
 	m_scene = NULL;
@@ -177,9 +174,22 @@ Node::createNode(Ogre::SceneNode *parentNode, Ogre::String id)
 	return true;
 }
 
+/* Returns true if the node may no longer be moved (see Prop::pinned()); the
+ * methods which would move it do nothing
+ */
+bool
+Node::pinned(void) const
+{
+	return false;
+}
+
 void
 Node::scale(const Ogre::Vector3 &vec)
 {
+	if(pinned())
+	{
+		return;
+	}
 	if(m_node)
 	{
 		m_node->scale(vec);
@@ -193,6 +203,10 @@ Node::scale(const Ogre::Vector3 &vec)
 void 
 Node::translate(const Ogre::Vector3 &vec)
 {
+	if(pinned())
+	{
+		return;
+	}
 	if(m_node)
 	{
 		m_node->translate(vec);
@@ -206,6 +220,10 @@ Node::translate(const Ogre::Vector3 &vec)
 void
 Node::setOrientation(const Ogre::Quaternion &q)
 {
+	if(pinned())
+	{
+		return;
+	}
 	if(m_node)
 	{
 		m_node->setOrientation(q);
@@ -219,6 +237,10 @@ Node::setOrientation(const Ogre::Quaternion &q)
 void
 Node::setPosition(Ogre::Real x, Ogre::Real y, Ogre::Real z)
 {
+	if(pinned())
+	{
+		return;
+	}
 	if(m_node)
 	{
 		m_node->setPosition(x, y, z);
@@ -232,6 +254,10 @@ Node::setPosition(Ogre::Real x, Ogre::Real y, Ogre::Real z)
 void
 Node::setPosition(const Ogre::Vector3 &vec)
 {
+	if(pinned())
+	{
+		return;
+	}
 	if(m_node)
 	{
 		m_node->setPosition(vec);
@@ -247,6 +273,10 @@ Node::yaw(const Ogre::Radian &angle)
 {
 	Ogre::Quaternion q;
 	
+	if(pinned())
+	{
+		return;
+	}
 	if(m_node)
 	{
 		m_node->yaw(angle);
@@ -264,6 +294,10 @@ Node::pitch(const Ogre::Radian &angle)
 {
 	Ogre::Quaternion q;
 	
+	if(pinned())
+	{
+		return;
+	}
 	if(m_node)
 	{
 		m_node->pitch(angle);
@@ -281,6 +315,10 @@ Node::roll(const Ogre::Radian &angle)
 {
 	Ogre::Quaternion q;
 	
+	if(pinned())
+	{
+		return;
+	}
 	if(m_node)
 	{
 		m_node->roll(angle);
@@ -292,3 +330,35 @@ Node::roll(const Ogre::Radian &angle)
 		m_orientation = m_orientation * q;
 	}
 }
+
+/* Record the node's transform, relative to its parent */
+void
+Node::snapshot(SnapshotNode &record) const
+{
+	const Ogre::Vector3 &pos = m_node->getPosition();
+	const Ogre::Quaternion &q = m_node->getOrientation();
+	const Ogre::Vector3 &scale = m_node->getScale();
+
+	record.position[0] = pos.x;
+	record.position[1] = pos.y;
+	record.position[2] = pos.z;
+	record.orientation[0] = q.w;
+	record.orientation[1] = q.x;
+	record.orientation[2] = q.y;
+	record.orientation[3] = q.z;
+	record.scale[0] = scale.x;
+	record.scale[1] = scale.y;
+	record.scale[2] = scale.z;
+}
+
+void
+Node::restore(const SnapshotNode &record)
+{
+	if(pinned())
+	{
+		return;
+	}
+	m_node->setPosition(record.position[0], record.position[1], record.position[2]);
+	m_node->setOrientation(record.orientation[0], record.orientation[1], record.orientation[2], record.orientation[3]);
+	m_node->setScale(record.scale[0], record.scale[1], record.scale[2]);
+}
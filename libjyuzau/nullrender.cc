@@ -0,0 +1,1195 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cstring>
+
+#include <OGRE/OgreRoot.h>
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreViewport.h>
+#include <OGRE/OgreFrustum.h>
+#include <OGRE/OgreDepthBuffer.h>
+#include <OGRE/OgreDefaultHardwareBufferManager.h>
+#include <OGRE/OgreRenderSystemCapabilities.h>
+
+#include "jyuzau/nullrender.hh"
+
+using namespace Jyuzau;
+
+/* NullRenderSystem */
+
+NullRenderSystem::NullRenderSystem():
+	Ogre::RenderSystem(),
+	m_hardwareBufferManager(NULL),
+	m_gpuProgramManager(NULL),
+	m_initialised(false)
+{
+	Ogre::ConfigOption mode, fullScreen;
+
+	mode.name = "Video Mode";
+	mode.currentValue = NULLRENDER_DEFAULT_MODE;
+	mode.possibleValues.push_back("640 x 480");
+	mode.possibleValues.push_back("800 x 600");
+	mode.possibleValues.push_back("1024 x 768");
+	mode.possibleValues.push_back("1280 x 720");
+	mode.possibleValues.push_back("1920 x 1080");
+	mode.immutable = false;
+	m_options[mode.name] = mode;
+
+	fullScreen.name = "Full Screen";
+	fullScreen.currentValue = "No";
+	fullScreen.possibleValues.push_back("No");
+	fullScreen.possibleValues.push_back("Yes");
+	fullScreen.immutable = false;
+	m_options[fullScreen.name] = fullScreen;
+
+	mDriverVersion.major = 1;
+}
+
+NullRenderSystem::~NullRenderSystem()
+{
+	shutdown();
+}
+
+const Ogre::String &
+NullRenderSystem::getName(void) const
+{
+	static Ogre::String name(NULLRENDER_NAME);
+
+	return name;
+}
+
+Ogre::ConfigOptionMap &
+NullRenderSystem::getConfigOptions(void)
+{
+	return m_options;
+}
+
+void
+NullRenderSystem::setConfigOption(const Ogre::String &name, const Ogre::String &value)
+{
+	Ogre::ConfigOptionMap::iterator it;
+
+	it = m_options.find(name);
+	if(it == m_options.end())
+	{
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Option named '" + name + "' does not exist.", "NullRenderSystem::setConfigOption");
+	}
+	it->second.currentValue = value;
+}
+
+/* The video mode may be any size, not only those offered as possible
+ * values, so that a headless run can match the window size of an
+ * interactive one.
+ */
+Ogre::String
+NullRenderSystem::validateConfigOptions(void)
+{
+	unsigned int width, height;
+
+	if(!parseVideoMode(m_options["Video Mode"].currentValue, width, height))
+	{
+		return "Invalid video mode '" + m_options["Video Mode"].currentValue + "'";
+	}
+	return Ogre::StringUtil::BLANK;
+}
+
+bool
+NullRenderSystem::parseVideoMode(const Ogre::String &mode, unsigned int &width, unsigned int &height) const
+{
+	Ogre::StringVector dims;
+
+	dims = Ogre::StringUtil::split(mode, " x");
+	if(dims.size() != 2)
+	{
+		return false;
+	}
+	width = Ogre::StringConverter::parseUnsignedInt(dims[0]);
+	height = Ogre::StringConverter::parseUnsignedInt(dims[1]);
+	return width > 0 && height > 0;
+}
+
+Ogre::RenderWindow *
+NullRenderSystem::_initialise(bool autoCreateWindow, const Ogre::String &windowTitle)
+{
+	Ogre::RenderWindow *window;
+	unsigned int width, height;
+
+	window = NULL;
+	if(!mTextureManager)
+	{
+		mTextureManager = new NullTextureManager();
+	}
+	if(autoCreateWindow)
+	{
+		if(!parseVideoMode(m_options["Video Mode"].currentValue, width, height))
+		{
+			OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Invalid video mode '" + m_options["Video Mode"].currentValue + "'", "NullRenderSystem::_initialise");
+		}
+		window = _createRenderWindow(windowTitle, width, height, m_options["Full Screen"].currentValue == "Yes");
+	}
+	Ogre::RenderSystem::_initialise(autoCreateWindow, windowTitle);
+	return window;
+}
+
+void
+NullRenderSystem::reinitialise(void)
+{
+	shutdown();
+	_initialise(true);
+}
+
+void
+NullRenderSystem::shutdown(void)
+{
+	Ogre::RenderSystem::shutdown();
+
+	delete m_gpuProgramManager;
+	m_gpuProgramManager = NULL;
+	delete m_hardwareBufferManager;
+	m_hardwareBufferManager = NULL;
+	delete mTextureManager;
+	mTextureManager = NULL;
+	m_initialised = false;
+}
+
+Ogre::RenderSystemCapabilities *
+NullRenderSystem::createRenderSystemCapabilities(void) const
+{
+	Ogre::RenderSystemCapabilities *rsc;
+
+	rsc = new Ogre::RenderSystemCapabilities();
+	rsc->setRenderSystemName(getName());
+	rsc->setDeviceName("Null");
+	rsc->setVendor(Ogre::GPU_UNKNOWN);
+	rsc->setDriverVersion(mDriverVersion);
+
+	rsc->setCapability(Ogre::RSC_FIXED_FUNCTION);
+	rsc->setCapability(Ogre::RSC_AUTOMIPMAP);
+	rsc->setCapability(Ogre::RSC_BLENDING);
+	rsc->setCapability(Ogre::RSC_ANISOTROPY);
+	rsc->setCapability(Ogre::RSC_DOT3);
+	rsc->setCapability(Ogre::RSC_CUBEMAPPING);
+	rsc->setCapability(Ogre::RSC_HWSTENCIL);
+	rsc->setCapability(Ogre::RSC_TWO_SIDED_STENCIL);
+	rsc->setCapability(Ogre::RSC_STENCIL_WRAP);
+	rsc->setCapability(Ogre::RSC_VBO);
+	rsc->setCapability(Ogre::RSC_SCISSOR_TEST);
+	rsc->setCapability(Ogre::RSC_USER_CLIP_PLANES);
+	rsc->setCapability(Ogre::RSC_VERTEX_FORMAT_UBYTE4);
+	rsc->setCapability(Ogre::RSC_INFINITE_FAR_PLANE);
+	rsc->setCapability(Ogre::RSC_TEXTURE_FLOAT);
+	rsc->setCapability(Ogre::RSC_TEXTURE_1D);
+	rsc->setCapability(Ogre::RSC_TEXTURE_3D);
+	rsc->setCapability(Ogre::RSC_NON_POWER_OF_2_TEXTURES);
+	rsc->setCapability(Ogre::RSC_TEXTURE_COMPRESSION);
+	rsc->setCapability(Ogre::RSC_TEXTURE_COMPRESSION_DXT);
+	rsc->setCapability(Ogre::RSC_POINT_SPRITES);
+	rsc->setCapability(Ogre::RSC_MIPMAP_LOD_BIAS);
+
+	rsc->setNumTextureUnits(OGRE_MAX_TEXTURE_LAYERS);
+	rsc->setStencilBufferBitDepth(8);
+	rsc->setNumMultiRenderTargets(1);
+	rsc->setMaxPointSize(1);
+	rsc->setNonPOW2TexturesLimited(false);
+	return rsc;
+}
+
+void
+NullRenderSystem::initialiseFromRenderSystemCapabilities(Ogre::RenderSystemCapabilities *caps, Ogre::RenderTarget *primary)
+{
+	Ogre::Log *log;
+
+	if(caps->getRenderSystemName() != getName())
+	{
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Trying to initialise the null render system from capabilities belonging to " + caps->getRenderSystemName(), "NullRenderSystem::initialiseFromRenderSystemCapabilities");
+	}
+	m_hardwareBufferManager = new Ogre::DefaultHardwareBufferManager();
+	m_gpuProgramManager = new NullGpuProgramManager();
+	log = Ogre::LogManager::getSingleton().getDefaultLog();
+	if(log)
+	{
+		caps->log(log);
+	}
+}
+
+Ogre::RenderWindow *
+NullRenderSystem::_createRenderWindow(const Ogre::String &name, unsigned int width, unsigned int height, bool fullScreen, const Ogre::NameValuePairList *miscParams)
+{
+	NullRenderWindow *window;
+
+	if(mRenderTargets.find(name) != mRenderTargets.end())
+	{
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Window with name '" + name + "' already exists", "NullRenderSystem::_createRenderWindow");
+	}
+	window = new NullRenderWindow();
+	window->create(name, width, height, fullScreen, miscParams);
+	attachRenderTarget(*window);
+	if(!m_initialised)
+	{
+		delete mRealCapabilities;
+		mRealCapabilities = createRenderSystemCapabilities();
+		if(!mUseCustomCapabilities)
+		{
+			mCurrentCapabilities = mRealCapabilities;
+		}
+		fireEvent("RenderSystemCapabilitiesCreated");
+		initialiseFromRenderSystemCapabilities(mCurrentCapabilities, window);
+		m_initialised = true;
+	}
+	return window;
+}
+
+Ogre::MultiRenderTarget *
+NullRenderSystem::createMultiRenderTarget(const Ogre::String &name)
+{
+	OGRE_EXCEPT(Ogre::Exception::ERR_NOT_IMPLEMENTED, "Multiple render targets are not supported by the null render system", "NullRenderSystem::createMultiRenderTarget");
+}
+
+Ogre::DepthBuffer *
+NullRenderSystem::_createDepthBufferFor(Ogre::RenderTarget *renderTarget)
+{
+	return new Ogre::DepthBuffer(renderTarget->getDepthBufferPool(), 0, renderTarget->getWidth(), renderTarget->getHeight(), renderTarget->getFSAA(), renderTarget->getFSAAHint(), false);
+}
+
+Ogre::HardwareOcclusionQuery *
+NullRenderSystem::createHardwareOcclusionQuery(void)
+{
+	NullOcclusionQuery *query;
+
+	query = new NullOcclusionQuery();
+	mHwOcclusionQueries.push_back(query);
+	return query;
+}
+
+void
+NullRenderSystem::_setRenderTarget(Ogre::RenderTarget *target)
+{
+	mActiveRenderTarget = target;
+}
+
+void
+NullRenderSystem::_setViewport(Ogre::Viewport *vp)
+{
+	if(!vp)
+	{
+		mActiveViewport = NULL;
+		_setRenderTarget(NULL);
+		return;
+	}
+	if(vp != mActiveViewport || vp->_isUpdated())
+	{
+		mActiveViewport = vp;
+		_setRenderTarget(vp->getTarget());
+		vp->_clearUpdatedFlag();
+	}
+}
+
+unsigned int
+NullRenderSystem::getDisplayMonitorCount(void) const
+{
+	return 0;
+}
+
+void
+NullRenderSystem::_beginFrame(void)
+{
+}
+
+void
+NullRenderSystem::_endFrame(void)
+{
+}
+
+/* Nothing is drawn, but the base class keeps count of the batches, faces
+ * and vertices submitted, so that frame statistics can still be gathered
+ */
+void
+NullRenderSystem::_render(const Ogre::RenderOperation &op)
+{
+	Ogre::RenderSystem::_render(op);
+}
+
+void
+NullRenderSystem::clearFrameBuffer(unsigned int buffers, const Ogre::ColourValue &colour, Ogre::Real depth, unsigned short stencil)
+{
+}
+
+/* Projection matrices follow OpenGL's conventions, with depth in the range
+ * [-1, 1], so that frustum culling behaves as it would with the GL render
+ * system.
+ */
+Ogre::VertexElementType
+NullRenderSystem::getColourVertexElementType(void) const
+{
+	return Ogre::VET_COLOUR_ABGR;
+}
+
+void
+NullRenderSystem::_convertProjectionMatrix(const Ogre::Matrix4 &matrix, Ogre::Matrix4 &dest, bool forGpuProgram)
+{
+	dest = matrix;
+}
+
+void
+NullRenderSystem::_makeProjectionMatrix(const Ogre::Radian &fovy, Ogre::Real aspect, Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4 &dest, bool forGpuProgram)
+{
+	Ogre::Real tanThetaY, w, h, q, qn;
+
+	tanThetaY = Ogre::Math::Tan(fovy / 2.0f);
+	w = (1.0f / tanThetaY) / aspect;
+	h = 1.0f / tanThetaY;
+	if(farPlane == 0)
+	{
+		q = Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 1;
+		qn = nearPlane * (Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 2);
+	}
+	else
+	{
+		q = -(farPlane + nearPlane) / (farPlane - nearPlane);
+		qn = -2 * (farPlane * nearPlane) / (farPlane - nearPlane);
+	}
+	dest = Ogre::Matrix4::ZERO;
+	dest[0][0] = w;
+	dest[1][1] = h;
+	dest[2][2] = q;
+	dest[2][3] = qn;
+	dest[3][2] = -1;
+}
+
+void
+NullRenderSystem::_makeProjectionMatrix(Ogre::Real left, Ogre::Real right, Ogre::Real bottom, Ogre::Real top, Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4 &dest, bool forGpuProgram)
+{
+	Ogre::Real width, height, q, qn;
+
+	width = right - left;
+	height = top - bottom;
+	if(farPlane == 0)
+	{
+		q = Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 1;
+		qn = nearPlane * (Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 2);
+	}
+	else
+	{
+		q = -(farPlane + nearPlane) / (farPlane - nearPlane);
+		qn = -2 * (farPlane * nearPlane) / (farPlane - nearPlane);
+	}
+	dest = Ogre::Matrix4::ZERO;
+	dest[0][0] = 2 * nearPlane / width;
+	dest[0][2] = (right + left) / width;
+	dest[1][1] = 2 * nearPlane / height;
+	dest[1][2] = (top + bottom) / height;
+	dest[2][2] = q;
+	dest[2][3] = qn;
+	dest[3][2] = -1;
+}
+
+void
+NullRenderSystem::_makeOrthoMatrix(const Ogre::Radian &fovy, Ogre::Real aspect, Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4 &dest, bool forGpuProgram)
+{
+	Ogre::Real tanThetaY, tanThetaX, q;
+
+	tanThetaY = Ogre::Math::Tan(fovy / 2.0f);
+	tanThetaX = tanThetaY * aspect;
+	q = (farPlane == 0) ? 0 : 2.0f / (farPlane - nearPlane);
+	dest = Ogre::Matrix4::ZERO;
+	dest[0][0] = 1.0f / (tanThetaX * nearPlane);
+	dest[1][1] = 1.0f / (tanThetaY * nearPlane);
+	dest[2][2] = -q;
+	dest[2][3] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+	dest[3][3] = 1;
+}
+
+void
+NullRenderSystem::_applyObliqueDepthProjection(Ogre::Matrix4 &matrix, const Ogre::Plane &plane, bool forGpuProgram)
+{
+	Ogre::Vector4 q, clip, c;
+
+	q.x = (Ogre::Math::Sign(plane.normal.x) + matrix[0][2]) / matrix[0][0];
+	q.y = (Ogre::Math::Sign(plane.normal.y) + matrix[1][2]) / matrix[1][1];
+	q.z = -1.0f;
+	q.w = (1.0f + matrix[2][2]) / matrix[2][3];
+	clip = Ogre::Vector4(plane.normal.x, plane.normal.y, plane.normal.z, plane.d);
+	c = clip * (2.0f / clip.dotProduct(q));
+	matrix[2][0] = c.x;
+	matrix[2][1] = c.y;
+	matrix[2][2] = c.z + 1.0f;
+	matrix[2][3] = c.w;
+}
+
+Ogre::Real
+NullRenderSystem::getHorizontalTexelOffset(void)
+{
+	return 0.0f;
+}
+
+Ogre::Real
+NullRenderSystem::getVerticalTexelOffset(void)
+{
+	return 0.0f;
+}
+
+Ogre::Real
+NullRenderSystem::getMinimumDepthInputValue(void)
+{
+	return -1.0f;
+}
+
+Ogre::Real
+NullRenderSystem::getMaximumDepthInputValue(void)
+{
+	return 1.0f;
+}
+
+/* Render state */
+
+void
+NullRenderSystem::setAmbientLight(float r, float g, float b)
+{
+}
+
+void
+NullRenderSystem::setShadingType(Ogre::ShadeOptions so)
+{
+}
+
+void
+NullRenderSystem::setLightingEnabled(bool enabled)
+{
+}
+
+void
+NullRenderSystem::setNormaliseNormals(bool normalise)
+{
+}
+
+void
+NullRenderSystem::setStencilCheckEnabled(bool enabled)
+{
+}
+
+void
+NullRenderSystem::setStencilBufferParams(Ogre::CompareFunction func, Ogre::uint32 refValue, Ogre::uint32 compareMask, Ogre::uint32 writeMask, Ogre::StencilOperation stencilFailOp, Ogre::StencilOperation depthFailOp, Ogre::StencilOperation passOp, bool twoSidedOperation)
+{
+}
+
+void
+NullRenderSystem::setVertexDeclaration(Ogre::VertexDeclaration *decl)
+{
+}
+
+void
+NullRenderSystem::setVertexBufferBinding(Ogre::VertexBufferBinding *binding)
+{
+}
+
+void
+NullRenderSystem::setScissorTest(bool enabled, size_t left, size_t top, size_t right, size_t bottom)
+{
+}
+
+void
+NullRenderSystem::bindGpuProgramParameters(Ogre::GpuProgramType gptype, Ogre::GpuProgramParametersSharedPtr params, Ogre::uint16 variabilityMask)
+{
+}
+
+void
+NullRenderSystem::bindGpuProgramPassIterationParameters(Ogre::GpuProgramType gptype)
+{
+}
+
+void
+NullRenderSystem::_useLights(const Ogre::LightList &lights, unsigned short limit)
+{
+}
+
+void
+NullRenderSystem::_setWorldMatrix(const Ogre::Matrix4 &m)
+{
+}
+
+void
+NullRenderSystem::_setViewMatrix(const Ogre::Matrix4 &m)
+{
+}
+
+void
+NullRenderSystem::_setProjectionMatrix(const Ogre::Matrix4 &m)
+{
+}
+
+void
+NullRenderSystem::_setSurfaceParams(const Ogre::ColourValue &ambient, const Ogre::ColourValue &diffuse, const Ogre::ColourValue &specular, const Ogre::ColourValue &emissive, Ogre::Real shininess, Ogre::TrackVertexColourType tracking)
+{
+}
+
+void
+NullRenderSystem::_setPointSpritesEnabled(bool enabled)
+{
+}
+
+void
+NullRenderSystem::_setPointParameters(Ogre::Real size, bool attenuationEnabled, Ogre::Real constant, Ogre::Real linear, Ogre::Real quadratic, Ogre::Real minSize, Ogre::Real maxSize)
+{
+}
+
+void
+NullRenderSystem::_setTexture(size_t unit, bool enabled, const Ogre::TexturePtr &texPtr)
+{
+}
+
+void
+NullRenderSystem::_setTextureCoordSet(size_t unit, size_t index)
+{
+}
+
+void
+NullRenderSystem::_setTextureCoordCalculation(size_t unit, Ogre::TexCoordCalcMethod m, const Ogre::Frustum *frustum)
+{
+}
+
+void
+NullRenderSystem::_setTextureBlendMode(size_t unit, const Ogre::LayerBlendModeEx &bm)
+{
+}
+
+void
+NullRenderSystem::_setTextureUnitFiltering(size_t unit, Ogre::FilterType ftype, Ogre::FilterOptions filter)
+{
+}
+
+void
+NullRenderSystem::_setTextureUnitCompareEnabled(size_t unit, bool compare)
+{
+}
+
+void
+NullRenderSystem::_setTextureUnitCompareFunction(size_t unit, Ogre::CompareFunction function)
+{
+}
+
+void
+NullRenderSystem::_setTextureLayerAnisotropy(size_t unit, unsigned int maxAnisotropy)
+{
+}
+
+void
+NullRenderSystem::_setTextureAddressingMode(size_t unit, const Ogre::TextureUnitState::UVWAddressingMode &uvw)
+{
+}
+
+void
+NullRenderSystem::_setTextureBorderColour(size_t unit, const Ogre::ColourValue &colour)
+{
+}
+
+void
+NullRenderSystem::_setTextureMipmapBias(size_t unit, float bias)
+{
+}
+
+void
+NullRenderSystem::_setTextureMatrix(size_t unit, const Ogre::Matrix4 &xform)
+{
+}
+
+void
+NullRenderSystem::_setSceneBlending(Ogre::SceneBlendFactor sourceFactor, Ogre::SceneBlendFactor destFactor, Ogre::SceneBlendOperation op)
+{
+}
+
+void
+NullRenderSystem::_setSeparateSceneBlending(Ogre::SceneBlendFactor sourceFactor, Ogre::SceneBlendFactor destFactor, Ogre::SceneBlendFactor sourceFactorAlpha, Ogre::SceneBlendFactor destFactorAlpha, Ogre::SceneBlendOperation op, Ogre::SceneBlendOperation alphaOp)
+{
+}
+
+void
+NullRenderSystem::_setAlphaRejectSettings(Ogre::CompareFunction func, unsigned char value, bool alphaToCoverage)
+{
+}
+
+void
+NullRenderSystem::_setCullingMode(Ogre::CullingMode mode)
+{
+	mCullingMode = mode;
+}
+
+void
+NullRenderSystem::_setDepthBufferParams(bool depthTest, bool depthWrite, Ogre::CompareFunction depthFunction)
+{
+}
+
+void
+NullRenderSystem::_setDepthBufferCheckEnabled(bool enabled)
+{
+}
+
+void
+NullRenderSystem::_setDepthBufferWriteEnabled(bool enabled)
+{
+}
+
+void
+NullRenderSystem::_setDepthBufferFunction(Ogre::CompareFunction func)
+{
+}
+
+void
+NullRenderSystem::_setColourBufferWriteEnabled(bool red, bool green, bool blue, bool alpha)
+{
+}
+
+void
+NullRenderSystem::_setDepthBias(float constantBias, float slopeScaleBias)
+{
+}
+
+void
+NullRenderSystem::_setFog(Ogre::FogMode mode, const Ogre::ColourValue &colour, Ogre::Real expDensity, Ogre::Real linearStart, Ogre::Real linearEnd)
+{
+}
+
+void
+NullRenderSystem::_setPolygonMode(Ogre::PolygonMode level)
+{
+}
+
+void
+NullRenderSystem::setClipPlanesImpl(const Ogre::PlaneList &clipPlanes)
+{
+}
+
+/* Miscellany */
+
+Ogre::String
+NullRenderSystem::getErrorDescription(long errorNumber) const
+{
+	return Ogre::StringUtil::BLANK;
+}
+
+bool
+NullRenderSystem::hasAnisotropicMipMapFilter(void) const
+{
+	return false;
+}
+
+void
+NullRenderSystem::eventOccurred(const Ogre::String &eventName, const Ogre::NameValuePairList *parameters)
+{
+}
+
+void
+NullRenderSystem::preExtraThreadsStarted(void)
+{
+}
+
+void
+NullRenderSystem::postExtraThreadsStarted(void)
+{
+}
+
+void
+NullRenderSystem::registerThread(void)
+{
+}
+
+void
+NullRenderSystem::unregisterThread(void)
+{
+}
+
+void
+NullRenderSystem::beginProfileEvent(const Ogre::String &eventName)
+{
+}
+
+void
+NullRenderSystem::endProfileEvent(void)
+{
+}
+
+void
+NullRenderSystem::markProfileEvent(const Ogre::String &event)
+{
+}
+
+/* NullRenderWindow */
+
+NullRenderWindow::NullRenderWindow():
+	Ogre::RenderWindow(),
+	m_closed(true)
+{
+}
+
+NullRenderWindow::~NullRenderWindow()
+{
+	destroy();
+}
+
+void
+NullRenderWindow::create(const Ogre::String &name, unsigned int width, unsigned int height, bool fullScreen, const Ogre::NameValuePairList *miscParams)
+{
+	mName = name;
+	mWidth = width;
+	mHeight = height;
+	mColourDepth = 32;
+	mLeft = 0;
+	mTop = 0;
+	mIsFullScreen = fullScreen;
+	mActive = true;
+	m_closed = false;
+}
+
+void
+NullRenderWindow::destroy(void)
+{
+	mActive = false;
+	m_closed = true;
+}
+
+void
+NullRenderWindow::resize(unsigned int width, unsigned int height)
+{
+	ViewportList::iterator it;
+
+	mWidth = width;
+	mHeight = height;
+	for(it = mViewportList.begin(); it != mViewportList.end(); it++)
+	{
+		it->second->_updateDimensions();
+	}
+}
+
+void
+NullRenderWindow::reposition(int left, int top)
+{
+	mLeft = left;
+	mTop = top;
+}
+
+bool
+NullRenderWindow::isClosed(void) const
+{
+	return m_closed;
+}
+
+/* Nothing has been drawn, so the window's contents are always black */
+void
+NullRenderWindow::copyContentsToMemory(const Ogre::PixelBox &dst, FrameBuffer buffer)
+{
+	size_t y, z, row;
+	Ogre::uint8 *p;
+
+	row = dst.getWidth() * Ogre::PixelUtil::getNumElemBytes(dst.format);
+	for(z = dst.front; z < dst.back; z++)
+	{
+		for(y = dst.top; y < dst.bottom; y++)
+		{
+			p = static_cast<Ogre::uint8 *>(dst.data) + (z * dst.slicePitch + y * dst.rowPitch + dst.left) * Ogre::PixelUtil::getNumElemBytes(dst.format);
+			memset(p, 0, row);
+		}
+	}
+}
+
+bool
+NullRenderWindow::requiresTextureFlipping(void) const
+{
+	return false;
+}
+
+/* NullPixelBuffer */
+
+NullPixelBuffer::NullPixelBuffer(Ogre::uint32 width, Ogre::uint32 height, Ogre::uint32 depth, Ogre::PixelFormat format, Ogre::HardwareBuffer::Usage usage):
+	Ogre::HardwarePixelBuffer(width, height, depth, format, usage, true, false),
+	m_data(NULL)
+{
+	/* The base class doesn't account for compressed formats */
+	mSizeInBytes = Ogre::PixelUtil::getMemorySize(width, height, depth, format);
+	m_data = new Ogre::uint8[mSizeInBytes]();
+}
+
+NullPixelBuffer::~NullPixelBuffer()
+{
+	delete [] m_data;
+}
+
+Ogre::PixelBox
+NullPixelBuffer::contents(void) const
+{
+	return Ogre::PixelBox(mWidth, mHeight, mDepth, mFormat, m_data);
+}
+
+Ogre::PixelBox
+NullPixelBuffer::lockImpl(const Ogre::Image::Box lockBox, LockOptions options)
+{
+	return contents().getSubVolume(lockBox);
+}
+
+void
+NullPixelBuffer::unlockImpl(void)
+{
+}
+
+void
+NullPixelBuffer::blitFromMemory(const Ogre::PixelBox &src, const Ogre::Image::Box &dstBox)
+{
+	Ogre::PixelBox dst;
+
+	dst = contents().getSubVolume(dstBox);
+	if(src.getWidth() != dst.getWidth() || src.getHeight() != dst.getHeight() || src.getDepth() != dst.getDepth())
+	{
+		Ogre::Image::scale(src, dst);
+	}
+	else
+	{
+		Ogre::PixelUtil::bulkPixelConversion(src, dst);
+	}
+}
+
+void
+NullPixelBuffer::blitToMemory(const Ogre::Image::Box &srcBox, const Ogre::PixelBox &dst)
+{
+	Ogre::PixelBox src;
+
+	src = contents().getSubVolume(srcBox);
+	if(src.getWidth() != dst.getWidth() || src.getHeight() != dst.getHeight() || src.getDepth() != dst.getDepth())
+	{
+		Ogre::Image::scale(src, dst);
+	}
+	else
+	{
+		Ogre::PixelUtil::bulkPixelConversion(src, dst);
+	}
+}
+
+/* NullTexture */
+
+NullTexture::NullTexture(Ogre::ResourceManager *creator, const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader):
+	Ogre::Texture(creator, name, handle, group, isManual, loader)
+{
+}
+
+NullTexture::~NullTexture()
+{
+	/* This can't be left to Resource's destructor, as the virtual methods
+	 * which it would call are no longer ours by then
+	 */
+	if(isLoaded())
+	{
+		unload();
+	}
+	else
+	{
+		freeInternalResources();
+	}
+}
+
+Ogre::HardwarePixelBufferSharedPtr
+NullTexture::getBuffer(size_t face, size_t mipmap)
+{
+	if(face >= getNumFaces())
+	{
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Face index out of range", "NullTexture::getBuffer");
+	}
+	if(mipmap > mNumMipmaps)
+	{
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Mipmap index out of range", "NullTexture::getBuffer");
+	}
+	return m_surfaces[face * (mNumMipmaps + 1) + mipmap];
+}
+
+/* Textures are loaded from their images in the same way as they are by the
+ * GL render system: a cube map is either a single DDS file, or six images
+ * with a suffix for each face.
+ */
+void
+NullTexture::loadImpl(void)
+{
+	static const char *faces[6] = { "_rt", "_lf", "_up", "_dn", "_fr", "_bk" };
+	std::vector<Ogre::Image> images;
+	Ogre::ConstImagePtrList imagePtrs;
+	Ogre::String base, ext, name;
+	size_t pos, c;
+
+	if(mUsage & Ogre::TU_RENDERTARGET)
+	{
+		createInternalResources();
+		return;
+	}
+	pos = mName.find_last_of(".");
+	base = mName.substr(0, pos);
+	if(pos != Ogre::String::npos)
+	{
+		ext = mName.substr(pos + 1);
+	}
+	if(mTextureType == Ogre::TEX_TYPE_CUBE_MAP && getSourceFileType() != "dds")
+	{
+		images.resize(6);
+		for(c = 0; c < 6; c++)
+		{
+			name = base + faces[c];
+			if(!ext.empty())
+			{
+				name += "." + ext;
+			}
+			readImage(name, ext, images[c]);
+		}
+	}
+	else
+	{
+		images.resize(1);
+		readImage(mName, ext, images[0]);
+		if(images[0].hasFlag(Ogre::IF_CUBEMAP))
+		{
+			mTextureType = Ogre::TEX_TYPE_CUBE_MAP;
+		}
+		if(images[0].getDepth() > 1 && mTextureType != Ogre::TEX_TYPE_2D_ARRAY)
+		{
+			mTextureType = Ogre::TEX_TYPE_3D;
+		}
+	}
+	for(c = 0; c < images.size(); c++)
+	{
+		imagePtrs.push_back(&images[c]);
+	}
+	_loadImages(imagePtrs);
+}
+
+void
+NullTexture::readImage(const Ogre::String &name, const Ogre::String &ext, Ogre::Image &image)
+{
+	Ogre::DataStreamPtr stream;
+
+	stream = Ogre::ResourceGroupManager::getSingleton().openResource(name, mGroup, true, this);
+	image.load(stream, ext);
+}
+
+/* Every face and mipmap level of the texture is given a surface in memory;
+ * mipmaps which Ogre would expect the hardware to generate are left blank.
+ */
+void
+NullTexture::createInternalResourcesImpl(void)
+{
+	Ogre::uint32 width, height, depth;
+	size_t face, mip, maxMips;
+
+	mFormat = Ogre::TextureManager::getSingleton().getNativeFormat(mTextureType, mFormat, mUsage);
+	maxMips = 0;
+	for(width = mWidth, height = mHeight, depth = mDepth; width > 1 || height > 1 || depth > 1; maxMips++)
+	{
+		width = std::max<Ogre::uint32>(1, width / 2);
+		height = std::max<Ogre::uint32>(1, height / 2);
+		depth = std::max<Ogre::uint32>(1, depth / 2);
+	}
+	mNumMipmaps = std::min<size_t>(mNumRequestedMipmaps, maxMips);
+	mMipmapsHardwareGenerated = true;
+	m_surfaces.clear();
+	for(face = 0; face < getNumFaces(); face++)
+	{
+		width = mWidth;
+		height = mHeight;
+		depth = mDepth;
+		for(mip = 0; mip <= mNumMipmaps; mip++)
+		{
+			m_surfaces.push_back(Ogre::HardwarePixelBufferSharedPtr(new NullPixelBuffer(width, height, depth, mFormat, static_cast<Ogre::HardwareBuffer::Usage>(mUsage))));
+			width = std::max<Ogre::uint32>(1, width / 2);
+			height = std::max<Ogre::uint32>(1, height / 2);
+			depth = std::max<Ogre::uint32>(1, depth / 2);
+		}
+	}
+}
+
+void
+NullTexture::freeInternalResourcesImpl(void)
+{
+	m_surfaces.clear();
+}
+
+/* NullTextureManager */
+
+NullTextureManager::NullTextureManager():
+	Ogre::TextureManager()
+{
+	Ogre::ResourceGroupManager::getSingleton()._registerResourceManager(mResourceType, this);
+}
+
+NullTextureManager::~NullTextureManager()
+{
+	Ogre::ResourceGroupManager::getSingleton()._unregisterResourceManager(mResourceType);
+}
+
+Ogre::Resource *
+NullTextureManager::createImpl(const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader, const Ogre::NameValuePairList *createParams)
+{
+	return new NullTexture(this, name, handle, group, isManual, loader);
+}
+
+/* Any format can be held in memory */
+Ogre::PixelFormat
+NullTextureManager::getNativeFormat(Ogre::TextureType ttype, Ogre::PixelFormat format, int usage)
+{
+	if(format == Ogre::PF_UNKNOWN)
+	{
+		return Ogre::PF_A8R8G8B8;
+	}
+	return format;
+}
+
+bool
+NullTextureManager::isHardwareFilteringSupported(Ogre::TextureType ttype, Ogre::PixelFormat format, int usage, bool preciseFormatOnly)
+{
+	return true;
+}
+
+/* NullGpuProgram */
+
+NullGpuProgram::NullGpuProgram(Ogre::ResourceManager *creator, const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader):
+	Ogre::GpuProgram(creator, name, handle, group, isManual, loader)
+{
+	if(createParamDictionary("NullGpuProgram"))
+	{
+		setupBaseParamDictionary();
+	}
+}
+
+NullGpuProgram::~NullGpuProgram()
+{
+	unload();
+}
+
+void
+NullGpuProgram::loadFromSource(void)
+{
+}
+
+void
+NullGpuProgram::unloadImpl(void)
+{
+}
+
+/* NullGpuProgramManager */
+
+NullGpuProgramManager::NullGpuProgramManager():
+	Ogre::GpuProgramManager()
+{
+	Ogre::ResourceGroupManager::getSingleton()._registerResourceManager(mResourceType, this);
+}
+
+NullGpuProgramManager::~NullGpuProgramManager()
+{
+	Ogre::ResourceGroupManager::getSingleton()._unregisterResourceManager(mResourceType);
+}
+
+/* The program's type and syntax are applied from the parameters by
+ * ResourceManager::createResource() once it's been created
+ */
+Ogre::Resource *
+NullGpuProgramManager::createImpl(const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader, const Ogre::NameValuePairList *params)
+{
+	return new NullGpuProgram(this, name, handle, group, isManual, loader);
+}
+
+Ogre::Resource *
+NullGpuProgramManager::createImpl(const Ogre::String &name, Ogre::ResourceHandle handle, const Ogre::String &group, bool isManual, Ogre::ManualResourceLoader *loader, Ogre::GpuProgramType gptype, const Ogre::String &syntaxCode)
+{
+	NullGpuProgram *program;
+
+	program = new NullGpuProgram(this, name, handle, group, isManual, loader);
+	program->setType(gptype);
+	program->setSyntaxCode(syntaxCode);
+	return program;
+}
+
+/* NullOcclusionQuery */
+
+NullOcclusionQuery::NullOcclusionQuery():
+	Ogre::HardwareOcclusionQuery()
+{
+}
+
+NullOcclusionQuery::~NullOcclusionQuery()
+{
+}
+
+void
+NullOcclusionQuery::beginOcclusionQuery(void)
+{
+}
+
+void
+NullOcclusionQuery::endOcclusionQuery(void)
+{
+}
+
+bool
+NullOcclusionQuery::pullOcclusionQuery(unsigned int *NumOfFragments)
+{
+	mPixelCount = 1;
+	*NumOfFragments = 1;
+	return true;
+}
+
+bool
+NullOcclusionQuery::isStillOutstanding(void)
+{
+	return false;
+}
+
+/* NullRenderPlugin */
+
+NullRenderPlugin::NullRenderPlugin():
+	m_renderSystem(NULL)
+{
+}
+
+NullRenderPlugin::~NullRenderPlugin()
+{
+	delete m_renderSystem;
+}
+
+const Ogre::String &
+NullRenderPlugin::getName(void) const
+{
+	static Ogre::String name(NULLRENDER_PLUGIN_NAME);
+
+	return name;
+}
+
+void
+NullRenderPlugin::install(void)
+{
+	m_renderSystem = new NullRenderSystem();
+	Ogre::Root::getSingleton().addRenderSystem(m_renderSystem);
+}
+
+void
+NullRenderPlugin::initialise(void)
+{
+}
+
+void
+NullRenderPlugin::shutdown(void)
+{
+}
+
+void
+NullRenderPlugin::uninstall(void)
+{
+	delete m_renderSystem;
+	m_renderSystem = NULL;
+}
@@ -0,0 +1,336 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <OGRE/OgreDataStream.h>
+#include <OGRE/OgreException.h>
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreStringConverter.h>
+
+#include "jyuzau/packarchive.hh"
+#include "jyuzau/packed.hh"
+
+using namespace Jyuzau;
+
+/* PackArchive */
+
+PackArchive::PackArchive(const Ogre::String &name, const PackedArchive *pack):
+	Ogre::Archive(name, PACK_ARCHIVE_TYPE),
+	m_pack(pack)
+{
+}
+
+PackArchive::~PackArchive()
+{
+	unload();
+}
+
+bool
+PackArchive::isCaseSensitive(void) const
+{
+	return true;
+}
+
+/* Build the listing of the directory from the adjacent entries of the
+ * archive's index which lie within it
+ */
+void
+PackArchive::load(void)
+{
+	const PackedEntry *entry;
+	Ogre::FileInfo info;
+	Ogre::String name;
+	uint32_t c;
+	size_t slash;
+
+	m_files.clear();
+	if(!m_pack->relative(mName, m_prefix))
+	{
+		return;
+	}
+	m_prefix += "/";
+	for(c = m_pack->lowerBound(m_prefix); c < m_pack->entries(); c++)
+	{
+		entry = m_pack->entry(c);
+		name = m_pack->name(entry);
+		if(name.compare(0, m_prefix.length(), m_prefix))
+		{
+			break;
+		}
+		info.archive = this;
+		info.filename = name.substr(m_prefix.length());
+		slash = info.filename.rfind('/');
+		if(slash == Ogre::String::npos)
+		{
+			info.path = "";
+			info.basename = info.filename;
+		}
+		else
+		{
+			info.path = info.filename.substr(0, slash + 1);
+			info.basename = info.filename.substr(slash + 1);
+		}
+		info.compressedSize = info.uncompressedSize = entry->length;
+		m_files.push_back(info);
+	}
+}
+
+void
+PackArchive::unload(void)
+{
+	m_files.clear();
+}
+
+/* Open a file as a stream over the mapped archive; nothing is read until
+ * the stream is
+ */
+Ogre::DataStreamPtr
+PackArchive::open(const Ogre::String &filename, bool readOnly) const
+{
+	const PackedEntry *entry;
+
+	entry = m_pack->find(m_pack->root() + m_prefix + filename);
+	if(!entry)
+	{
+		OGRE_EXCEPT(Ogre::Exception::ERR_FILE_NOT_FOUND, "Cannot open file: " + filename, "PackArchive::open");
+	}
+	return Ogre::DataStreamPtr(OGRE_NEW Ogre::MemoryDataStream(filename, const_cast<void *>(m_pack->data(entry)), entry->length, false, true));
+}
+
+Ogre::StringVectorPtr
+PackArchive::list(bool recursive, bool dirs)
+{
+	Ogre::StringVectorPtr ret(OGRE_NEW_T(Ogre::StringVector, Ogre::MEMCATEGORY_GENERAL)(), Ogre::SPFM_DELETE_T);
+	Ogre::FileInfoList::const_iterator it;
+
+	/* Directories have no entries of their own, and so are never listed */
+	if(dirs)
+	{
+		return ret;
+	}
+	for(it = m_files.begin(); it != m_files.end(); it++)
+	{
+		if(recursive || !it->path.length())
+		{
+			ret->push_back(it->filename);
+		}
+	}
+	return ret;
+}
+
+Ogre::FileInfoListPtr
+PackArchive::listFileInfo(bool recursive, bool dirs)
+{
+	Ogre::FileInfoListPtr ret(OGRE_NEW_T(Ogre::FileInfoList, Ogre::MEMCATEGORY_GENERAL)(), Ogre::SPFM_DELETE_T);
+	Ogre::FileInfoList::const_iterator it;
+
+	if(dirs)
+	{
+		return ret;
+	}
+	for(it = m_files.begin(); it != m_files.end(); it++)
+	{
+		if(recursive || !it->path.length())
+		{
+			ret->push_back(*it);
+		}
+	}
+	return ret;
+}
+
+/* Patterns are matched in the same way as by Ogre's ZipArchive: against the
+ * whole name if the pattern contains a directory, and otherwise against
+ * the base name
+ */
+Ogre::StringVectorPtr
+PackArchive::find(const Ogre::String &pattern, bool recursive, bool dirs)
+{
+	Ogre::StringVectorPtr ret(OGRE_NEW_T(Ogre::StringVector, Ogre::MEMCATEGORY_GENERAL)(), Ogre::SPFM_DELETE_T);
+	Ogre::FileInfoListPtr info;
+	Ogre::FileInfoList::const_iterator it;
+
+	info = findFileInfo(pattern, recursive, dirs);
+	for(it = info->begin(); it != info->end(); it++)
+	{
+		ret->push_back(it->filename);
+	}
+	return ret;
+}
+
+Ogre::FileInfoListPtr
+PackArchive::findFileInfo(const Ogre::String &pattern, bool recursive, bool dirs) const
+{
+	Ogre::FileInfoListPtr ret(OGRE_NEW_T(Ogre::FileInfoList, Ogre::MEMCATEGORY_GENERAL)(), Ogre::SPFM_DELETE_T);
+	Ogre::FileInfoList::const_iterator it;
+	bool full;
+
+	if(dirs)
+	{
+		return ret;
+	}
+	full = (pattern.find('/') != Ogre::String::npos);
+	for(it = m_files.begin(); it != m_files.end(); it++)
+	{
+		if((recursive || full || !it->path.length()) && Ogre::StringUtil::match(full ? it->filename : it->basename, pattern, true))
+		{
+			ret->push_back(*it);
+		}
+	}
+	return ret;
+}
+
+bool
+PackArchive::exists(const Ogre::String &filename)
+{
+	return m_pack->find(m_pack->root() + m_prefix + filename) != NULL;
+}
+
+time_t
+PackArchive::getModifiedTime(const Ogre::String &filename)
+{
+	const PackedEntry *entry;
+
+	entry = m_pack->find(m_pack->root() + m_prefix + filename);
+	return (entry ? (time_t) entry->mtime : 0);
+}
+
+/* PackArchiveFactory */
+
+PackArchiveFactory::PackArchiveFactory()
+{
+}
+
+/* Ogre::Root must have been destroyed first, along with the PackArchives
+ * which refer to the mounted archives
+ */
+PackArchiveFactory::~PackArchiveFactory()
+{
+	std::vector<PackedArchive *>::iterator it;
+
+	for(it = m_packs.begin(); it != m_packs.end(); it++)
+	{
+		delete *it;
+	}
+}
+
+/* Map a packed archive; paths beneath root are looked up in it. Archives
+ * mounted earlier take precedence over those mounted later.
+ */
+bool
+PackArchiveFactory::mount(const Ogre::String &path, const Ogre::String &root)
+{
+	PackedArchive *pack;
+
+	pack = new PackedArchive();
+	if(!pack->open(path, root))
+	{
+		delete pack;
+		return false;
+	}
+	m_packs.push_back(pack);
+	Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: mounted " + Ogre::StringConverter::toString(pack->entries()) + " files from " + path);
+	return true;
+}
+
+size_t
+PackArchiveFactory::mounted(void) const
+{
+	return m_packs.size();
+}
+
+/* Returns true if a directory lies within a mounted archive, and so can be
+ * added as a PACK_ARCHIVE_TYPE resource location
+ */
+bool
+PackArchiveFactory::contains(const Ogre::String &directory) const
+{
+	return PackArchiveFactory::directory(directory) != NULL;
+}
+
+/* Obtain the contents of a file from the mounted archives; the data remains
+ * valid for as long as the factory exists
+ */
+bool
+PackArchiveFactory::read(const Ogre::String &path, const void *&data, size_t &length) const
+{
+	std::vector<PackedArchive *>::const_iterator it;
+	const PackedEntry *entry;
+
+	for(it = m_packs.begin(); it != m_packs.end(); it++)
+	{
+		entry = (*it)->find(path);
+		if(entry)
+		{
+			data = (*it)->data(entry);
+			length = entry->length;
+			return true;
+		}
+	}
+	return false;
+}
+
+const Ogre::String &
+PackArchiveFactory::getType(void) const
+{
+	static const Ogre::String type(PACK_ARCHIVE_TYPE);
+
+	return type;
+}
+
+Ogre::Archive *
+PackArchiveFactory::createInstance(const Ogre::String &name, bool readOnly)
+{
+	const PackedArchive *pack;
+
+	pack = directory(name);
+	if(!readOnly || !pack)
+	{
+		OGRE_EXCEPT(Ogre::Exception::ERR_FILE_NOT_FOUND, "No mounted archive contains " + name, "PackArchiveFactory::createInstance");
+	}
+	return OGRE_NEW PackArchive(name, pack);
+}
+
+void
+PackArchiveFactory::destroyInstance(Ogre::Archive *archive)
+{
+	OGRE_DELETE archive;
+}
+
+/* Return the first mounted archive with any files within a directory */
+const PackedArchive *
+PackArchiveFactory::directory(const Ogre::String &directory) const
+{
+	std::vector<PackedArchive *>::const_iterator it;
+	Ogre::String prefix;
+	uint32_t index;
+
+	for(it = m_packs.begin(); it != m_packs.end(); it++)
+	{
+		if(!(*it)->relative(directory, prefix))
+		{
+			continue;
+		}
+		prefix += "/";
+		index = (*it)->lowerBound(prefix);
+		if(index < (*it)->entries() && !Ogre::String((*it)->name((*it)->entry(index))).compare(0, prefix.length(), prefix))
+		{
+			return *it;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,273 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+#endif
+
+#include "jyuzau/packed.hh"
+
+using namespace Jyuzau;
+
+PackedArchive::PackedArchive():
+	m_base(NULL),
+	m_len(0),
+	m_mapped(false),
+	m_header(NULL),
+	m_entries(NULL),
+	m_names(NULL)
+{
+}
+
+PackedArchive::~PackedArchive()
+{
+	close();
+}
+
+/* Map (or, where mmap() is unavailable, read) a packed archive and validate
+ * it; the file itself is opened just this once.
+ */
+bool
+PackedArchive::open(const std::string &path, const std::string &root)
+{
+	close();
+#ifdef HAVE_SYS_MMAN_H
+	int fd;
+	struct stat sb;
+	void *p;
+
+	fd = ::open(path.c_str(), O_RDONLY);
+	if(fd == -1)
+	{
+		return false;
+	}
+	if(fstat(fd, &sb) || sb.st_size < (off_t) sizeof(PackedHeader))
+	{
+		::close(fd);
+		return false;
+	}
+	p = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		return false;
+	}
+	m_base = (unsigned char *) p;
+	m_len = sb.st_size;
+	m_mapped = true;
+#else
+	FILE *f;
+	long size;
+
+	f = fopen(path.c_str(), "rb");
+	if(!f)
+	{
+		return false;
+	}
+	if(fseek(f, 0, SEEK_END) || (size = ftell(f)) < (long) sizeof(PackedHeader) || fseek(f, 0, SEEK_SET))
+	{
+		fclose(f);
+		return false;
+	}
+	m_base = (unsigned char *) malloc(size);
+	if(!m_base || fread(m_base, size, 1, f) != 1)
+	{
+		fclose(f);
+		close();
+		return false;
+	}
+	fclose(f);
+	m_len = size;
+#endif
+	if(!validate())
+	{
+		close();
+		return false;
+	}
+	m_path = path;
+	m_root = root;
+	return true;
+}
+
+void
+PackedArchive::close(void)
+{
+	if(m_base)
+	{
+#ifdef HAVE_SYS_MMAN_H
+		if(m_mapped)
+		{
+			munmap(m_base, m_len);
+		}
+		else
+#endif
+		{
+			free(m_base);
+		}
+	}
+	m_path.clear();
+	m_root.clear();
+	m_base = NULL;
+	m_len = 0;
+	m_mapped = false;
+	m_header = NULL;
+	m_entries = NULL;
+	m_names = NULL;
+}
+
+const std::string &
+PackedArchive::path(void) const
+{
+	return m_path;
+}
+
+const std::string &
+PackedArchive::root(void) const
+{
+	return m_root;
+}
+
+uint32_t
+PackedArchive::entries(void) const
+{
+	return (m_header ? m_header->nentries : 0);
+}
+
+const PackedEntry *
+PackedArchive::entry(uint32_t index) const
+{
+	return &(m_entries[index]);
+}
+
+const char *
+PackedArchive::name(const PackedEntry *entry) const
+{
+	return m_names + entry->name;
+}
+
+const void *
+PackedArchive::data(const PackedEntry *entry) const
+{
+	return m_base + entry->offset;
+}
+
+/* Find a file by its path (including the root at which the archive is
+ * mounted); returns NULL if the archive doesn't contain it.
+ */
+const PackedEntry *
+PackedArchive::find(const std::string &path) const
+{
+	std::string name;
+	uint32_t index;
+
+	if(!relative(path, name))
+	{
+		return NULL;
+	}
+	index = lowerBound(name);
+	if(index < entries() && !name.compare(m_names + m_entries[index].name))
+	{
+		return &(m_entries[index]);
+	}
+	return NULL;
+}
+
+/* Return the index of the first entry whose name is not less than the
+ * prefix (relative to the root); the entries within a directory begin at
+ * lowerBound(directory + "/").
+ */
+uint32_t
+PackedArchive::lowerBound(const std::string &prefix) const
+{
+	uint32_t lo, hi, mid;
+
+	lo = 0;
+	hi = entries();
+	while(lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if(prefix.compare(m_names + m_entries[mid].name) > 0)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* Strip the root from a path, returning false if the path lies outside it */
+bool
+PackedArchive::relative(const std::string &path, std::string &name) const
+{
+	if(path.compare(0, m_root.length(), m_root))
+	{
+		return false;
+	}
+	name = path.substr(m_root.length());
+	return true;
+}
+
+/* Check that the archive is one we understand, and that every offset within
+ * it is in bounds, so that the accessors need not do so; the index must be
+ * sorted for find() to work.
+ */
+bool
+PackedArchive::validate(void)
+{
+	const PackedHeader *h;
+	const PackedEntry *e;
+	uint32_t c;
+
+	h = (const PackedHeader *) m_base;
+	if(memcmp(h->magic, PACKED_MAGIC, 4) || h->byteorder != PACKED_BYTEORDER || h->version != PACKED_VERSION)
+	{
+		return false;
+	}
+	if((h->entries % 8) || h->entries < sizeof(PackedHeader) || h->entries + (uint64_t) h->nentries * sizeof(PackedEntry) > m_len ||
+	   !h->nameslen || h->names + (uint64_t) h->nameslen > m_len || m_base[h->names + h->nameslen - 1])
+	{
+		return false;
+	}
+	m_entries = (const PackedEntry *) (m_base + h->entries);
+	m_names = (const char *) (m_base + h->names);
+	for(c = 0; c < h->nentries; c++)
+	{
+		e = &(m_entries[c]);
+		if(e->name >= h->nameslen || (uint64_t) e->name + e->namelen >= h->nameslen || m_names[e->name + e->namelen] ||
+		   e->offset > m_len || e->length > m_len - e->offset ||
+		   (c && strcmp(m_names + m_entries[c - 1].name, m_names + e->name) >= 0))
+		{
+			return false;
+		}
+	}
+	m_header = h;
+	return true;
+}
@@ -0,0 +1,246 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cstring>
+
+#include "jyuzau/physicsthread.hh"
+#include "jyuzau/prop.hh"
+#include "jyuzau/core.hh"
+#include "jyuzau/trace.hh"
+
+#include <OGRE/OgreLogManager.h>
+
+using namespace Jyuzau;
+
+/* Set in m_ready when the frame it refers to hasn't been read yet */
+#define FRAME_FRESH                    4
+
+PhysicsThread::PhysicsThread(PhysicsWorld *world, int tickRate, int maxSubsteps):
+	m_world(world),
+	m_dynamics(world->dynamics()),
+	m_tick(btScalar(1) / tickRate),
+	m_maxSubsteps(maxSubsteps),
+	m_stop(false),
+	m_running(false),
+	m_generation(0),
+	m_ticks(0),
+	m_dropped(0),
+	m_write(0),
+	m_read(1),
+	m_ready(2)
+{
+	int c;
+
+	for(c = 0; c < 3; c++)
+	{
+		m_frames[c].generation = 0;
+		m_frames[c].ticks = 0;
+		m_frames[c].time = 0;
+		m_frames[c].dropped = 0;
+		memset(&(m_frames[c].broadphase), 0, sizeof(m_frames[c].broadphase));
+	}
+}
+
+PhysicsThread::~PhysicsThread()
+{
+	stop();
+}
+
+bool
+PhysicsThread::start(void)
+{
+	if(m_running)
+	{
+		return true;
+	}
+	m_stop = false;
+	try
+	{
+		m_thread = std::thread(&PhysicsThread::run, this);
+	}
+	catch(std::system_error &e)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to start physics thread: " + Ogre::String(e.what()));
+		return false;
+	}
+	m_running = true;
+	return true;
+}
+
+/* Stop the thread, waiting for it to finish any batch in progress; this must
+ * not be called with the lock held.
+ */
+void
+PhysicsThread::stop(void)
+{
+	if(!m_running)
+	{
+		return;
+	}
+	m_stop = true;
+	m_thread.join();
+	m_running = false;
+}
+
+bool
+PhysicsThread::running(void) const
+{
+	return m_running;
+}
+
+btScalar
+PhysicsThread::tickLength(void) const
+{
+	return m_tick;
+}
+
+void
+PhysicsThread::lock(void)
+{
+	m_mutex.lock();
+}
+
+void
+PhysicsThread::unlock(void)
+{
+	m_mutex.unlock();
+}
+
+/* Invoked, with the lock held, whenever a body is removed from the world:
+ * frames published before then may refer to props which no longer exist,
+ * and so will be rejected by current().
+ */
+void
+PhysicsThread::invalidate(void)
+{
+	m_generation++;
+}
+
+/* Swap the most recently published frame (if it hasn't already been read)
+ * to the front, returning true if there was one.
+ */
+bool
+PhysicsThread::acquire(void)
+{
+	if(!(m_ready.load() & FRAME_FRESH))
+	{
+		return false;
+	}
+	m_read = m_ready.exchange(m_read) & ~FRAME_FRESH;
+	return true;
+}
+
+const PhysicsFrame &
+PhysicsThread::front(void) const
+{
+	return m_frames[m_read];
+}
+
+/* Returns true if the props referred to by the front frame are all still
+ * in the world. Only the render thread ever changes m_generation, so it
+ * can safely be read here without the lock.
+ */
+bool
+PhysicsThread::current(void) const
+{
+	return m_frames[m_read].ticks && m_frames[m_read].generation == m_generation;
+}
+
+/* The thread body: run as many ticks as are due (up to m_maxSubsteps, any
+ * further backlog being dropped), publish the results, and sleep until the
+ * next tick is due.
+ */
+void
+PhysicsThread::run(void)
+{
+	std::chrono::steady_clock::time_point next, now, began;
+	std::chrono::steady_clock::duration tick;
+	Tracer *tracer;
+	int steps;
+
+	tracer = Core::getInstance() ? Core::getInstance()->tracer() : NULL;
+	if(tracer)
+	{
+		tracer->nameThread("physics");
+	}
+	tick = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_tick));
+	next = std::chrono::steady_clock::now() + tick;
+	while(!m_stop)
+	{
+		now = std::chrono::steady_clock::now();
+		if(now < next)
+		{
+			std::this_thread::sleep_until(next);
+			continue;
+		}
+		lock();
+		{
+			TraceScope scope(tracer, "PhysicsThread::step");
+
+			began = std::chrono::steady_clock::now();
+			for(steps = 0; next <= now && steps < m_maxSubsteps; steps++)
+			{
+				/* As in State::updatePhysics(), each call is exactly one tick */
+				m_dynamics->stepSimulation(m_tick, 0);
+				next += tick;
+				m_ticks++;
+			}
+			if(next <= now)
+			{
+				m_dropped += std::chrono::duration<float>(now - next).count();
+				next = now + tick;
+			}
+			publish(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - began).count());
+		}
+		unlock();
+	}
+}
+
+/* Record the transform of every moving prop in the write frame and then
+ * exchange it for the ready frame; invoked with the lock held.
+ */
+void
+PhysicsThread::publish(float time)
+{
+	btCollisionObjectArray &objects = m_dynamics->getCollisionObjectArray();
+	PhysicsFrame &frame = m_frames[m_write];
+	PhysicsTransform entry;
+	btRigidBody *body;
+	int c;
+
+	frame.transforms.resize(0);
+	for(c = 0; c < objects.size(); c++)
+	{
+		body = btRigidBody::upcast(objects[c]);
+		if(!body || body->isStaticOrKinematicObject() || !body->getUserPointer())
+		{
+			continue;
+		}
+		entry.prop = static_cast<Prop *>(body->getUserPointer());
+		entry.transform = body->getWorldTransform();
+		frame.transforms.push_back(entry);
+	}
+	frame.generation = m_generation;
+	frame.ticks = m_ticks;
+	frame.time = time;
+	frame.dropped = m_dropped;
+	frame.broadphase = m_world->broadphaseStats();
+	frame.published = std::chrono::steady_clock::now();
+	m_write = m_ready.exchange(m_write | FRAME_FRESH) & ~FRAME_FRESH;
+}
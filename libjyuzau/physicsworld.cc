@@ -0,0 +1,295 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <atomic>
+#include <cstring>
+#include <chrono>
+#include <utility>
+
+#include "jyuzau/physicsworld.hh"
+
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <BulletCollision/CollisionDispatch/btSimulationIslandManager.h>
+#include <BulletMultiThreaded/SpuGatheringCollisionDispatcher.h>
+#include <BulletMultiThreaded/SpuNarrowPhaseCollisionTask/SpuGatheringCollisionTask.h>
+#include <BulletMultiThreaded/btParallelConstraintSolver.h>
+#ifdef _WIN32
+# include <BulletMultiThreaded/Win32ThreadSupport.h>
+#elif defined(USE_PTHREADS)
+# include <BulletMultiThreaded/PosixThreadSupport.h>
+#endif
+
+using namespace Jyuzau;
+
+/* The collision tasks' local storage is shared by every dispatcher in the
+ * process, and so can only be released once the last of them has gone;
+ * worlds may be created by LoadQueue workers, so the count is atomic.
+ */
+static std::atomic<int> collisionThreadPools(0);
+
+/* Create a pool of worker threads, or return NULL if threads aren't
+ * supported on this platform.
+ */
+static btThreadSupportInterface *
+createThreadSupport(const char *name, void (*func)(void *, void *), void *(*lsMemory)(void), int threads)
+{
+#ifdef _WIN32
+	Win32ThreadSupport *support;
+
+	support = new Win32ThreadSupport(Win32ThreadSupport::Win32ThreadConstructionInfo(name, func, lsMemory, threads));
+	support->startSPU();
+	return support;
+#elif defined(USE_PTHREADS)
+	PosixThreadSupport::ThreadConstructionInfo info(name, func, lsMemory, threads);
+
+	return new PosixThreadSupport(info);
+#else
+	return NULL;
+#endif
+}
+
+/* A collision dispatcher which gives each new contact manifold the
+ * configured breaking threshold, in place of the one Bullet derives from
+ * the global gContactBreakingThreshold
+ */
+template<class Dispatcher>
+class BreakingDispatcher: public Dispatcher
+{
+public:
+	template<typename... Args>
+	BreakingDispatcher(btScalar breaking, Args&&... args):
+		Dispatcher(std::forward<Args>(args)...),
+		m_breaking(breaking)
+	{
+	}
+
+	virtual btPersistentManifold *
+	getNewManifold(const btCollisionObject *body0, const btCollisionObject *body1)
+	{
+		btPersistentManifold *manifold;
+
+		manifold = Dispatcher::getNewManifold(body0, body1);
+		if(manifold && m_breaking > 0)
+		{
+			manifold->setContactBreakingThreshold(m_breaking);
+		}
+		return manifold;
+	}
+protected:
+	btScalar m_breaking;
+};
+
+/* A dynamics world which records the cost of its broadphase in each step */
+class TimedDynamicsWorld: public btDiscreteDynamicsWorld
+{
+public:
+	TimedDynamicsWorld(BroadphaseStats *stats, btDispatcher *dispatcher, btBroadphaseInterface *broadphase, btConstraintSolver *solver, btCollisionConfiguration *config):
+		btDiscreteDynamicsWorld(dispatcher, broadphase, solver, config),
+		m_stats(stats)
+	{
+	}
+
+	virtual void
+	updateAabbs(void)
+	{
+		std::chrono::steady_clock::time_point began;
+
+		began = std::chrono::steady_clock::now();
+		btDiscreteDynamicsWorld::updateAabbs();
+		m_stats->aabbTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - began).count();
+	}
+
+	virtual void
+	computeOverlappingPairs(void)
+	{
+		std::chrono::steady_clock::time_point began;
+
+		began = std::chrono::steady_clock::now();
+		btDiscreteDynamicsWorld::computeOverlappingPairs();
+		m_stats->pairTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - began).count();
+		m_stats->objects = getNumCollisionObjects();
+		m_stats->pairs = getBroadphase()->getOverlappingPairCache()->getNumOverlappingPairs();
+		m_stats->steps++;
+	}
+protected:
+	BroadphaseStats *m_stats;
+};
+
+/* The defaults are those of Bullet itself */
+PhysicsConfig::PhysicsConfig():
+	broadphase(BP_DBVT),
+	bounded(false),
+	worldMin(-PHYSICS_WORLD_EXTENT, -PHYSICS_WORLD_EXTENT, -PHYSICS_WORLD_EXTENT),
+	worldMax(PHYSICS_WORLD_EXTENT, PHYSICS_WORLD_EXTENT, PHYSICS_WORLD_EXTENT),
+	maxProxies(0),
+	prediction(0),
+	dynamicUpdates(0),
+	fixedUpdates(1),
+	contactBreaking(0),
+	linearSleep(-1),
+	angularSleep(-1)
+{
+}
+
+PhysicsWorld::PhysicsWorld(int threads, const PhysicsConfig &config):
+	m_threads(1),
+	m_config(config),
+	m_broadphase(NULL),
+	m_collisionConfig(NULL),
+	m_dispatcher(NULL),
+	m_solver(NULL),
+	m_dynamics(NULL),
+	m_collisionThreads(NULL),
+	m_solverThreads(NULL),
+	m_ghostPairs(NULL)
+{
+	btDefaultCollisionConstructionInfo info;
+
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_broadphase = createBroadphase();
+	m_ghostPairs = new btGhostPairCallback();
+	m_broadphase->getOverlappingPairCache()->setInternalGhostPairCallback(m_ghostPairs);
+	if(threads > 1)
+	{
+		m_collisionThreads = createThreadSupport("collision", processCollisionTask, createCollisionLocalStoreMemory, threads);
+		m_solverThreads = createThreadSupport("solver", SolverThreadFunc, SolverlsMemoryFunc, threads);
+	}
+	if(m_collisionThreads && m_solverThreads)
+	{
+		m_threads = threads;
+		collisionThreadPools++;
+		info.m_defaultMaxPersistentManifoldPoolSize = PHYSICS_MANIFOLD_POOL_SIZE;
+		m_collisionConfig = new btDefaultCollisionConfiguration(info);
+		m_dispatcher = new BreakingDispatcher<SpuGatheringCollisionDispatcher>(m_config.contactBreaking, m_collisionThreads, threads, m_collisionConfig);
+		m_dispatcher->setDispatcherFlags(btCollisionDispatcher::CD_DISABLE_CONTACTPOOL_DYNAMIC_ALLOCATION);
+		m_solver = new btParallelConstraintSolver(m_solverThreads);
+	}
+	else
+	{
+		delete m_collisionThreads;
+		m_collisionThreads = NULL;
+		delete m_solverThreads;
+		m_solverThreads = NULL;
+		m_collisionConfig = new btDefaultCollisionConfiguration(info);
+		m_dispatcher = new BreakingDispatcher<btCollisionDispatcher>(m_config.contactBreaking, m_collisionConfig);
+		m_solver = new btSequentialImpulseConstraintSolver();
+	}
+	m_dynamics = new TimedDynamicsWorld(&m_stats, m_dispatcher, m_broadphase, m_solver, m_collisionConfig);
+	if(m_threads > 1)
+	{
+		/* The parallel solver batches the whole world itself, rather than
+		 * being invoked once per island.
+		 */
+		m_dynamics->getSimulationIslandManager()->setSplitIslands(false);
+		m_dynamics->getDispatchInfo().m_enableSPU = true;
+	}
+}
+
+PhysicsWorld::~PhysicsWorld()
+{
+	delete m_dynamics;
+	delete m_solver;
+	delete m_solverThreads;
+	delete m_dispatcher;
+	delete m_collisionThreads;
+	delete m_collisionConfig;
+	delete m_broadphase;
+	delete m_ghostPairs;
+	if(m_threads > 1 && !--collisionThreadPools)
+	{
+		deleteCollisionLocalStoreMemory();
+	}
+}
+
+/* The number of worker threads used to step the world, which will be one if
+ * the requested number couldn't be created.
+ */
+int
+PhysicsWorld::threads(void) const
+{
+	return m_threads;
+}
+
+btDiscreteDynamicsWorld *
+PhysicsWorld::dynamics(void) const
+{
+	return m_dynamics;
+}
+
+btBroadphaseInterface *
+PhysicsWorld::broadphase(void) const
+{
+	return m_broadphase;
+}
+
+const PhysicsConfig &
+PhysicsWorld::config(void) const
+{
+	return m_config;
+}
+
+/* The statistics are updated by whichever thread steps the world, and so
+ * should only be read while it's locked
+ */
+const BroadphaseStats &
+PhysicsWorld::broadphaseStats(void) const
+{
+	return m_stats;
+}
+
+/* Add a body to the world, applying the configured sleeping thresholds */
+void
+PhysicsWorld::addRigidBody(btRigidBody *body)
+{
+	if(m_config.linearSleep >= 0 || m_config.angularSleep >= 0)
+	{
+		body->setSleepingThresholds(m_config.linearSleep >= 0 ? m_config.linearSleep : body->getLinearSleepingThreshold(),
+			m_config.angularSleep >= 0 ? m_config.angularSleep : body->getAngularSleepingThreshold());
+	}
+	m_dynamics->addRigidBody(body);
+}
+
+/* Create the broadphase selected by the configuration. A sweep-and-prune
+ * broadphase is limited to a fixed number of objects within fixed bounds,
+ * but is faster than the default tree when few of them are moving.
+ */
+btBroadphaseInterface *
+PhysicsWorld::createBroadphase(void)
+{
+	btDbvtBroadphase *dbvt;
+	unsigned int proxies;
+
+	switch(m_config.broadphase)
+	{
+	case BP_SWEEP:
+		/* Handles are 16-bit, and the top bit is reserved */
+		proxies = (m_config.maxProxies ? btMin(m_config.maxProxies, 32766U) : 16384);
+		return new btAxisSweep3(m_config.worldMin, m_config.worldMax, proxies);
+	case BP_SWEEP32:
+		proxies = (m_config.maxProxies ? m_config.maxProxies : 1500000);
+		return new bt32BitAxisSweep3(m_config.worldMin, m_config.worldMax, proxies);
+	default:
+		break;
+	}
+	dbvt = new btDbvtBroadphase();
+	dbvt->setVelocityPrediction(m_config.prediction);
+	dbvt->m_dupdates = m_config.dynamicUpdates;
+	dbvt->m_fupdates = m_config.fixedUpdates;
+	return dbvt;
+}
@@ -20,9 +20,19 @@
 #include "jyuzau/prop.hh"
 #include "jyuzau/scene.hh"
 #include "jyuzau/state.hh"
+#include "jyuzau/core.hh"
+#include "jyuzau/shapecache.hh"
+#include "jyuzau/resourceloader.hh"
+#include "jyuzau/packarchive.hh"
+#include "jyuzau/script.hh"
+#include "jyuzau/snapshot.hh"
 
 #include <OGRE/OgreSceneNode.h>
 #include <OGRE/OgreEntity.h>
+#include <OGRE/OgreInstancedEntity.h>
+#include <OGRE/OgreInstanceBatch.h>
+#include <OGRE/OgreMeshManager.h>
+#include <OGRE/OgreSubMesh.h>
 #include <OGRE/OgreSceneManager.h>
 #include <OGRE/OgreLogManager.h>
 #include <OGRE/OgreResourceGroupManager.h>
@@ -36,8 +46,16 @@ Prop::Prop(const Prop &object):
 	m_entity(NULL),
 	m_collisionShape(NULL),
 	m_rigidBody(NULL),
-	m_prefabType(Ogre::SceneManager::PT_CUBE)
+	m_prefabType(Ogre::SceneManager::PT_CUBE),
+	m_batched(false),
+	m_instance(NULL),
+	m_simulated(false),
+	m_interpolating(false),
+	m_script(NULL)
 {
+	m_fixed = object.m_fixed;
+	m_instanced = object.m_instanced;
+	m_instancing = object.m_instancing;
 	m_mass = object.m_mass;
 	m_inertia = object.m_inertia;
 	m_mesh = object.m_mesh;
@@ -45,6 +63,9 @@ Prop::Prop(const Prop &object):
 	m_prefabType = object.m_prefabType;
 	m_restitution = object.m_restitution;
 	m_friction = object.m_friction;
+	m_scriptPath = object.m_scriptPath;
+	m_kinematic = object.m_kinematic;
+	m_nodeTransform.setIdentity();
 }
 
 Prop::Prop(Ogre::String name, State *state, Ogre::String kind):
@@ -58,27 +79,49 @@ Prop::Prop(Ogre::String name, State *state, Ogre::String kind):
 	m_material(""),
 	m_prefabType(Ogre::SceneManager::PT_CUBE),
 	m_restitution(0.25f),
-	m_friction(0.5f)
+	m_friction(0.5f),
+	m_fixed(false),
+	m_batched(false),
+	m_instanced(false),
+	m_instancing(Ogre::InstanceManager::HWInstancingBasic),
+	m_instance(NULL),
+	m_simulated(false),
+	m_interpolating(false),
+	m_scriptPath(""),
+	m_script(NULL),
+	m_kinematic(false)
 {
+	m_nodeTransform.setIdentity();
 }
 
 Prop::~Prop()
 {
-	if(m_rigidBody)
+	stopScript();
+	if(m_rigidBody && m_scene)
 	{
-		/* m_state->removeRigidBody(m_rigidBody); */
+		m_scene->removeRigidBody(m_rigidBody);
 	}
 	delete m_rigidBody;
-	delete m_collisionShape;
+	if(m_collisionShape && Core::getInstance())
+	{
+		Core::getInstance()->shapeCache()->release(m_collisionShape);
+	}
+	if(m_instance)
+	{
+		m_instance->_getOwner()->removeInstancedEntity(m_instance);
+	}
 	if(m_node)
 	{
-		m_node->detachObject(m_entity);
-		delete m_node;
+		if(m_entity && !m_batched)
+		{
+			m_node->detachObject(m_entity);
+		}
+		m_node->getCreator()->destroySceneNode(m_node);
 		m_node = NULL;
 	}
 	if(m_entity)
 	{
-		delete m_entity;
+		m_entity->_getManager()->destroyEntity(m_entity);
 	}
 }
 
@@ -94,12 +137,25 @@ Prop::entity(void) const
 	return m_entity;
 }
 
+Ogre::InstancedEntity *
+Prop::instancedEntity(void) const
+{
+	return m_instance;
+}
+
 btRigidBody *
 Prop::rigidBody(void) const
 {
 	return m_rigidBody;
 }
 
+/* The running instance of the class's behaviour script, if any */
+Script *
+Prop::script(void) const
+{
+	return m_script;
+}
+
 btScalar
 Prop::mass(void) const
 {
@@ -112,14 +168,32 @@ Prop::inertia(void) const
 	return m_inertia;
 }
 
-/* Define this object as physically immovable (used for walls, etc.) */
+bool
+Prop::fixed(void) const
+{
+	return m_fixed;
+}
+
+/* Define this object as physically immovable (used for walls, etc.); this
+ * is normally invoked before the prop is attached, so that the rigid body
+ * is created with the right kind of collision shape. A fixed mesh prop
+ * can't subsequently be made movable.
+ */
 void
 Prop::setFixed(bool isFixed)
 {
 	int flags;
 	
+	if(!isFixed && m_collisionShape && m_collisionShape->isConcave())
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: fixed mesh prop " + m_group + " cannot be made movable");
+		return;
+	}
+	m_fixed = isFixed;
 	if(m_rigidBody)
 	{
+		SceneDynamicsLock lock(m_scene);
+
 		flags = m_rigidBody->getCollisionFlags();
 		if(isFixed)
 		{
@@ -130,12 +204,51 @@ Prop::setFixed(bool isFixed)
 		else
 		{
 			m_rigidBody->setCollisionFlags(flags & ~btCollisionObject::CF_STATIC_OBJECT);
-			m_rigidBody->setMassProps(m_mass, btVector3(0, 0, 0));
+			m_collisionShape->calculateLocalInertia(m_mass, m_inertia);
+			m_rigidBody->setMassProps(m_mass, m_inertia);
 			m_rigidBody->clearForces();
 		}
 	}
 }
 
+bool
+Prop::batched(void) const
+{
+	return m_batched;
+}
+
+/* Invoked by Scene::batch() once the prop's entity has been copied into a
+ * StaticGeometry, to detach the entity from the prop's node so that it's no
+ * longer rendered separately (and to re-attach it, should that be needed).
+ */
+void
+Prop::setBatched(bool isBatched)
+{
+	if(isBatched == m_batched || !m_node || !m_entity)
+	{
+		return;
+	}
+	if(isBatched)
+	{
+		m_node->detachObject(m_entity);
+	}
+	else
+	{
+		m_node->attachObject(m_entity);
+	}
+	m_batched = isBatched;
+}
+
+/* A batched prop is drawn by its StaticGeometry, which isn't rebuilt when
+ * the prop's node moves, and so the prop can't be moved (any more than its
+ * static rigid body can) once it has been batched
+ */
+bool
+Prop::pinned(void) const
+{
+	return m_batched;
+}
+
 /* Attach the prop to a scene, creating the entity if necessary. Note that
  * the id supplied must be unique in the scene (and if the entity is being
  * created, a unique entity name, too). The position defaults to [0, 0, 0],
@@ -146,6 +259,11 @@ Prop::attachToSceneNode(Scene *scene, Ogre::SceneNode *parentNode, Ogre::String
 {
 	btDynamicsWorld *dynamics;
 
+	/* The class's resources may still be loading in the background */
+	if(Core::getInstance() && Core::getInstance()->resourceLoader())
+	{
+		Core::getInstance()->resourceLoader()->wait(m_group);
+	}
 	if(!Node::attachToSceneNode(scene, parentNode, id))
 	{
 		return false;
@@ -162,9 +280,32 @@ Prop::attachToSceneNode(Scene *scene, Ogre::SceneNode *parentNode, Ogre::String
 			return false;
 		}
 	}
+	if(m_scriptPath.length() && m_state)
+	{
+		stopScript();
+		m_script = m_state->scripts()->start(this, m_container + "/" + m_scriptPath);
+	}
 	return true;
 }
 
+/* The prop's node is about to be destroyed, so its script must stop */
+void
+Prop::detach(void)
+{
+	stopScript();
+	Node::detach();
+}
+
+void
+Prop::stopScript(void)
+{
+	if(m_script)
+	{
+		m_state->scripts()->stop(m_script);
+		m_script = NULL;
+	}
+}
+
 /* Obtain an Ogre::Entity for this prop. If unspecified, the name will default
  * to the group name (class::name) of the prop. When invoked by attach(),
  * the node name supplied will be re-used as the entity name here unless the
@@ -198,13 +339,59 @@ Prop::createEntity(Ogre::SceneManager *sceneManager, Ogre::String id)
 	return m_entity;
 }
 
+/* Obtain an Ogre::InstancedEntity for this prop, if its class has opted in
+ * to instancing. Props of any class which share a mesh share an instance
+ * manager, which is created on demand, and within it, a batch per material.
+ * Returns NULL if the prop isn't instanced, or if the technique isn't
+ * supported, in which case createEntity() should be used instead.
+ */
+Ogre::InstancedEntity *
+Prop::createInstance(Ogre::SceneManager *sceneManager)
+{
+	Ogre::String mesh, group, material, managerName;
+	size_t perBatch;
+	
+	if(m_instance || !m_instanced)
+	{
+		return m_instance;
+	}
+	if(m_mesh.length())
+	{
+		mesh = m_mesh;
+		group = m_group;
+	}
+	else
+	{
+		mesh = (m_prefabType == Ogre::SceneManager::PT_PLANE ? "Prefab_Plane" : (m_prefabType == Ogre::SceneManager::PT_SPHERE ? "Prefab_Sphere" : "Prefab_Cube"));
+		group = Ogre::ResourceGroupManager::INTERNAL_RESOURCE_GROUP_NAME;
+	}
+	material = m_material;
+	if(!material.length())
+	{
+		material = Ogre::MeshManager::getSingleton().load(mesh, group)->getSubMesh(0)->getMaterialName();
+	}
+	managerName = "Jyuzau/" + mesh + "/" + std::to_string((int) m_instancing);
+	if(!sceneManager->hasInstanceManager(managerName))
+	{
+		perBatch = sceneManager->getNumInstancesPerBatch(mesh, group, material, m_instancing, PROP_INSTANCES_PER_BATCH);
+		if(!perBatch)
+		{
+			Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: instancing technique for " + m_group + " is not supported; drawing as ordinary entities");
+			return NULL;
+		}
+		sceneManager->createInstanceManager(managerName, mesh, group, m_instancing, perBatch);
+	}
+	m_instance = sceneManager->createInstancedEntity(material, managerName);
+	return m_instance;
+}
+
 /* Utility method invoked by attachSceneNode() in order to create the scene
  * node.
  */
 bool
 Prop::createNode(Ogre::SceneNode *parentNode, Ogre::String id)
 {
-	if(!createEntity(parentNode->getCreator(), id))
+	if(!createInstance(parentNode->getCreator()) && !createEntity(parentNode->getCreator(), id))
 	{
 		return false;
 	}
@@ -212,6 +399,17 @@ Prop::createNode(Ogre::SceneNode *parentNode, Ogre::String id)
 	{
 		return false;
 	}
+	if(m_instance)
+	{
+		/* Clear any transform left over from an earlier use of the instance,
+		 * so that it's positioned by the node alone
+		 */
+		m_instance->setOrientation(Ogre::Quaternion::IDENTITY, false);
+		m_instance->setScale(Ogre::Vector3::UNIT_SCALE, false);
+		m_instance->setPosition(Ogre::Vector3::ZERO);
+		m_node->attachObject(m_instance);
+		return true;
+	}
 	m_node->attachObject(m_entity);
 	return true;
 }
@@ -222,40 +420,44 @@ Prop::createNode(Ogre::SceneNode *parentNode, Ogre::String id)
 bool
 Prop::createPhysics(btDynamicsWorld *dynamics)
 {
+	ShapeCache *cache;
 	btVector3 scale;
+	btScalar mass;
 	
+	cache = (Core::getInstance() ? Core::getInstance()->shapeCache() : NULL);
+	if(!cache)
+	{
+		return false;
+	}
 	scale = ogreVecToBullet(m_node->getScale());
+	mass = (m_fixed ? 0 : m_mass);
 	if(m_mesh.length())
 	{
-		/* ... */
+		m_collisionShape = cache->mesh(m_group, (m_entity ? m_entity->getMesh() : Ogre::MeshManager::getSingleton().load(m_mesh, m_group)), m_container + "/" + m_mesh, (mass > 0 ? ST_HULL : ST_BVH), scale);
 	}
 	else
 	{
-		switch(m_prefabType)
-		{
-			case Ogre::SceneManager::PT_CUBE:
-				m_collisionShape = new btBoxShape(btVector3(50, 50, 50));
-				break;
-			case Ogre::SceneManager::PT_SPHERE:
-				m_collisionShape = new btSphereShape(50);
-				break;
-			case Ogre::SceneManager::PT_PLANE:
-				m_collisionShape = new btBoxShape(btVector3(100, 100, 0));
-				break;
-		}
+		m_collisionShape = cache->prefab(m_group, m_prefabType, scale);
 	}
 	if(!m_collisionShape)
 	{
 		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to create collision shape for " + m_group);
 		return false;
 	}
-	m_collisionShape->setLocalScaling(scale);
-	m_collisionShape->setUserPointer(this);
-	m_collisionShape->calculateLocalInertia(m_mass, m_inertia);
-	btRigidBody::btRigidBodyConstructionInfo ci(m_mass, this, m_collisionShape, m_inertia);
+	if(mass > 0)
+	{
+		m_collisionShape->calculateLocalInertia(mass, m_inertia);
+	}
+	else
+	{
+		m_inertia.setZero();
+	}
+	updateNodeTransform();
+	btRigidBody::btRigidBodyConstructionInfo ci(mass, this, m_collisionShape, m_inertia);
 	ci.m_restitution = m_restitution;
 	ci.m_friction = m_friction;
 	m_rigidBody = new btRigidBody(ci);
+	m_rigidBody->setUserPointer(this);
 	return true;
 }
 
@@ -269,39 +471,157 @@ Prop::attachPhysics(btDynamicsWorld *dynamics)
 	{
 		return false;
 	}
+	if(m_scene)
+	{
+		return m_scene->addRigidBody(m_rigidBody);
+	}
 	dynamics->addRigidBody(m_rigidBody);
 	return true;
 }
 
-/* btMotionState interface */
+/* Record the node's transform, to be reported to Bullet by
+ * getWorldTransform(); invoked on the render thread whenever the body is
+ * about to be given its transform by its motion state
+ */
 void
-Prop::getWorldTransform(btTransform &worldTrans) const
+Prop::updateNodeTransform(void)
 {
 	Ogre::Quaternion rot;
 	Ogre::Vector3 pos;
-	
+
 	if(!m_node)
 	{
 		return;
 	}
 	rot = m_node->getOrientation();
 	pos = m_node->getPosition();
-	worldTrans.setRotation(btQuaternion(rot.x, rot.y, rot.z, rot.w));
-	worldTrans.setOrigin(btVector3(pos.x, pos.y, pos.z));
+	m_nodeTransform.setRotation(btQuaternion(rot.x, rot.y, rot.z, rot.w));
+	m_nodeTransform.setOrigin(btVector3(pos.x, pos.y, pos.z));
+}
+
+/* btMotionState interface */
+void
+Prop::getWorldTransform(btTransform &worldTrans) const
+{
+	worldTrans = m_nodeTransform;
 }
 
+/* Invoked by the dynamics world at the end of each tick with the body's new
+ * transform. If the scene is threaded, this happens on the physics thread,
+ * and so is ignored: the transforms are instead published by the thread and
+ * passed to setSimulatedTransform() by Scene::synchronise().
+ */
 void 
 Prop::setWorldTransform(const btTransform &worldTrans)
 {
-	btQuaternion rot = worldTrans.getRotation();
-	btVector3 pos = worldTrans.getOrigin();
+	if(m_scene && m_scene->threaded())
+	{
+		return;
+	}
+	setSimulatedTransform(worldTrans);
+	interpolate(1);
+}
 
-	if(!m_node)
+/* Record the body's latest simulated transform, retaining the previous one
+ * so that interpolate() can blend between the two until the next tick.
+ */
+void
+Prop::setSimulatedTransform(const btTransform &worldTrans)
+{
+	if(!m_simulated)
+	{
+		m_prevTransform = worldTrans;
+		m_simulated = true;
+	}
+	else
+	{
+		m_prevTransform = m_curTransform;
+	}
+	m_curTransform = worldTrans;
+	m_nodeTransform = worldTrans;
+	/* A threaded scene interpolates the props published by its thread */
+	if(!m_interpolating && m_scene && !m_scene->threaded())
+	{
+		m_interpolating = true;
+		m_scene->moving(this);
+	}
+}
+
+/* Position the scene node between the two most recent simulated transforms,
+ * where alpha is zero for the previous and one for the current
+ */
+void
+Prop::interpolate(btScalar alpha)
+{
+	btQuaternion rot;
+	btVector3 pos;
+
+	if(!m_node || !m_simulated)
 	{
 		return;
 	}
+	rot = m_prevTransform.getRotation().slerp(m_curTransform.getRotation(), alpha);
+	pos = m_prevTransform.getOrigin().lerp(m_curTransform.getOrigin(), alpha);
 	m_node->setOrientation(rot.w(), rot.x(), rot.y(), rot.z());
 	m_node->setPosition(pos.x(), pos.y(), pos.z());
+	if(m_instance)
+	{
+		/* Once the body is moving, position the instance directly from the
+		 * simulated transform, rather than via its node
+		 */
+		if(m_instance->getParentSceneNode())
+		{
+			m_node->detachObject(m_instance);
+			m_instance->setScale(m_node->_getDerivedScale(), false);
+		}
+		m_instance->setOrientation(Ogre::Quaternion(rot.w(), rot.x(), rot.y(), rot.z()), false);
+		m_instance->setPosition(Ogre::Vector3(pos.x(), pos.y(), pos.z()));
+	}
+}
+
+/* Invoked in place of interpolate() while the body is asleep, and so not
+ * being given new transforms: leave the node at the last simulated one,
+ * rather than at a blend of the last two, and then leave it alone
+ */
+void
+Prop::settle(void)
+{
+	m_interpolating = false;
+	if(!m_simulated || m_prevTransform == m_curTransform)
+	{
+		return;
+	}
+	m_prevTransform = m_curTransform;
+	interpolate(1);
+}
+
+void
+Prop::snapshot(SnapshotNode &record) const
+{
+	Node::snapshot(record);
+	if(m_simulated)
+	{
+		record.flags |= SNAPSHOT_SIMULATED;
+	}
+}
+
+/* Invoked by Snapshot::restore() once the rigid body (if any) has been
+ * restored; interpolation begins afresh from the body's transform
+ */
+void
+Prop::restore(const SnapshotNode &record)
+{
+	Node::restore(record);
+	if(!m_rigidBody || m_rigidBody->isStaticOrKinematicObject())
+	{
+		return;
+	}
+	if(m_simulated || (record.flags & SNAPSHOT_SIMULATED))
+	{
+		m_simulated = false;
+		setSimulatedTransform(m_rigidBody->getWorldTransform());
+		interpolate(1);
+	}
 }
 
 /* Construct a new LoadableObject as the <prop> is being loaded */
@@ -314,7 +634,7 @@ Prop::factory(Ogre::String kind, AttrList &attrs)
 	{
 		if(!kind.compare(m_kind))
 		{
-			return new LoadableProp(this, kind, attrs);
+			return new(m_arena) LoadableProp(this, kind, attrs);
 		}
 		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: unexpected root element <" + kind + ">");
 		return NULL;
@@ -324,15 +644,15 @@ Prop::factory(Ogre::String kind, AttrList &attrs)
 		prop = dynamic_cast<LoadableProp *>(m_cur);
 		if(!kind.compare("mesh"))
 		{
-			return new LoadablePropMesh(this, prop, kind, attrs);
+			return new(m_arena) LoadablePropMesh(this, prop, kind, attrs);
 		}
 		if(!kind.compare("material"))
 		{
-			return new LoadablePropMaterial(this, prop, kind, attrs);
+			return new(m_arena) LoadablePropMaterial(this, prop, kind, attrs);
 		}
 		if(!kind.compare("cube") || !kind.compare("sphere") || !kind.compare("plane"))
 		{
-			return new LoadablePropPrefab(this, prop, kind, attrs);
+			return new(m_arena) LoadablePropPrefab(this, prop, kind, attrs);
 		}
 		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: unexpected element <" + kind + ">");
 		return NULL;
@@ -346,14 +666,27 @@ bool
 Prop::addResources(Ogre::String groupName)
 {
 	Ogre::ResourceGroupManager *gm;
+	PackArchiveFactory *packs;
 	
 	gm = Ogre::ResourceGroupManager::getSingletonPtr();
-	gm->addResourceLocation(m_container, "FileSystem", m_group);
+	/* If the container was packed, its resources are read from the archive */
+	packs = (Core::getInstance() ? Core::getInstance()->packs() : NULL);
+	gm->addResourceLocation(m_container, (packs && packs->contains(m_container) ? PACK_ARCHIVE_TYPE : "FileSystem"), m_group);
 	if(!Loadable::addResources(groupName))
 	{
 		return false;
 	}
-	gm->initialiseResourceGroup(m_group);
+	/* The group is initialised and loaded in the background, along with
+	 * those of the other classes being loaded at the same time
+	 */
+	if(Core::getInstance() && Core::getInstance()->resourceLoader())
+	{
+		Core::getInstance()->resourceLoader()->add(m_group);
+	}
+	else
+	{
+		gm->initialiseResourceGroup(m_group);
+	}
 	return true;
 }
 
@@ -385,6 +718,38 @@ LoadableProp::LoadableProp(Prop *owner, Ogre::String name, AttrList &attrs):
 		{
 			owner->m_friction = atof((*it).second.c_str());
 		}
+		else if(!(*it).first.compare("script"))
+		{
+			owner->m_scriptPath = (*it).second;
+		}
+		else if(!(*it).first.compare("kinematic"))
+		{
+			owner->m_kinematic = !(*it).second.compare("yes");
+		}
+		else if(!(*it).first.compare("instancing"))
+		{
+			owner->m_instanced = true;
+			if(!(*it).second.compare("hw-basic"))
+			{
+				owner->m_instancing = Ogre::InstanceManager::HWInstancingBasic;
+			}
+			else if(!(*it).second.compare("hw-vtf"))
+			{
+				owner->m_instancing = Ogre::InstanceManager::HWInstancingVTF;
+			}
+			else if(!(*it).second.compare("vtf"))
+			{
+				owner->m_instancing = Ogre::InstanceManager::TextureVTF;
+			}
+			else
+			{
+				owner->m_instanced = false;
+				if((*it).second.compare("no"))
+				{
+					Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: unsupported instancing technique '" + (*it).second + "'");
+				}
+			}
+		}
 	}
 }
 
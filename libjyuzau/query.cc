@@ -0,0 +1,508 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <algorithm>
+
+#include "jyuzau/query.hh"
+#include "jyuzau/prop.hh"
+#include "jyuzau/actor.hh"
+
+#include <BulletCollision/BroadphaseCollision/btDbvtBroadphase.h>
+#include <LinearMath/btAabbUtil2.h>
+
+#include "p_utils.hh"
+
+using namespace Jyuzau;
+
+/* The state of a single query while it's being run. It's a broadphase
+ * callback, so that it can be passed to a broadphase's own rayTest() and
+ * aabbTest(), as well as being used by QueryService's tree walks; each
+ * candidate which passes the filters is tested by the narrowphase (for
+ * rays and sweeps) or against its exact bounds (for overlaps). A ray or
+ * sweep is shortened to its closest hit so far, so that anything further
+ * away is skipped.
+ */
+class QueryCallback: public btBroadphaseRayCallback
+{
+public:
+	QueryCallback(const Query &query, QueryResult &result):
+		m_query(query),
+		m_result(result),
+		m_ray(query.from, query.to),
+		m_sweep(query.from, query.to)
+	{
+		btVector3 dir;
+
+		m_from.setIdentity();
+		m_from.setOrigin(query.from);
+		m_to.setIdentity();
+		m_to.setOrigin(query.to);
+		dir = query.to - query.from;
+		if(!dir.fuzzyZero())
+		{
+			dir.normalize();
+		}
+		m_rayDirectionInverse.setValue(
+			dir.x() == btScalar(0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1) / dir.x(),
+			dir.y() == btScalar(0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1) / dir.y(),
+			dir.z() == btScalar(0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1) / dir.z());
+		m_signs[0] = m_rayDirectionInverse.x() < 0;
+		m_signs[1] = m_rayDirectionInverse.y() < 0;
+		m_signs[2] = m_rayDirectionInverse.z() < 0;
+		m_length = dir.dot(query.to - query.from);
+		m_lambda_max = m_length;
+		m_result.hit = false;
+		m_result.fraction = 1;
+		m_result.point = m_result.normal = Ogre::Vector3::ZERO;
+		m_result.object = NULL;
+		m_result.prop = NULL;
+		m_result.actor = NULL;
+		m_result.props.clear();
+	}
+
+	virtual bool
+	process(const btBroadphaseProxy *proxy)
+	{
+		btCollisionObject *object;
+		btVector3 nearest;
+		Prop *prop;
+
+		object = static_cast<btCollisionObject *>(proxy->m_clientObject);
+		if(!(proxy->m_collisionFilterGroup & m_query.mask) || !(m_query.group & proxy->m_collisionFilterMask))
+		{
+			return true;
+		}
+		prop = static_cast<Prop *>(object->getUserPointer());
+		if(m_query.ignore && prop == m_query.ignore)
+		{
+			return true;
+		}
+		switch(m_query.type)
+		{
+		case QT_RAY:
+			btCollisionWorld::rayTestSingle(m_from, m_to, object, object->getCollisionShape(), object->getWorldTransform(), m_ray);
+			if(m_ray.m_collisionObject == object)
+			{
+				m_lambda_max = m_ray.m_closestHitFraction * m_length;
+				hit(object, m_ray.m_closestHitFraction, m_ray.m_hitPointWorld, m_ray.m_hitNormalWorld);
+			}
+			break;
+		case QT_SWEEP:
+			btCollisionWorld::objectQuerySingle(m_query.shape, m_from, m_to, object, object->getCollisionShape(), object->getWorldTransform(), m_sweep, 0);
+			if(m_sweep.m_hitCollisionObject == object)
+			{
+				m_lambda_max = m_sweep.m_closestHitFraction * m_length;
+				hit(object, m_sweep.m_closestHitFraction, m_sweep.m_hitPointWorld, m_sweep.m_hitNormalWorld);
+			}
+			break;
+		case QT_AABB:
+			if(prop && TestAabbAgainstAabb2(proxy->m_aabbMin, proxy->m_aabbMax, m_query.from, m_query.to))
+			{
+				overlap(prop);
+			}
+			break;
+		case QT_SPHERE:
+			nearest = m_query.from;
+			nearest.setMax(proxy->m_aabbMin);
+			nearest.setMin(proxy->m_aabbMax);
+			if(prop && nearest.distance2(m_query.from) <= m_query.radius * m_query.radius)
+			{
+				overlap(prop);
+			}
+			break;
+		}
+		return true;
+	}
+
+	const btVector3 &from(void) const
+	{
+		return m_query.from;
+	}
+protected:
+	const Query &m_query;
+	QueryResult &m_result;
+	btCollisionWorld::ClosestRayResultCallback m_ray;
+	btCollisionWorld::ClosestConvexResultCallback m_sweep;
+	btTransform m_from, m_to;
+	btScalar m_length;
+
+	void hit(const btCollisionObject *object, btScalar fraction, const btVector3 &point, const btVector3 &normal)
+	{
+		m_result.hit = true;
+		m_result.fraction = fraction;
+		m_result.point = bulletVecToOgre(point);
+		m_result.normal = bulletVecToOgre(normal);
+		m_result.object = object;
+		m_result.prop = static_cast<Prop *>(object->getUserPointer());
+		m_result.actor = dynamic_cast<Actor *>(m_result.prop);
+	}
+
+	/* An actor with a kinematic controller is found by both its body and
+	 * its controller's ghost, but is listed once
+	 */
+	void overlap(Prop *prop)
+	{
+		if(std::find(m_result.props.begin(), m_result.props.end(), prop) == m_result.props.end())
+		{
+			m_result.props.push_back(prop);
+		}
+	}
+};
+
+/* Passes the leaves of a tree which overlap a volume to a QueryCallback */
+struct QueryCollide: public btDbvt::ICollide
+{
+	QueryCallback &callback;
+
+	QueryCollide(QueryCallback &cb):
+		callback(cb)
+	{
+	}
+
+	void Process(const btDbvtNode *leaf)
+	{
+		callback.process(static_cast<const btBroadphaseProxy *>(leaf->data));
+	}
+};
+
+/* Walk a tree for a ray (or, with the bounds of the shape being swept, a
+ * sweep), as btDbvt::rayTestInternal() does, but with a stack belonging to
+ * the caller rather than the tree, and re-reading the length of the ray
+ * at each node
+ */
+static void
+rayWalk(const btDbvtNode *root, QueryCallback &callback, const btVector3 &aabbMin, const btVector3 &aabbMax, std::vector<const btDbvtNode *> &stack)
+{
+	const btDbvtNode *node;
+	btVector3 bounds[2];
+	btScalar tmin;
+
+	if(!root)
+	{
+		return;
+	}
+	stack.clear();
+	stack.push_back(root);
+	while(stack.size())
+	{
+		node = stack.back();
+		stack.pop_back();
+		bounds[0] = node->volume.Mins() - aabbMax;
+		bounds[1] = node->volume.Maxs() - aabbMin;
+		tmin = 1;
+		if(!btRayAabb2(callback.from(), callback.m_rayDirectionInverse, callback.m_signs, bounds, tmin, 0, callback.m_lambda_max))
+		{
+			continue;
+		}
+		if(node->isinternal())
+		{
+			stack.push_back(node->childs[0]);
+			stack.push_back(node->childs[1]);
+		}
+		else
+		{
+			callback.process(static_cast<const btBroadphaseProxy *>(node->data));
+		}
+	}
+}
+
+/* QueryBatch */
+
+QueryBatch::QueryBatch():
+	m_size(0)
+{
+}
+
+QueryBatch::~QueryBatch()
+{
+}
+
+/* Queries and results beyond m_size are kept, so that a batch which is
+ * cleared and refilled each frame doesn't allocate
+ */
+Query &
+QueryBatch::add(QueryType type, const Prop *ignore, short mask)
+{
+	Query *query;
+
+	if(m_size == m_queries.size())
+	{
+		m_queries.resize(m_size + 1);
+		m_results.resize(m_size + 1);
+	}
+	query = &(m_queries[m_size]);
+	m_size++;
+	query->type = type;
+	query->radius = 0;
+	query->shape = NULL;
+	query->ignore = ignore;
+	query->group = btBroadphaseProxy::DefaultFilter;
+	query->mask = mask;
+	return *query;
+}
+
+size_t
+QueryBatch::ray(const Ogre::Vector3 &from, const Ogre::Vector3 &to, const Prop *ignore, short mask)
+{
+	Query &query = add(QT_RAY, ignore, mask);
+
+	query.from = ogreVecToBullet(from);
+	query.to = ogreVecToBullet(to);
+	return m_size - 1;
+}
+
+size_t
+QueryBatch::sweep(const btConvexShape *shape, const Ogre::Vector3 &from, const Ogre::Vector3 &to, const Prop *ignore, short mask)
+{
+	Query &query = add(QT_SWEEP, ignore, mask);
+
+	query.shape = shape;
+	query.from = ogreVecToBullet(from);
+	query.to = ogreVecToBullet(to);
+	return m_size - 1;
+}
+
+size_t
+QueryBatch::aabb(const Ogre::Vector3 &min, const Ogre::Vector3 &max, const Prop *ignore, short mask)
+{
+	Query &query = add(QT_AABB, ignore, mask);
+
+	query.from = ogreVecToBullet(min);
+	query.to = ogreVecToBullet(max);
+	return m_size - 1;
+}
+
+size_t
+QueryBatch::sphere(const Ogre::Vector3 &centre, Ogre::Real radius, const Prop *ignore, short mask)
+{
+	Query &query = add(QT_SPHERE, ignore, mask);
+
+	query.from = query.to = ogreVecToBullet(centre);
+	query.radius = radius;
+	return m_size - 1;
+}
+
+void
+QueryBatch::clear(void)
+{
+	m_size = 0;
+}
+
+size_t
+QueryBatch::size(void) const
+{
+	return m_size;
+}
+
+const Query &
+QueryBatch::query(size_t index) const
+{
+	return m_queries[index];
+}
+
+const QueryResult &
+QueryBatch::result(size_t index) const
+{
+	return m_results[index];
+}
+
+/* QueryService */
+
+/* Start threads - 1 workers; the thread calling execute() is the last */
+QueryService::QueryService(btCollisionWorld *world, int threads):
+	m_world(world),
+	m_batch(NULL),
+	m_next(0),
+	m_generation(0),
+	m_busy(0),
+	m_stop(false)
+{
+	int c;
+
+	m_dbvt = dynamic_cast<btDbvtBroadphase *>(world->getBroadphase());
+	if(!m_dbvt)
+	{
+		return;
+	}
+	for(c = 1; c < threads; c++)
+	{
+		m_threads.push_back(std::thread(&QueryService::run, this));
+	}
+}
+
+QueryService::~QueryService()
+{
+	std::vector<std::thread>::iterator it;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for(it = m_threads.begin(); it != m_threads.end(); it++)
+	{
+		it->join();
+	}
+}
+
+int
+QueryService::threads(void) const
+{
+	return m_threads.size() + 1;
+}
+
+/* Run every query in a batch, returning once they've all completed */
+void
+QueryService::execute(QueryBatch &batch)
+{
+	size_t c;
+
+	if(!m_threads.size() || batch.m_size < QUERY_PARALLEL_MIN)
+	{
+		for(c = 0; c < batch.m_size; c++)
+		{
+			process(batch.m_queries[c], batch.m_results[c], m_stack);
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_batch = &batch;
+		m_next = 0;
+		m_busy = m_threads.size();
+		m_generation++;
+	}
+	m_wake.notify_all();
+	work(m_stack);
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_done.wait(lock, [this] { return !m_busy; });
+		m_batch = NULL;
+	}
+}
+
+/* The body of each worker thread */
+void
+QueryService::run(void)
+{
+	std::vector<const btDbvtNode *> stack;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	unsigned long generation;
+
+	/* Workers are only started by the constructor, before any batch, but
+	 * may not get here until after the first has been posted
+	 */
+	generation = 0;
+	for(;;)
+	{
+		m_wake.wait(lock, [this, &generation] { return m_stop || m_generation != generation; });
+		if(m_stop)
+		{
+			return;
+		}
+		generation = m_generation;
+		lock.unlock();
+		work(stack);
+		lock.lock();
+		m_busy--;
+		if(!m_busy)
+		{
+			m_done.notify_all();
+		}
+	}
+}
+
+/* Take queries from the current batch, a few at a time, until there are
+ * none left
+ */
+void
+QueryService::work(std::vector<const btDbvtNode *> &stack)
+{
+	size_t start, end, c;
+
+	for(;;)
+	{
+		start = m_next.fetch_add(QUERY_CHUNK_SIZE);
+		if(start >= m_batch->m_size)
+		{
+			return;
+		}
+		end = std::min(start + QUERY_CHUNK_SIZE, m_batch->m_size);
+		for(c = start; c < end; c++)
+		{
+			process(m_batch->m_queries[c], m_batch->m_results[c], stack);
+		}
+	}
+}
+
+void
+QueryService::process(const Query &query, QueryResult &result, std::vector<const btDbvtNode *> &stack)
+{
+	QueryCallback callback(query, result);
+	QueryCollide collide(callback);
+	btVector3 aabbMin, aabbMax;
+	btTransform identity;
+	int c;
+
+	aabbMin.setZero();
+	aabbMax.setZero();
+	if(query.type == QT_SWEEP)
+	{
+		identity.setIdentity();
+		query.shape->getAabb(identity, aabbMin, aabbMax);
+	}
+	if(!m_dbvt)
+	{
+		switch(query.type)
+		{
+		case QT_RAY:
+		case QT_SWEEP:
+			m_world->getBroadphase()->rayTest(query.from, query.to, callback, aabbMin, aabbMax);
+			break;
+		case QT_AABB:
+			m_world->getBroadphase()->aabbTest(query.from, query.to, callback);
+			break;
+		case QT_SPHERE:
+			aabbMax.setValue(query.radius, query.radius, query.radius);
+			m_world->getBroadphase()->aabbTest(query.from - aabbMax, query.from + aabbMax, callback);
+			break;
+		}
+		return;
+	}
+	/* The broadphase keeps moving and fixed objects in separate trees */
+	for(c = 0; c < 2; c++)
+	{
+		switch(query.type)
+		{
+		case QT_RAY:
+		case QT_SWEEP:
+			rayWalk(m_dbvt->m_sets[c].m_root, callback, aabbMin, aabbMax, stack);
+			break;
+		case QT_AABB:
+			m_dbvt->m_sets[c].collideTV(m_dbvt->m_sets[c].m_root, btDbvtVolume::FromMM(query.from, query.to), collide);
+			break;
+		case QT_SPHERE:
+			m_dbvt->m_sets[c].collideTV(m_dbvt->m_sets[c].m_root, btDbvtVolume::FromCR(query.from, query.radius), collide);
+			break;
+		}
+	}
+}
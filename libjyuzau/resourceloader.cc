@@ -0,0 +1,223 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vector>
+
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreResourceGroupManager.h>
+
+#include "jyuzau/resourceloader.hh"
+
+using namespace Jyuzau;
+
+ResourceLoader::ResourceLoader(Ogre::WorkQueue *queue):
+	m_queue(queue),
+	m_pending(0)
+{
+}
+
+/* Any groups which are still being loaded are completed first, so that no
+ * callbacks arrive once the listener has gone
+ */
+ResourceLoader::~ResourceLoader()
+{
+	wait();
+}
+
+/* Add a resource group whose resources have been declared; this may be
+ * invoked by a LoadQueue worker thread. Adding a group more than once has
+ * no effect.
+ */
+void
+ResourceLoader::add(const Ogre::String &group)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+	if(m_groups.find(group) != m_groups.end())
+	{
+		return;
+	}
+	m_pending++;
+	m_groups[group] = RG_DECLARED;
+#if OGRE_THREAD_SUPPORT == 1
+	Ogre::BackgroundProcessTicket ticket;
+
+	/* If the work queue refuses the request, the group is left to be
+	 * initialised on the main thread by update()
+	 */
+	ticket = Ogre::ResourceBackgroundQueue::getSingleton().initialiseResourceGroup(group, this);
+	if(ticket)
+	{
+		m_groups[group] = RG_INITIALISING;
+		m_tickets[ticket] = group;
+	}
+#endif
+}
+
+/* Returns true if a group has been loaded, or isn't one of ours */
+bool
+ResourceLoader::ready(const Ogre::String &group)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	std::map<Ogre::String, ResourceGroupStatus>::iterator it;
+
+	it = m_groups.find(group);
+	return it == m_groups.end() || it->second == RG_READY;
+}
+
+/* Return the number of groups which are yet to be loaded */
+size_t
+ResourceLoader::pending(void)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+	return m_pending;
+}
+
+/* Initialise every group which is waiting to be initialised on the main
+ * thread, and then start loading them all
+ */
+void
+ResourceLoader::update(void)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	std::map<Ogre::String, ResourceGroupStatus>::iterator it;
+	std::vector<Ogre::String> declared;
+	std::vector<Ogre::String>::iterator dit;
+
+	for(it = m_groups.begin(); it != m_groups.end(); it++)
+	{
+		if(it->second == RG_DECLARED)
+		{
+			declared.push_back(it->first);
+		}
+	}
+	if(!declared.size())
+	{
+		return;
+	}
+	for(dit = declared.begin(); dit != declared.end(); dit++)
+	{
+		initialise(*dit);
+	}
+	for(dit = declared.begin(); dit != declared.end(); dit++)
+	{
+		load(*dit);
+	}
+}
+
+/* Block until every group has been loaded */
+void
+ResourceLoader::wait(void)
+{
+	update();
+	while(pending())
+	{
+		m_queue->processResponses();
+		if(pending())
+		{
+			OGRE_THREAD_SLEEP(1);
+		}
+	}
+}
+
+/* Block until a particular group has been loaded */
+void
+ResourceLoader::wait(const Ogre::String &group)
+{
+	if(ready(group))
+	{
+		return;
+	}
+	update();
+	while(!ready(group))
+	{
+		m_queue->processResponses();
+		if(!ready(group))
+		{
+			OGRE_THREAD_SLEEP(1);
+		}
+	}
+}
+
+/* Invoked on the main thread when a background initialisation or load has
+ * completed; a group which has been initialised is then loaded. A group
+ * which fails is logged, and considered ready, so that Ogre is left to load
+ * its resources on demand (and report each failure individually).
+ */
+void
+ResourceLoader::operationCompleted(Ogre::BackgroundProcessTicket ticket, const Ogre::BackgroundProcessResult &result)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	std::map<Ogre::BackgroundProcessTicket, Ogre::String>::iterator it;
+	Ogre::String group;
+
+	it = m_tickets.find(ticket);
+	if(it == m_tickets.end())
+	{
+		return;
+	}
+	group = it->second;
+	m_tickets.erase(it);
+	if(result.error)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to load resource group " + group + " in the background: " + result.message);
+		loaded(group);
+		return;
+	}
+	if(m_groups[group] == RG_INITIALISING)
+	{
+		load(group);
+		return;
+	}
+	loaded(group);
+}
+
+/* Initialise a group on the main thread */
+void
+ResourceLoader::initialise(const Ogre::String &group)
+{
+	Ogre::ResourceGroupManager::getSingleton().initialiseResourceGroup(group);
+	m_groups[group] = RG_INITIALISING;
+}
+
+/* Begin loading a group which has been initialised. Without thread support,
+ * this happens synchronously, and there's no ticket to wait for.
+ */
+void
+ResourceLoader::load(const Ogre::String &group)
+{
+	Ogre::BackgroundProcessTicket ticket;
+
+	m_groups[group] = RG_LOADING;
+	ticket = Ogre::ResourceBackgroundQueue::getSingleton().loadResourceGroup(group, this);
+	if(!ticket)
+	{
+		loaded(group);
+		return;
+	}
+	m_tickets[ticket] = group;
+}
+
+void
+ResourceLoader::loaded(const Ogre::String &group)
+{
+	m_groups[group] = RG_READY;
+	m_pending--;
+}
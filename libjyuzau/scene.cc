@@ -21,10 +21,21 @@
 #include "jyuzau/prop.hh"
 #include "jyuzau/actor.hh"
 #include "jyuzau/light.hh"
+#include "jyuzau/kinematics.hh"
+#include "jyuzau/query.hh"
 #include "jyuzau/state.hh"
+#include "jyuzau/core.hh"
+#include "jyuzau/loadqueue.hh"
+#include "jyuzau/resourceloader.hh"
+#include "jyuzau/physicsthread.hh"
+#include "jyuzau/physicsworld.hh"
 
 #include <OGRE/OgreLogManager.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
 #include "p_utils.hh"
 
 using namespace Jyuzau;
@@ -32,46 +43,96 @@ using namespace Jyuzau;
 Scene::Scene(const Scene &scene):
 	Loadable::Loadable(scene),
 	m_manager(NULL),
-	m_broadphase(NULL),
-	m_collisionConfig(NULL),
-	m_dispatcher(NULL),
+	m_world(NULL),
 	m_dynamics(NULL),
-	m_solver(NULL),
+	m_physicsThreads(scene.m_physicsThreads),
+	m_physicsConfig(scene.m_physicsConfig),
+	m_crowd(NULL),
+	m_queries(NULL),
+	m_crowdNear(scene.m_crowdNear),
+	m_crowdIdle(scene.m_crowdIdle),
 	m_gravity(scene.m_gravity),
+	m_threaded(scene.m_threaded),
+	m_physicsThread(NULL),
+	m_moving(),
+	m_active(),
+	m_lastTicks(0),
+	m_lastDropped(0),
 	m_hasAmbientLight(scene.m_hasAmbientLight),
-	m_ambientColour(scene.m_ambientColour)
+	m_ambientColour(scene.m_ambientColour),
+	m_cellSize(scene.m_cellSize),
+	m_streamRadius(scene.m_streamRadius),
+	m_streamBudget(scene.m_streamBudget),
+	m_cells(),
+	m_partitioned(false),
+	m_streamFrame(0),
+	m_residentCells(0),
+	m_residentObjects(0),
+	m_batching(scene.m_batching),
+	m_staticGeometry(NULL),
+	m_batches(0)
 {
 }
 
 Scene::Scene(Ogre::String className, State *state):
 	Loadable::Loadable(className, state, "scene", false),
 	m_manager(NULL),
-	m_broadphase(NULL),
-	m_collisionConfig(NULL),
-	m_dispatcher(NULL),
+	m_world(NULL),
 	m_dynamics(NULL),
-	m_solver(NULL),
+	m_physicsThreads(1),
+	m_physicsConfig(),
+	m_crowd(NULL),
+	m_queries(NULL),
+	m_crowdNear(CROWD_NEAR_DISTANCE),
+	m_crowdIdle(CROWD_IDLE_INTERVAL),
 	m_gravity(0.0f, 0.0f, 0.0f),
+	m_threaded(false),
+	m_physicsThread(NULL),
+	m_moving(),
+	m_active(),
+	m_lastTicks(0),
+	m_lastDropped(0),
 	m_hasAmbientLight(false),
-	m_ambientColour(0.5f, 0.5f, 0.5f, 1.0f)
+	m_ambientColour(0.5f, 0.5f, 0.5f, 1.0f),
+	m_cellSize(0),
+	m_streamRadius(0),
+	m_streamBudget(0),
+	m_cells(),
+	m_partitioned(false),
+	m_streamFrame(0),
+	m_residentCells(0),
+	m_residentObjects(0),
+	m_batching(true),
+	m_staticGeometry(NULL),
+	m_batches(0)
 {
+	/* Each scene owns its own physics world and the nodes attached to it,
+	 * so scene definitions are never pooled.
+	 */
+	m_unique = true;
 }
 
 Scene::~Scene()
 {
+	Core *core;
+	
+	/* A worker may still be parsing the scene if it's being preloaded */
+	core = Core::getInstance();
+	if(core && core->loadQueue())
+	{
+		core->loadQueue()->release(this);
+	}
 	if(m_manager)
 	{
 		detach();
 	}
-	delete m_dynamics;
-	delete m_solver;
-	delete m_dispatcher;
-	delete m_collisionConfig;
-	delete m_broadphase;
+	delete m_queries;
+	delete m_crowd;
+	delete m_world;
 }
 
 Loadable *
-Scene::clone(void)
+Scene::clone(void) const
 {
 	return new Scene(*this);
 }
@@ -101,7 +162,11 @@ Scene::dynamics(void) const
 btBroadphaseInterface *
 Scene::broadphase(void) const
 {
-	return m_broadphase;
+	if(!m_world)
+	{
+		return NULL;
+	}
+	return m_world->broadphase();
 }
 
 
@@ -114,13 +179,7 @@ Scene::gravity(void) const
 bool
 Scene::setGravity(const Ogre::Vector3 &vec)
 {
-	m_gravity = ogreVecToBullet(vec);
-	if(!m_dynamics)
-	{
-		return true;
-	}
-	m_dynamics->setGravity(m_gravity);
-	return true;
+	return setGravity(ogreVecToBullet(vec));
 }
 
 bool
@@ -131,7 +190,9 @@ Scene::setGravity(const btVector3 &vec)
 	{
 		return true;
 	}
+	lockDynamics();
 	m_dynamics->setGravity(m_gravity);
+	unlockDynamics();
 	return true;
 }
 
@@ -139,7 +200,9 @@ Scene::setGravity(const btVector3 &vec)
 bool
 Scene::attach(void)
 {
-	std::vector<LoadableSceneObject *>::iterator it;
+	std::vector<LoadableSceneObject *> unstreamed;
+	LoadableObject *p;
+	LoadableSceneObject *obj;
 	Ogre::SceneManager *manager;
 	
 	if(!m_loaded)
@@ -170,10 +233,43 @@ Scene::attach(void)
 	{
 		manager->setAmbientLight(m_ambientColour);
 	}
-	/* Attach all of the objects to the scene */
-	m_root->attach();
+	if(m_cellSize > 0)
+	{
+		/* Divide the objects into cells; any which aren't streamed are
+		 * attached immediately, the rest are left to stream()
+		 */
+		partition();
+	}
+	else
+	{
+		/* Load any assets which haven't been loaded yet in the background */
+		prefetch();
+		/* Wait for the resource groups of all of their classes, which are
+		 * loaded together, before any entities are created
+		 */
+		if(Core::getInstance() && Core::getInstance()->resourceLoader())
+		{
+			Core::getInstance()->resourceLoader()->wait();
+		}
+		/* Attach all of the objects to the scene */
+		m_root->attach();
+	}
+	/* Batch the fixed props which aren't streamed */
+	for(p = m_root->first(); p; p = p->next())
+	{
+		obj = dynamic_cast<LoadableSceneObject *>(p);
+		if(obj && (m_cellSize <= 0 || !obj->m_streamed))
+		{
+			unstreamed.push_back(obj);
+		}
+	}
+	m_staticGeometry = batch(unstreamed, Ogre::Vector3::ZERO, Ogre::Vector3(SCENE_BATCH_REGION_SIZE, SCENE_BATCH_REGION_SIZE, SCENE_BATCH_REGION_SIZE));
 	/* Inform the State that this scene has been attached */
 	m_state->sceneAttached(this);
+	if(m_threaded)
+	{
+		startPhysics();
+	}
 	return true;
 }
 
@@ -182,7 +278,20 @@ Scene::detach(void)
 {
 	std::vector<Loadable *>::iterator it;
 
+	std::map<SceneCellKey, SceneCell>::iterator cit;
+
+	stopPhysics();
 	m_state->sceneDetached(this);
+	/* Evict any resident cells */
+	for(cit = m_cells.begin(); cit != m_cells.end(); cit++)
+	{
+		if(cit->second.resident)
+		{
+			evictCell(cit->second);
+		}
+	}
+	unbatch(m_staticGeometry);
+	m_staticGeometry = NULL;
 	/* Delete the nodes in the scene that we own */
 	for(it = m_objects.begin(); it != m_objects.end(); it++)
 	{
@@ -193,10 +302,417 @@ Scene::detach(void)
 	return true;
 }
 
+/* Streaming */
+
+bool
+Scene::streaming(void) const
+{
+	return m_cellSize > 0;
+}
+
+size_t
+Scene::residentCells(void) const
+{
+	return m_residentCells;
+}
+
+size_t
+Scene::residentObjects(void) const
+{
+	return m_residentObjects;
+}
+
+/* Invoked by attach() to divide the top-level objects in a streamed scene
+ * into cells according to their position (the first time the scene is
+ * attached); objects with stream="no" are attached straight away.
+ */
+void
+Scene::partition(void)
+{
+	LoadableObject *p, *c;
+	LoadableSceneObject *obj;
+	SceneCellKey key;
+	size_t n;
+	
+	for(p = m_root->first(); p; p = p->next())
+	{
+		obj = dynamic_cast<LoadableSceneObject *>(p);
+		if(!obj)
+		{
+			continue;
+		}
+		if(!obj->m_streamed)
+		{
+			obj->attach();
+			continue;
+		}
+		if(m_partitioned)
+		{
+			continue;
+		}
+		/* Count the scene objects in the subtree, so that the budget
+		 * accounts for nested objects, too
+		 */
+		n = 0;
+		for(c = obj; c; )
+		{
+			if(dynamic_cast<LoadableSceneObject *>(c))
+			{
+				n++;
+			}
+			if(c->first())
+			{
+				c = c->first();
+				continue;
+			}
+			while(c != obj && !c->next())
+			{
+				c = c->parent();
+			}
+			c = (c == obj ? NULL : c->next());
+		}
+		key = SceneCellKey((int) floor(obj->m_translate.x / m_cellSize), (int) floor(obj->m_translate.z / m_cellSize));
+		if(m_cells.find(key) == m_cells.end())
+		{
+			SceneCell &cell = m_cells[key];
+			
+			cell.key = key;
+			cell.geometry = NULL;
+			cell.size = 0;
+			cell.resident = false;
+			cell.prefetched = false;
+			cell.lastWanted = cell.lastRequired = 0;
+		}
+		m_cells[key].objects.push_back(obj);
+		m_cells[key].size += n;
+	}
+	if(!m_partitioned)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: scene " + m_className + " has been divided into " + std::to_string(m_cells.size()) + " cells");
+	}
+	m_partitioned = true;
+}
+
+/* Return the distance on the X-Z plane between a point and the nearest
+ * edge of a cell (or zero if the point lies within it)
+ */
+Ogre::Real
+Scene::cellDistance(const SceneCellKey &key, const Ogre::Vector3 &point) const
+{
+	Ogre::Real x0, z0, dx, dz;
+	
+	x0 = key.first * m_cellSize;
+	z0 = key.second * m_cellSize;
+	dx = std::max(std::max(x0 - point.x, point.x - (x0 + m_cellSize)), (Ogre::Real) 0);
+	dz = std::max(std::max(z0 - point.z, point.z - (z0 + m_cellSize)), (Ogre::Real) 0);
+	return Ogre::Math::Sqrt(dx * dx + dz * dz);
+}
+
+/* Invoked each frame by the State with the positions of the active cameras.
+ *
+ * Cells within the stream radius of any camera are required, and are
+ * attached (nearest first) if they aren't already resident. Cells within the
+ * hysteresis distance are wanted: they're prefetched if necessary, and if
+ * resident they're kept, unless room is needed for a required cell within
+ * the budget. Everything else is evicted.
+ */
+void
+Scene::stream(const std::vector<Ogre::Vector3> &focus)
+{
+	std::vector<Ogre::Vector3>::const_iterator fit;
+	std::map<SceneCellKey, SceneCell>::iterator it, victim;
+	std::vector<std::pair<Ogre::Real, SceneCellKey> > required;
+	std::vector<std::pair<Ogre::Real, SceneCellKey> >::iterator rit;
+	Ogre::Real outer, d;
+	int x, z, x0, x1, z0, z1;
+	Core *core;
+	LoadQueue *queue;
+	
+	if(m_cellSize <= 0 || !m_manager)
+	{
+		return;
+	}
+	SceneDynamicsLock lock(this);
+	m_streamFrame++;
+	outer = m_streamRadius * SCENE_STREAM_HYSTERESIS;
+	core = Core::getInstance();
+	queue = (core ? core->loadQueue() : NULL);
+	for(fit = focus.begin(); fit != focus.end(); fit++)
+	{
+		x0 = (int) floor((fit->x - outer) / m_cellSize);
+		x1 = (int) floor((fit->x + outer) / m_cellSize);
+		z0 = (int) floor((fit->z - outer) / m_cellSize);
+		z1 = (int) floor((fit->z + outer) / m_cellSize);
+		for(x = x0; x <= x1; x++)
+		{
+			for(z = z0; z <= z1; z++)
+			{
+				it = m_cells.find(SceneCellKey(x, z));
+				if(it == m_cells.end())
+				{
+					continue;
+				}
+				d = cellDistance(it->first, *fit);
+				if(d > outer)
+				{
+					continue;
+				}
+				it->second.lastWanted = m_streamFrame;
+				if(!it->second.prefetched && queue)
+				{
+					std::vector<LoadableSceneObject *>::iterator oit;
+					
+					for(oit = it->second.objects.begin(); oit != it->second.objects.end(); oit++)
+					{
+						(*oit)->prefetch(queue);
+					}
+					it->second.prefetched = true;
+				}
+				if(d <= m_streamRadius && it->second.lastRequired != m_streamFrame)
+				{
+					it->second.lastRequired = m_streamFrame;
+					required.push_back(std::make_pair(d, it->first));
+				}
+			}
+		}
+	}
+	/* Evict the cells which are no longer wanted at all */
+	for(it = m_cells.begin(); m_residentCells && it != m_cells.end(); it++)
+	{
+		if(it->second.resident && it->second.lastWanted != m_streamFrame)
+		{
+			evictCell(it->second);
+		}
+	}
+	/* Attach the required cells, nearest first */
+	std::sort(required.begin(), required.end());
+	for(rit = required.begin(); rit != required.end(); rit++)
+	{
+		SceneCell &cell = m_cells[rit->second];
+		
+		if(cell.resident)
+		{
+			continue;
+		}
+		/* Make room within the budget by evicting the wanted-but-not-required
+		 * cell which was required least recently
+		 */
+		while(m_streamBudget && m_residentObjects + cell.size > m_streamBudget)
+		{
+			victim = m_cells.end();
+			for(it = m_cells.begin(); it != m_cells.end(); it++)
+			{
+				if(it->second.resident && it->second.lastRequired != m_streamFrame &&
+				   (victim == m_cells.end() || it->second.lastRequired < victim->second.lastRequired))
+				{
+					victim = it;
+				}
+			}
+			if(victim == m_cells.end())
+			{
+				break;
+			}
+			evictCell(victim->second);
+		}
+		if(m_streamBudget && m_residentObjects + cell.size > m_streamBudget)
+		{
+			/* Everything still resident is required; the remaining cells
+			 * (which are further away) will have to wait
+			 */
+			break;
+		}
+		attachCell(cell);
+	}
+}
+
+/* Attach all of the objects in a cell */
+bool
+Scene::attachCell(SceneCell &cell)
+{
+	std::vector<LoadableSceneObject *>::iterator it;
+	bool status;
+	
+	status = true;
+	for(it = cell.objects.begin(); it != cell.objects.end(); it++)
+	{
+		if(!(*it)->attach())
+		{
+			status = false;
+		}
+	}
+	cell.geometry = batch(cell.objects, Ogre::Vector3(cell.key.first * m_cellSize, 0, cell.key.second * m_cellSize), Ogre::Vector3(m_cellSize, m_cellSize, m_cellSize));
+	cell.resident = true;
+	m_residentCells++;
+	m_residentObjects += cell.size;
+	return status;
+}
+
+/* Detach all of the objects in a cell, and destroy their nodes (which will
+ * in turn remove them from the scene manager and the dynamics world)
+ */
+void
+Scene::evictCell(SceneCell &cell)
+{
+	std::vector<LoadableSceneObject *>::iterator it;
+	std::set<Loadable *> nodes;
+	LoadableObject *c;
+	LoadableSceneObject *obj;
+	
+	unbatch(cell.geometry);
+	cell.geometry = NULL;
+	for(it = cell.objects.begin(); it != cell.objects.end(); it++)
+	{
+		for(c = *it; c; )
+		{
+			obj = dynamic_cast<LoadableSceneObject *>(c);
+			if(obj && obj->node())
+			{
+				nodes.insert(obj->node());
+			}
+			if(c->first())
+			{
+				c = c->first();
+				continue;
+			}
+			while(c != *it && !c->next())
+			{
+				c = c->parent();
+			}
+			c = (c == *it ? NULL : c->next());
+		}
+		(*it)->detach();
+	}
+	removeObjects(nodes);
+	cell.resident = false;
+	m_residentCells--;
+	m_residentObjects -= cell.size;
+}
+
+/* Batching */
+
 bool
-Scene::load(void)
+Scene::batching(void) const
+{
+	return m_batching;
+}
+
+/* Enable or disable batching of fixed props; this takes effect the next time
+ * the scene (or a cell of it) is attached.
+ */
+void
+Scene::setBatching(bool batching)
+{
+	m_batching = batching;
+}
+
+/* Merge the entities of the fixed props among a set of attached scene
+ * objects (and their descendants) into a new StaticGeometry, which is
+ * divided into regions of the given size from the given origin. The props
+ * keep their nodes, so that anything attached to them stays put and their
+ * rigid bodies are unaffected, but their entities are detached from them.
+ * Returns NULL if batching is disabled or there's nothing to batch.
+ */
+Ogre::StaticGeometry *
+Scene::batch(const std::vector<LoadableSceneObject *> &objects, const Ogre::Vector3 &origin, const Ogre::Vector3 &regionSize)
+{
+	std::vector<LoadableSceneObject *>::const_iterator it;
+	std::vector<Prop *> props;
+	std::vector<Prop *>::iterator pit;
+	Ogre::StaticGeometry *geometry;
+	Ogre::SceneNode *node;
+	LoadableObject *c;
+	LoadableSceneObject *obj;
+	Prop *prop;
+	
+	if(!m_batching || !m_manager)
+	{
+		return NULL;
+	}
+	for(it = objects.begin(); it != objects.end(); it++)
+	{
+		for(c = *it; c; )
+		{
+			obj = dynamic_cast<LoadableSceneObject *>(c);
+			prop = (obj ? dynamic_cast<Prop *>(obj->node()) : NULL);
+			if(prop && prop->fixed() && prop->entity() && prop->entity()->isAttached())
+			{
+				props.push_back(prop);
+			}
+			if(c->first())
+			{
+				c = c->first();
+				continue;
+			}
+			while(c != *it && !c->next())
+			{
+				c = c->parent();
+			}
+			c = (c == *it ? NULL : c->next());
+		}
+	}
+	if(!props.size())
+	{
+		return NULL;
+	}
+	geometry = m_manager->createStaticGeometry("Jyuzau/" + m_className + "/" + std::to_string(m_batches++));
+	geometry->setOrigin(origin);
+	geometry->setRegionDimensions(regionSize);
+	for(pit = props.begin(); pit != props.end(); pit++)
+	{
+		node = (*pit)->entity()->getParentSceneNode();
+		geometry->addEntity((*pit)->entity(), node->_getDerivedPosition(), node->_getDerivedOrientation(), node->_getDerivedScale());
+		(*pit)->setBatched(true);
+	}
+	geometry->build();
+	return geometry;
+}
+
+/* Destroy a StaticGeometry created by batch(); the props themselves are
+ * expected to be destroyed along with it.
+ */
+void
+Scene::unbatch(Ogre::StaticGeometry *geometry)
 {
-	if(!Loadable::load())
+	if(geometry && m_manager)
+	{
+		m_manager->destroyStaticGeometry(geometry);
+	}
+}
+
+/* Destroy a set of the nodes owned by the scene in a single pass */
+void
+Scene::removeObjects(const std::set<Loadable *> &objects)
+{
+	std::vector<Loadable *> remaining;
+	std::vector<Loadable *>::iterator it;
+	
+	if(!objects.size())
+	{
+		return;
+	}
+	remaining.reserve(m_objects.size());
+	for(it = m_objects.begin(); it != m_objects.end(); it++)
+	{
+		if(objects.find(*it) != objects.end())
+		{
+			delete (*it);
+		}
+		else
+		{
+			remaining.push_back(*it);
+		}
+	}
+	m_objects.swap(remaining);
+}
+
+/* Parse the scene's descriptor and create its physics world; this is the
+ * part of load() which a LoadQueue worker performs when the scene is being
+ * preloaded in the background, and so touches nothing beyond the scene.
+ */
+bool
+Scene::parse(void)
+{
+	if(!Loadable::parse())
 	{
 		return false;
 	}
@@ -207,6 +723,40 @@ Scene::load(void)
 	return true;
 }
 
+/* Hand the assets referred to by the scene which have not yet been loaded
+ * to the LoadQueue, without waiting for them; this includes the objects of
+ * every cell of a streamed scene, as it's only the definitions of their
+ * classes which are loaded.
+ */
+void
+Scene::preload(LoadQueue *queue)
+{
+	if(m_root)
+	{
+		m_root->prefetch(queue);
+	}
+}
+
+/* Hand the assets referred to by the scene which have not yet been loaded
+ * to the LoadQueue, and wait for them to be added to the State's object
+ * pool, so that attaching the scene will only need to duplicate them.
+ */
+void
+Scene::prefetch(void)
+{
+	Core *core;
+	LoadQueue *queue;
+	
+	core = Core::getInstance();
+	queue = (core ? core->loadQueue() : NULL);
+	if(!queue || !m_root)
+	{
+		return;
+	}
+	preload(queue);
+	queue->wait();
+}
+
 LoadableObject *
 Scene::factory(Ogre::String kind, AttrList &attrs)
 {
@@ -216,7 +766,7 @@ Scene::factory(Ogre::String kind, AttrList &attrs)
 	{
 		if(!kind.compare(m_kind))
 		{
-			return new LoadableScene(this, kind, attrs);
+			return new(m_arena) LoadableScene(this, kind, attrs);
 		}
 		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: unexpected root element <" + kind + ">");
 		return NULL;
@@ -226,11 +776,15 @@ Scene::factory(Ogre::String kind, AttrList &attrs)
 		/* Scene properties */
 		if(!kind.compare("ambientlight"))
 		{
-			return new LoadableSceneAmbientLight(this, kind, attrs);
+			return new(m_arena) LoadableSceneAmbientLight(this, kind, attrs);
 		}
 		if(!kind.compare("gravity"))
 		{
-			return new LoadableSceneGravity(this, kind, attrs);
+			return new(m_arena) LoadableSceneGravity(this, kind, attrs);
+		}
+		if(!kind.compare("broadphase") || !kind.compare("deactivation") || !kind.compare("contacts") || !kind.compare("characters"))
+		{
+			return new(m_arena) LoadableScenePhysics(this, kind, attrs);
 		}
 	}
 	/* Props can have transforms applied to them */
@@ -238,11 +792,11 @@ Scene::factory(Ogre::String kind, AttrList &attrs)
 	{
 		if(!kind.compare("scale") || !kind.compare("translate"))
 		{
-			return new LoadableSceneTransform(this, obj, kind, attrs);
+			return new(m_arena) LoadableSceneTransform(this, obj, kind, attrs);
 		}
 		if(!kind.compare("yaw") || !kind.compare("pitch") || !kind.compare("roll"))
 		{
-			return new LoadableSceneRotation(this, obj, kind, attrs);
+			return new(m_arena) LoadableSceneRotation(this, obj, kind, attrs);
 		}
 	}
 	if((m_cur == m_root) || obj)
@@ -252,15 +806,15 @@ Scene::factory(Ogre::String kind, AttrList &attrs)
 		 */
 		if(!kind.compare("prop"))
 		{
-			return new LoadableSceneProp(this, obj, kind, attrs);
+			return new(m_arena) LoadableSceneProp(this, obj, kind, attrs);
 		}
 		if(!kind.compare("actor"))
 		{
-			return new LoadableSceneActor(this, obj, kind, attrs);
+			return new(m_arena) LoadableSceneActor(this, obj, kind, attrs);
 		}
 		if(!kind.compare("light"))
 		{
-			return new LoadableSceneLight(this, obj, kind, attrs);
+			return new(m_arena) LoadableSceneLight(this, obj, kind, attrs);
 		}
 		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: unexpected child element <" + kind + ">");
 		return NULL;
@@ -269,16 +823,353 @@ Scene::factory(Ogre::String kind, AttrList &attrs)
 	return NULL;
 }
 
-/* Create the physics engine for the scene */
+/* Create the physics engine for the scene, with m_physicsThreads worker
+ * threads for collision and constraint solving, and configured by
+ * m_physicsConfig. A sweep-and-prune broadphase which hasn't been given
+ * bounds is fitted to the origins of the scene's objects, which have been
+ * parsed by now.
+ */
 void
 Scene::createPhysics(void)
 {
-	m_broadphase = new btDbvtBroadphase();
-	m_collisionConfig = new btDefaultCollisionConfiguration();
-	m_dispatcher = new btCollisionDispatcher(m_collisionConfig);
-	m_solver = new btSequentialImpulseConstraintSolver();
-	m_dynamics = new btDiscreteDynamicsWorld(m_dispatcher, m_broadphase, m_solver, m_collisionConfig);
+	PhysicsConfig config;
+	LoadableObject *p;
+	LoadableSceneObject *obj;
+	btVector3 origin, margin;
+	bool found;
+
+	config = m_physicsConfig;
+	if(config.broadphase != BP_DBVT && !config.bounded && m_root)
+	{
+		found = false;
+		for(p = m_root->first(); p; p = p->next())
+		{
+			obj = dynamic_cast<LoadableSceneObject *>(p);
+			if(!obj)
+			{
+				continue;
+			}
+			origin = ogreVecToBullet(obj->m_translate);
+			if(!found)
+			{
+				config.worldMin = config.worldMax = origin;
+				found = true;
+				continue;
+			}
+			config.worldMin.setMin(origin);
+			config.worldMax.setMax(origin);
+		}
+		if(found)
+		{
+			margin.setValue(SCENE_WORLD_MARGIN, SCENE_WORLD_MARGIN, SCENE_WORLD_MARGIN);
+			config.worldMin -= margin;
+			config.worldMax += margin;
+		}
+	}
+	m_world = new PhysicsWorld(m_physicsThreads, config);
+	if(m_world->threads() != m_physicsThreads)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: " + std::to_string(m_physicsThreads) + " physics worker threads requested for scene " + m_className + ", but only " + std::to_string(m_world->threads()) + " available");
+	}
+	m_dynamics = m_world->dynamics();
 	m_dynamics->setGravity(m_gravity);
+	m_crowd = new Crowd(m_dynamics, m_crowdNear, m_crowdIdle);
+}
+
+/* Invoked by State::updatePhysics() once the dynamics world has been
+ * stepped, to blend the rendered transform of each moving prop between its
+ * last two simulated ones; alpha is the fraction of a tick which has
+ * elapsed since the most recent. Only the props which have been given a new
+ * transform since they last settled are visited: those whose bodies have
+ * since gone to sleep (and so won't be given any more) are settled and
+ * dropped from the list until they wake.
+ */
+void
+Scene::interpolate(btScalar alpha)
+{
+	btRigidBody *body;
+	Prop *prop;
+	size_t c;
+
+	for(c = 0; c < m_active.size(); )
+	{
+		prop = m_active[c];
+		body = prop->rigidBody();
+		if(body && !body->isStaticOrKinematicObject() && body->isActive())
+		{
+			prop->interpolate(alpha);
+			c++;
+			continue;
+		}
+		prop->settle();
+		m_active[c] = m_active.back();
+		m_active.pop_back();
+	}
+}
+
+/* Invoked by a prop when it's first given a new simulated transform after
+ * settling (see Prop::setSimulatedTransform())
+ */
+void
+Scene::moving(Prop *prop)
+{
+	m_active.push_back(prop);
+}
+
+/* Start stepping the dynamics world on a thread of its own, at the State's
+ * tick rate; invoked by attach() once everything is in place.
+ */
+bool
+Scene::startPhysics(void)
+{
+	if(!m_dynamics)
+	{
+		return false;
+	}
+	if(!m_physicsThread)
+	{
+		m_physicsThread = new PhysicsThread(m_world, m_state->tickRate(), m_state->maxSubsteps());
+	}
+	m_moving.clear();
+	m_lastTicks = 0;
+	m_lastDropped = 0;
+	if(!m_physicsThread->start())
+	{
+		/* Fall back to stepping the world from the render thread */
+		delete m_physicsThread;
+		m_physicsThread = NULL;
+		m_threaded = false;
+		return false;
+	}
+	return true;
+}
+
+/* Stop the physics thread, if there is one; the dynamics world then
+ * belongs to the render thread again.
+ */
+void
+Scene::stopPhysics(void)
+{
+	if(!m_physicsThread)
+	{
+		return;
+	}
+	m_physicsThread->stop();
+	delete m_physicsThread;
+	m_physicsThread = NULL;
+	m_moving.clear();
+}
+
+bool
+Scene::threaded(void) const
+{
+	return m_threaded;
+}
+
+/* Select whether the dynamics world is stepped on its own thread; this takes
+ * effect when the scene is next attached.
+ */
+void
+Scene::setThreaded(bool threaded)
+{
+	m_threaded = threaded;
+}
+
+int
+Scene::physicsThreads(void) const
+{
+	if(m_world)
+	{
+		return m_world->threads();
+	}
+	return m_physicsThreads;
+}
+
+/* Set the number of worker threads used for collision and constraint
+ * solving; this can't be changed once the scene has been attached, but the
+ * (empty) world of a scene which has merely been loaded is re-created.
+ */
+bool
+Scene::setPhysicsThreads(int threads)
+{
+	if(threads < 1)
+	{
+		return false;
+	}
+	if(threads == m_physicsThreads)
+	{
+		return true;
+	}
+	if(m_manager)
+	{
+		return false;
+	}
+	m_physicsThreads = threads;
+	if(m_world)
+	{
+		delete m_queries;
+		m_queries = NULL;
+		delete m_crowd;
+		m_crowd = NULL;
+		delete m_world;
+		m_world = NULL;
+		m_dynamics = NULL;
+		createPhysics();
+	}
+	return true;
+}
+
+const PhysicsConfig &
+Scene::physicsConfig(void) const
+{
+	return m_physicsConfig;
+}
+
+/* Reconfigure the physics world; as with setPhysicsThreads(), this can't
+ * be done once the scene has been attached.
+ */
+bool
+Scene::setPhysicsConfig(const PhysicsConfig &config)
+{
+	if(m_manager)
+	{
+		return false;
+	}
+	m_physicsConfig = config;
+	if(m_world)
+	{
+		delete m_queries;
+		m_queries = NULL;
+		delete m_crowd;
+		m_crowd = NULL;
+		delete m_world;
+		m_world = NULL;
+		m_dynamics = NULL;
+		createPhysics();
+	}
+	return true;
+}
+
+/* The cost of the broadphase in the most recent tick; if the scene is
+ * threaded, the dynamics lock must be held while these are read.
+ */
+const BroadphaseStats *
+Scene::broadphaseStats(void) const
+{
+	if(!m_world)
+	{
+		return NULL;
+	}
+	return &(m_world->broadphaseStats());
+}
+
+/* The Crowd which moves the scene's kinematic characters; it exists for as
+ * long as the physics world does
+ */
+Crowd *
+Scene::crowd(void) const
+{
+	return m_crowd;
+}
+
+/* Run a batch of spatial queries against the physics world, with the
+ * dynamics lock held throughout; the QueryService, and its workers, are
+ * created when the first batch is run
+ */
+void
+Scene::query(QueryBatch &batch)
+{
+	if(!m_dynamics || !batch.size())
+	{
+		return;
+	}
+	SceneDynamicsLock lock(this);
+
+	if(!m_queries)
+	{
+		m_queries = new QueryService(m_dynamics, m_world->threads());
+	}
+	m_queries->execute(batch);
+}
+
+/* Invoked by State::updatePhysics() in place of stepping the world when the
+ * scene is threaded: pick up the most recent transforms published by the
+ * physics thread, and blend between them and the ones before according to
+ * how long ago they were published.
+ */
+void
+Scene::synchronise(DynamicsStats &stats)
+{
+	int c;
+	std::vector<Prop *>::iterator it;
+	btScalar alpha;
+
+	stats.steps = 0;
+	stats.dropped = 0;
+	if(!m_physicsThread)
+	{
+		return;
+	}
+	if(m_crowd && m_crowd->size())
+	{
+		/* Exchange the characters' movement for their positions */
+		lockDynamics();
+		m_crowd->submit();
+		m_crowd->collect(stats);
+		unlockDynamics();
+	}
+	if(m_physicsThread->acquire() && m_physicsThread->current())
+	{
+		const PhysicsFrame &frame = m_physicsThread->front();
+
+		m_moving.clear();
+		for(c = 0; c < frame.transforms.size(); c++)
+		{
+			frame.transforms[c].prop->setSimulatedTransform(frame.transforms[c].transform);
+			m_moving.push_back(frame.transforms[c].prop);
+		}
+		stats.steps = frame.ticks - m_lastTicks;
+		stats.time = frame.time;
+		stats.dropped = frame.dropped - m_lastDropped;
+		stats.objects = frame.broadphase.objects;
+		stats.pairs = frame.broadphase.pairs;
+		stats.aabbTime = frame.broadphase.aabbTime;
+		stats.pairTime = frame.broadphase.pairTime;
+		m_lastTicks = frame.ticks;
+		m_lastDropped = frame.dropped;
+	}
+	if(!m_physicsThread->current())
+	{
+		return;
+	}
+	alpha = std::chrono::duration<btScalar>(std::chrono::steady_clock::now() - m_physicsThread->front().published).count() / m_physicsThread->tickLength();
+	if(alpha > 1)
+	{
+		alpha = 1;
+	}
+	stats.alpha = alpha;
+	for(it = m_moving.begin(); it != m_moving.end(); it++)
+	{
+		(*it)->interpolate(alpha);
+	}
+}
+
+void
+Scene::lockDynamics(void)
+{
+	if(m_physicsThread)
+	{
+		m_physicsThread->lock();
+	}
+}
+
+void
+Scene::unlockDynamics(void)
+{
+	if(m_physicsThread)
+	{
+		m_physicsThread->unlock();
+	}
 }
 
 bool
@@ -288,21 +1179,61 @@ Scene::addRigidBody(btRigidBody *body)
 	{
 		return false;
 	}
-	m_dynamics->addRigidBody(body);
+	lockDynamics();
+	m_world->addRigidBody(body);
+	unlockDynamics();
 	return true;
 }
 
+/* Remove a body from the world; any transforms already published by the
+ * physics thread may refer to it, and so are discarded.
+ */
 bool
 Scene::removeRigidBody(btRigidBody *body)
 {
+	std::vector<Prop *>::iterator it;
+	Prop *prop;
+
 	if(!m_dynamics)
 	{
 		return false;
 	}
+	lockDynamics();
 	m_dynamics->removeRigidBody(body);
+	prop = static_cast<Prop *>(body->getUserPointer());
+	it = std::find(m_active.begin(), m_active.end(), prop);
+	if(prop && it != m_active.end())
+	{
+		/* Settling it also means it's listed again if the body returns */
+		m_active.erase(it);
+		prop->settle();
+	}
+	if(m_physicsThread)
+	{
+		m_physicsThread->invalidate();
+		m_moving.clear();
+	}
+	unlockDynamics();
 	return true;
 }
 
+SceneDynamicsLock::SceneDynamicsLock(Scene *scene):
+	m_scene(scene)
+{
+	if(m_scene)
+	{
+		m_scene->lockDynamics();
+	}
+}
+
+SceneDynamicsLock::~SceneDynamicsLock()
+{
+	if(m_scene)
+	{
+		m_scene->unlockDynamics();
+	}
+}
+
 
 
 
@@ -313,9 +1244,52 @@ LoadableScene::LoadableScene(const LoadableScene &object):
 {
 }
 
+/* <scene cellsize="n" radius="n" budget="n" threaded="yes|no">
+ *
+ * cellsize enables streaming; radius defaults to SCENE_STREAM_RADIUS cells,
+ * and budget (the maximum number of resident objects) to unlimited.
+ * threaded steps the dynamics world on a thread of its own.
+ */
 LoadableScene::LoadableScene(Loadable *owner, Ogre::String name, AttrList &attrs):
 	LoadableObject(owner, NULL, name, attrs)
 {
+	Scene *scene;
+	AttrListIterator it;
+	
+	scene = dynamic_cast<Scene *>(owner);
+	for(it = m_attrs.begin(); it != m_attrs.end(); it++)
+	{
+		Attr p = *it;
+		
+		if(!p.first.compare("cellsize"))
+		{
+			scene->m_cellSize = atof(p.second.c_str());
+		}
+		else if(!p.first.compare("radius"))
+		{
+			scene->m_streamRadius = atof(p.second.c_str());
+		}
+		else if(!p.first.compare("budget"))
+		{
+			scene->m_streamBudget = strtoul(p.second.c_str(), NULL, 10);
+		}
+		else if(!p.first.compare("threaded"))
+		{
+			scene->m_threaded = !p.second.compare("yes");
+		}
+		else if(!p.first.compare("batch"))
+		{
+			scene->m_batching = p.second.compare("no");
+		}
+		else if(!p.first.compare("threads"))
+		{
+			scene->m_physicsThreads = std::max(1, atoi(p.second.c_str()));
+		}
+	}
+	if(scene->m_cellSize > 0 && scene->m_streamRadius <= 0)
+	{
+		scene->m_streamRadius = scene->m_cellSize * SCENE_STREAM_RADIUS;
+	}
 }
 
 LoadableObject *
@@ -346,9 +1320,11 @@ LoadableSceneProperty::LoadableSceneProperty(Scene *owner, LoadableSceneObject *
  */
 
 LoadableSceneObject::LoadableSceneObject(const LoadableSceneObject &object):
-	LoadableObject(object)
+	LoadableObject(object),
+	m_node(NULL)
 {
 	m_id = object.m_id;
+	m_streamed = object.m_streamed;
 	m_scale = object.m_scale;
 	m_translate = object.m_translate;
 	m_yaw = object.m_yaw;
@@ -358,7 +1334,9 @@ LoadableSceneObject::LoadableSceneObject(const LoadableSceneObject &object):
 
 LoadableSceneObject::LoadableSceneObject(Scene *owner, LoadableSceneObject *parent, Ogre::String name, AttrList &attrs):
 	LoadableObject(owner, parent, name, attrs),
+	m_node(NULL),
 	m_id(""),
+	m_streamed(true),
 	m_scale(1, 1, 1),
 	m_translate(0, 0, 0),
 	m_yaw(0), m_pitch(0), m_roll(0)
@@ -373,8 +1351,18 @@ LoadableSceneObject::LoadableSceneObject(Scene *owner, LoadableSceneObject *pare
 		{
 			m_id = p.second;
 		}
+		else if(!p.first.compare("stream"))
+		{
+			/* stream="no" keeps an object attached for as long as its
+			 * scene is, even if the scene is streamed
+			 */
+			if(!p.second.compare("no"))
+			{
+				m_streamed = false;
+			}
+		}
 	}
-	m_translate = parseXYZ(attrs);
+	m_translate = parseXYZ(m_attrs);
 }
 
 bool
@@ -566,6 +1554,25 @@ LoadableSceneProp::fixed(void) const
 	return m_fixed;
 }
 
+/* Enqueue this prop's class if its definition hasn't been loaded yet */
+void
+LoadableSceneProp::prefetch(LoadQueue *queue)
+{
+	State *state;
+	Loadable *p;
+
+	state = m_owner->state();
+	if(!state->pooled(m_kind, m_className))
+	{
+		p = state->create(m_kind, m_className);
+		if(p)
+		{
+			queue->enqueue(p);
+		}
+	}
+	LoadableSceneObject::prefetch(queue);
+}
+
 Node *
 LoadableSceneProp::createNode(State *state)
 {
@@ -727,7 +1734,7 @@ LoadableSceneAmbientLight::LoadableSceneAmbientLight(Scene *owner,  Ogre::String
 	LoadableSceneProperty(owner, NULL, name, attrs)
 {
 	owner->m_hasAmbientLight = true;
-	owner->m_ambientColour = parseColourValue(attrs);
+	owner->m_ambientColour = parseColourValue(m_attrs);
 }
 
 
@@ -740,7 +1747,7 @@ LoadableSceneAmbientLight::LoadableSceneAmbientLight(Scene *owner,  Ogre::String
 LoadableSceneTransform::LoadableSceneTransform(Scene *owner, LoadableSceneObject *parent, Ogre::String kind, AttrList &attrs):
 	LoadableSceneProperty(owner, parent, kind, attrs)
 {
-	m_vector = parseXYZ(attrs);
+	m_vector = parseXYZ(m_attrs);
 	if(!kind.compare("scale"))
 	{
 		parent->m_scale = m_vector;
@@ -802,5 +1809,116 @@ LoadableSceneRotation::LoadableSceneRotation(Scene *owner, LoadableSceneObject *
 LoadableSceneGravity::LoadableSceneGravity(Scene *owner,  Ogre::String kind, AttrList &attrs):
 	LoadableSceneProperty(owner, NULL, kind, attrs)
 {
-	owner->m_gravity = ogreVecToBullet(parseXYZ(attrs));
+	owner->m_gravity = ogreVecToBullet(parseXYZ(m_attrs));
+}
+
+
+
+
+/* LoadableScenePhysics encapsulates a <broadphase>, <deactivation>,
+ * <contacts> or <characters> within a <scene>; the attributes which are
+ * present are applied to the scene's PhysicsConfig, or to its Crowd.
+ */
+
+LoadableScenePhysics::LoadableScenePhysics(Scene *owner, Ogre::String kind, AttrList &attrs):
+	LoadableSceneProperty(owner, NULL, kind, attrs)
+{
+	PhysicsConfig &config = owner->m_physicsConfig;
+	AttrListIterator it;
+	btScalar value;
+
+	for(it = m_attrs.begin(); it != m_attrs.end(); it++)
+	{
+		Attr p = *it;
+
+		value = atof(p.second.c_str());
+		if(!kind.compare("broadphase"))
+		{
+			if(!p.first.compare("type"))
+			{
+				if(!p.second.compare("dbvt"))
+				{
+					config.broadphase = BP_DBVT;
+				}
+				else if(!p.second.compare("sweep"))
+				{
+					config.broadphase = BP_SWEEP;
+				}
+				else if(!p.second.compare("sweep32"))
+				{
+					config.broadphase = BP_SWEEP32;
+				}
+				else
+				{
+					Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: unknown broadphase type '" + p.second + "' in scene " + owner->m_className);
+				}
+			}
+			else if(!p.first.compare("proxies"))
+			{
+				config.maxProxies = strtoul(p.second.c_str(), NULL, 10);
+			}
+			else if(!p.first.compare("prediction"))
+			{
+				config.prediction = value;
+			}
+			else if(!p.first.compare("dynamic"))
+			{
+				config.dynamicUpdates = atoi(p.second.c_str());
+			}
+			else if(!p.first.compare("fixed"))
+			{
+				config.fixedUpdates = atoi(p.second.c_str());
+			}
+			else if(p.first.length() == 4 && (!p.first.compare(0, 3, "min") || !p.first.compare(0, 3, "max")) &&
+				p.first[3] >= 'x' && p.first[3] <= 'z')
+			{
+				/* Bounds which are only partly given are completed from
+				 * the defaults
+				 */
+				if(!config.bounded)
+				{
+					config.worldMin = PhysicsConfig().worldMin;
+					config.worldMax = PhysicsConfig().worldMax;
+					config.bounded = true;
+				}
+				if(p.first[1] == 'i')
+				{
+					config.worldMin[p.first[3] - 'x'] = value;
+				}
+				else
+				{
+					config.worldMax[p.first[3] - 'x'] = value;
+				}
+			}
+		}
+		else if(!kind.compare("deactivation"))
+		{
+			if(!p.first.compare("linear"))
+			{
+				config.linearSleep = value;
+			}
+			else if(!p.first.compare("angular"))
+			{
+				config.angularSleep = value;
+			}
+		}
+		else if(!kind.compare("contacts"))
+		{
+			if(!p.first.compare("breaking"))
+			{
+				config.contactBreaking = value;
+			}
+		}
+		else if(!kind.compare("characters"))
+		{
+			if(!p.first.compare("near"))
+			{
+				owner->m_crowdNear = value;
+			}
+			else if(!p.first.compare("idle"))
+			{
+				owner->m_crowdIdle = atoi(p.second.c_str());
+			}
+		}
+	}
 }
@@ -0,0 +1,925 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstring>
+
+#include <lua.hpp>
+
+#include "jyuzau/script.hh"
+#include "jyuzau/actor.hh"
+#include "jyuzau/scene.hh"
+#include "jyuzau/core.hh"
+#include "jyuzau/packarchive.hh"
+
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreSceneNode.h>
+
+using namespace Jyuzau;
+
+/* Identifies the userdata created by a ScriptScheduler */
+#define SCRIPT_HANDLE_MAGIC            0x4a59534bU
+
+#define POOL_ROUND(size)               (((size) + (SCRIPT_POOL_ALIGN - 1)) & ~((size_t) SCRIPT_POOL_ALIGN - 1))
+#define POOL_CLASS(size)               (((size) - 1) / SCRIPT_POOL_ALIGN)
+#define POOL_SIZE(cls)                 (((cls) + 1) * SCRIPT_POOL_ALIGN)
+#define POOL_HEADER                    POOL_ROUND(sizeof(Block))
+
+/* The end of the current time slice, checked by the instruction-count hook,
+ * the thread of the script being resumed, and whether the hook has suspended
+ * it; scripts only ever run on the main thread, and one at a time.
+ */
+static std::chrono::steady_clock::time_point sliceDeadline;
+static lua_State *sliceThread;
+static bool slicePreempted;
+
+/* ScriptAllocator */
+
+ScriptAllocator::ScriptAllocator(size_t blockSize):
+	m_blockSize(POOL_ROUND(blockSize)),
+	m_blocks(NULL),
+	m_cur(NULL),
+	m_left(0),
+	m_allocations(0),
+	m_bytes(0),
+	m_peak(0),
+	m_reserved(0)
+{
+	memset(m_free, 0, sizeof(m_free));
+}
+
+ScriptAllocator::~ScriptAllocator()
+{
+	Block *block;
+
+	while(m_blocks)
+	{
+		block = m_blocks;
+		m_blocks = block->next;
+		free(block);
+	}
+}
+
+/* The lua_Alloc function; ud is the allocator. When ptr is NULL, osize
+ * describes the kind of object being allocated rather than a size.
+ */
+void *
+ScriptAllocator::alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+	ScriptAllocator *self;
+
+	self = static_cast<ScriptAllocator *>(ud);
+	if(!nsize)
+	{
+		if(ptr)
+		{
+			self->release(ptr, osize);
+		}
+		return NULL;
+	}
+	if(!ptr)
+	{
+		return self->allocate(nsize);
+	}
+	return self->reallocate(ptr, osize, nsize);
+}
+
+void *
+ScriptAllocator::allocate(size_t size)
+{
+	Free *f;
+	void *p;
+	size_t cls;
+
+	if(size > SCRIPT_POOL_MAX)
+	{
+		p = malloc(size);
+	}
+	else
+	{
+		cls = POOL_CLASS(size);
+		f = m_free[cls];
+		if(f)
+		{
+			m_free[cls] = f->next;
+			p = f;
+		}
+		else
+		{
+			p = refill(POOL_SIZE(cls));
+		}
+	}
+	if(!p)
+	{
+		return NULL;
+	}
+	m_allocations++;
+	m_bytes += size;
+	if(m_bytes > m_peak)
+	{
+		m_peak = m_bytes;
+	}
+	return p;
+}
+
+void
+ScriptAllocator::release(void *ptr, size_t size)
+{
+	Free *f;
+	size_t cls;
+
+	m_bytes -= size;
+	if(size > SCRIPT_POOL_MAX)
+	{
+		free(ptr);
+		return;
+	}
+	cls = POOL_CLASS(size);
+	f = static_cast<Free *>(ptr);
+	f->next = m_free[cls];
+	m_free[cls] = f;
+}
+
+/* A block which stays within the same size class is left where it is */
+void *
+ScriptAllocator::reallocate(void *ptr, size_t osize, size_t nsize)
+{
+	void *p;
+
+	if(osize > SCRIPT_POOL_MAX && nsize > SCRIPT_POOL_MAX)
+	{
+		p = realloc(ptr, nsize);
+		if(!p)
+		{
+			return NULL;
+		}
+	}
+	else if(osize <= SCRIPT_POOL_MAX && nsize <= SCRIPT_POOL_MAX && POOL_CLASS(osize) == POOL_CLASS(nsize))
+	{
+		p = ptr;
+	}
+	else
+	{
+		p = allocate(nsize);
+		if(!p)
+		{
+			return NULL;
+		}
+		memcpy(p, ptr, (osize < nsize ? osize : nsize));
+		release(ptr, osize);
+		/* allocate() and release() have accounted for both sizes */
+		return p;
+	}
+	m_bytes = m_bytes - osize + nsize;
+	if(m_bytes > m_peak)
+	{
+		m_peak = m_bytes;
+	}
+	return p;
+}
+
+/* Carve a chunk for an empty size class from the current block, starting a
+ * new block if there isn't room; whatever was left of the old block is
+ * given to the size class which fits it.
+ */
+void *
+ScriptAllocator::refill(size_t size)
+{
+	Block *block;
+	Free *f;
+	void *p;
+
+	if(m_left < size)
+	{
+		block = static_cast<Block *>(malloc(POOL_HEADER + m_blockSize));
+		if(!block)
+		{
+			return NULL;
+		}
+		if(m_left >= SCRIPT_POOL_ALIGN)
+		{
+			f = reinterpret_cast<Free *>(m_cur);
+			f->next = m_free[POOL_CLASS(m_left)];
+			m_free[POOL_CLASS(m_left)] = f;
+		}
+		block->next = m_blocks;
+		m_blocks = block;
+		m_cur = reinterpret_cast<unsigned char *>(block) + POOL_HEADER;
+		m_left = m_blockSize;
+		m_reserved += POOL_HEADER + m_blockSize;
+	}
+	p = m_cur;
+	m_cur += size;
+	m_left -= size;
+	return p;
+}
+
+size_t
+ScriptAllocator::allocations(void) const
+{
+	return m_allocations;
+}
+
+/* The number of bytes which Lua currently has allocated */
+size_t
+ScriptAllocator::bytes(void) const
+{
+	return m_bytes;
+}
+
+size_t
+ScriptAllocator::peak(void) const
+{
+	return m_peak;
+}
+
+/* The number of bytes obtained from the heap for the free lists */
+size_t
+ScriptAllocator::reserved(void) const
+{
+	return m_reserved;
+}
+
+/* Script */
+
+Script::Script(Prop *prop, const Ogre::String &path):
+	m_prop(prop),
+	m_path(path),
+	m_thread(NULL),
+	m_ref(LUA_NOREF),
+	m_handleRef(LUA_NOREF),
+	m_handle(NULL),
+	m_wake(0),
+	m_started(false),
+	m_finished(false)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+Script::~Script()
+{
+}
+
+Prop *
+Script::prop(void) const
+{
+	return m_prop;
+}
+
+const Ogre::String &
+Script::path(void) const
+{
+	return m_path;
+}
+
+/* A script has finished once its function has returned, or raised an
+ * error; it's kept until its prop is detached, so that its statistics
+ * remain available.
+ */
+bool
+Script::finished(void) const
+{
+	return m_finished;
+}
+
+const ScriptStats &
+Script::stats(void) const
+{
+	return m_stats;
+}
+
+/* The Lua thread on which the script runs */
+lua_State *
+Script::thread(void) const
+{
+	return m_thread;
+}
+
+/* Don't resume the script until the scheduler's clock reaches a time */
+void
+Script::sleep(double until)
+{
+	m_wake = until;
+}
+
+/* Handle methods: the handle is always the first argument, and carries
+ * everything the method needs, so that it's never necessary to look
+ * anything up by name.
+ */
+
+static ScriptHandle *
+checkHandle(lua_State *L)
+{
+	ScriptHandle *h;
+
+	if(lua_type(L, 1) != LUA_TUSERDATA || lua_rawlen(L, 1) != sizeof(ScriptHandle))
+	{
+		luaL_argerror(L, 1, "expected a prop handle");
+	}
+	h = static_cast<ScriptHandle *>(lua_touserdata(L, 1));
+	if(h->magic != SCRIPT_HANDLE_MAGIC)
+	{
+		luaL_argerror(L, 1, "expected a prop handle");
+	}
+	if(!h->prop)
+	{
+		luaL_error(L, "prop is no longer attached");
+	}
+	return h;
+}
+
+static Actor *
+checkActor(lua_State *L)
+{
+	ScriptHandle *h;
+
+	h = checkHandle(L);
+	if(!h->actor)
+	{
+		luaL_error(L, "prop is not an actor");
+	}
+	return h->actor;
+}
+
+static Ogre::Vector3
+checkVector(lua_State *L, int index)
+{
+	return Ogre::Vector3(luaL_checknumber(L, index), luaL_checknumber(L, index + 1), luaL_checknumber(L, index + 2));
+}
+
+static int
+pushVector(lua_State *L, const Ogre::Vector3 &vec)
+{
+	lua_pushnumber(L, vec.x);
+	lua_pushnumber(L, vec.y);
+	lua_pushnumber(L, vec.z);
+	return 3;
+}
+
+static int
+nodeName(lua_State *L)
+{
+	ScriptHandle *h;
+
+	h = checkHandle(L);
+	lua_pushstring(L, h->prop->sceneNode() ? h->prop->sceneNode()->getName().c_str() : "");
+	return 1;
+}
+
+static int
+nodeClassName(lua_State *L)
+{
+	lua_pushstring(L, checkHandle(L)->prop->className().c_str());
+	return 1;
+}
+
+static int
+nodePosition(lua_State *L)
+{
+	ScriptHandle *h;
+
+	h = checkHandle(L);
+	if(!h->prop->sceneNode())
+	{
+		return 0;
+	}
+	return pushVector(L, h->prop->sceneNode()->getPosition());
+}
+
+static int
+nodeSetPosition(lua_State *L)
+{
+	checkHandle(L)->prop->setPosition(checkVector(L, 2));
+	return 0;
+}
+
+static int
+nodeTranslate(lua_State *L)
+{
+	checkHandle(L)->prop->translate(checkVector(L, 2));
+	return 0;
+}
+
+static int
+nodeYaw(lua_State *L)
+{
+	checkHandle(L)->prop->yaw(Ogre::Radian(luaL_checknumber(L, 2)));
+	return 0;
+}
+
+static int
+nodePitch(lua_State *L)
+{
+	checkHandle(L)->prop->pitch(Ogre::Radian(luaL_checknumber(L, 2)));
+	return 0;
+}
+
+static int
+nodeRoll(lua_State *L)
+{
+	checkHandle(L)->prop->roll(Ogre::Radian(luaL_checknumber(L, 2)));
+	return 0;
+}
+
+/* self:wait(seconds) suspends the script for (at least) that long */
+static int
+nodeWait(lua_State *L)
+{
+	ScriptHandle *h;
+
+	h = checkHandle(L);
+	/* Yielding from a coroutine which the script created would only
+	 * return to the script, rather than suspending it
+	 */
+	if(L != h->script->thread())
+	{
+		return luaL_error(L, "wait() may only be called by the script itself, not from within a coroutine");
+	}
+	h->script->sleep(h->scheduler->clock() + luaL_optnumber(L, 2, 0));
+	return lua_yield(L, 0);
+}
+
+static int
+nodeClock(lua_State *L)
+{
+	lua_pushnumber(L, checkHandle(L)->scheduler->clock());
+	return 1;
+}
+
+static int
+propImpulse(lua_State *L)
+{
+	ScriptHandle *h;
+	btRigidBody *body;
+	Ogre::Vector3 vec;
+
+	h = checkHandle(L);
+	vec = checkVector(L, 2);
+	body = h->prop->rigidBody();
+	if(body)
+	{
+		SceneDynamicsLock lock(h->prop->scene());
+
+		body->activate();
+		body->applyCentralImpulse(btVector3(vec.x, vec.y, vec.z));
+	}
+	return 0;
+}
+
+static int
+propVelocity(lua_State *L)
+{
+	ScriptHandle *h;
+	btRigidBody *body;
+	btVector3 vec;
+
+	h = checkHandle(L);
+	body = h->prop->rigidBody();
+	if(!body)
+	{
+		return pushVector(L, Ogre::Vector3::ZERO);
+	}
+	{
+		SceneDynamicsLock lock(h->prop->scene());
+
+		vec = body->getLinearVelocity();
+	}
+	return pushVector(L, Ogre::Vector3(vec.x(), vec.y(), vec.z()));
+}
+
+template<void (Actor::*method)(MoveSpeed)>
+static int
+actorMove(lua_State *L)
+{
+	(checkActor(L)->*method)(MS_CURRENT);
+	return 0;
+}
+
+template<void (Actor::*method)(void)>
+static int
+actorAction(lua_State *L)
+{
+	(checkActor(L)->*method)();
+	return 0;
+}
+
+template<MoveSpeed speed>
+static int
+actorSpeed(lua_State *L)
+{
+	checkActor(L)->setSpeed(speed);
+	return 0;
+}
+
+static const luaL_Reg nodeMethods[] = {
+	{ "name", nodeName },
+	{ "className", nodeClassName },
+	{ "position", nodePosition },
+	{ "setPosition", nodeSetPosition },
+	{ "translate", nodeTranslate },
+	{ "yaw", nodeYaw },
+	{ "pitch", nodePitch },
+	{ "roll", nodeRoll },
+	{ "wait", nodeWait },
+	{ "clock", nodeClock },
+	{ "impulse", propImpulse },
+	{ "velocity", propVelocity },
+	{ NULL, NULL }
+};
+
+static const luaL_Reg actorMethods[] = {
+	{ "forward", actorMove<&Actor::forward> },
+	{ "backward", actorMove<&Actor::backward> },
+	{ "turnLeft", actorMove<&Actor::turnLeft> },
+	{ "turnRight", actorMove<&Actor::turnRight> },
+	{ "strafeLeft", actorMove<&Actor::strafeLeft> },
+	{ "strafeRight", actorMove<&Actor::strafeRight> },
+	{ "beginForward", actorMove<&Actor::beginForward> },
+	{ "endForward", actorAction<&Actor::endForward> },
+	{ "beginBackward", actorMove<&Actor::beginBackward> },
+	{ "endBackward", actorAction<&Actor::endBackward> },
+	{ "beginTurnLeft", actorAction<&Actor::beginTurnLeft> },
+	{ "endTurnLeft", actorAction<&Actor::endTurnLeft> },
+	{ "beginTurnRight", actorAction<&Actor::beginTurnRight> },
+	{ "endTurnRight", actorAction<&Actor::endTurnRight> },
+	{ "beginStrafeLeft", actorMove<&Actor::beginStrafeLeft> },
+	{ "endStrafeLeft", actorAction<&Actor::endStrafeLeft> },
+	{ "beginStrafeRight", actorMove<&Actor::beginStrafeRight> },
+	{ "endStrafeRight", actorAction<&Actor::endStrafeRight> },
+	{ "jump", actorAction<&Actor::jump> },
+	{ "crouch", actorAction<&Actor::crouch> },
+	{ "creep", actorSpeed<MS_CREEP> },
+	{ "walk", actorSpeed<MS_WALK> },
+	{ "run", actorSpeed<MS_RUN> },
+	{ NULL, NULL }
+};
+
+/* The libraries available to scripts; those which could block the frame
+ * (io, os, package) or escape the scheduler (debug) are left out
+ */
+static const luaL_Reg scriptLibraries[] = {
+	{ "_G", luaopen_base },
+	{ LUA_COLIBNAME, luaopen_coroutine },
+	{ LUA_TABLIBNAME, luaopen_table },
+	{ LUA_STRLIBNAME, luaopen_string },
+	{ LUA_BITLIBNAME, luaopen_bit32 },
+	{ LUA_MATHLIBNAME, luaopen_math },
+	{ NULL, NULL }
+};
+
+/* ScriptScheduler */
+
+ScriptScheduler::ScriptScheduler(float budget):
+	m_allocator(),
+	m_lua(NULL),
+	m_scripts(),
+	m_cursor(0),
+	m_chunks(),
+	m_nodeMeta(LUA_NOREF),
+	m_actorMeta(LUA_NOREF),
+	m_budget(budget),
+	m_clock(0)
+{
+	memset(&m_frameStats, 0, sizeof(m_frameStats));
+	m_lua = lua_newstate(ScriptAllocator::alloc, &m_allocator);
+	bind();
+}
+
+/* Any props whose scripts are still running are told that they've stopped */
+ScriptScheduler::~ScriptScheduler()
+{
+	std::vector<Script *>::iterator it;
+
+	for(it = m_scripts.begin(); it != m_scripts.end(); it++)
+	{
+		(*it)->m_prop->m_script = NULL;
+		delete *it;
+	}
+	lua_close(m_lua);
+}
+
+void
+ScriptScheduler::bind(void)
+{
+	const luaL_Reg *lib;
+
+	for(lib = scriptLibraries; lib->func; lib++)
+	{
+		luaL_requiref(m_lua, lib->name, lib->func, 1);
+		lua_pop(m_lua, 1);
+	}
+	/* Every handle's metatable refers to its methods through __index, and
+	 * is itself hidden from scripts
+	 */
+	lua_newtable(m_lua);
+	lua_newtable(m_lua);
+	luaL_setfuncs(m_lua, nodeMethods, 0);
+	lua_setfield(m_lua, -2, "__index");
+	lua_pushboolean(m_lua, 0);
+	lua_setfield(m_lua, -2, "__metatable");
+	m_nodeMeta = luaL_ref(m_lua, LUA_REGISTRYINDEX);
+
+	lua_newtable(m_lua);
+	lua_newtable(m_lua);
+	luaL_setfuncs(m_lua, nodeMethods, 0);
+	luaL_setfuncs(m_lua, actorMethods, 0);
+	lua_setfield(m_lua, -2, "__index");
+	lua_pushboolean(m_lua, 0);
+	lua_setfield(m_lua, -2, "__metatable");
+	m_actorMeta = luaL_ref(m_lua, LUA_REGISTRYINDEX);
+}
+
+lua_State *
+ScriptScheduler::lua(void) const
+{
+	return m_lua;
+}
+
+size_t
+ScriptScheduler::size(void) const
+{
+	return m_scripts.size();
+}
+
+/* The time, in milliseconds, which scripts may take in each frame */
+float
+ScriptScheduler::budget(void) const
+{
+	return m_budget;
+}
+
+void
+ScriptScheduler::setBudget(float budget)
+{
+	m_budget = budget;
+}
+
+/* The total of the elapsed times passed to update(), in seconds */
+double
+ScriptScheduler::clock(void) const
+{
+	return m_clock;
+}
+
+/* Start a new instance of a script on behalf of a prop; it first runs in
+ * the next update(). Returns NULL if the script can't be compiled.
+ */
+Script *
+ScriptScheduler::start(Prop *prop, const Ogre::String &path)
+{
+	Script *script;
+	ScriptHandle *h;
+	int ref;
+
+	ref = chunk(path);
+	if(ref == LUA_NOREF)
+	{
+		return NULL;
+	}
+	script = new Script(prop, path);
+	script->m_thread = lua_newthread(m_lua);
+	script->m_ref = luaL_ref(m_lua, LUA_REGISTRYINDEX);
+	lua_sethook(script->m_thread, hook, LUA_MASKCOUNT, SCRIPT_HOOK_COUNT);
+	/* The script's stack holds its function and the argument it's first
+	 * resumed with; the handle is also anchored in the registry, as the
+	 * script may discard it
+	 */
+	lua_rawgeti(script->m_thread, LUA_REGISTRYINDEX, ref);
+	h = static_cast<ScriptHandle *>(lua_newuserdata(script->m_thread, sizeof(ScriptHandle)));
+	h->magic = SCRIPT_HANDLE_MAGIC;
+	h->scheduler = this;
+	h->script = script;
+	h->prop = prop;
+	h->actor = dynamic_cast<Actor *>(prop);
+	lua_rawgeti(script->m_thread, LUA_REGISTRYINDEX, (h->actor ? m_actorMeta : m_nodeMeta));
+	lua_setmetatable(script->m_thread, -2);
+	lua_pushvalue(script->m_thread, -1);
+	script->m_handleRef = luaL_ref(script->m_thread, LUA_REGISTRYINDEX);
+	script->m_handle = h;
+	script->m_wake = m_clock;
+	m_scripts.push_back(script);
+	return script;
+}
+
+/* Stop a script and discard it; its coroutine and handle are left for the
+ * garbage collector
+ */
+void
+ScriptScheduler::stop(Script *script)
+{
+	std::vector<Script *>::iterator it;
+	size_t index;
+
+	for(it = m_scripts.begin(); it != m_scripts.end(); it++)
+	{
+		if(*it == script)
+		{
+			break;
+		}
+	}
+	if(it == m_scripts.end())
+	{
+		return;
+	}
+	index = it - m_scripts.begin();
+	m_scripts.erase(it);
+	if(index < m_cursor)
+	{
+		m_cursor--;
+	}
+	script->m_handle->script = NULL;
+	script->m_handle->prop = NULL;
+	script->m_handle->actor = NULL;
+	luaL_unref(m_lua, LUA_REGISTRYINDEX, script->m_handleRef);
+	luaL_unref(m_lua, LUA_REGISTRYINDEX, script->m_ref);
+	delete script;
+}
+
+/* Invoked once per frame by the State: resume each script which is due, in
+ * turn, until all have been resumed or the budget is spent. Any time left
+ * over is given to the garbage collector.
+ */
+void
+ScriptScheduler::update(float elapsed)
+{
+	std::chrono::steady_clock::time_point began, deadline;
+	Script *script;
+	size_t c, n;
+
+	m_clock += elapsed;
+	m_frameStats.scripts = m_scripts.size();
+	m_frameStats.resumed = 0;
+	m_frameStats.preempted = 0;
+	m_frameStats.time = 0;
+	if(!m_scripts.size())
+	{
+		return;
+	}
+	began = std::chrono::steady_clock::now();
+	deadline = began + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float, std::milli>(m_budget));
+	n = m_scripts.size();
+	for(c = 0; c < n && m_scripts.size(); c++)
+	{
+		if(m_cursor >= m_scripts.size())
+		{
+			m_cursor = 0;
+		}
+		script = m_scripts[m_cursor];
+		m_cursor++;
+		if(script->m_finished || script->m_wake > m_clock)
+		{
+			continue;
+		}
+		resume(script, deadline);
+		m_frameStats.resumed++;
+		if(slicePreempted)
+		{
+			m_frameStats.preempted++;
+		}
+		if(std::chrono::steady_clock::now() >= deadline)
+		{
+			break;
+		}
+	}
+	if(std::chrono::steady_clock::now() < deadline)
+	{
+		lua_gc(m_lua, LUA_GCSTEP, 0);
+	}
+	m_frameStats.time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - began).count();
+}
+
+const ScriptFrameStats &
+ScriptScheduler::frameStats(void) const
+{
+	return m_frameStats;
+}
+
+const ScriptAllocator &
+ScriptScheduler::allocator(void) const
+{
+	return m_allocator;
+}
+
+/* Compile a script, or return the function compiled from it before; the
+ * function is kept in the registry. A script which fails to compile is
+ * remembered, so that it's only reported once.
+ */
+int
+ScriptScheduler::chunk(const Ogre::String &path)
+{
+	std::map<Ogre::String, int>::iterator it;
+	PackArchiveFactory *packs;
+	const void *data;
+	size_t length;
+	int status;
+
+	it = m_chunks.find(path);
+	if(it != m_chunks.end())
+	{
+		return it->second;
+	}
+	packs = (Core::getInstance() ? Core::getInstance()->packs() : NULL);
+	if(packs && packs->read(path, data, length))
+	{
+		status = luaL_loadbufferx(m_lua, static_cast<const char *>(data), length, ("@" + path).c_str(), "t");
+	}
+	else
+	{
+		status = luaL_loadfilex(m_lua, path.c_str(), "t");
+	}
+	if(status != LUA_OK)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to load script " + path + ": " + lua_tostring(m_lua, -1));
+		lua_pop(m_lua, 1);
+		m_chunks[path] = LUA_NOREF;
+		return LUA_NOREF;
+	}
+	m_chunks[path] = luaL_ref(m_lua, LUA_REGISTRYINDEX);
+	return m_chunks[path];
+}
+
+/* Run a script until it yields, finishes, or is preempted at the deadline,
+ * and account for the time it took. Returns false once the script has
+ * finished.
+ */
+bool
+ScriptScheduler::resume(Script *script, std::chrono::steady_clock::time_point deadline)
+{
+	std::chrono::steady_clock::time_point began;
+	int status, nargs;
+	float time;
+
+	if(script->m_started)
+	{
+		/* Discard anything passed to coroutine.yield() */
+		lua_settop(script->m_thread, 0);
+		nargs = 0;
+	}
+	else
+	{
+		script->m_started = true;
+		nargs = 1;
+	}
+	sliceDeadline = deadline;
+	sliceThread = script->m_thread;
+	slicePreempted = false;
+	began = std::chrono::steady_clock::now();
+	status = lua_resume(script->m_thread, m_lua, nargs);
+	time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - began).count();
+	script->m_stats.resumes++;
+	script->m_stats.time += time;
+	script->m_stats.last = time;
+	if(time > script->m_stats.worst)
+	{
+		script->m_stats.worst = time;
+	}
+	if(status == LUA_YIELD)
+	{
+		if(slicePreempted)
+		{
+			script->m_stats.preempted++;
+		}
+		return true;
+	}
+	if(status != LUA_OK)
+	{
+		luaL_traceback(m_lua, script->m_thread, lua_tostring(script->m_thread, -1), 0);
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: script " + script->m_path + " failed: " + lua_tostring(m_lua, -1));
+		lua_pop(m_lua, 1);
+	}
+	script->m_finished = true;
+	lua_settop(script->m_thread, 0);
+	return false;
+}
+
+/* The instruction-count hook: suspend the running script if its time is
+ * up. Coroutines created by the script inherit the hook, but yielding from
+ * one of those would only return to the script, which would take it for an
+ * ordinary coroutine.yield(); the script is left to run on until the hook
+ * is next invoked on its own thread.
+ */
+void
+ScriptScheduler::hook(lua_State *L, lua_Debug *ar)
+{
+	if(ar->event == LUA_HOOKCOUNT && L == sliceThread && std::chrono::steady_clock::now() >= sliceDeadline)
+	{
+		slicePreempted = true;
+		lua_yield(L, 0);
+	}
+}
@@ -0,0 +1,602 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "jyuzau/shapecache.hh"
+#include "jyuzau/compiled.hh"
+#include "jyuzau/core.hh"
+#include "jyuzau/packarchive.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreSubMesh.h>
+
+#include <BulletCollision/CollisionShapes/btShapeHull.h>
+#include <BulletCollision/CollisionShapes/btScaledBvhTriangleMeshShape.h>
+
+using namespace Jyuzau;
+
+#ifdef BT_USE_DOUBLE_PRECISION
+# define COOKED_SCALAR_TYPE            PHY_DOUBLE
+#else
+# define COOKED_SCALAR_TYPE            PHY_FLOAT
+#endif
+
+/* Round an offset within a cooked shape file up to the BVH's alignment */
+#define COOKED_ALIGN(n)                (((n) + 15) & ~15)
+
+/* Describe a cooked shape's triangles to Bullet; the arrays are referred to,
+ * not copied, and so must outlive the interface.
+ */
+static btTriangleIndexVertexArray *
+createMeshInterface(btAlignedObjectArray<btScalar> &vertices, btAlignedObjectArray<int> &indices)
+{
+	btTriangleIndexVertexArray *meshInterface;
+	btIndexedMesh mesh;
+
+	mesh.m_numTriangles = indices.size() / 3;
+	mesh.m_triangleIndexBase = (const unsigned char *) &(indices[0]);
+	mesh.m_triangleIndexStride = 3 * sizeof(int);
+	mesh.m_numVertices = vertices.size() / 3;
+	mesh.m_vertexBase = (const unsigned char *) &(vertices[0]);
+	mesh.m_vertexStride = 3 * sizeof(btScalar);
+	mesh.m_vertexType = COOKED_SCALAR_TYPE;
+	meshInterface = new btTriangleIndexVertexArray();
+	meshInterface->addIndexedMesh(mesh, PHY_INTEGER);
+	return meshInterface;
+}
+
+ShapeCache::ShapeCache()
+{
+}
+
+ShapeCache::~ShapeCache()
+{
+	std::map<Ogre::String, CachedShape>::iterator it;
+	std::map<Ogre::String, CookedShape *>::iterator cit;
+
+	for(it = m_shapes.begin(); it != m_shapes.end(); it++)
+	{
+		delete it->second.shape;
+	}
+	for(cit = m_cooked.begin(); cit != m_cooked.end(); cit++)
+	{
+		freeCooked(cit->second);
+	}
+}
+
+/* Obtain the collision shape for a prefabricated prop */
+btCollisionShape *
+ShapeCache::prefab(const Ogre::String &group, Ogre::SceneManager::PrefabType type, const btVector3 &scale)
+{
+	btCollisionShape *shape;
+	Ogre::String k;
+
+	k = key(group, "prefab", scale);
+	if((shape = retain(k)))
+	{
+		return shape;
+	}
+	switch(type)
+	{
+		case Ogre::SceneManager::PT_CUBE:
+			shape = new btBoxShape(btVector3(50, 50, 50));
+			break;
+		case Ogre::SceneManager::PT_SPHERE:
+			shape = new btSphereShape(50);
+			break;
+		case Ogre::SceneManager::PT_PLANE:
+			shape = new btBoxShape(btVector3(100, 100, 0));
+			break;
+		default:
+			return NULL;
+	}
+	shape->setLocalScaling(scale);
+	return add(k, shape, NULL);
+}
+
+/* Obtain the collision shape for a prop with a mesh, cooking it (or loading
+ * the cooked form from disk) if no other prop of the same class is using it;
+ * source is the path to the mesh file.
+ */
+btCollisionShape *
+ShapeCache::mesh(const Ogre::String &group, const Ogre::MeshPtr &mesh, const Ogre::String &source, ShapeType type, const btVector3 &scale)
+{
+	btCollisionShape *shape;
+	btConvexHullShape *hull;
+	CookedShape *cooked;
+	Ogre::String k;
+	int c;
+
+	k = key(group, (type == ST_BVH ? "bvh" : "hull"), scale);
+	if((shape = retain(k)))
+	{
+		return shape;
+	}
+	cooked = cook(group, mesh, source, type);
+	if(!cooked)
+	{
+		return NULL;
+	}
+	if(type == ST_BVH)
+	{
+		shape = new btScaledBvhTriangleMeshShape(cooked->bvhShape, scale);
+	}
+	else
+	{
+		hull = new btConvexHullShape();
+		for(c = 0; c + 2 < cooked->vertices.size(); c += 3)
+		{
+			hull->addPoint(btVector3(cooked->vertices[c], cooked->vertices[c + 1], cooked->vertices[c + 2]), false);
+		}
+		hull->setLocalScaling(scale);
+		shape = hull;
+	}
+	cooked->refs++;
+	return add(k, shape, cooked);
+}
+
+/* Return a shape obtained from prefab() or mesh(), destroying it if it's no
+ * longer being used by any prop.
+ */
+void
+ShapeCache::release(btCollisionShape *shape)
+{
+	std::map<btCollisionShape *, Ogre::String>::iterator kit;
+	std::map<Ogre::String, CachedShape>::iterator it;
+	CookedShape *cooked;
+
+	kit = m_keys.find(shape);
+	if(kit == m_keys.end())
+	{
+		return;
+	}
+	it = m_shapes.find(kit->second);
+	if(--it->second.refs)
+	{
+		return;
+	}
+	cooked = it->second.cooked;
+	delete shape;
+	m_shapes.erase(it);
+	m_keys.erase(kit);
+	if(cooked && !--cooked->refs)
+	{
+		m_cooked.erase(cooked->key);
+		freeCooked(cooked);
+	}
+}
+
+/* The number of distinct shapes in use */
+size_t
+ShapeCache::shapes(void) const
+{
+	return m_shapes.size();
+}
+
+/* The number of cooked meshes in use */
+size_t
+ShapeCache::cooked(void) const
+{
+	return m_cooked.size();
+}
+
+Ogre::String
+ShapeCache::key(const Ogre::String &group, const Ogre::String &tag, const btVector3 &scale) const
+{
+	return group + "/" + tag + "/" + std::to_string(scale.x()) + "," + std::to_string(scale.y()) + "," + std::to_string(scale.z());
+}
+
+btCollisionShape *
+ShapeCache::retain(const Ogre::String &key)
+{
+	std::map<Ogre::String, CachedShape>::iterator it;
+
+	it = m_shapes.find(key);
+	if(it == m_shapes.end())
+	{
+		return NULL;
+	}
+	it->second.refs++;
+	return it->second.shape;
+}
+
+btCollisionShape *
+ShapeCache::add(const Ogre::String &key, btCollisionShape *shape, CookedShape *cooked)
+{
+	CachedShape entry;
+
+	entry.shape = shape;
+	entry.cooked = cooked;
+	entry.refs = 1;
+	m_shapes[key] = entry;
+	m_keys[shape] = key;
+	return shape;
+}
+
+/* Obtain the unscaled cooked form of a mesh: from memory if it's already in
+ * use, otherwise from disk if the file is current, and otherwise by building
+ * it from the mesh's vertex and index buffers (and then writing it to disk
+ * for next time).
+ */
+ShapeCache::CookedShape *
+ShapeCache::cook(const Ogre::String &group, const Ogre::MeshPtr &mesh, const Ogre::String &source, ShapeType type)
+{
+	std::map<Ogre::String, CookedShape *>::iterator it;
+	CookedShape *shape;
+	Ogre::String k, path;
+
+	k = group + (type == ST_BVH ? "/bvh" : "/hull");
+	it = m_cooked.find(k);
+	if(it != m_cooked.end())
+	{
+		return it->second;
+	}
+	shape = new CookedShape();
+	shape->key = k;
+	shape->type = type;
+	shape->bvhData = NULL;
+	shape->meshInterface = NULL;
+	shape->bvhShape = NULL;
+	shape->refs = 0;
+	path = source + (type == ST_BVH ? COOKED_BVH_SUFFIX : COOKED_HULL_SUFFIX);
+	if((packed(path) || CompiledDocument::current(source, path)) && readCooked(path, shape))
+	{
+		m_cooked[k] = shape;
+		return shape;
+	}
+	if(mesh.isNull() || !extract(mesh, shape) || !(type == ST_BVH ? buildBvh(shape) : buildHull(shape)))
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to build collision shape for " + group);
+		freeCooked(shape);
+		return NULL;
+	}
+	if(!writeCooked(path, shape))
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to write cooked collision shape " + path);
+	}
+	m_cooked[k] = shape;
+	return shape;
+}
+
+/* Returns true if a cooked shape was packed into a mounted archive, in which
+ * case it's always current
+ */
+bool
+ShapeCache::packed(const Ogre::String &path) const
+{
+	PackArchiveFactory *packs;
+	const void *data;
+	size_t len;
+
+	packs = (Core::getInstance() ? Core::getInstance()->packs() : NULL);
+	return packs && packs->read(path, data, len);
+}
+
+/* Copy the positions and triangle indices of every submesh into a cooked
+ * shape (only triangle lists are supported)
+ */
+bool
+ShapeCache::extract(const Ogre::MeshPtr &mesh, CookedShape *shape)
+{
+	Ogre::SubMesh *sub;
+	Ogre::VertexData *vd;
+	const Ogre::VertexElement *pos;
+	Ogre::HardwareVertexBufferSharedPtr vbuf;
+	Ogre::HardwareIndexBufferSharedPtr ibuf;
+	unsigned char *vp;
+	float *p;
+	uint32_t *i32;
+	uint16_t *i16;
+	size_t c, n, base, sharedBase;
+	bool sharedAdded;
+
+	sharedAdded = false;
+	sharedBase = 0;
+	for(n = 0; n < mesh->getNumSubMeshes(); n++)
+	{
+		sub = mesh->getSubMesh(n);
+		if(sub->operationType != Ogre::RenderOperation::OT_TRIANGLE_LIST)
+		{
+			continue;
+		}
+		vd = (sub->useSharedVertices ? mesh->sharedVertexData : sub->vertexData);
+		if(!vd || !sub->indexData || !sub->indexData->indexCount)
+		{
+			continue;
+		}
+		if(sub->useSharedVertices && sharedAdded)
+		{
+			base = sharedBase;
+		}
+		else
+		{
+			base = shape->vertices.size() / 3;
+			pos = vd->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION);
+			if(!pos)
+			{
+				continue;
+			}
+			vbuf = vd->vertexBufferBinding->getBuffer(pos->getSource());
+			vp = static_cast<unsigned char *>(vbuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY));
+			vp += vd->vertexStart * vbuf->getVertexSize();
+			for(c = 0; c < vd->vertexCount; c++, vp += vbuf->getVertexSize())
+			{
+				pos->baseVertexPointerToElement(vp, &p);
+				shape->vertices.push_back(p[0]);
+				shape->vertices.push_back(p[1]);
+				shape->vertices.push_back(p[2]);
+			}
+			vbuf->unlock();
+			if(sub->useSharedVertices)
+			{
+				sharedBase = base;
+				sharedAdded = true;
+			}
+		}
+		ibuf = sub->indexData->indexBuffer;
+		if(ibuf->getType() == Ogre::HardwareIndexBuffer::IT_32BIT)
+		{
+			i32 = static_cast<uint32_t *>(ibuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY)) + sub->indexData->indexStart;
+			for(c = 0; c < sub->indexData->indexCount; c++)
+			{
+				shape->indices.push_back(base + i32[c]);
+			}
+		}
+		else
+		{
+			i16 = static_cast<uint16_t *>(ibuf->lock(Ogre::HardwareBuffer::HBL_READ_ONLY)) + sub->indexData->indexStart;
+			for(c = 0; c < sub->indexData->indexCount; c++)
+			{
+				shape->indices.push_back(base + i16[c]);
+			}
+		}
+		ibuf->unlock();
+	}
+	return shape->vertices.size() && shape->indices.size() >= 3;
+}
+
+/* Replace a cooked shape's vertices with those of the simplified hull which
+ * encloses them
+ */
+bool
+ShapeCache::buildHull(CookedShape *shape)
+{
+	btConvexHullShape points;
+	btShapeHull *hull;
+	const btVector3 *v;
+	int c;
+
+	for(c = 0; c + 2 < shape->vertices.size(); c += 3)
+	{
+		points.addPoint(btVector3(shape->vertices[c], shape->vertices[c + 1], shape->vertices[c + 2]), false);
+	}
+	points.recalcLocalAabb();
+	hull = new btShapeHull(&points);
+	if(!hull->buildHull(points.getMargin()) || !hull->numVertices())
+	{
+		delete hull;
+		return false;
+	}
+	shape->vertices.resize(0);
+	shape->indices.resize(0);
+	v = hull->getVertexPointer();
+	for(c = 0; c < hull->numVertices(); c++)
+	{
+		shape->vertices.push_back(v[c].x());
+		shape->vertices.push_back(v[c].y());
+		shape->vertices.push_back(v[c].z());
+	}
+	delete hull;
+	return true;
+}
+
+bool
+ShapeCache::buildBvh(CookedShape *shape)
+{
+	shape->meshInterface = createMeshInterface(shape->vertices, shape->indices);
+	shape->bvhShape = new btBvhTriangleMeshShape(shape->meshInterface, true, true);
+	return true;
+}
+
+/* Read the contents of a cooked shape file, which is held in memory, into a
+ * shape, returning false if it's truncated or doesn't match this build
+ */
+static bool
+readCookedData(const unsigned char *data, size_t len, ShapeType type, btAlignedObjectArray<btScalar> &vertices, btAlignedObjectArray<int> &indices, void **bvhData, btOptimizedBvh **bvh)
+{
+	CookedShapeHeader header;
+	size_t vlen, ilen;
+
+	if(len < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if(memcmp(header.magic, COOKED_MAGIC, 4) ||
+	   header.byteorder != COOKED_BYTEORDER ||
+	   header.version != COOKED_VERSION ||
+	   header.bullet != BT_BULLET_VERSION ||
+	   header.scalar != sizeof(btScalar) ||
+	   header.type != (uint32_t) type ||
+	   !header.nvertices ||
+	   (type == ST_BVH && (header.nindices < 3 || !header.bvhlen)))
+	{
+		return false;
+	}
+	vlen = (size_t) header.nvertices * sizeof(btScalar) * 3;
+	ilen = (size_t) header.nindices * sizeof(int);
+	if(sizeof(header) + vlen + ilen > len ||
+	   (type == ST_BVH && (header.bvh > len || header.bvhlen > len - header.bvh)))
+	{
+		return false;
+	}
+	vertices.resize(header.nvertices * 3);
+	indices.resize(header.nindices);
+	memcpy(&(vertices[0]), data + sizeof(header), vlen);
+	if(ilen)
+	{
+		memcpy(&(indices[0]), data + sizeof(header) + vlen, ilen);
+	}
+	if(type != ST_BVH)
+	{
+		return true;
+	}
+	/* The BVH is deserialised in place, and so needs a copy of its own */
+	*bvhData = btAlignedAlloc(header.bvhlen, 16);
+	memcpy(*bvhData, data + header.bvh, header.bvhlen);
+	*bvh = btOptimizedBvh::deSerializeInPlace(*bvhData, header.bvhlen, false);
+	return (*bvh != NULL);
+}
+
+/* Load a cooked shape written by writeCooked(), from a mounted packed
+ * archive if it was packed, or otherwise by reading the whole file at once
+ */
+bool
+ShapeCache::readCooked(const Ogre::String &path, CookedShape *shape)
+{
+	PackArchiveFactory *packs;
+	std::vector<unsigned char> buf;
+	btOptimizedBvh *bvh;
+	const void *data;
+	size_t len;
+	FILE *f;
+	long size;
+	bool r;
+
+	packs = (Core::getInstance() ? Core::getInstance()->packs() : NULL);
+	if(!packs || !packs->read(path, data, len))
+	{
+		f = fopen(path.c_str(), "rb");
+		if(!f)
+		{
+			return false;
+		}
+		if(fseek(f, 0, SEEK_END) || (size = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET))
+		{
+			fclose(f);
+			return false;
+		}
+		buf.resize(size);
+		r = (fread(&(buf[0]), size, 1, f) == 1);
+		fclose(f);
+		if(!r)
+		{
+			return false;
+		}
+		data = &(buf[0]);
+		len = buf.size();
+	}
+	bvh = NULL;
+	r = readCookedData((const unsigned char *) data, len, shape->type, shape->vertices, shape->indices, &(shape->bvhData), &bvh);
+	if(!r)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: ignoring invalid cooked collision shape " + path);
+		shape->vertices.clear();
+		shape->indices.clear();
+		if(shape->bvhData)
+		{
+			btAlignedFree(shape->bvhData);
+			shape->bvhData = NULL;
+		}
+		return false;
+	}
+	if(bvh)
+	{
+		shape->meshInterface = createMeshInterface(shape->vertices, shape->indices);
+		shape->bvhShape = new btBvhTriangleMeshShape(shape->meshInterface, true, false);
+		shape->bvhShape->setOptimizedBvh(bvh);
+	}
+	return true;
+}
+
+bool
+ShapeCache::writeCooked(const Ogre::String &path, const CookedShape *shape)
+{
+	CookedShapeHeader header;
+	btOptimizedBvh *bvh;
+	void *data;
+	FILE *f;
+	long len;
+	bool r;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, COOKED_MAGIC, 4);
+	header.byteorder = COOKED_BYTEORDER;
+	header.version = COOKED_VERSION;
+	header.bullet = BT_BULLET_VERSION;
+	header.scalar = sizeof(btScalar);
+	header.type = shape->type;
+	header.nvertices = shape->vertices.size() / 3;
+	header.nindices = (shape->type == ST_BVH ? shape->indices.size() : 0);
+	data = NULL;
+	if(shape->type == ST_BVH)
+	{
+		bvh = shape->bvhShape->getOptimizedBvh();
+		len = sizeof(header) + sizeof(btScalar) * shape->vertices.size() + sizeof(int) * header.nindices;
+		header.bvh = COOKED_ALIGN(len);
+		header.bvhlen = bvh->calculateSerializeBufferSize();
+		data = btAlignedAlloc(header.bvhlen, 16);
+		if(!bvh->serializeInPlace(data, header.bvhlen, false))
+		{
+			btAlignedFree(data);
+			return false;
+		}
+	}
+	f = fopen(path.c_str(), "wb");
+	if(!f)
+	{
+		if(data)
+		{
+			btAlignedFree(data);
+		}
+		return false;
+	}
+	r = (fwrite(&header, sizeof(header), 1, f) == 1 &&
+		 fwrite(&(shape->vertices[0]), sizeof(btScalar) * 3, header.nvertices, f) == header.nvertices &&
+		 (!header.nindices || fwrite(&(shape->indices[0]), sizeof(int), header.nindices, f) == header.nindices) &&
+		 (!data || (!fseek(f, header.bvh, SEEK_SET) && fwrite(data, header.bvhlen, 1, f) == 1)));
+	if(fclose(f))
+	{
+		r = false;
+	}
+	if(data)
+	{
+		btAlignedFree(data);
+	}
+	if(!r)
+	{
+		remove(path.c_str());
+	}
+	return r;
+}
+
+void
+ShapeCache::freeCooked(CookedShape *shape)
+{
+	delete shape->bvhShape;
+	delete shape->meshInterface;
+	if(shape->bvhData)
+	{
+		btAlignedFree(shape->bvhData);
+	}
+	delete shape;
+}
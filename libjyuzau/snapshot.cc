@@ -0,0 +1,469 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreSceneNode.h>
+#include <OGRE/OgreStringConverter.h>
+
+#include <btBulletDynamicsCommon.h>
+#include <LinearMath/btSerializer.h>
+
+#include "jyuzau/snapshot.hh"
+#include "jyuzau/scene.hh"
+#include "jyuzau/prop.hh"
+#include "jyuzau/physicsthread.hh"
+
+using namespace Jyuzau;
+
+static size_t
+align(size_t offset)
+{
+	return (offset + SNAPSHOT_ALIGN - 1) & ~((size_t) SNAPSHOT_ALIGN - 1);
+}
+
+/* Check that Bullet data was written by a serializer with the same
+ * precision, pointer size, byte order and version as ours, and so can be
+ * read without its DNA
+ */
+static bool
+compatible(const unsigned char *header)
+{
+	int littleEndian = 1;
+
+	littleEndian = ((char *) &littleEndian)[0];
+	return !memcmp(header, "BULLET", 6) &&
+		header[6] == (sizeof(btScalar) == 8 ? 'd' : 'f') &&
+		header[7] == (sizeof(void *) == 8 ? '-' : '_') &&
+		header[8] == (littleEndian ? 'v' : 'V') &&
+		(header[9] - '0') * 100 + (header[10] - '0') * 10 + (header[11] - '0') == btGetVersion();
+}
+
+/* Put a rigid body back into the state it was serialized in */
+static void
+restoreBody(btDynamicsWorld *dynamics, btRigidBody *body, const btRigidBodyData &data)
+{
+	btTransform xform;
+	btVector3 vec;
+
+	xform.deSerialize(data.m_collisionObjectData.m_worldTransform);
+	body->setWorldTransform(xform);
+	xform.deSerialize(data.m_collisionObjectData.m_interpolationWorldTransform);
+	body->setInterpolationWorldTransform(xform);
+	vec.deSerialize(data.m_collisionObjectData.m_interpolationLinearVelocity);
+	body->setInterpolationLinearVelocity(vec);
+	vec.deSerialize(data.m_collisionObjectData.m_interpolationAngularVelocity);
+	body->setInterpolationAngularVelocity(vec);
+	vec.deSerialize(data.m_linearVelocity);
+	body->setLinearVelocity(vec);
+	vec.deSerialize(data.m_angularVelocity);
+	body->setAngularVelocity(vec);
+	body->clearForces();
+	body->forceActivationState(data.m_collisionObjectData.m_activationState1);
+	body->setDeactivationTime(data.m_collisionObjectData.m_deactivationTime);
+	dynamics->updateSingleAabb(body);
+}
+
+Snapshot::Snapshot()
+{
+}
+
+Snapshot::~Snapshot()
+{
+}
+
+/* Take a snapshot of an attached scene; any previous contents of the
+ * snapshot are discarded.
+ */
+bool
+Snapshot::capture(Scene *scene)
+{
+	std::vector<Loadable *>::const_iterator it;
+	std::vector<SnapshotNode> records;
+	std::string names;
+	btDefaultSerializer serializer;
+	SnapshotHeader *header;
+	SnapshotNode record;
+	btRigidBody *body;
+	btChunk *chunk, c;
+	const char *structType;
+	const unsigned char *p, *end;
+	Node *node;
+	Prop *prop;
+	size_t offset, length;
+	uint32_t nbodies;
+
+	clear();
+	if(!scene->sceneManager())
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: cannot take a snapshot of a scene which is not attached");
+		return false;
+	}
+	nbodies = 0;
+	serializer.startSerialization();
+	{
+		SceneDynamicsLock lock(scene);
+
+		for(it = scene->m_objects.begin(); it != scene->m_objects.end(); it++)
+		{
+			node = dynamic_cast<Node *>(*it);
+			if(!node || !node->sceneNode())
+			{
+				continue;
+			}
+			memset(&record, 0, sizeof(record));
+			record.name = names.length();
+			record.body = -1;
+			names += node->sceneNode()->getName();
+			names.push_back('\0');
+			node->snapshot(record);
+			/* Only dynamic bodies are serialized: static ones don't move,
+			 * and kinematic ones follow their nodes (or controllers)
+			 */
+			prop = dynamic_cast<Prop *>(node);
+			body = (prop ? prop->rigidBody() : NULL);
+			if(body && body->getBroadphaseHandle() && !body->isStaticOrKinematicObject())
+			{
+				chunk = serializer.allocate(body->calculateSerializeBufferSize(), 1);
+				structType = body->serialize(chunk->m_oldPtr, &serializer);
+				serializer.finalizeChunk(chunk, structType, BT_RIGIDBODY_CODE, body);
+				record.body = nbodies;
+				nbodies++;
+			}
+			records.push_back(record);
+		}
+	}
+	serializer.finishSerialization();
+	/* Lay out the header, the node records and their names */
+	offset = align(sizeof(SnapshotHeader));
+	m_data.resize(align(offset + records.size() * sizeof(SnapshotNode) + names.length()) + BT_HEADER_LENGTH);
+	header = (SnapshotHeader *) &(m_data[0]);
+	memcpy(header->magic, SNAPSHOT_MAGIC, 4);
+	header->byteorder = SNAPSHOT_BYTEORDER;
+	header->version = SNAPSHOT_VERSION;
+	header->nnodes = records.size();
+	header->nodes = offset;
+	header->names = offset + records.size() * sizeof(SnapshotNode);
+	header->nameslen = names.length();
+	header->nbodies = nbodies;
+	header->bodies = align(header->names + header->nameslen);
+	if(records.size())
+	{
+		memcpy(&(m_data[header->nodes]), &(records[0]), records.size() * sizeof(SnapshotNode));
+	}
+	memcpy(&(m_data[header->names]), names.data(), names.length());
+	/* Append the serializer's buffer, less its DNA */
+	p = serializer.getBufferPointer();
+	end = p + serializer.getCurrentBufferSize();
+	memcpy(&(m_data[header->bodies]), p, BT_HEADER_LENGTH);
+	for(p += BT_HEADER_LENGTH; p + sizeof(btChunk) <= end; p += length)
+	{
+		memcpy(&c, p, sizeof(btChunk));
+		length = sizeof(btChunk) + c.m_length;
+		if(c.m_chunkCode != BT_DNA_CODE)
+		{
+			m_data.insert(m_data.end(), p, p + length);
+		}
+	}
+	header = (SnapshotHeader *) &(m_data[0]);
+	header->bodieslen = m_data.size() - header->bodies;
+	if(!validate())
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to take a snapshot of the scene");
+		clear();
+		return false;
+	}
+	return true;
+}
+
+/* Restore a snapshot to the scene from which it was taken, which must still
+ * be attached
+ */
+bool
+Snapshot::restore(Scene *scene) const
+{
+	std::map<Ogre::String, Node *> nodes;
+	std::map<Ogre::String, Node *>::iterator nit;
+	std::vector<Loadable *>::const_iterator it;
+	const SnapshotHeader *header;
+	const SnapshotNode *records;
+	const char *names;
+	btDynamicsWorld *dynamics;
+	btDispatcher *dispatcher;
+	btRigidBodyData data;
+	btRigidBody *body;
+	Node *node;
+	Prop *prop;
+	uint32_t c;
+	int d;
+	size_t missing;
+
+	if(m_data.empty())
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: cannot restore an empty snapshot");
+		return false;
+	}
+	if(!scene->sceneManager())
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: cannot restore a snapshot to a scene which is not attached");
+		return false;
+	}
+	header = (const SnapshotHeader *) &(m_data[0]);
+	records = (const SnapshotNode *) &(m_data[header->nodes]);
+	names = (const char *) &(m_data[header->names]);
+	for(it = scene->m_objects.begin(); it != scene->m_objects.end(); it++)
+	{
+		node = dynamic_cast<Node *>(*it);
+		if(node && node->sceneNode())
+		{
+			nodes[node->sceneNode()->getName()] = node;
+		}
+	}
+	missing = 0;
+	dynamics = scene->dynamics();
+	SceneDynamicsLock lock(scene);
+
+	for(c = 0; c < header->nnodes; c++)
+	{
+		nit = nodes.find(names + records[c].name);
+		if(nit == nodes.end())
+		{
+			missing++;
+			continue;
+		}
+		if(records[c].body >= 0 && dynamics)
+		{
+			prop = dynamic_cast<Prop *>(nit->second);
+			body = (prop ? prop->rigidBody() : NULL);
+			if(body && body->getBroadphaseHandle() && !body->isStaticOrKinematicObject())
+			{
+				memcpy(&data, &(m_data[m_bodies[records[c].body]]), sizeof(data));
+				restoreBody(dynamics, body, data);
+			}
+		}
+		nit->second->restore(records[c]);
+	}
+	if(dynamics)
+	{
+		/* Forget the contacts made since the snapshot was taken; they're
+		 * found afresh in the next tick
+		 */
+		dispatcher = dynamics->getDispatcher();
+		for(d = 0; d < dispatcher->getNumManifolds(); d++)
+		{
+			dispatcher->getManifoldByIndexInternal(d)->clearManifold();
+		}
+	}
+	/* Any frames published by the physics thread are now out of date */
+	if(scene->m_physicsThread)
+	{
+		scene->m_physicsThread->invalidate();
+		scene->m_moving.clear();
+	}
+	if(missing)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: " + Ogre::StringConverter::toString(missing) + " nodes in the snapshot are not attached to the scene");
+	}
+	return true;
+}
+
+const void *
+Snapshot::data(void) const
+{
+	return (m_data.empty() ? NULL : &(m_data[0]));
+}
+
+size_t
+Snapshot::size(void) const
+{
+	return m_data.size();
+}
+
+size_t
+Snapshot::nodes(void) const
+{
+	return (m_data.empty() ? 0 : ((const SnapshotHeader *) &(m_data[0]))->nnodes);
+}
+
+size_t
+Snapshot::bodies(void) const
+{
+	return m_bodies.size();
+}
+
+/* Replace the contents of the snapshot with a copy of a blob previously
+ * obtained from data(); returns false (leaving the snapshot empty) if it
+ * isn't a valid snapshot, or was taken by an incompatible build
+ */
+bool
+Snapshot::assign(const void *data, size_t size)
+{
+	m_data.assign((const unsigned char *) data, (const unsigned char *) data + size);
+	if(!validate())
+	{
+		clear();
+		return false;
+	}
+	return true;
+}
+
+void
+Snapshot::clear(void)
+{
+	m_data.clear();
+	m_bodies.clear();
+}
+
+bool
+Snapshot::save(const Ogre::String &path) const
+{
+	FILE *f;
+	bool ok;
+
+	if(m_data.empty())
+	{
+		return false;
+	}
+	f = fopen(path.c_str(), "wb");
+	if(!f)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to open " + path + " for writing");
+		return false;
+	}
+	ok = (fwrite(&(m_data[0]), m_data.size(), 1, f) == 1);
+	if(fclose(f))
+	{
+		ok = false;
+	}
+	if(!ok)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to write snapshot to " + path);
+	}
+	return ok;
+}
+
+bool
+Snapshot::load(const Ogre::String &path)
+{
+	FILE *f;
+	long size;
+
+	clear();
+	f = fopen(path.c_str(), "rb");
+	if(!f)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to open snapshot " + path);
+		return false;
+	}
+	if(fseek(f, 0, SEEK_END) || (size = ftell(f)) < (long) sizeof(SnapshotHeader) || fseek(f, 0, SEEK_SET))
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: " + path + " is not a valid snapshot");
+		fclose(f);
+		return false;
+	}
+	m_data.resize(size);
+	if(fread(&(m_data[0]), size, 1, f) != 1)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to read snapshot " + path);
+		fclose(f);
+		clear();
+		return false;
+	}
+	fclose(f);
+	if(!validate())
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: " + path + " is not a valid snapshot, or was taken by an incompatible build");
+		clear();
+		return false;
+	}
+	return true;
+}
+
+/* Check that the snapshot is one we understand, and that everything within
+ * it is in bounds, so that restore() need not do so; the offsets of the
+ * rigid bodies' data are recorded as they're found.
+ */
+bool
+Snapshot::validate(void)
+{
+	const SnapshotHeader *h;
+	const SnapshotNode *n;
+	const unsigned char *p, *end;
+	btChunk c;
+	uint32_t i;
+
+	m_bodies.clear();
+	if(m_data.size() < sizeof(SnapshotHeader))
+	{
+		return false;
+	}
+	h = (const SnapshotHeader *) &(m_data[0]);
+	if(memcmp(h->magic, SNAPSHOT_MAGIC, 4) || h->byteorder != SNAPSHOT_BYTEORDER || h->version != SNAPSHOT_VERSION)
+	{
+		return false;
+	}
+	if((h->nodes % 8) || h->nodes < sizeof(SnapshotHeader) || h->nodes + (uint64_t) h->nnodes * sizeof(SnapshotNode) > h->names ||
+	   h->names + (uint64_t) h->nameslen > h->bodies || (h->nnodes && (!h->nameslen || m_data[h->names + h->nameslen - 1])) ||
+	   h->bodieslen < BT_HEADER_LENGTH || h->bodies + (uint64_t) h->bodieslen != m_data.size() ||
+	   !compatible(&(m_data[h->bodies])))
+	{
+		return false;
+	}
+	/* Find the rigid bodies amongst the chunks */
+	p = &(m_data[h->bodies]) + BT_HEADER_LENGTH;
+	end = &(m_data[0]) + m_data.size();
+	while(p < end)
+	{
+		if((size_t) (end - p) < sizeof(btChunk))
+		{
+			return false;
+		}
+		memcpy(&c, p, sizeof(btChunk));
+		if(c.m_length < 0 || (size_t) c.m_length > (size_t) (end - p) - sizeof(btChunk))
+		{
+			return false;
+		}
+		if(c.m_chunkCode == BT_RIGIDBODY_CODE)
+		{
+			if((size_t) c.m_length < sizeof(btRigidBodyData))
+			{
+				return false;
+			}
+			m_bodies.push_back(p + sizeof(btChunk) - &(m_data[0]));
+		}
+		p += sizeof(btChunk) + c.m_length;
+	}
+	if(m_bodies.size() != h->nbodies)
+	{
+		return false;
+	}
+	for(i = 0; i < h->nnodes; i++)
+	{
+		n = (const SnapshotNode *) &(m_data[h->nodes + i * sizeof(SnapshotNode)]);
+		if(n->name >= h->nameslen || n->body >= (int32_t) h->nbodies || n->body < -1)
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -26,67 +26,55 @@
 #include "jyuzau/camera.hh"
 #include "jyuzau/controller.hh"
 #include "jyuzau/light.hh"
+#include "jyuzau/trace.hh"
+#include "jyuzau/locomotion.hh"
+#include "jyuzau/kinematics.hh"
+#include "jyuzau/script.hh"
+#include "jyuzau/loadqueue.hh"
 
 #include <utility>
+#include <cstring>
 
 using namespace Jyuzau;
 
-struct StateOverlapCallback: public btBroadphaseAabbCallback
-{
-	btVector3 m_queryAabbMin;
-	btVector3 m_queryAabbMax;
-	int m_numOverlap;
-
-	StateOverlapCallback(const btVector3 &aabbMin, const btVector3 &aabbMax );
-	
-	virtual bool process(const btBroadphaseProxy *proxy);
-};
-
-StateOverlapCallback::StateOverlapCallback(const btVector3 &aabbMin, const btVector3 &aabbMax ):
-	m_queryAabbMin(aabbMin),
-	m_queryAabbMax(aabbMax),
-	m_numOverlap(0)
-{
-}
-
-bool
-StateOverlapCallback::process(const btBroadphaseProxy* proxy)
-{
-	btVector3 proxyAabbMin,proxyAabbMax;
-	btCollisionObject* colObj0 = (btCollisionObject*)proxy->m_clientObject;
-	
-	colObj0->getCollisionShape()->getAabb(colObj0->getWorldTransform(), proxyAabbMin,proxyAabbMax);
-	if (TestAabbAgainstAabb2(proxyAabbMin,proxyAabbMax,m_queryAabbMin,m_queryAabbMax))
-	{
-		m_numOverlap++;
-	}
-	return true;
-}
-
-
-
-
 State::State():
 	m_prev(NULL), m_next(NULL), m_loaded(false),
+	m_preloading(false),
+	m_preloadQueued(0), m_preloadCompleted(0),
 	m_sceneManager(NULL),
 	m_currentScene(NULL),
 	m_cameras(),
 	m_actors(),
+	m_locomotion(NULL),
+	m_scripts(NULL),
 	m_defaultPlayerCameraType(CT_FIRSTPERSON),
 	m_dynamics(NULL),
-	m_overlay(false)
+	m_tickRate(DYNAMICS_TICK_RATE),
+	m_maxSubsteps(DYNAMICS_MAX_SUBSTEPS),
+	m_accumulator(0),
+	m_overlay(false),
+	m_pool()
 {
 	m_core = Core::getInstance();
 	m_controller = m_core->controller();
+	memset(&m_dynamicsStats, 0, sizeof(m_dynamicsStats));
 }
 
 State::~State()
 {
+	/* Assets queued by a background preload refer back to us */
+	if(m_preloading)
+	{
+		m_core->loadQueue()->wait();
+	}
 	m_core->removeState(this);
 	if(m_currentScene)
 	{
 		deletePlayers(m_currentScene);
 	}
+	delete m_locomotion;
+	purgePool();
+	delete m_scripts;
 }
 
 Ogre::SceneManager *
@@ -117,6 +105,44 @@ State::dynamics(void) const
 	return m_dynamics;
 }
 
+/* The rate, in ticks per second, at which the dynamics world is stepped */
+int
+State::tickRate(void) const
+{
+	return m_tickRate;
+}
+
+void
+State::setTickRate(int rate)
+{
+	if(rate > 0)
+	{
+		m_tickRate = rate;
+	}
+}
+
+/* The maximum number of ticks which will be run in a single frame */
+int
+State::maxSubsteps(void) const
+{
+	return m_maxSubsteps;
+}
+
+void
+State::setMaxSubsteps(int steps)
+{
+	if(steps > 0)
+	{
+		m_maxSubsteps = steps;
+	}
+}
+
+const DynamicsStats &
+State::dynamicsStats(void) const
+{
+	return m_dynamicsStats;
+}
+
 bool
 State::overlay(void) const
 {
@@ -143,39 +169,176 @@ State::preload(void)
 	}
 }
 
-/* Add a non-unique asset to the object pool for later re-use */
+/* Begin loading the state without blocking the frame loop: createScenes()
+ * is invoked as normal, but the scenes it obtains from factory() are handed
+ * back unloaded, and are parsed (and their physics worlds created) by the
+ * LoadQueue's workers. As each scene is completed, the definitions of the
+ * assets it refers to are queued in turn. The rest of load(), which needs
+ * the scene manager, is left until the state is activated, by which time
+ * there should be little left to wait for.
+ */
 void
-State::addToPool(const Loadable *object)
+State::preloadInBackground(void)
 {
+	if(m_loaded || m_preloading)
+	{
+		return;
+	}
+	if(!m_core->loadQueue())
+	{
+		load();
+		return;
+	}
+	Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: preloading state in the background");
+	m_preloading = true;
+	m_preloadQueued = 0;
+	m_preloadCompleted = 0;
+	createScenes();
 }
 
-/* Create an instance of an asset */
-Loadable *
-State::factory(Ogre::String m_kind, Ogre::String m_name)
+bool
+State::preloading(void) const
 {
-	Loadable *loadable;
+	return m_preloading;
+}
+
+/* Returns true once everything queued by a background preload has been
+ * completed, such that activating the state won't have to wait
+ */
+bool
+State::preloaded(void) const
+{
+	return m_loaded || (m_preloading && m_preloadCompleted >= m_preloadQueued);
+}
+
+/* The proportion of the assets queued by a background preload which have
+ * been completed, for display by a loading screen; the total grows as
+ * each scene is parsed and the assets it refers to are discovered.
+ */
+float
+State::preloadProgress(void) const
+{
+	if(!m_preloading || !m_preloadQueued)
+	{
+		return (preloaded() ? 1.0f : 0.0f);
+	}
+	return (float) m_preloadCompleted / m_preloadQueued;
+}
+
+/* Invoked by the LoadQueue when one of our assets is queued */
+void
+State::assetQueued(Loadable *loadable)
+{
+	if(m_preloading)
+	{
+		m_preloadQueued++;
+	}
+}
+
+/* Invoked by the LoadQueue when one of our assets has been completed; if
+ * it's a scene being preloaded, the assets it refers to are queued next
+ */
+void
+State::assetLoaded(Loadable *loadable, bool status)
+{
+	Scene *scene;
+	
+	if(!m_preloading)
+	{
+		return;
+	}
+	if(status && (scene = dynamic_cast<Scene *>(loadable)))
+	{
+		scene->preload(m_core->loadQueue());
+	}
+	m_preloadCompleted++;
+	if(m_preloadCompleted == m_preloadQueued)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: background preload of " + std::to_string(m_preloadCompleted) + " assets complete");
+	}
+}
+
+/* Add a non-unique asset to the object pool for later re-use. The pool
+ * keeps its own duplicate of the definition (keyed by the kind::class group
+ * name), so the caller retains ownership of the instance passed in.
+ */
+void
+State::addToPool(const Loadable *object)
+{
+	Loadable *definition;
+	Ogre::String key;
 	
-	/* TODO: check pool */
-	if(!m_kind.compare("scene"))
+	if(object->unique())
 	{
-		loadable = new Scene(m_name, this);
+		return;
 	}
-	else if(!m_kind.compare("prop"))
+	key = object->group();
+	if(m_pool.find(key) != m_pool.end())
 	{
-		loadable = new Prop(m_name, this, m_kind);
+		return;
 	}
-	else if(!m_kind.compare("actor"))
+	definition = object->clone();
+	if(!definition)
 	{
-		loadable = new Actor(m_name, this);
+		return;
 	}
-	else if(!m_kind.compare("light"))
+	m_pool[key] = definition;
+}
+
+/* Return the pooled definition of an asset, if one has been loaded */
+const Loadable *
+State::pooled(Ogre::String kind, Ogre::String name) const
+{
+	std::map<Ogre::String, Loadable *>::const_iterator it;
+	
+	it = m_pool.find(kind + "::" + name);
+	if(it == m_pool.end())
 	{
-		loadable = new Light(m_name, this, m_kind);
+		return NULL;
 	}
-	else
+	return it->second;
+}
+
+/* Discard all of the pooled asset definitions */
+void
+State::purgePool(void)
+{
+	std::map<Ogre::String, Loadable *>::iterator it;
+	
+	for(it = m_pool.begin(); it != m_pool.end(); it++)
+	{
+		delete it->second;
+	}
+	m_pool.clear();
+}
+
+/* Create an instance of an asset. If the asset's definition has already
+ * been loaded, the new instance is duplicated from the pooled copy rather
+ * than parsing the descriptor and adding its resources again.
+ */
+Loadable *
+State::factory(Ogre::String m_kind, Ogre::String m_name)
+{
+	const Loadable *definition;
+	Loadable *loadable;
+	
+	definition = pooled(m_kind, m_name);
+	if(definition)
+	{
+		return definition->clone();
+	}
+	loadable = create(m_kind, m_name);
+	if(!loadable)
 	{
 		return NULL;
 	}
+	/* While preloading in the background, a unique asset (i.e., a scene) is
+	 * loaded in place by a worker, and returned to the caller unloaded
+	 */
+	if(m_preloading && loadable->unique() && m_core->loadQueue()->enqueue(loadable, false))
+	{
+		return loadable;
+	}
 	if(!loadable->load())
 	{
 		delete loadable;
@@ -184,14 +347,46 @@ State::factory(Ogre::String m_kind, Ogre::String m_name)
 	return loadable;
 }
 
+/* Create a new, unloaded, instance of an asset of the specified kind */
+Loadable *
+State::create(Ogre::String kind, Ogre::String name)
+{
+	if(!kind.compare("scene"))
+	{
+		return new Scene(name, this);
+	}
+	if(!kind.compare("prop"))
+	{
+		return new Prop(name, this, kind);
+	}
+	if(!kind.compare("actor"))
+	{
+		return new Actor(name, this);
+	}
+	if(!kind.compare("light"))
+	{
+		return new Light(name, this, kind);
+	}
+	return NULL;
+}
+
 /* Invoked by preload() or activated() to demand-load the resources for the
- * state.
+ * state; if a background preload is under way, its scenes have already been
+ * created, and anything which remains outstanding is waited for.
  */
 void
 State::load(void)
 {
 	m_loaded = true;
-	createScenes();
+	if(m_preloading)
+	{
+		m_core->loadQueue()->wait();
+		m_preloading = false;
+	}
+	else
+	{
+		createScenes();
+	}
 	createSceneManager();
 	attachScenes();
 }
@@ -255,7 +450,7 @@ State::createPlayers(Scene *scene)
 			Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to create actor for Character '" + c->title() + "'");
 			continue;
 		}
-		m_actors.push_back(a);
+		addActor(a);
 		/* Temporary hack until spawn points are implemented */
 		a->setPosition(0, 0, 200);
 		cam = a->createCamera(m_defaultPlayerCameraType);
@@ -268,6 +463,68 @@ State::createPlayers(Scene *scene)
 	}
 }
 
+/* Take ownership of an actor which has been attached to the current scene,
+ * so that it's moved each frame and deleted along with the players. If
+ * batched locomotion is enabled, an actor without a Character is moved by
+ * the State's Locomotion rather than by its own frameRenderingQueued().
+ */
+void
+State::addActor(Actor *actor)
+{
+	m_actors.push_back(actor);
+	if(m_locomotion && !actor->character())
+	{
+		m_locomotion->add(actor);
+	}
+}
+
+Locomotion *
+State::locomotion(void) const
+{
+	return m_locomotion;
+}
+
+/* Enable or disable batched locomotion; actors which have already been added
+ * are moved across accordingly
+ */
+void
+State::setBatchedLocomotion(bool enabled)
+{
+	std::vector<Actor *>::iterator ait;
+
+	if(enabled == (m_locomotion != NULL))
+	{
+		return;
+	}
+	if(!enabled)
+	{
+		delete m_locomotion;
+		m_locomotion = NULL;
+		return;
+	}
+	m_locomotion = new Locomotion();
+	for(ait = m_actors.begin(); ait != m_actors.end(); ait++)
+	{
+		if(!(*ait)->character())
+		{
+			m_locomotion->add(*ait);
+		}
+	}
+}
+
+/* The scheduler which runs the behaviour scripts of our props and actors,
+ * which is created when the first of them is attached
+ */
+ScriptScheduler *
+State::scripts(void)
+{
+	if(!m_scripts)
+	{
+		m_scripts = new ScriptScheduler();
+	}
+	return m_scripts;
+}
+
 /* This is a utility method invoked primarily by sceneDetached() to remove
  * any cameras and actors from the scene.
  */
@@ -347,16 +604,120 @@ State::removeViewports(Ogre::RenderWindow *window)
 /* Utility method invoked by frameEventQueued() to ensure that the dynamics
  * world is updated before the frame is rendered and to perform any
  * collision-related processing.
+ *
+ * The world is always stepped in fixed ticks of 1/m_tickRate seconds,
+ * however long the frame took: elapsed time accumulates until there's at
+ * least a whole tick's worth, and whatever is left over after the ticks
+ * have been run is used to blend the rendered position of each body
+ * between its two most recent simulated transforms (see
+ * Prop::interpolate()). If the frame took so long that more than
+ * m_maxSubsteps ticks are due, the excess is dropped rather than allowing
+ * the simulation to fall ever further behind.
+ *
+ * If the scene is threaded, the world is stepped in the same way by its
+ * physics thread instead, and we need only pick up the results.
+ *
+ * Either way, the movement of the scene's kinematic characters is handed
+ * to its Crowd, along with the positions of the cameras, and their new
+ * positions are collected.
  */
 void
 State::updatePhysics(btScalar timeSinceLastFrame)
 {
-/*	btVector3 aabbMin(1,1,1);
-	btVector3 aabbMax(2,2,2);
-	StateOverlapCallback aabbOverlap(aabbMin,aabbMax);*/
+	std::vector<Ogre::Vector3> points;
+	btScalar tick, limit;
+	Crowd *crowd;
+	int steps;
+
+	crowd = (m_currentScene ? m_currentScene->crowd() : NULL);
+	if(crowd && !crowd->size())
+	{
+		crowd = NULL;
+	}
+	if(crowd)
+	{
+		focus(points);
+		crowd->setFocus(points);
+	}
+	if(m_currentScene && m_currentScene->threaded())
+	{
+		m_currentScene->synchronise(m_dynamicsStats);
+		return;
+	}
+	if(crowd)
+	{
+		crowd->submit();
+	}
+	tick = btScalar(1) / m_tickRate;
+	limit = tick * m_maxSubsteps;
+	m_dynamicsStats.dropped = 0;
+	m_accumulator += timeSinceLastFrame;
+	if(m_accumulator > limit)
+	{
+		m_dynamicsStats.dropped = m_accumulator - limit;
+		m_accumulator = limit;
+	}
+	m_dynamicsTimer.reset();
+	for(steps = 0; m_accumulator >= tick; steps++)
+	{
+		/* With maxSubSteps of zero, Bullet performs exactly one step of the
+		 * length given and reports the resulting transforms to each body's
+		 * motion state.
+		 */
+		m_dynamics->stepSimulation(tick, 0);
+		m_accumulator -= tick;
+	}
+	if(crowd)
+	{
+		crowd->collect(m_dynamicsStats);
+	}
+	m_dynamicsStats.steps = steps;
+	m_dynamicsStats.alpha = m_accumulator / tick;
+	if(m_currentScene)
+	{
+		m_currentScene->interpolate(m_dynamicsStats.alpha);
+	}
+	m_dynamicsStats.time = m_dynamicsTimer.getMicroseconds() / 1000.0f;
+	if(m_currentScene && steps && m_currentScene->broadphaseStats())
+	{
+		const BroadphaseStats *bp = m_currentScene->broadphaseStats();
+
+		m_dynamicsStats.objects = bp->objects;
+		m_dynamicsStats.pairs = bp->pairs;
+		m_dynamicsStats.aabbTime = bp->aabbTime;
+		m_dynamicsStats.pairTime = bp->pairTime;
+	}
+}
+
+/* Utility method invoked by frameRenderingQueued() to allow a streamed scene
+ * to attach and evict cells according to the positions of our cameras; this
+ * takes place before the dynamics world is stepped, so that nothing falls
+ * through a floor which hasn't been attached yet.
+ */
+void
+State::updateStreaming(void)
+{
+	std::vector<Ogre::Vector3> points;
+	
+	focus(points);
+	m_currentScene->stream(points);
+}
 
-	m_dynamics->stepSimulation(timeSinceLastFrame, 60);
-/*	m_dynamics->getBroadphase()->aabbTest(aabbMin, aabbMax, aabbOverlap); */
+/* Obtain the points around which the scene is streamed, and near to which
+ * characters are moved precisely: the positions of our cameras
+ */
+void
+State::focus(std::vector<Ogre::Vector3> &points) const
+{
+	std::vector<Camera *>::const_iterator cit;
+
+	for(cit = m_cameras.begin(); cit != m_cameras.end(); cit++)
+	{
+		if((*cit)->camera)
+		{
+			points.push_back((*cit)->camera->getDerivedPosition());
+		}
+	}
 }
 
 /* Event listeners */
@@ -369,6 +730,7 @@ State::sceneAttached(Scene *scene)
 {
 	m_currentScene = scene;
 	m_dynamics = scene->dynamics();
+	m_accumulator = 0;
 	createPlayers(scene);
 }
 
@@ -430,13 +792,41 @@ bool
 State::frameRenderingQueued(const Ogre::FrameEvent& evt)
 {
 	std::vector<Actor *>::iterator ait;
+	Tracer *tracer;
 	
+	tracer = m_core->tracer();
+	if(m_currentScene && m_currentScene->streaming())
+	{
+		TraceScope scope(tracer, "State::updateStreaming");
+		
+		updateStreaming();
+	}
 	if(m_dynamics)
 	{
+		TraceScope scope(tracer, "State::updatePhysics");
+		
 		updatePhysics(evt.timeSinceLastFrame);
 	}
+	if(m_scripts && m_scripts->size())
+	{
+		TraceScope scope(tracer, "ScriptScheduler::update");
+		
+		m_scripts->update(evt.timeSinceLastFrame);
+	}
+	if(m_locomotion && m_locomotion->size())
+	{
+		TraceScope scope(tracer, "Locomotion::update");
+		
+		m_locomotion->update(evt.timeSinceLastFrame);
+	}
 	for(ait = m_actors.begin(); ait != m_actors.end(); ait++)
 	{
+		if((*ait)->locomotion())
+		{
+			continue;
+		}
+		TraceScope scope(tracer, "Actor::frameRenderingQueued");
+		
 		(*ait)->frameRenderingQueued(evt);
 	}
 	return true;
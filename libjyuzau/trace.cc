@@ -0,0 +1,508 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <OGRE/OgreLogManager.h>
+#include <OGRE/OgreProfiler.h>
+
+#include "jyuzau/trace.hh"
+
+using namespace Jyuzau;
+
+/* Each thread's buffer is found through a thread-local pointer, tagged with
+ * the serial number of the Tracer which it belongs to, so that a buffer
+ * left over from a Tracer which has since been destroyed is never used.
+ */
+struct ThreadTrace
+{
+	unsigned long serial;
+	TraceBuffer *buffer;
+};
+
+static std::atomic<unsigned long> tracerSerial(0);
+static thread_local ThreadTrace threadTrace = { 0, NULL };
+
+/* Write a string to a trace file as a JSON string literal */
+static void
+writeString(FILE *f, const char *str)
+{
+	fputc('"', f);
+	for(; *str; str++)
+	{
+		if(*str == '"' || *str == '\\')
+		{
+			fputc('\\', f);
+			fputc(*str, f);
+		}
+		else if((unsigned char) *str < 0x20)
+		{
+			fprintf(f, "\\u%04x", (unsigned char) *str);
+		}
+		else
+		{
+			fputc(*str, f);
+		}
+	}
+	fputc('"', f);
+}
+
+/* TraceBuffer */
+
+TraceBuffer::TraceBuffer(unsigned int thread, size_t capacity):
+	m_thread(thread),
+	m_name(NULL),
+	m_spans(NULL),
+	m_capacity(capacity),
+	m_head(0),
+	m_depth(0),
+	m_skipped(0)
+{
+	m_spans = new TraceSpan[capacity];
+}
+
+TraceBuffer::~TraceBuffer()
+{
+	delete [] m_spans;
+}
+
+unsigned int
+TraceBuffer::thread(void) const
+{
+	return m_thread;
+}
+
+const char *
+TraceBuffer::name(void) const
+{
+	return m_name;
+}
+
+void
+TraceBuffer::setName(const char *name)
+{
+	m_name = name;
+}
+
+/* Open a span; spans nested more deeply than TRACE_MAX_DEPTH are counted so
+ * that the matching end() can be ignored, but aren't recorded
+ */
+bool
+TraceBuffer::begin(const char *name, uint64_t now)
+{
+	if(m_depth >= TRACE_MAX_DEPTH)
+	{
+		m_skipped++;
+		return true;
+	}
+	m_open[m_depth] = name;
+	m_openBegin[m_depth] = now;
+	m_depth++;
+	return true;
+}
+
+/* Close the innermost open span, returning its name */
+const char *
+TraceBuffer::end(uint64_t now)
+{
+	if(m_skipped)
+	{
+		m_skipped--;
+		return NULL;
+	}
+	if(!m_depth)
+	{
+		return NULL;
+	}
+	m_depth--;
+	push(m_open[m_depth], m_openBegin[m_depth], now);
+	return m_open[m_depth];
+}
+
+void
+TraceBuffer::push(const char *name, uint64_t begin, uint64_t end)
+{
+	uint64_t head;
+	TraceSpan *span;
+
+	head = m_head.load(std::memory_order_relaxed);
+	span = &(m_spans[head % m_capacity]);
+	span->name = name;
+	span->begin = begin;
+	span->end = end;
+	m_head.store(head + 1, std::memory_order_release);
+}
+
+/* Copy every span still held by the buffer, oldest first */
+void
+TraceBuffer::snapshot(std::vector<TraceSpan> &spans) const
+{
+	uint64_t first, head, c;
+	size_t base;
+
+	base = spans.size();
+	head = m_head.load(std::memory_order_acquire);
+	first = (head > m_capacity) ? head - m_capacity : 0;
+	for(c = first; c < head; c++)
+	{
+		spans.push_back(m_spans[c % m_capacity]);
+	}
+	/* Anything before the oldest slot which remains intact after copying
+	 * may have been overwritten while we were reading it
+	 */
+	head = m_head.load(std::memory_order_acquire);
+	if(head > m_capacity && head - m_capacity > first)
+	{
+		c = std::min<uint64_t>(head - m_capacity - first, spans.size() - base);
+		spans.erase(spans.begin() + base, spans.begin() + base + c);
+	}
+}
+
+/* Obtain the durations (in milliseconds) of up to count of the most recent
+ * spans with the given name, newest first
+ */
+void
+TraceBuffer::recent(const char *name, size_t count, std::vector<float> &durations) const
+{
+	std::vector<uint64_t> indices;
+	uint64_t first, head, c;
+	const TraceSpan *span;
+
+	head = m_head.load(std::memory_order_acquire);
+	first = (head > m_capacity) ? head - m_capacity : 0;
+	for(c = head; c > first && indices.size() < count; c--)
+	{
+		span = &(m_spans[(c - 1) % m_capacity]);
+		if(span->name == name || (span->name && !strcmp(span->name, name)))
+		{
+			durations.push_back((span->end - span->begin) / 1000000.0f);
+			indices.push_back(c - 1);
+		}
+	}
+	head = m_head.load(std::memory_order_acquire);
+	if(head > m_capacity)
+	{
+		first = head - m_capacity;
+		while(indices.size() && indices.back() < first)
+		{
+			indices.pop_back();
+			durations.pop_back();
+		}
+	}
+}
+
+/* Tracer */
+
+Tracer::Tracer():
+	m_enabled(false),
+	m_epoch(std::chrono::steady_clock::now()),
+	m_mainThread(std::this_thread::get_id()),
+	m_serial(++tracerSerial)
+{
+}
+
+Tracer::~Tracer()
+{
+	std::vector<TraceBuffer *>::iterator it;
+
+	for(it = m_buffers.begin(); it != m_buffers.end(); it++)
+	{
+		delete (*it);
+	}
+}
+
+bool
+Tracer::enabled(void) const
+{
+	return m_enabled.load(std::memory_order_relaxed);
+}
+
+void
+Tracer::setEnabled(bool enabled)
+{
+	m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/* Return the time in nanoseconds since the Tracer was created */
+uint64_t
+Tracer::now(void) const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+/* Return the calling thread's buffer, creating it if this is the first span
+ * the thread has recorded; this is the only time a lock is taken.
+ */
+TraceBuffer *
+Tracer::buffer(void)
+{
+	TraceBuffer *buffer;
+
+	if(threadTrace.serial == m_serial)
+	{
+		return threadTrace.buffer;
+	}
+	std::lock_guard<std::mutex> lock(m_mutex);
+	buffer = new TraceBuffer(m_buffers.size() + 1, TRACE_BUFFER_SPANS);
+	m_buffers.push_back(buffer);
+	threadTrace.serial = m_serial;
+	threadTrace.buffer = buffer;
+	return buffer;
+}
+
+bool
+Tracer::begin(const char *name)
+{
+	if(!enabled())
+	{
+		return false;
+	}
+#if OGRE_PROFILING == 1
+	if(std::this_thread::get_id() == m_mainThread && Ogre::Profiler::getSingletonPtr())
+	{
+		Ogre::Profiler::getSingleton().beginProfile(name);
+	}
+#endif
+	return buffer()->begin(name, now());
+}
+
+void
+Tracer::end(void)
+{
+	const char *name;
+
+	name = buffer()->end(now());
+#if OGRE_PROFILING == 1
+	if(name && std::this_thread::get_id() == m_mainThread && Ogre::Profiler::getSingletonPtr())
+	{
+		Ogre::Profiler::getSingleton().endProfile(name);
+	}
+#else
+	(void) name;
+#endif
+}
+
+/* Record a span which has already been timed */
+void
+Tracer::span(const char *name, uint64_t begin, uint64_t end)
+{
+	if(enabled())
+	{
+		buffer()->push(name, begin, end);
+	}
+}
+
+/* Give the calling thread a name, which is shown in the trace */
+void
+Tracer::nameThread(const char *name)
+{
+	buffer()->setName(name);
+}
+
+/* Calculate percentiles of the durations of the most recent spans with the
+ * given name, on any thread
+ */
+bool
+Tracer::stats(const char *name, TraceStats &stats, size_t window)
+{
+	std::vector<float> durations;
+	std::vector<TraceBuffer *>::iterator it;
+	size_t n;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for(it = m_buffers.begin(); it != m_buffers.end(); it++)
+		{
+			(*it)->recent(name, window, durations);
+		}
+	}
+	stats.count = durations.size();
+	if(!stats.count)
+	{
+		stats.p50 = stats.p95 = stats.p99 = stats.max = 0;
+		return false;
+	}
+	std::sort(durations.begin(), durations.end());
+	n = durations.size();
+	stats.p50 = durations[(n - 1) * 50 / 100];
+	stats.p95 = durations[(n - 1) * 95 / 100];
+	stats.p99 = durations[(n - 1) * 99 / 100];
+	stats.max = durations[n - 1];
+	return true;
+}
+
+/* Write every span still held to a file in Chrome's trace event format */
+bool
+Tracer::write(const Ogre::String &path)
+{
+	std::vector<TraceSpan> spans;
+	std::vector<TraceSpan>::iterator sit;
+	std::vector<TraceBuffer *>::iterator it;
+	FILE *f;
+	bool first;
+	char buf[32];
+
+	f = fopen(path.c_str(), "w");
+	if(!f)
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to open " + path + " to write trace");
+		return false;
+	}
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	first = true;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for(it = m_buffers.begin(); it != m_buffers.end(); it++)
+		{
+			fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", (first ? "" : ","), (*it)->thread());
+			if((*it)->name())
+			{
+				writeString(f, (*it)->name());
+			}
+			else
+			{
+				snprintf(buf, sizeof(buf), "thread %u", (*it)->thread());
+				writeString(f, buf);
+			}
+			fprintf(f, "}}");
+			first = false;
+			spans.clear();
+			(*it)->snapshot(spans);
+			for(sit = spans.begin(); sit != spans.end(); sit++)
+			{
+				fprintf(f, ",\n{\"name\":");
+				writeString(f, sit->name);
+				fprintf(f, ",\"cat\":\"jyuzau\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", (*it)->thread(), sit->begin / 1000.0, (sit->end - sit->begin) / 1000.0);
+			}
+		}
+	}
+	fprintf(f, "\n]}\n");
+	if(fclose(f))
+	{
+		Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: failed to write trace to " + path);
+		return false;
+	}
+	Ogre::LogManager::getSingletonPtr()->logMessage("Jyuzau: trace written to " + path);
+	return true;
+}
+
+/* TraceScope */
+
+TraceScope::TraceScope(Tracer *tracer, const char *name):
+	m_tracer(NULL)
+{
+	if(tracer && tracer->begin(name))
+	{
+		m_tracer = tracer;
+	}
+}
+
+TraceScope::~TraceScope()
+{
+	if(m_tracer)
+	{
+		m_tracer->end();
+	}
+}
+
+/* RenderTrace */
+
+RenderTrace::RenderTrace(Tracer *tracer):
+	m_tracer(tracer),
+	m_viewport(false),
+	m_sceneGraph(false),
+	m_culling(false),
+	m_submission(false)
+{
+}
+
+RenderTrace::~RenderTrace()
+{
+}
+
+void
+RenderTrace::preViewportUpdate(const Ogre::RenderTargetViewportEvent &evt)
+{
+	m_viewport = m_tracer->begin("Viewport");
+}
+
+/* Submission runs from the end of culling until the viewport has been
+ * rendered
+ */
+void
+RenderTrace::postViewportUpdate(const Ogre::RenderTargetViewportEvent &evt)
+{
+	if(m_submission)
+	{
+		m_tracer->end();
+		m_submission = false;
+	}
+	if(m_viewport)
+	{
+		m_tracer->end();
+		m_viewport = false;
+	}
+}
+
+void
+RenderTrace::preUpdateSceneGraph(Ogre::SceneManager *source, Ogre::Camera *camera)
+{
+	m_sceneGraph = m_tracer->begin("Scene graph");
+}
+
+void
+RenderTrace::postUpdateSceneGraph(Ogre::SceneManager *source, Ogre::Camera *camera)
+{
+	if(m_sceneGraph)
+	{
+		m_tracer->end();
+		m_sceneGraph = false;
+	}
+}
+
+/* Shadow textures are rendered (and so their casters culled) from within
+ * the main pass; only the main pass is traced, so that the spans nest.
+ */
+void
+RenderTrace::preFindVisibleObjects(Ogre::SceneManager *source, Ogre::SceneManager::IlluminationRenderStage irs, Ogre::Viewport *v)
+{
+	if(irs == Ogre::SceneManager::IRS_NONE && !m_submission)
+	{
+		m_culling = m_tracer->begin("Culling");
+	}
+}
+
+void
+RenderTrace::postFindVisibleObjects(Ogre::SceneManager *source, Ogre::SceneManager::IlluminationRenderStage irs, Ogre::Viewport *v)
+{
+	if(!m_culling)
+	{
+		return;
+	}
+	m_tracer->end();
+	m_culling = false;
+	if(m_viewport)
+	{
+		m_submission = m_tracer->begin("Submission");
+	}
+}
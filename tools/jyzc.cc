@@ -0,0 +1,624 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* jyzc: compile Jyuzau asset descriptors (scene.xml, prop.xml, actor.xml)
+ * into the binary form loaded by Jyuzau::Loadable.
+ *
+ * Usage: jyzc [-o OUTPUT] FILE.xml
+ *        jyzc FILE.xml [FILE.xml ...]
+ *        jyzc --bench [-n ITERATIONS] FILE.xml
+ *        jyzc --pack -o OUTPUT.jyzp PATH [PATH ...]
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include <libxml/parser.h>
+
+#include "jyuzau/compiled.hh"
+#include "jyuzau/packed.hh"
+
+using namespace Jyuzau;
+
+typedef std::pair<std::string, std::string> BenchAttr;
+typedef std::vector<BenchAttr> BenchAttrList;
+
+/* The Compiler class accumulates the tables of a compiled document as the
+ * source is parsed, then writes them out.
+ */
+class Compiler
+{
+public:
+	Compiler();
+
+	bool parse(const std::string &path);
+	bool write(const std::string &path);
+
+	static void sax_startElement(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes);
+	static void sax_endElement(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI);
+protected:
+	std::map<std::string, uint32_t> m_index;
+	std::vector<uint32_t> m_strings;
+	std::string m_data;
+	std::vector<CompiledElement> m_elements;
+	std::vector<CompiledAttr> m_attrs;
+	uint32_t m_depth;
+	bool m_error;
+
+	uint32_t intern(const std::string &str);
+};
+
+Compiler::Compiler():
+	m_depth(0),
+	m_error(false)
+{
+}
+
+/* Return the index of a string in the string table, adding it if needed */
+uint32_t
+Compiler::intern(const std::string &str)
+{
+	std::map<std::string, uint32_t>::iterator it;
+	uint32_t index;
+
+	it = m_index.find(str);
+	if(it != m_index.end())
+	{
+		return it->second;
+	}
+	index = m_strings.size();
+	m_strings.push_back(m_data.length());
+	m_data.append(str);
+	m_data.push_back(0);
+	m_index[str] = index;
+	return index;
+}
+
+/* Parse a source document using the same SAX2 options as Loadable */
+bool
+Compiler::parse(const std::string &path)
+{
+	xmlParserCtxtPtr ctx;
+	xmlSAXHandler sax;
+	xmlDocPtr doc;
+
+	memset(&sax, 0, sizeof(sax));
+	sax.initialized = XML_SAX2_MAGIC;
+	sax.startElementNs = sax_startElement;
+	sax.endElementNs = sax_endElement;
+	ctx = xmlCreatePushParserCtxt(&(sax), (void *) this, "", 0, NULL);
+	if(!ctx)
+	{
+		fprintf(stderr, "jyzc: failed to create XML parser context\n");
+		return false;
+	}
+	xmlCtxtUseOptions(ctx, XML_PARSE_NODICT | XML_PARSE_NOENT);
+	doc = xmlCtxtReadFile(ctx, path.c_str(), "utf-8", XML_PARSE_NONET|XML_PARSE_NOCDATA);
+	if(doc)
+	{
+		xmlFreeDoc(doc);
+	}
+	if(!ctx->wellFormed)
+	{
+		m_error = true;
+	}
+	xmlFreeParserCtxt(ctx);
+	if(m_error || !m_elements.size())
+	{
+		fprintf(stderr, "jyzc: %s: failed to parse document\n", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+/* Write the compiled document */
+bool
+Compiler::write(const std::string &path)
+{
+	CompiledHeader h;
+	FILE *f;
+	std::string tmp;
+	static const char pad[4] = { 0, 0, 0, 0 };
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, COMPILED_MAGIC, 4);
+	h.byteorder = COMPILED_BYTEORDER;
+	h.version = COMPILED_VERSION;
+	h.nstrings = m_strings.size();
+	h.nelements = m_elements.size();
+	h.nattrs = m_attrs.size();
+	h.strings = sizeof(h);
+	h.elements = h.strings + h.nstrings * sizeof(uint32_t);
+	h.attrs = h.elements + h.nelements * sizeof(CompiledElement);
+	h.data = h.attrs + h.nattrs * sizeof(CompiledAttr);
+	h.datalen = m_data.length();
+	/* Write to a temporary file and rename it into place, so that a
+	 * running engine never sees a partially-written document
+	 */
+	tmp = path + ".tmp";
+	f = fopen(tmp.c_str(), "wb");
+	if(!f)
+	{
+		perror(tmp.c_str());
+		return false;
+	}
+	if(fwrite(&h, sizeof(h), 1, f) != 1 ||
+	   (h.nstrings && fwrite(&(m_strings[0]), sizeof(uint32_t), h.nstrings, f) != h.nstrings) ||
+	   fwrite(&(m_elements[0]), sizeof(CompiledElement), h.nelements, f) != h.nelements ||
+	   (h.nattrs && fwrite(&(m_attrs[0]), sizeof(CompiledAttr), h.nattrs, f) != h.nattrs) ||
+	   fwrite(m_data.data(), 1, h.datalen, f) != h.datalen ||
+	   fwrite(pad, 1, (4 - (h.datalen % 4)) % 4, f) != (4 - (h.datalen % 4)) % 4)
+	{
+		perror(tmp.c_str());
+		fclose(f);
+		remove(tmp.c_str());
+		return false;
+	}
+	if(fclose(f) || rename(tmp.c_str(), path.c_str()))
+	{
+		perror(path.c_str());
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+void
+Compiler::sax_startElement(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+	Compiler *me = reinterpret_cast<Compiler *>(ctx);
+	CompiledElement el;
+	CompiledAttr attr;
+	std::string name;
+	int i, c;
+
+	if(!me->m_depth && me->m_elements.size())
+	{
+		me->m_error = true;
+		return;
+	}
+	name = (URI ? (const char *) URI : "");
+	name.append((const char *) localname);
+	el.name = me->intern(name);
+	el.depth = me->m_depth;
+	el.attr = me->m_attrs.size();
+	el.nattrs = nb_attributes;
+	for(i = c = 0; c < nb_attributes; c++)
+	{
+		name = (attributes[i + 2] ? (const char *) attributes[i + 2] : "");
+		name.append((const char *) attributes[i]);
+		attr.name = me->intern(name);
+		attr.value = me->intern(std::string((const char *) attributes[i + 3], (size_t) (attributes[i + 4] - attributes[i + 3])));
+		me->m_attrs.push_back(attr);
+		i += 5;
+	}
+	me->m_elements.push_back(el);
+	me->m_depth++;
+}
+
+void
+Compiler::sax_endElement(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+{
+	Compiler *me = reinterpret_cast<Compiler *>(ctx);
+
+	me->m_depth--;
+}
+
+/* Benchmarking: the SAX handler does the same per-element work as
+ * Loadable::startElement() in order to build the attribute list, while
+ * the replay does the same work as Loadable::loadCompiled().
+ */
+static size_t bench_elements;
+
+static void
+bench_startElement(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI, int nb_namespaces, const xmlChar **namespaces, int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+	std::string name((const char *) localname);
+	std::string ns(URI ? (const char *) URI : "");
+	std::string qname(ns + name);
+	BenchAttrList attrs;
+	int i, c;
+
+	for(i = c = 0; c < nb_attributes; c++)
+	{
+		std::string ans(attributes[i + 2] ? (const char *) attributes[i + 2] : "");
+		std::string aname((const char *) attributes[i]);
+		std::string attr(ans + aname);
+		std::string value((const char *) attributes[i + 3], (size_t) (attributes[i + 4] - attributes[i + 3]));
+		attrs.push_back(std::make_pair(attr, value));
+		i += 5;
+	}
+	bench_elements += attrs.size() + 1;
+}
+
+static double
+bench_xml(const std::string &path)
+{
+	xmlParserCtxtPtr ctx;
+	xmlSAXHandler sax;
+	xmlDocPtr doc;
+	std::chrono::steady_clock::time_point start;
+
+	start = std::chrono::steady_clock::now();
+	memset(&sax, 0, sizeof(sax));
+	sax.initialized = XML_SAX2_MAGIC;
+	sax.startElementNs = bench_startElement;
+	ctx = xmlCreatePushParserCtxt(&(sax), NULL, "", 0, NULL);
+	xmlCtxtUseOptions(ctx, XML_PARSE_NODICT | XML_PARSE_NOENT);
+	doc = xmlCtxtReadFile(ctx, path.c_str(), "utf-8", XML_PARSE_NONET|XML_PARSE_NOCDATA);
+	if(doc)
+	{
+		xmlFreeDoc(doc);
+	}
+	xmlFreeParserCtxt(ctx);
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double
+bench_compiled(const std::string &path)
+{
+	CompiledDocument doc;
+	std::vector<std::string> strings;
+	const CompiledElement *el;
+	const CompiledAttr *attr;
+	std::chrono::steady_clock::time_point start;
+	uint32_t c, n;
+
+	start = std::chrono::steady_clock::now();
+	if(!doc.open(path))
+	{
+		return -1;
+	}
+	strings.reserve(doc.strings());
+	for(c = 0; c < doc.strings(); c++)
+	{
+		strings.push_back(std::string(doc.string(c)));
+	}
+	for(c = 0; c < doc.elements(); c++)
+	{
+		BenchAttrList attrs;
+
+		el = doc.element(c);
+		attrs.reserve(el->nattrs);
+		for(n = 0; n < el->nattrs; n++)
+		{
+			attr = doc.attr(el->attr + n);
+			attrs.push_back(std::make_pair(strings[attr->name], strings[attr->value]));
+		}
+		bench_elements += attrs.size() + 1;
+	}
+	doc.close();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int
+bench(const std::string &path, int iterations)
+{
+	Compiler compiler;
+	std::string compiled;
+	double xml, bin, t;
+	size_t xmlcount, bincount;
+	int c;
+
+	compiled = CompiledDocument::compiledPath(path);
+	if(!compiler.parse(path) || !compiler.write(compiled))
+	{
+		return 1;
+	}
+	xml = bin = 0;
+	bench_elements = 0;
+	for(c = 0; c < iterations; c++)
+	{
+		xml += bench_xml(path);
+	}
+	xmlcount = bench_elements;
+	bench_elements = 0;
+	for(c = 0; c < iterations; c++)
+	{
+		t = bench_compiled(compiled);
+		if(t < 0)
+		{
+			fprintf(stderr, "jyzc: %s: failed to load compiled document\n", compiled.c_str());
+			return 1;
+		}
+		bin += t;
+	}
+	bincount = bench_elements;
+	if(xmlcount != bincount)
+	{
+		fprintf(stderr, "jyzc: %s: compiled document differs from source (%lu vs %lu nodes)\n", path.c_str(), (unsigned long) bincount, (unsigned long) xmlcount);
+		return 1;
+	}
+	printf("%s: %lu elements and attributes, %d iterations\n", path.c_str(), (unsigned long) (xmlcount / iterations), iterations);
+	printf("  xml:      %10.3f ms/load\n", xml / iterations);
+	printf("  compiled: %10.3f ms/load\n", bin / iterations);
+	printf("  speed-up: %10.2fx\n", xml / bin);
+	return 0;
+}
+
+/* Packing: every file beneath each of the paths is added to the archive,
+ * under its path as given, so that it can be found by the same path that
+ * would be used to open it unpacked; hidden files are skipped. Assets should
+ * be compiled first, so that the compiled documents are packed too.
+ */
+static bool
+collect(const std::string &path, std::vector<std::string> &files)
+{
+	struct stat sb;
+	DIR *dir;
+	struct dirent *de;
+	bool status;
+
+	if(stat(path.c_str(), &sb))
+	{
+		perror(path.c_str());
+		return false;
+	}
+	if(S_ISREG(sb.st_mode))
+	{
+		files.push_back(path);
+		return true;
+	}
+	if(!S_ISDIR(sb.st_mode))
+	{
+		return true;
+	}
+	dir = opendir(path.c_str());
+	if(!dir)
+	{
+		perror(path.c_str());
+		return false;
+	}
+	status = true;
+	while((de = readdir(dir)))
+	{
+		if(de->d_name[0] == '.')
+		{
+			continue;
+		}
+		if(!collect(path + "/" + de->d_name, files))
+		{
+			status = false;
+		}
+	}
+	closedir(dir);
+	return status;
+}
+
+/* Remove any leading "./" and trailing "/" from a path */
+static std::string
+normalise(std::string path)
+{
+	while(path.length() > 2 && !path.compare(0, 2, "./"))
+	{
+		path.erase(0, 2);
+	}
+	while(path.length() > 1 && path[path.length() - 1] == '/')
+	{
+		path.erase(path.length() - 1);
+	}
+	return path;
+}
+
+static int
+pack(const std::string &output, char **paths, int npaths)
+{
+	std::vector<std::string> files;
+	std::vector<PackedEntry> entries;
+	std::string names, tmp;
+	PackedHeader h;
+	PackedArchive check;
+	struct stat sb;
+	std::vector<char> buf;
+	uint64_t offset, total;
+	FILE *f, *in;
+	size_t c, padding;
+	int n;
+	static const char pad[PACKED_ALIGN] = { 0 };
+
+	for(n = 0; n < npaths; n++)
+	{
+		if(!collect(normalise(paths[n]), files))
+		{
+			return 1;
+		}
+	}
+	std::sort(files.begin(), files.end());
+	files.erase(std::unique(files.begin(), files.end()), files.end());
+	files.erase(std::remove(files.begin(), files.end(), normalise(output)), files.end());
+	if(!files.size())
+	{
+		fprintf(stderr, "jyzc: nothing to pack\n");
+		return 1;
+	}
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, PACKED_MAGIC, 4);
+	h.byteorder = PACKED_BYTEORDER;
+	h.version = PACKED_VERSION;
+	h.nentries = files.size();
+	h.entries = sizeof(h);
+	h.names = h.entries + h.nentries * sizeof(PackedEntry);
+	for(c = 0; c < files.size(); c++)
+	{
+		PackedEntry e;
+
+		memset(&e, 0, sizeof(e));
+		e.name = names.length();
+		e.namelen = files[c].length();
+		names.append(files[c]);
+		names.push_back(0);
+		entries.push_back(e);
+	}
+	h.nameslen = names.length();
+	offset = h.names + h.nameslen;
+	total = 0;
+	for(c = 0; c < files.size(); c++)
+	{
+		if(stat(files[c].c_str(), &sb))
+		{
+			perror(files[c].c_str());
+			return 1;
+		}
+		offset = (offset + PACKED_ALIGN - 1) & ~((uint64_t) PACKED_ALIGN - 1);
+		entries[c].offset = offset;
+		entries[c].length = sb.st_size;
+		entries[c].mtime = sb.st_mtime;
+		offset += sb.st_size;
+		total += sb.st_size;
+	}
+	/* As with compiled documents, write to a temporary file and rename it
+	 * into place
+	 */
+	tmp = output + ".tmp";
+	f = fopen(tmp.c_str(), "wb");
+	if(!f)
+	{
+		perror(tmp.c_str());
+		return 1;
+	}
+	if(fwrite(&h, sizeof(h), 1, f) != 1 ||
+	   fwrite(&(entries[0]), sizeof(PackedEntry), h.nentries, f) != h.nentries ||
+	   fwrite(names.data(), 1, h.nameslen, f) != h.nameslen)
+	{
+		perror(tmp.c_str());
+		fclose(f);
+		remove(tmp.c_str());
+		return 1;
+	}
+	offset = h.names + h.nameslen;
+	for(c = 0; c < files.size(); c++)
+	{
+		padding = entries[c].offset - offset;
+		buf.resize(entries[c].length);
+		in = fopen(files[c].c_str(), "rb");
+		if(!in || (buf.size() && fread(&(buf[0]), buf.size(), 1, in) != 1) ||
+		   fwrite(pad, 1, padding, f) != padding ||
+		   (buf.size() && fwrite(&(buf[0]), buf.size(), 1, f) != 1))
+		{
+			perror(in ? tmp.c_str() : files[c].c_str());
+			if(in)
+			{
+				fclose(in);
+			}
+			fclose(f);
+			remove(tmp.c_str());
+			return 1;
+		}
+		fclose(in);
+		offset = entries[c].offset + entries[c].length;
+	}
+	if(fclose(f) || rename(tmp.c_str(), output.c_str()))
+	{
+		perror(output.c_str());
+		remove(tmp.c_str());
+		return 1;
+	}
+	/* Make sure that the engine will accept it */
+	if(!check.open(output) || check.entries() != files.size())
+	{
+		fprintf(stderr, "jyzc: %s: failed to verify packed archive\n", output.c_str());
+		return 1;
+	}
+	printf("%s: packed %lu files, %llu bytes\n", output.c_str(), (unsigned long) files.size(), (unsigned long long) total);
+	return 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: jyzc [-o OUTPUT] FILE.xml\n"
+		"       jyzc FILE.xml [FILE.xml ...]\n"
+		"       jyzc --bench [-n ITERATIONS] FILE.xml\n"
+		"       jyzc --pack -o OUTPUT.jyzp PATH [PATH ...]\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	std::string output;
+	bool benchmark = false, packing = false;
+	int iterations = 10, c, status;
+
+	xmlInitParser();
+	for(c = 1; c < argc && argv[c][0] == '-'; c++)
+	{
+		if(!strcmp(argv[c], "--bench"))
+		{
+			benchmark = true;
+		}
+		else if(!strcmp(argv[c], "--pack"))
+		{
+			packing = true;
+		}
+		else if(!strcmp(argv[c], "-n") && c + 1 < argc)
+		{
+			iterations = atoi(argv[++c]);
+		}
+		else if(!strcmp(argv[c], "-o") && c + 1 < argc)
+		{
+			output = argv[++c];
+		}
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+	if(packing)
+	{
+		if(c == argc || benchmark || !output.length())
+		{
+			usage();
+			return 1;
+		}
+		return pack(output, argv + c, argc - c);
+	}
+	if(c == argc || iterations < 1 || ((benchmark || output.length()) && c + 1 != argc))
+	{
+		usage();
+		return 1;
+	}
+	if(benchmark)
+	{
+		return bench(argv[c], iterations);
+	}
+	status = 0;
+	for(; c < argc; c++)
+	{
+		Compiler compiler;
+
+		if(!compiler.parse(argv[c]) || !compiler.write(output.length() ? output : CompiledDocument::compiledPath(argv[c])))
+		{
+			status = 1;
+		}
+	}
+	xmlCleanupParser();
+	return status;
+}
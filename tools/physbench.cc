@@ -0,0 +1,233 @@
+/* Copyright 2014-2015 Mo McRoberts.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* physbench: measure how long a tick of a scene's physics takes with
+ * differing numbers of worker threads, using a scene of stacked dynamic
+ * props of the same size as the prefabricated cube.
+ *
+ * Usage: physbench [-n PROPS] [-h HEIGHT] [-s TICKS] [-b BROADPHASE]
+ *                  [THREADS ...]
+ *
+ * The props are arranged in a square grid of stacks, each HEIGHT props
+ * tall (default 10), and the world is stepped for TICKS ticks (default 300)
+ * at DYNAMICS_TICK_RATE; THREADS defaults to 1, 2, 4 and 8. BROADPHASE is
+ * one of dbvt (the default), sweep or sweep32; a sweep-and-prune
+ * broadphase is bounded by the grid.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#include "jyuzau/physicsworld.hh"
+
+using namespace Jyuzau;
+
+/* Kept in step with DYNAMICS_TICK_RATE, which can't be included here
+ * without OGRE
+ */
+#define BENCH_TICK_RATE                60
+#define BENCH_HALF_EXTENT              50.0f
+#define BENCH_GAP                      20.0f
+
+struct BenchResult
+{
+	int threads;
+	double total, worst, broadphase;
+	int pairs;
+};
+
+static void
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [-n PROPS] [-h HEIGHT] [-s TICKS] [-b dbvt|sweep|sweep32] [THREADS ...]\n", progname);
+}
+
+/* Build the scene in a new world with the given number of threads, step it,
+ * and tear it down again
+ */
+static BenchResult
+bench(int threads, BroadphaseType broadphase, int props, int height, int ticks)
+{
+	PhysicsConfig config;
+	PhysicsWorld *world;
+	btDiscreteDynamicsWorld *dynamics;
+	btCollisionShape *ground, *box;
+	btRigidBody *body;
+	std::vector<btRigidBody *> bodies;
+	btVector3 inertia;
+	std::chrono::steady_clock::time_point began, tick;
+	double elapsed;
+	int side, x, y, z, c, n;
+	btScalar pitch;
+	BenchResult result;
+
+	side = (int) ceil(sqrt((double) props / height));
+	pitch = BENCH_HALF_EXTENT * 2 + BENCH_GAP;
+	config.broadphase = broadphase;
+	config.bounded = true;
+	config.worldMin.setValue(-(side / 2 + 1) * pitch, -pitch, -(side / 2 + 1) * pitch);
+	config.worldMax.setValue((side / 2 + 1) * pitch, (height + 1) * BENCH_HALF_EXTENT * 2, (side / 2 + 1) * pitch);
+	world = new PhysicsWorld(threads, config);
+	dynamics = world->dynamics();
+	dynamics->setGravity(btVector3(0, -981, 0));
+	ground = new btStaticPlaneShape(btVector3(0, 1, 0), 0);
+	box = new btBoxShape(btVector3(BENCH_HALF_EXTENT, BENCH_HALF_EXTENT, BENCH_HALF_EXTENT));
+	box->calculateLocalInertia(1, inertia);
+	body = new btRigidBody(btRigidBody::btRigidBodyConstructionInfo(0, NULL, ground));
+	dynamics->addRigidBody(body);
+	bodies.push_back(body);
+	for(n = 0, x = 0; x < side && n < props; x++)
+	{
+		for(z = 0; z < side && n < props; z++)
+		{
+			for(y = 0; y < height && n < props; y++, n++)
+			{
+				btRigidBody::btRigidBodyConstructionInfo ci(1, NULL, box, inertia);
+
+				ci.m_startWorldTransform.setIdentity();
+				ci.m_startWorldTransform.setOrigin(btVector3((x - side / 2) * pitch, BENCH_HALF_EXTENT + y * BENCH_HALF_EXTENT * 2, (z - side / 2) * pitch));
+				ci.m_restitution = 0.25f;
+				ci.m_friction = 0.5f;
+				body = new btRigidBody(ci);
+				dynamics->addRigidBody(body);
+				bodies.push_back(body);
+			}
+		}
+	}
+	result.threads = world->threads();
+	result.total = 0;
+	result.worst = 0;
+	result.broadphase = 0;
+	for(c = 0; c < ticks; c++)
+	{
+		began = std::chrono::steady_clock::now();
+		dynamics->stepSimulation(btScalar(1) / BENCH_TICK_RATE, 0);
+		tick = std::chrono::steady_clock::now();
+		elapsed = std::chrono::duration<double, std::milli>(tick - began).count();
+		result.total += elapsed;
+		result.broadphase += world->broadphaseStats().aabbTime + world->broadphaseStats().pairTime;
+		if(elapsed > result.worst)
+		{
+			result.worst = elapsed;
+		}
+	}
+	result.pairs = world->broadphaseStats().pairs;
+	for(c = 0; c < (int) bodies.size(); c++)
+	{
+		dynamics->removeRigidBody(bodies[c]);
+		delete bodies[c];
+	}
+	delete box;
+	delete ground;
+	delete world;
+	return result;
+}
+
+int
+main(int argc, char **argv)
+{
+	std::vector<int> threads;
+	BroadphaseType broadphase;
+	int props, height, ticks, c;
+	double base;
+
+	props = 4000;
+	height = 10;
+	ticks = 300;
+	broadphase = BP_DBVT;
+	for(c = 1; c < argc; c++)
+	{
+		if(!strcmp(argv[c], "-n") && c + 1 < argc)
+		{
+			props = atoi(argv[++c]);
+		}
+		else if(!strcmp(argv[c], "-h") && c + 1 < argc)
+		{
+			height = atoi(argv[++c]);
+		}
+		else if(!strcmp(argv[c], "-s") && c + 1 < argc)
+		{
+			ticks = atoi(argv[++c]);
+		}
+		else if(!strcmp(argv[c], "-b") && c + 1 < argc)
+		{
+			c++;
+			if(!strcmp(argv[c], "dbvt"))
+			{
+				broadphase = BP_DBVT;
+			}
+			else if(!strcmp(argv[c], "sweep"))
+			{
+				broadphase = BP_SWEEP;
+			}
+			else if(!strcmp(argv[c], "sweep32"))
+			{
+				broadphase = BP_SWEEP32;
+			}
+			else
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else if(argv[c][0] == '-' || atoi(argv[c]) < 1)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		else
+		{
+			threads.push_back(atoi(argv[c]));
+		}
+	}
+	if(props < 1 || height < 1 || ticks < 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if(!threads.size())
+	{
+		threads.push_back(1);
+		threads.push_back(2);
+		threads.push_back(4);
+		threads.push_back(8);
+	}
+	printf("%d props in stacks of %d, %d ticks at %d Hz\n\n", props, height, ticks, BENCH_TICK_RATE);
+	printf("%8s %12s %12s %12s %8s %12s %8s\n", "threads", "total (ms)", "tick (ms)", "worst (ms)", "speedup", "bp/tick (ms)", "pairs");
+	base = 0;
+	for(c = 0; c < (int) threads.size(); c++)
+	{
+		BenchResult r = bench(threads[c], broadphase, props, height, ticks);
+
+		if(!c)
+		{
+			base = r.total;
+		}
+		if(r.threads != threads[c])
+		{
+			fprintf(stderr, "%s: %d threads requested, but only %d available\n", argv[0], threads[c], r.threads);
+		}
+		printf("%8d %12.1f %12.3f %12.3f %7.2fx %12.3f %8d\n", r.threads, r.total, r.total / ticks, r.worst, base / r.total, r.broadphase / ticks, r.pairs);
+	}
+	return 0;
+}